@@ -0,0 +1,537 @@
+#include "client_tunnel.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <android/log.h>
+
+const int ClientTunnel::BATCH_SIZE;
+const int ClientTunnel::DATAGRAM_SIZE;
+const int ClientTunnel::MAX_PACKET_SIZE;
+const int ClientTunnel::TICK_MS;
+const int ClientTunnel::KEEPALIVE_INTERVAL;
+const int ClientTunnel::DISCONNECT_RETRIES;
+
+namespace {
+
+const char* const TAG = "ClientTunnel";
+
+/* control messages of the tunnel (see protocol_specs.md): */
+const uint8_t  CONTROL_VERSION     = 0x81;
+const int      CONTROL_HEADER_SIZE = 8;
+const uint8_t  ACK                 = 2;
+const uint8_t  KEEPALIVE           = 3;
+const uint8_t  DISCONNECT          = 4;
+const uint8_t  ACK_REQUESTED       = 1;
+const uint16_t DISCONNECT_SEQUENCE = 1; // the same as VpnConnection uses
+
+/*
+ * bionic declares recvmmsg(2) and sendmmsg(2) since API 21 only,
+ * the kernels of older devices have the syscalls
+ */
+int receiveBatch(int fd, mmsghdr* msgs, unsigned count) {
+    return syscall(__NR_recvmmsg, fd, msgs, count, MSG_DONTWAIT, nullptr);
+}
+
+int sendBatch(int fd, mmsghdr* msgs, unsigned count) {
+    return syscall(__NR_sendmmsg, fd, msgs, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+} // namespace
+
+TunnelStats::TunnelStats() {
+    for(std::atomic<uint64_t>& counter : counters)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+void TunnelStats::add(Counter counter, uint64_t value) {
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief ClientTunnel - takes over the descriptors and the I/O
+ * of the established session, the loop is started by 'start'
+ * @param ssl - session after the handshake, must outlive the tunnel
+ * @param tunFd - VpnService interface
+ * @param sockFd - UDP socket connected to the server
+ */
+ClientTunnel::ClientTunnel(WOLFSSL* ssl, int tunFd, int sockFd)
+    : ssl(ssl), javaReadCtx(nullptr), javaWriteCtx(nullptr),
+      tunFd(tunFd), sockFd(sockFd), epollFd(-1), timerFd(-1), wakeupFd(-1),
+      state(RUNNING), stopRequested(false), tunWatched(true),
+      disconnecting(false), disconnectRetries(0), rxData(nullptr), rxLength(0),
+      txQueued(0), txBlocked(false), sockEvents(EPOLLIN)
+{
+    memset(rxMsgs, 0, sizeof(rxMsgs));
+    memset(txMsgs, 0, sizeof(txMsgs));
+    for(int i = 0; i < BATCH_SIZE; ++i) {
+        rxIov[i].iov_base             = rxBuffers[i];
+        rxIov[i].iov_len              = DATAGRAM_SIZE;
+        rxMsgs[i].msg_hdr.msg_iov     = &rxIov[i];
+        rxMsgs[i].msg_hdr.msg_iovlen  = 1;
+        txIov[i].iov_base             = txBuffers[i];
+        txMsgs[i].msg_hdr.msg_iov     = &txIov[i]; // the socket is connected
+        txMsgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    epollFd  = epoll_create1(EPOLL_CLOEXEC);
+    timerFd  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(epollFd == -1 || timerFd == -1 || wakeupFd == -1 ||
+       !setNonBlocking(tunFd) || !setNonBlocking(sockFd)) {
+        int error = errno;
+        for(int fd : { epollFd, timerFd, wakeupFd }) {
+            if(fd != -1)
+                close(fd);
+        }
+        // the interface and the socket stay with the caller
+        throw std::runtime_error(std::string("Tunnel loop can't be created: ") +
+                                 strerror(error));
+    }
+
+    itimerspec tick;
+    tick.it_interval.tv_sec  = 0;
+    tick.it_interval.tv_nsec = TICK_MS * 1000000L;
+    tick.it_value            = tick.it_interval;
+    timerfd_settime(timerFd, 0, &tick, nullptr);
+
+    watch(tunFd, EPOLLIN, true);
+    watch(sockFd, EPOLLIN, true);
+    watch(timerFd, EPOLLIN, true);
+    watch(wakeupFd, EPOLLIN, true);
+
+    javaReadCtx  = wolfSSL_GetIOReadCtx(ssl);
+    javaWriteCtx = wolfSSL_GetIOWriteCtx(ssl);
+    wolfSSL_SSLSetIORecv(ssl, ioRecv);
+    wolfSSL_SSLSetIOSend(ssl, ioSend);
+    wolfSSL_SetIOReadCtx(ssl, this);
+    wolfSSL_SetIOWriteCtx(ssl, this);
+    lastSent = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief ~ClientTunnel - stops the loop without DISCONNECT
+ * if it still runs and closes the descriptors. The session
+ * is left with I/O callbacks that fail, it can only be freed.
+ */
+ClientTunnel::~ClientTunnel() {
+    if(thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(state == RUNNING)
+                state = STOPPED;
+        }
+        uint64_t one = 1;
+        write(wakeupFd, &one, sizeof(one));
+        thread.join();
+    }
+    // the JNI callbacks of the session can't be got back:
+    wolfSSL_SSLSetIORecv(ssl, closedRecv);
+    wolfSSL_SSLSetIOSend(ssl, closedSend);
+    wolfSSL_SetIOReadCtx(ssl, javaReadCtx);
+    wolfSSL_SetIOWriteCtx(ssl, javaWriteCtx);
+    for(int fd : { tunFd, sockFd, epollFd, timerFd, wakeupFd }) {
+        if(fd != -1)
+            close(fd);
+    }
+}
+
+/**
+ * @brief start - runs the loop in its own thread
+ */
+void ClientTunnel::start() {
+    thread = std::thread(&ClientTunnel::run, this);
+}
+
+/**
+ * @brief stop - asks the loop to send DISCONNECT and finish,
+ * callable from any thread
+ */
+void ClientTunnel::stop() {
+    stopRequested.store(true);
+    uint64_t one = 1;
+    write(wakeupFd, &one, sizeof(one));
+}
+
+/**
+ * @brief waitState - waits until the loop finishes or the timeout passes
+ * @return - the state, RUNNING if the timeout has passed
+ */
+ClientTunnel::State ClientTunnel::waitState(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [this]() { return state != RUNNING; });
+    return state;
+}
+
+ClientTunnel::State ClientTunnel::getState() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
+
+uint64_t ClientTunnel::getCounter(TunnelStats::Counter counter) const {
+    return stats.counters[counter].load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief run - the loop: waits for the descriptors, dispatches
+ * their events and sends the queued records after every batch
+ */
+void ClientTunnel::run() {
+    __android_log_print(ANDROID_LOG_INFO, TAG, "Data path started");
+    epoll_event events[4];
+    while(getState() == RUNNING) {
+        int count = epoll_wait(epollFd, events, 4, -1);
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+            __android_log_print(ANDROID_LOG_ERROR, TAG, "epoll_wait() error: %s",
+                                strerror(errno));
+            finish(SOCKET_ERROR);
+            break;
+        }
+        for(int i = 0; i < count && getState() == RUNNING; ++i) {
+            int fd = events[i].data.fd;
+            if(fd == sockFd) {
+                if(events[i].events & EPOLLOUT)
+                    flush();
+                if(events[i].events & (EPOLLIN | EPOLLERR))
+                    onSocketReadable();
+            }
+            else if(fd == tunFd) {
+                onTunReadable();
+            }
+            else if(fd == timerFd) {
+                uint64_t expirations;
+                read(timerFd, &expirations, sizeof(expirations));
+                onTick();
+            }
+            else if(fd == wakeupFd) {
+                uint64_t value;
+                read(wakeupFd, &value, sizeof(value));
+                if(stopRequested.load() && !disconnecting) {
+                    disconnecting = true;
+                    onTick(); // the first DISCONNECT is sent at once
+                }
+            }
+        }
+        flush();
+
+        // don't read the interface while records can't be sent:
+        bool watchTun = !txBlocked && !disconnecting;
+        if(watchTun != tunWatched) {
+            tunWatched = watchTun;
+            watch(tunFd, tunWatched ? (uint32_t)EPOLLIN : 0, false);
+        }
+        uint32_t wanted = txBlocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        if(wanted != sockEvents) {
+            sockEvents = wanted;
+            watch(sockFd, sockEvents, false);
+        }
+    }
+
+    __android_log_print(ANDROID_LOG_INFO, TAG, "Data path finished, state %d", getState());
+}
+
+/**
+ * @brief finish - ends the loop and wakes up the waiting Java thread
+ */
+void ClientTunnel::finish(State reason) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(state != RUNNING)
+            return;
+        state = reason;
+    }
+    changed.notify_all();
+}
+
+/**
+ * @brief onTunReadable - reads up to BATCH_SIZE packets of the interface
+ * and writes them to the session, the records go to the send queue
+ */
+void ClientTunnel::onTunReadable() {
+    for(int i = 0; i < BATCH_SIZE && !txBlocked; ++i) {
+        ssize_t length = read(tunFd, packet, sizeof(packet));
+        if(length < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                __android_log_print(ANDROID_LOG_ERROR, TAG, "Interface read error: %s",
+                                    strerror(errno));
+                finish(TUN_ERROR);
+            }
+            return;
+        }
+        if(length == 0) {
+            finish(TUN_ERROR);
+            return;
+        }
+        stats.add(TunnelStats::TUN_PACKETS, 1);
+        stats.add(TunnelStats::TUN_BYTES, length);
+        writeRecord(packet, length);
+    }
+}
+
+/**
+ * @brief onSocketReadable - reads datagrams of the server in batches
+ * and decrypts them
+ */
+void ClientTunnel::onSocketReadable() {
+    for(;;) {
+        int received = receiveBatch(sockFd, rxMsgs, BATCH_SIZE);
+        if(received < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                onSocketError();
+            return;
+        }
+
+        stats.add(TunnelStats::RX_CALLS, 1);
+        stats.add(TunnelStats::RX_DATAGRAMS, received);
+        for(int i = 0; i < received && getState() == RUNNING; ++i) {
+            if(rxMsgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                continue; // can't be a valid DTLS datagram
+            receive(rxBuffers[i], rxMsgs[i].msg_len);
+        }
+        if(received < BATCH_SIZE)
+            return; // socket is drained
+    }
+}
+
+/**
+ * @brief onSocketError - ICMP errors of the connected socket
+ * (the server restarts, the network changes) are reported
+ * by recv, they are not fatal: the server may come back
+ */
+void ClientTunnel::onSocketError() {
+    switch(errno) {
+    case ECONNREFUSED:
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+        return;
+    default:
+        __android_log_print(ANDROID_LOG_ERROR, TAG, "recvmmsg() error: %s",
+                            strerror(errno));
+        finish(SOCKET_ERROR);
+    }
+}
+
+/**
+ * @brief onTick - sends KEEPALIVE when the client was quiet
+ * and repeats DISCONNECT while it is not acknowledged
+ */
+void ClientTunnel::onTick() {
+    if(disconnecting) {
+        if(disconnectRetries++ >= DISCONNECT_RETRIES) {
+            finish(STOPPED);
+            return;
+        }
+        sendControl(DISCONNECT, DISCONNECT_SEQUENCE, ACK_REQUESTED);
+        return;
+    }
+    if(std::chrono::steady_clock::now() - lastSent >=
+       std::chrono::milliseconds(KEEPALIVE_INTERVAL))
+        sendControl(KEEPALIVE, 0, 0);
+}
+
+/**
+ * @brief receive - decrypts the records of a datagram,
+ * packets go to the interface
+ */
+void ClientTunnel::receive(const char* data, int length) {
+    rxData   = data;
+    rxLength = length;
+    for(;;) {
+        int size = wolfSSL_read(ssl, packet, sizeof(packet));
+        if(size <= 0) {
+            int error = wolfSSL_get_error(ssl, size);
+            if(error == SSL_ERROR_ZERO_RETURN) {
+                finish(PEER_CLOSED);
+            }
+            else if(error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+                // DTLS drops broken records, other errors are fatal
+                __android_log_print(ANDROID_LOG_ERROR, TAG, "wolfSSL_read() error: %d",
+                                    error);
+                finish(SESSION_ERROR);
+            }
+            break;
+        }
+
+        if(packet[0] == 0) {
+            onControlMessage(packet, size);
+            continue;
+        }
+        if(write(tunFd, packet, size) != size) {
+            stats.add(TunnelStats::DROPPED, 1); // interface queue is full
+            continue;
+        }
+        stats.add(TunnelStats::NET_PACKETS, 1);
+        stats.add(TunnelStats::NET_BYTES, size);
+    }
+    rxData = nullptr;
+}
+
+/**
+ * @brief onControlMessage - answers requested ACKs (PARAMETERS sent
+ * again, path MTU probes, messages of newer servers), finishes
+ * on DISCONNECT of the server or on ACK of ours
+ */
+void ClientTunnel::onControlMessage(const char* data, int length) {
+    if(length < CONTROL_HEADER_SIZE || (uint8_t)data[1] != CONTROL_VERSION)
+        return; // older control packets
+
+    uint8_t  type     = data[2];
+    uint8_t  flags    = data[3];
+    uint16_t sequence = ((uint8_t)data[4] << 8) | (uint8_t)data[5];
+
+    if(type == ACK) {
+        if(disconnecting && sequence == DISCONNECT_SEQUENCE)
+            finish(STOPPED);
+        return;
+    }
+    if(flags & ACK_REQUESTED)
+        sendControl(ACK, sequence, 0);
+    if(type == DISCONNECT) {
+        __android_log_print(ANDROID_LOG_INFO, TAG, "Server has closed the tunnel");
+        finish(PEER_CLOSED);
+    }
+}
+
+/**
+ * @brief sendControl - message without fields (ACK, KEEPALIVE, DISCONNECT)
+ */
+void ClientTunnel::sendControl(uint8_t type, uint16_t sequence, uint8_t flags) {
+    char message[CONTROL_HEADER_SIZE] = { 0, (char)CONTROL_VERSION, (char)type,
+                                          (char)flags, (char)(sequence >> 8),
+                                          (char)sequence, 0, 0 };
+    writeRecord(message, sizeof(message));
+}
+
+void ClientTunnel::writeRecord(const char* data, int length) {
+    int written = wolfSSL_write(ssl, data, length);
+    if(written <= 0) {
+        int error = wolfSSL_get_error(ssl, written);
+        if(error != SSL_ERROR_WANT_WRITE) {
+            __android_log_print(ANDROID_LOG_ERROR, TAG, "wolfSSL_write() error: %d",
+                                error);
+            finish(SESSION_ERROR);
+        }
+        return;
+    }
+    lastSent = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief queue - copies a record to the send queue,
+ * a full batch is sent at once
+ * @return false if the socket buffer is full
+ */
+bool ClientTunnel::queue(const char* data, int length) {
+    if(txQueued == BATCH_SIZE && !flush())
+        return false;
+
+    memcpy(txBuffers[txQueued], data, length);
+    txIov[txQueued].iov_len = length;
+    ++txQueued;
+    if(txQueued == BATCH_SIZE)
+        flush();
+    return true;
+}
+
+/**
+ * @brief flush - sends the queued records with sendmmsg(2)
+ * @return true if the queue is empty, false if the socket is full
+ * (it is watched for EPOLLOUT then)
+ */
+bool ClientTunnel::flush() {
+    int first = 0;
+    while(first < txQueued) {
+        int sent = sendBatch(sockFd, txMsgs + first, txQueued - first);
+        if(sent < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                txBlocked = true;
+                break;
+            }
+            // the first datagram cannot be sent (e.g. no route), skip it
+            stats.add(TunnelStats::DROPPED, 1);
+            ++first;
+            continue;
+        }
+        stats.add(TunnelStats::TX_CALLS, 1);
+        stats.add(TunnelStats::TX_DATAGRAMS, sent);
+        first += sent;
+    }
+
+    if(first > 0 && first < txQueued) {
+        // keep the rest at the head of the queue:
+        for(int i = first; i < txQueued; ++i) {
+            memcpy(txBuffers[i - first], txBuffers[i], txIov[i].iov_len);
+            txIov[i - first].iov_len = txIov[i].iov_len;
+        }
+    }
+    txQueued -= first;
+    if(txQueued == 0)
+        txBlocked = false;
+    return txQueued == 0;
+}
+
+void ClientTunnel::watch(int fd, uint32_t events, bool add) {
+    epoll_event event;
+    event.events  = events;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+}
+
+/**
+ * @brief ioRecv - wolfSSL receive callback,
+ * hands the pending datagram (if any) to wolfSSL
+ */
+int ClientTunnel::ioRecv(WOLFSSL*, char* buf, int sz, void* ctx) {
+    ClientTunnel* tunnel = static_cast<ClientTunnel*>(ctx);
+
+    if(tunnel->rxData == nullptr)
+        return WOLFSSL_CBIO_ERR_WANT_READ;
+
+    int length = tunnel->rxLength < sz ? tunnel->rxLength : sz;
+    memcpy(buf, tunnel->rxData, length);
+    tunnel->rxData = nullptr; // one datagram per call
+    return length;
+}
+
+/**
+ * @brief ioSend - wolfSSL send callback, queues the record
+ */
+int ClientTunnel::ioSend(WOLFSSL*, char* buf, int sz, void* ctx) {
+    ClientTunnel* tunnel = static_cast<ClientTunnel*>(ctx);
+
+    if(sz > DATAGRAM_SIZE || !tunnel->queue(buf, sz)) {
+        // socket is full, the datagram is lost like on the wire
+        tunnel->stats.add(TunnelStats::DROPPED, 1);
+    }
+    return sz;
+}
+
+/**
+ * @brief closedRecv - receive callback of the session after the tunnel
+ * is destroyed, doesn't use its context
+ */
+int ClientTunnel::closedRecv(WOLFSSL*, char*, int, void*) {
+    return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+}
+
+int ClientTunnel::closedSend(WOLFSSL*, char*, int, void*) {
+    return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+}
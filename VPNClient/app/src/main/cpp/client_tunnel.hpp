@@ -0,0 +1,150 @@
+#ifndef CLIENT_TUNNEL_HPP
+#define CLIENT_TUNNEL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+
+/**
+ * @brief The TunnelStats struct - counters of the data path,
+ * updated by the loop thread, read by any thread
+ */
+struct TunnelStats {
+    enum Counter {
+        TUN_PACKETS = 0, // read from the interface, sent to the server
+        TUN_BYTES,
+        NET_PACKETS,     // received from the server, written to the interface
+        NET_BYTES,
+        TX_CALLS,        // sendmmsg(2) calls
+        TX_DATAGRAMS,
+        RX_CALLS,        // recvmmsg(2) calls
+        RX_DATAGRAMS,
+        DROPPED,         // packets lost on a full socket or interface
+        COUNT
+    };
+
+    std::atomic<uint64_t> counters[COUNT];
+
+    explicit TunnelStats();
+    void add(Counter counter, uint64_t value);
+};
+
+/**
+ * @brief The ClientTunnel class<br>
+ * Data path of an established connection: packets read from<br>
+ * the VpnService interface are written to the DTLS session<br>
+ * and records of the server are decrypted to the interface,<br>
+ * without crossing into Java.<br>
+ * The tunnel owns both descriptors (dups of the interface and<br>
+ * of the connected UDP socket) and takes over the I/O callbacks<br>
+ * of the session for good, the handshake is done by the Java side<br>
+ * before. After the tunnel is destroyed the session can only be freed.<br>
+ * One thread runs an epoll(7) loop, like a worker of the server:<br>
+ * datagrams are received with recvmmsg(2), records written<br>
+ * by wolfSSL are queued and sent with sendmmsg(2) when a batch<br>
+ * is gathered or at the end of the loop iteration, the interface<br>
+ * is read in bursts of up to BATCH_SIZE packets.<br>
+ * Control messages are answered by the loop: requested ACKs,<br>
+ * a KEEPALIVE after KEEPALIVE_INTERVAL without sent records<br>
+ * and DISCONNECT when the tunnel is stopped.<br>
+ * Java only polls the state and the counters.<br>
+ */
+class ClientTunnel {
+public:
+    static const int BATCH_SIZE         = 32;   // datagrams per syscall
+    static const int DATAGRAM_SIZE      = 2048;
+    static const int MAX_PACKET_SIZE    = 16384;
+    static const int TICK_MS            = 200;
+    static const int KEEPALIVE_INTERVAL = 3000; // ms
+    static const int DISCONNECT_RETRIES = 4;    // one per tick
+
+    enum State {
+        RUNNING = 0,
+        STOPPED,      // by 'stop', DISCONNECT is acknowledged or retries are out
+        PEER_CLOSED,  // DISCONNECT or close_notify of the server
+        SOCKET_ERROR,
+        TUN_ERROR,    // interface is closed (e.g. the VPN is revoked)
+        SESSION_ERROR // fatal error of the DTLS session
+    };
+
+private:
+    WOLFSSL*                 ssl;
+    void*                    javaReadCtx; // restored by the destructor
+    void*                    javaWriteCtx;
+    int                      tunFd;
+    int                      sockFd;
+    int                      epollFd;
+    int                      timerFd;
+    int                      wakeupFd;
+    std::thread              thread;
+    std::mutex               mutex;
+    std::condition_variable  changed;
+    State                    state;      // guarded by 'mutex'
+    std::atomic<bool>        stopRequested;
+    TunnelStats              stats;
+
+    // owned by the loop thread:
+    bool                     tunWatched;
+    bool                     disconnecting;
+    int                      disconnectRetries;
+    std::chrono::steady_clock::time_point lastSent;
+    mmsghdr                  rxMsgs[BATCH_SIZE];
+    iovec                    rxIov[BATCH_SIZE];
+    char                     rxBuffers[BATCH_SIZE][DATAGRAM_SIZE];
+    const char*              rxData;     // datagram given to wolfSSL
+    int                      rxLength;
+    mmsghdr                  txMsgs[BATCH_SIZE];
+    iovec                    txIov[BATCH_SIZE];
+    char                     txBuffers[BATCH_SIZE][DATAGRAM_SIZE];
+    int                      txQueued;
+    bool                     txBlocked;  // socket buffer is full
+    uint32_t                 sockEvents; // watched on the socket
+    char                     packet[MAX_PACKET_SIZE];
+
+public:
+    /* Forbid creating default copy ctor: */
+    ClientTunnel(ClientTunnel& that) = delete;
+
+    explicit ClientTunnel(WOLFSSL* ssl, int tunFd, int sockFd);
+    ~ClientTunnel();
+
+    void start();
+    void stop();
+    State waitState(std::chrono::milliseconds timeout);
+    State getState();
+    uint64_t getCounter(TunnelStats::Counter counter) const;
+
+private:
+    void run();
+    void finish(State reason);
+    void onTunReadable();
+    void onSocketReadable();
+    void onSocketError();
+    void onTick();
+    void receive(const char* data, int length);
+    void onControlMessage(const char* data, int length);
+    void sendControl(uint8_t type, uint16_t sequence, uint8_t flags);
+    void writeRecord(const char* data, int length);
+    bool queue(const char* data, int length);
+    bool flush();
+    void watch(int fd, uint32_t events, bool add);
+
+    static int ioRecv(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int ioSend(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int closedRecv(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int closedSend(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+};
+
+#endif // CLIENT_TUNNEL_HPP
@@ -0,0 +1,75 @@
+#include "client_tunnel.hpp"
+
+#include <jni.h>
+#include <android/log.h>
+
+/*
+ * Native methods of apriorit.vpnclient.NativeTunnel.
+ * The handle is the address of the ClientTunnel.
+ */
+
+extern "C" {
+
+/**
+ * @brief nativeStart - takes the descriptors in any case
+ * @return - handle of the running tunnel, 0 on error
+ */
+JNIEXPORT jlong JNICALL
+Java_apriorit_vpnclient_NativeTunnel_nativeStart(JNIEnv*, jclass, jlong sslPtr,
+                                                 jint tunFd, jint sockFd) {
+    ClientTunnel* tunnel = nullptr;
+    try {
+        tunnel = new ClientTunnel(reinterpret_cast<WOLFSSL*>(sslPtr), tunFd, sockFd);
+    }
+    catch(const std::exception& e) {
+        __android_log_print(ANDROID_LOG_ERROR, "ClientTunnel", "%s", e.what());
+        close(tunFd);
+        close(sockFd);
+        return 0;
+    }
+
+    try {
+        tunnel->start();
+    }
+    catch(const std::exception& e) {
+        __android_log_print(ANDROID_LOG_ERROR, "ClientTunnel", "%s", e.what());
+        delete tunnel; // closes the descriptors
+        return 0;
+    }
+    return reinterpret_cast<jlong>(tunnel);
+}
+
+JNIEXPORT void JNICALL
+Java_apriorit_vpnclient_NativeTunnel_nativeStop(JNIEnv*, jclass, jlong handle) {
+    reinterpret_cast<ClientTunnel*>(handle)->stop();
+}
+
+JNIEXPORT jint JNICALL
+Java_apriorit_vpnclient_NativeTunnel_nativeWaitState(JNIEnv*, jclass, jlong handle,
+                                                     jlong timeoutMs) {
+    return reinterpret_cast<ClientTunnel*>(handle)->waitState(
+                std::chrono::milliseconds(timeoutMs));
+}
+
+/**
+ * @brief nativeGetStats - counters in the order of TunnelStats::Counter
+ */
+JNIEXPORT jlongArray JNICALL
+Java_apriorit_vpnclient_NativeTunnel_nativeGetStats(JNIEnv* env, jclass, jlong handle) {
+    ClientTunnel* tunnel = reinterpret_cast<ClientTunnel*>(handle);
+    jlong values[TunnelStats::COUNT];
+    for(int i = 0; i < TunnelStats::COUNT; ++i)
+        values[i] = tunnel->getCounter(static_cast<TunnelStats::Counter>(i));
+
+    jlongArray stats = env->NewLongArray(TunnelStats::COUNT);
+    if(stats != nullptr)
+        env->SetLongArrayRegion(stats, 0, TunnelStats::COUNT, values);
+    return stats;
+}
+
+JNIEXPORT void JNICALL
+Java_apriorit_vpnclient_NativeTunnel_nativeDestroy(JNIEnv*, jclass, jlong handle) {
+    delete reinterpret_cast<ClientTunnel*>(handle);
+}
+
+} // extern "C"
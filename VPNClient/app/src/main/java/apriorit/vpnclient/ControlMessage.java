@@ -0,0 +1,122 @@
+package apriorit.vpnclient;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * Binary control message of the tunnel (see protocol_specs.md):
+ * {0, VERSION, type, flags, sequence (2 bytes), length (2 bytes)}
+ * and 'length' bytes of fields {tag, value length, value}.
+ * Numbers are in network byte order, unknown fields are skipped,
+ * bytes after the fields are padding (PROBE messages).
+ */
+class ControlMessage
+{
+    public static final int VERSION     = 0x81;
+    public static final int HEADER_SIZE = 8;
+    public static final int MAX_SIZE    = 512;
+
+    /* types: */
+    public static final int PARAMETERS = 1;
+    public static final int ACK        = 2;
+    public static final int KEEPALIVE  = 3;
+    public static final int DISCONNECT = 4;
+    public static final int PROBE      = 5;
+
+    /* flags: */
+    public static final int ACK_REQUESTED = 1;
+
+    /* tags of the fields: */
+    public static final int MTU      = 1;
+    public static final int ADDRESS  = 2;
+    public static final int DNS      = 3;
+    public static final int ROUTE    = 4;
+    public static final int ADDRESS6 = 5;
+    public static final int ROUTE6   = 6;
+    public static final int DNS6     = 7;
+
+    public static class Field {
+        public final int    tag;
+        public final byte[] value;
+
+        Field(int tag, byte[] value) {
+            this.tag = tag;
+            this.value = value;
+        }
+    }
+
+    private final int type;
+    private final int flags;
+    private final int sequence;
+    private final List<Field> fields;
+
+    private ControlMessage(int type, int flags, int sequence, List<Field> fields) {
+        this.type = type;
+        this.flags = flags;
+        this.sequence = sequence;
+        this.fields = fields;
+    }
+
+    public int getType() {
+        return type;
+    }
+
+    public int getFlags() {
+        return flags;
+    }
+
+    public int getSequence() {
+        return sequence;
+    }
+
+    public List<Field> getFields() {
+        return fields;
+    }
+
+    /**
+     * @return - value of the MTU field, 0 if there is none
+     */
+    public int getMtu() {
+        for (Field field : fields) {
+            if (field.tag == MTU && field.value.length == 2)
+                return ((field.value[0] & 0xFF) << 8) | (field.value[1] & 0xFF);
+        }
+        return 0;
+    }
+
+    /**
+     * Message without fields (ACK, KEEPALIVE, DISCONNECT).
+     */
+    public static byte[] encode(int type, int sequence, int flags) {
+        return new byte[] { 0, (byte) VERSION, (byte) type, (byte) flags,
+                            (byte) (sequence >> 8), (byte) sequence, 0, 0 };
+    }
+
+    /**
+     * @return - the message or null for IP packets, older control packets
+     *           and truncated messages
+     */
+    public static ControlMessage parse(byte[] data, int length) {
+        if (length < HEADER_SIZE || data[0] != 0 || (data[1] & 0xFF) != VERSION)
+            return null;
+
+        int end = HEADER_SIZE + (((data[6] & 0xFF) << 8) | (data[7] & 0xFF));
+        if (end > length)
+            return null;
+
+        List<Field> fields = new ArrayList<>();
+        for (int offset = HEADER_SIZE; offset < end; ) {
+            if (offset + 2 > end)
+                return null;
+            int valueEnd = offset + 2 + (data[offset + 1] & 0xFF);
+            if (valueEnd > end)
+                return null;
+            fields.add(new Field(data[offset] & 0xFF,
+                                 Arrays.copyOfRange(data, offset + 2, valueEnd)));
+            offset = valueEnd;
+        }
+        return new ControlMessage(data[2] & 0xFF, data[3] & 0xFF,
+                                  ((data[4] & 0xFF) << 8) | (data[5] & 0xFF), fields);
+    }
+}
@@ -0,0 +1,109 @@
+package apriorit.vpnclient;
+
+import android.os.ParcelFileDescriptor;
+
+import java.io.IOException;
+import java.net.DatagramSocket;
+
+import com.wolfssl.WolfSSLSession;
+
+/**
+ * Data path of an established connection in native code (src/main/cpp/client_tunnel.hpp):
+ * a loop thread moves packets between the interface and the DTLS session in batches
+ * and answers control messages. The tunnel takes dups of the interface and the socket
+ * and the I/O of the session for good: from then on the session must not be read, written
+ * or shut down from Java, after {@link #close()} (or a failed start) it can only be freed.
+ * Java only waits for the state and reads the counters.
+ */
+class NativeTunnel
+{
+    static {
+        System.loadLibrary("wolfssl");
+        System.loadLibrary("vpnclient");
+    }
+
+    /* states, see ClientTunnel::State: */
+    public static final int RUNNING       = 0;
+    public static final int STOPPED       = 1;
+    public static final int PEER_CLOSED   = 2;
+    public static final int SOCKET_ERROR  = 3;
+    public static final int TUN_ERROR     = 4;
+    public static final int SESSION_ERROR = 5;
+
+    /* indexes of the counters, see TunnelStats::Counter: */
+    public static final int TUN_PACKETS  = 0;
+    public static final int TUN_BYTES    = 1;
+    public static final int NET_PACKETS  = 2;
+    public static final int NET_BYTES    = 3;
+    public static final int TX_CALLS     = 4;
+    public static final int TX_DATAGRAMS = 5;
+    public static final int RX_CALLS     = 6;
+    public static final int RX_DATAGRAMS = 7;
+    public static final int DROPPED      = 8;
+
+    private long handle;
+
+    /**
+     * Starts the loop.
+     * @param ssl - session after the handshake, see the class description
+     * @param iface - established interface
+     * @param socket - socket connected to the server
+     * @throws IOException - if the loop can't be created
+     */
+    NativeTunnel(WolfSSLSession ssl, ParcelFileDescriptor iface, DatagramSocket socket)
+            throws IOException {
+        int tunFd  = iface.dup().detachFd();
+        int sockFd = ParcelFileDescriptor.fromDatagramSocket(socket).detachFd();
+        handle = nativeStart(ssl.getSessionPtr(), tunFd, sockFd);
+        if (handle == 0)
+            throw new IOException("Can't start the native tunnel");
+    }
+
+    /**
+     * Waits until the loop finishes or the timeout passes.
+     * @return - the state, RUNNING if the timeout has passed
+     */
+    public int waitState(long timeoutMs) {
+        return nativeWaitState(handle, timeoutMs);
+    }
+
+    /**
+     * Sends DISCONNECT to the server, the loop finishes when it is acknowledged.
+     */
+    public void stop() {
+        nativeStop(handle);
+    }
+
+    public long[] getStats() {
+        return nativeGetStats(handle);
+    }
+
+    /**
+     * Stops the loop (without DISCONNECT if it still runs) and closes the descriptors.
+     * The I/O of the session fails from now on, free it.
+     */
+    public void close() {
+        if (handle != 0) {
+            nativeDestroy(handle);
+            handle = 0;
+        }
+    }
+
+    public static String stateName(int state) {
+        switch (state) {
+            case RUNNING:       return "running";
+            case STOPPED:       return "stopped";
+            case PEER_CLOSED:   return "closed by the server";
+            case SOCKET_ERROR:  return "socket error";
+            case TUN_ERROR:     return "interface closed";
+            case SESSION_ERROR: return "DTLS session error";
+            default:            return "state " + state;
+        }
+    }
+
+    private static native long nativeStart(long sslPtr, int tunFd, int sockFd);
+    private static native void nativeStop(long handle);
+    private static native int nativeWaitState(long handle, long timeoutMs);
+    private static native long[] nativeGetStats(long handle);
+    private static native void nativeDestroy(long handle);
+}
@@ -1,15 +1,11 @@
 package apriorit.vpnclient;
 
-import static java.nio.charset.StandardCharsets.US_ASCII;
-
 import android.app.PendingIntent;
 import android.content.Context;
 import android.os.ParcelFileDescriptor;
 import android.os.PowerManager;
 import android.util.Log;
 
-import java.io.FileInputStream;
-import java.io.FileOutputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.net.DatagramPacket;
@@ -19,8 +15,11 @@ import java.net.InetSocketAddress;
 import java.net.PortUnreachableException;
 import java.net.SocketAddress;
 import java.net.SocketException;
+import java.net.UnknownHostException;
 import java.nio.ByteBuffer;
 import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Map;
 import java.util.concurrent.TimeUnit;
 import java.io.DataInputStream;
 import java.io.DataOutputStream;
@@ -63,14 +62,19 @@ public class VpnConnection implements Runnable {
         void onEstablish(ParcelFileDescriptor tunInterface);
     }
 
-    /** Maximum packet size is constrained by the MTU, which is given as a signed short. */
-    private static final int MAX_PACKET_SIZE = Short.MAX_VALUE / 2 - 1;
-
     /**
      * Time between polling the VPN interface for new traffic
      */
     private static final long IDLE_INTERVAL_MS = TimeUnit.MILLISECONDS.toMillis(4); // 20 by default
     private static final int MAX_HANDSHAKE_ATTEMPTS = 50;
+    private static final int MAX_DISCONNECT_ATTEMPTS = 4;
+
+    /**
+     * Sessions of the last connection to every server ("host:port"), so a reconnect
+     * after a network change resumes the session instead of a full handshake.
+     * The server keeps them for an hour (see its -c and -k options).
+     */
+    private static final Map<String, Long> savedSessions = new HashMap<>();
 
     private final CustomVpnService mService;
     private final int mConnectionId;
@@ -81,12 +85,21 @@ public class VpnConnection implements Runnable {
     private PendingIntent mConfigureIntent;
     private OnEstablishListener mOnEstablishListener;
     /**
-     * This boolean controls recv-thread execution. If false, thread will be terminated.
+     * True from the DTLS connect till the end of the connection.
      */
     private boolean connectedToServer = false;
 
     private boolean send_vpn_close = false;
 
+    /** Sequence number of the DISCONNECT message, the native tunnel uses the same */
+    private static final int DISCONNECT_SEQUENCE = 1;
+
+    /** Time between checks of the native tunnel, the counters are logged every STATS_CHECKS */
+    private static final long CHECK_INTERVAL_MS = 500;
+    private static final int STATS_CHECKS = 20;
+    /** The native tunnel sends DISCONNECT every 200 ms, MAX_DISCONNECT_ATTEMPTS times */
+    private static final long DISCONNECT_TIMEOUT_MS = 1000;
+
     /** WakeLock object to prevent client from falling asleep when VPN is enabled */
     private PowerManager.WakeLock wakeLock = null;
 
@@ -191,6 +204,8 @@ public class VpnConnection implements Runnable {
         }
 
         ParcelFileDescriptor iface = null;
+        NativeTunnel tunnel = null;
+        boolean sessionHandedOver = false;
         connectedToServer = false;
         // Create a DatagramSocket as the VPN tunnel.
         try  {
@@ -211,7 +226,6 @@ public class VpnConnection implements Runnable {
 
             /* register callbacks: */
             ConnectRecvCallback connCallback = new ConnectRecvCallback();
-            MyRecvCallback rcb = new MyRecvCallback();
             MySendCallback scb = new MySendCallback();
             MyIOCtx ioctx = new MyIOCtx(dtlsOutputStream, dtlsInputStream, dgramSock,
                     server.getAddress(), mServerPort);
@@ -241,6 +255,8 @@ public class VpnConnection implements Runnable {
                 Thread.sleep(200);
             }
 
+            resumeSession(ssl);
+
             /* call wolfSSL_connect */
 
             status = ssl.connect();
@@ -253,6 +269,7 @@ public class VpnConnection implements Runnable {
                 throw new IOException("Can't connect to server");
             }
             showPeer(ssl);
+            saveSession(ssl);
 
             connectedToServer = true;
 
@@ -262,58 +279,21 @@ public class VpnConnection implements Runnable {
                 mService.old_vpn_interface.close();
             }
             mService.old_vpn_interface = iface;
-            FileInputStream  in = new FileInputStream(iface.getFileDescriptor());
-            FileOutputStream out = new FileOutputStream(iface.getFileDescriptor());
 
-            try {
-                sslCtx.setIORecv(rcb);
-            } catch (WolfSSLJNIException e) {
-                throw new IOException("Can't set sslCtx.setIORecv()");
-            }
-
-            // Allocate the buffer for a single packet.
-            ByteBuffer packet = ByteBuffer.allocate(MAX_PACKET_SIZE);
-
-            /* Here Runnable instance will be created.
-             * It will be listening for incoming packets
-             * from outside (dtls) in a new thread
-             */
-
-            //After all test can be uncommented
-            DgramReaderRunnable r = new DgramReaderRunnable(dgramSock, ssl, out);
-            Thread receiver = new Thread(r);
-            receiver.start();
-
-            // dgramSock.setSoTimeout(0);
-
-            // Here packets are forwarding from tunnel to secured socket:
-            int ctrlPktCounter = 0;
-            // Calculate when control messages will be sent (after 'maxLimit' times of 'read')
-            int maxLimit = (int) (3000 / IDLE_INTERVAL_MS);
-
-            while (true) {
-                int len = in.read(packet.array());
-                if (len > 0) {
-                    packet.limit(len);
-                    len = ssl.write(packet.array(), len);
-                    packet.clear();
-                    if(len==-1)
-                        throw new IOException("Can't write to the tunnel!");
-                    Log.i("SSL_WRITE_SUCCESS", "Written " + len + " bytes of data.");
-                }
-                if(++ctrlPktCounter > maxLimit) {
-                    ctrlPktCounter = 0;
-                    packet.put((byte) 0).limit(1);
-                    for (int i = 0; i < 3; ++i) {
-                        packet.position(0);
-                        ssl.write(packet.array(), 1);
-                        if(len==-1)
-                            throw new IOException("Can't write to the tunnel!");
-                        Log.i("CTRL_MSG_SENT", "Control message sent to server");
-                    }
-                    packet.clear();
-                }
-                Thread.sleep(IDLE_INTERVAL_MS);
+            // The data path runs in native code from now on, this thread only
+            // watches it and logs the counters:
+            sessionHandedOver = true;
+            tunnel = new NativeTunnel(ssl, iface, dgramSock);
+            for (int checks = 1; ; ++checks) {
+                int state = tunnel.waitState(CHECK_INTERVAL_MS);
+                if (state == NativeTunnel.SOCKET_ERROR)
+                    throw new SocketException("Tunnel socket failed");
+                if (state != NativeTunnel.RUNNING)
+                    throw new IOException("Tunnel is " + NativeTunnel.stateName(state));
+                if (Thread.interrupted())
+                    throw new InterruptedException();
+                if (checks % STATS_CHECKS == 0)
+                    logStats(tunnel.getStats());
             }
         } catch (PortUnreachableException e) {
             send_vpn_close = true;
@@ -325,13 +305,21 @@ public class VpnConnection implements Runnable {
             Log.e(getTag(), "Cannot use socket", e);
         } catch (InterruptedException e) {
             send_vpn_close = true;
-            ByteBuffer packet = ByteBuffer.allocate(1024);
-            for(int i = 0; i < 4; ++i) {
-                packet.clear();
-                packet.position(0);
-                packet.put((byte)0).put((byte)SpecialPacket.WANT_DISCONNECT.ordinal()).flip();
-                ssl.write(packet.array(), 2);
-                packet.clear();
+            if (tunnel != null) {
+                // the native loop repeats DISCONNECT until the server acknowledges it
+                tunnel.stop();
+                tunnel.waitState(DISCONNECT_TIMEOUT_MS);
+            } else {
+                byte[] disconnect = ControlMessage.encode(ControlMessage.DISCONNECT,
+                        DISCONNECT_SEQUENCE, ControlMessage.ACK_REQUESTED);
+                for(int i = 0; i < MAX_DISCONNECT_ATTEMPTS; ++i) {
+                    ssl.write(disconnect, disconnect.length);
+                    try {
+                        Thread.sleep(200);
+                    } catch (InterruptedException e1) {
+                        break;
+                    }
+                }
             }
             if(mService.old_vpn_interface!=null) {
                 try {
@@ -350,6 +338,12 @@ public class VpnConnection implements Runnable {
             }
 
         } finally {
+            if (tunnel != null) {
+                tunnel.close();
+            }
+            if (sessionHandedOver) {
+                freeSession(ssl); // its I/O belonged to the native tunnel
+            }
             mService.SendCanBeClosed();
             if(send_vpn_close)
                 mService.SetDisconnect(CustomVpnService.SIGNAL_VPN_FAIL);
@@ -377,18 +371,7 @@ public class VpnConnection implements Runnable {
         // and exchange session keys for encryption.
 
         // Allocate the buffer for handshaking.
-        ByteBuffer packet = ByteBuffer.allocate(1024);
-        byte[] packetArr  = packet.array();
-
-        // Control messages always start with zero.
-        packet.put((byte) 0).flip();
-
-        // Send the 'init-connection' packet several times in case of packet loss.
-        for (int i = 0; i < 4; ++i) {
-            packet.position(0);
-            ssl.write(packet.array(), 1024);
-        }
-        packet.clear();
+        byte[] packetArr = new byte[ControlMessage.MAX_SIZE];
 
         // Wait for the parameters within a limited time.
         for (int i = 0; i < MAX_HANDSHAKE_ATTEMPTS; ++i) {
@@ -398,50 +381,69 @@ public class VpnConnection implements Runnable {
                 e.printStackTrace();
             }
 
-            // Normally we should not receive random packets. Check that the first
-            // byte is 0 as expected.
-            int length = ssl.read(packetArr, 1024);
-            if (length > 0 && packet.get(0) == 0) {
-                return configure(new String(packetArr, 1, length - 1, US_ASCII).trim());
+            // Normally we should not receive random packets. Check that
+            // this is the PARAMETERS control message as expected.
+            int length = ssl.read(packetArr, packetArr.length);
+            ControlMessage message = ControlMessage.parse(packetArr, length);
+            if (message != null && message.getType() == ControlMessage.PARAMETERS) {
+                acknowledge(ssl, message);
+                return configure(message);
             }
         }
         throw new IOException("Timed out");
     }
 
     /**
-     * Method parses string for tunnel parameters.
-     * @param parameters - {@link String} with parameters to parse;
+     * Answers a message sent with ACK_REQUESTED, otherwise the server sends it again.
+     */
+    private static void acknowledge(WolfSSLSession ssl, ControlMessage message) {
+        if ((message.getFlags() & ControlMessage.ACK_REQUESTED) != 0) {
+            byte[] ack = ControlMessage.encode(ControlMessage.ACK, message.getSequence(), 0);
+            ssl.write(ack, ack.length);
+        }
+    }
+
+    /**
+     * Method configures the tunnel from the fields of PARAMETERS message.
+     * @param parameters - received {@link ControlMessage};
      * @return - configured {@link ParcelFileDescriptor}
      * @throws IllegalArgumentException - thrown if error occured while parsing parameters.
      */
-    private ParcelFileDescriptor configure(String parameters)
+    private ParcelFileDescriptor configure(ControlMessage parameters)
             throws IllegalArgumentException {
         Log.i("VPN_CONNECTION_CONF", "Configure called.");
         // Configure a builder while parsing the parameters.
         android.net.VpnService.Builder builder = mService.new Builder();
-        for (String parameter : parameters.split(" ")) {
-            String[] fields = parameter.split(",");
+        for (ControlMessage.Field field : parameters.getFields()) {
+            byte[] value = field.value;
             try {
-                switch (fields[0].charAt(0)) {
-                    case 'm':
-                        builder.setMtu(Short.parseShort(fields[1]));
-                        Log.i("MTU_SIZE", fields[1]);
-                        break;
-                    case 'a':
-                        builder.addAddress(fields[1], Integer.parseInt(fields[2]));
+                switch (field.tag) {
+                    case ControlMessage.MTU:
+                        int mtu = ByteBuffer.wrap(value).getShort() & 0xFFFF;
+                        builder.setMtu(mtu);
+                        Log.i("MTU_SIZE", Integer.toString(mtu));
                         break;
-                    case 'r':
-                        builder.addRoute(fields[1], Integer.parseInt(fields[2]));
+                    case ControlMessage.ADDRESS:
+                    case ControlMessage.ADDRESS6:
+                        builder.addAddress(InetAddress.getByAddress(
+                                Arrays.copyOf(value, value.length - 1)),
+                                value[value.length - 1] & 0xFF);
                         break;
-                    case 'd':
-                        builder.addDnsServer(fields[1]);
+                    case ControlMessage.ROUTE:
+                    case ControlMessage.ROUTE6:
+                        builder.addRoute(InetAddress.getByAddress(
+                                Arrays.copyOf(value, value.length - 1)),
+                                value[value.length - 1] & 0xFF);
                         break;
-                    case 's':
-                        builder.addSearchDomain(fields[1]);
+                    case ControlMessage.DNS:
+                    case ControlMessage.DNS6:
+                        builder.addDnsServer(InetAddress.getByAddress(value));
                         break;
+                    default:
+                        break; // fields of newer servers
                 }
-            } catch (NumberFormatException e) {
-                throw new IllegalArgumentException("Bad parameter: " + parameter);
+            } catch (UnknownHostException | RuntimeException e) {
+                throw new IllegalArgumentException("Bad parameter: " + field.tag);
             }
         }
 
@@ -457,10 +459,31 @@ public class VpnConnection implements Runnable {
             }
         }
 
-        Log.i(getTag(), "New interface: " + vpnInterface + " (" + parameters + ")");
+        Log.i(getTag(), "New interface: " + vpnInterface + " (" +
+                parameters.getFields().size() + " parameters)");
         return vpnInterface;
     }
 
+    private void freeSession(WolfSSLSession session) {
+        try {
+            session.freeSSL();
+        } catch (WolfSSLJNIException | IllegalStateException e) {
+            Log.d(getTag(), "Unable to free the session", e);
+        }
+    }
+
+    private void logStats(long[] stats) {
+        long txCalls = stats[NativeTunnel.TX_CALLS];
+        long rxCalls = stats[NativeTunnel.RX_CALLS];
+        Log.i(getTag(), "Sent " + stats[NativeTunnel.TUN_PACKETS] + " packets ("
+                + stats[NativeTunnel.TUN_BYTES] + " bytes), received "
+                + stats[NativeTunnel.NET_PACKETS] + " packets ("
+                + stats[NativeTunnel.NET_BYTES] + " bytes), dropped "
+                + stats[NativeTunnel.DROPPED] + ", datagrams per call: "
+                + (txCalls > 0 ? stats[NativeTunnel.TX_DATAGRAMS] / txCalls : 0) + " sent, "
+                + (rxCalls > 0 ? stats[NativeTunnel.RX_DATAGRAMS] / rxCalls : 0) + " received");
+    }
+
     private final String getTag() {
         return VpnConnection.class.getSimpleName() + "[" + mConnectionId + "]";
     }
@@ -469,6 +492,33 @@ public class VpnConnection implements Runnable {
      * The method shows peer cert information.
      * @param ssl - SSL Session instance
      */
+    private String sessionKey() {
+        return mServerName + ":" + mServerPort;
+    }
+
+    /**
+     * Offers the session of the previous connection to the server, if any.
+     * An expired or unknown session just leads to a full handshake.
+     */
+    private void resumeSession(WolfSSLSession ssl) {
+        Long session;
+        synchronized (savedSessions) {
+            session = savedSessions.get(sessionKey());
+        }
+        if (session != null && ssl.setSession(session) != WolfSSL.SSL_SUCCESS) {
+            Log.w(getTag(), "Saved session is rejected, full handshake");
+        }
+    }
+
+    private void saveSession(WolfSSLSession ssl) {
+        long session = ssl.getSession();
+        if (session == 0)
+            return;
+        synchronized (savedSessions) {
+            savedSessions.put(sessionKey(), session);
+        }
+    }
+
     private void showPeer(WolfSSLSession ssl) {
         String altname;
         try {
@@ -492,50 +542,4 @@ public class VpnConnection implements Runnable {
             e.printStackTrace();
         }
     }
-
-    /**
-     * The {@link DgramReaderRunnable} class
-     * Lisens for DTLS Socket income. Whet it gets some bytes, they will
-     * be retranslated to tun file (iface).
-     */
-    class DgramReaderRunnable implements Runnable {
-        DatagramSocket   ds;
-        WolfSSLSession   ssl;
-        FileOutputStream out;
-        ByteBuffer       buf = ByteBuffer.allocate(MAX_PACKET_SIZE);
-
-        DgramReaderRunnable(DatagramSocket sock, WolfSSLSession ssl, FileOutputStream out)
-                throws SocketException {
-            ds = sock;
-            ds.setSoTimeout(0);
-            this.ssl = ssl;
-            this.out = out;
-        }
-
-        @Override
-        public void run() {
-            while(connectedToServer) {
-                int len = ssl.read(buf.array(), MAX_PACKET_SIZE);
-                if(len > 0) {
-                    if(buf.get(0) != 0) {
-                        try {
-                            out.write(buf.array(), 0, len);
-                        } catch (IOException e) {
-                            e.printStackTrace();
-                        }
-                    } else {
-                        Log.i("CONTROL_PKT", "Control zero packet received");
-                    }
-                    Log.i("SSL_READ_SUCCESS", "Read " + len + " bytes of data: ");
-                    buf.clear();
-                }
-                try {
-                    Thread.sleep(IDLE_INTERVAL_MS);
-                } catch (InterruptedException e) {
-                    e.printStackTrace();
-                }
-            }
-
-        }
-    }
-}
\ No newline at end of file
+}
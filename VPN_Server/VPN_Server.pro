@@ -6,13 +6,61 @@ CONFIG -= qt
 SOURCES += src/main.cpp \
     src/vpn_server.cpp \
     src/tunnel_mgr.cpp \
-    src/ip_manager.cpp
+    src/ip_manager.cpp \
+    src/event_loop.cpp \
+    src/tunnel.cpp \
+    src/worker_pool.cpp \
+    src/dtls_listener.cpp \
+    src/tun_device.cpp \
+    src/packet_pool.cpp \
+    src/network_backend.cpp \
+    src/netlink_backend.cpp \
+    src/route_table.cpp \
+    src/logger.cpp \
+    src/metrics.cpp \
+    src/session_cache.cpp \
+    src/cipher_suites.cpp \
+    src/xfrm_offload.cpp \
+    src/io_engine.cpp \
+    src/control_message.cpp \
+    src/path_mtu.cpp \
+    src/packet_filter.cpp \
+    src/traffic_shaper.cpp \
+    src/handoff.cpp \
+    src/control_server.cpp \
+    src/timer_wheel.cpp \
+    src/keepalive.cpp \
+    src/crypto_pipeline.cpp
 
 HEADERS += \
     src/ip_manager.hpp \
     src/vpn_server.hpp \
     src/client_parameters.hpp \
-    src/tunnel_mgr.hpp
+    src/tunnel_mgr.hpp \
+    src/event_loop.hpp \
+    src/tunnel.hpp \
+    src/worker_pool.hpp \
+    src/dtls_listener.hpp \
+    src/tun_device.hpp \
+    src/packet_pool.hpp \
+    src/network_backend.hpp \
+    src/netlink_backend.hpp \
+    src/route_table.hpp \
+    src/logger.hpp \
+    src/metrics.hpp \
+    src/session_cache.hpp \
+    src/cipher_suites.hpp \
+    src/xfrm_offload.hpp \
+    src/io_engine.hpp \
+    src/control_message.hpp \
+    src/path_mtu.hpp \
+    src/packet_filter.hpp \
+    src/traffic_shaper.hpp \
+    src/handoff.hpp \
+    src/control_server.hpp \
+    src/timer_wheel.hpp \
+    src/keepalive.hpp \
+    src/crypto_pipeline.hpp
 
 LIBS += -lpthread \
         -lwolfssl \
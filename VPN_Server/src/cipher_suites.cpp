@@ -0,0 +1,93 @@
+#include "cipher_suites.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+const char* const CipherSuites::AES_GCM_FIRST =
+        "ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:"
+        "ECDHE-RSA-CHACHA20-POLY1305:DHE-RSA-AES128-GCM-SHA256";
+const char* const CipherSuites::CHACHA20_FIRST =
+        "ECDHE-RSA-CHACHA20-POLY1305:ECDHE-RSA-AES128-GCM-SHA256:"
+        "ECDHE-RSA-AES256-GCM-SHA384:DHE-RSA-AES128-GCM-SHA256";
+
+CpuFeatures::CpuFeatures()
+    : aes(false), clmul(false), avx2(false) { }
+
+/**
+ * @brief detect - features of the CPU the server runs on
+ */
+CpuFeatures CpuFeatures::detect() {
+    CpuFeatures cpu;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        cpu.aes   = (ecx & (1u << 25)) != 0;
+        cpu.clmul = (ecx & (1u << 1)) != 0;
+    }
+    if(__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        cpu.avx2 = (ebx & (1u << 5)) != 0;
+    }
+#elif defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    cpu.aes   = (hwcap & (1ul << 3)) != 0; // HWCAP_AES
+    cpu.clmul = (hwcap & (1ul << 4)) != 0; // HWCAP_PMULL
+#elif defined(__arm__)
+    unsigned long hwcap2 = getauxval(AT_HWCAP2);
+    cpu.aes   = (hwcap2 & (1ul << 0)) != 0; // HWCAP2_AES
+    cpu.clmul = (hwcap2 & (1ul << 1)) != 0; // HWCAP2_PMULL
+#endif
+    return cpu;
+}
+
+/**
+ * @brief hasAesGcmAcceleration - both AES and GHASH
+ * are done by instructions instead of table lookups
+ */
+bool CpuFeatures::hasAesGcmAcceleration() const {
+    return aes && clmul;
+}
+
+/**
+ * @brief describe
+ * @return e.g. "aes clmul avx2" or "no crypto extensions"
+ */
+std::string CpuFeatures::describe() const {
+    std::string text;
+    if(aes)
+        text += "aes ";
+    if(clmul)
+        text += "clmul ";
+    if(avx2)
+        text += "avx2 ";
+    if(text.empty())
+        return "no crypto extensions";
+    text.erase(text.size() - 1);
+    return text;
+}
+
+bool CipherSuites::isPolicyName(const std::string& policy) {
+    return policy == "auto" || policy == "aes-gcm"
+            || policy == "chacha20" || policy == "default";
+}
+
+/**
+ * @brief select - cipher list of the policy
+ * @param cpu - used by the "auto" policy
+ * @return list for wolfSSL_CTX_set_cipher_list or nullptr
+ *         to keep the list of wolfSSL
+ */
+const char* CipherSuites::select(const std::string& policy, const CpuFeatures& cpu) {
+    if(policy == "default")
+        return nullptr;
+    if(policy == "aes-gcm")
+        return AES_GCM_FIRST;
+    if(policy == "chacha20")
+        return CHACHA20_FIRST;
+    if(policy != "auto")
+        throw std::invalid_argument("Unknown cipher policy: " + policy);
+    return cpu.hasAesGcmAcceleration() ? AES_GCM_FIRST : CHACHA20_FIRST;
+}
@@ -0,0 +1,44 @@
+#ifndef CIPHER_SUITES_HPP
+#define CIPHER_SUITES_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include <stdint.h>
+
+/**
+ * @brief The CpuFeatures struct<br>
+ * Instructions that make AES-GCM fast: AES rounds and carry-less<br>
+ * multiplication for GHASH (AES-NI and PCLMULQDQ on x86,<br>
+ * AES and PMULL of the ARMv8 crypto extension).<br>
+ */
+struct CpuFeatures {
+    bool aes;
+    bool clmul;
+    bool avx2; // wider AES-GCM and ChaCha20 code of wolfSSL intel asm
+
+    explicit CpuFeatures();
+
+    static CpuFeatures detect();
+    bool hasAesGcmAcceleration() const;
+    std::string describe() const;
+};
+
+/**
+ * @brief The CipherSuites class<br>
+ * DTLS 1.2 cipher lists of the server, every list has only AEAD suites<br>
+ * with forward secrecy and keeps the other cipher for clients without<br>
+ * the first choice. wolfSSL prefers the order of the server list.<br>
+ * Policies: "auto" (AES-GCM with hardware support, ChaCha20-Poly1305<br>
+ * otherwise), "aes-gcm", "chacha20" and "default" (list of wolfSSL).<br>
+ */
+class CipherSuites {
+public:
+    static const char* const AES_GCM_FIRST;
+    static const char* const CHACHA20_FIRST;
+
+    static bool isPolicyName(const std::string& policy);
+    static const char* select(const std::string& policy, const CpuFeatures& cpu);
+};
+
+#endif // CIPHER_SUITES_HPP
@@ -1,24 +1,30 @@
 #ifndef CLIENT_PARAMETERS_HPP
 #define CLIENT_PARAMETERS_HPP
 
+#include "control_message.hpp"
 #include "ip_manager.hpp"
 
 /**
  * @brief The ClientParameters\r\n
  * Structure that contains info used\r\n
- * for creating 'parametersToSend[]' array\r\n
- * This array will form the package with client settings,\r\n
- * such as IP, DNS etc. and will be sent to client.\r\n
+ * for creating 'parametersToSend' message\r\n
+ * This message carries client settings, such as IP,\r\n
+ * DNS etc. and will be sent to client (see ControlMessage).\r\n
  */
 struct ClientParameters {
-    std::string mtu;
-    std::string virtualNetworkIp;
-    std::string networkMask;
-    std::string dnsIp;
-    std::string routeIp;
-    std::string routeMask;
-    std::string physInterface;   // eth0, wlan0 etc..
-    char  parametersToSend[1024];
+    std::string    mtu;
+    std::string    virtualNetworkIp;
+    std::string    networkMask;
+    std::string    dnsIp;
+    std::string    routeIp;
+    std::string    routeMask;
+    std::string    virtualNetwork6; // empty - clients have no IPv6 address
+    std::string    networkMask6;    // prefix length
+    std::string    dnsIp6;
+    std::string    routeIp6;
+    std::string    routeMask6;
+    std::string    physInterface;   // eth0, wlan0 etc..
+    ControlMessage parametersToSend;
 };
 
 #endif // CLIENT_PARAMETERS_HPP
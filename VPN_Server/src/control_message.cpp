@@ -0,0 +1,200 @@
+#include "control_message.hpp"
+
+const uint8_t ControlMessage::VERSION;
+const int     ControlMessage::HEADER_SIZE;
+const int     ControlMessage::MAX_SIZE;
+
+/**
+ * @brief ControlMessage constructor - message without fields
+ */
+ControlMessage::ControlMessage(Type type, uint16_t sequence, uint8_t flags)
+    : buffer(HEADER_SIZE, 0) {
+    buffer[1] = VERSION;
+    buffer[2] = type;
+    buffer[3] = flags;
+    setSequence(sequence);
+}
+
+/**
+ * @brief addField - appends field {tag, length, value}
+ * @throws std::invalid_argument if the value is longer than 255 bytes
+ * or the message would not fit MAX_SIZE
+ */
+void ControlMessage::addField(Tag tag, const void* value, size_t length) {
+    if(length > 0xFF || buffer.size() + 2 + length > (size_t)MAX_SIZE)
+        throw std::invalid_argument("Control message field is too long");
+
+    buffer.push_back(tag);
+    buffer.push_back(length);
+    const char* bytes = static_cast<const char*>(value);
+    buffer.insert(buffer.end(), bytes, bytes + length);
+    setLength();
+}
+
+void ControlMessage::addMtu(uint16_t mtu) {
+    uint16_t value = htons(mtu);
+    addField(MTU, &value, sizeof(value));
+}
+
+/**
+ * @brief addAddress - IPv4 address with prefix length (ADDRESS, ROUTE)
+ * @param address - in network byte order
+ */
+void ControlMessage::addAddress(Tag tag, in_addr_t address, uint8_t prefix) {
+    char value[sizeof(address) + 1];
+    memcpy(value, &address, sizeof(address));
+    value[sizeof(address)] = prefix;
+    addField(tag, value, sizeof(value));
+}
+
+/**
+ * @brief addAddress - IPv4 address without prefix (DNS)
+ */
+void ControlMessage::addAddress(Tag tag, in_addr_t address) {
+    addField(tag, &address, sizeof(address));
+}
+
+/**
+ * @brief addAddress - IPv6 address with prefix length (ADDRESS6, ROUTE6)
+ */
+void ControlMessage::addAddress(Tag tag, const in6_addr& address, uint8_t prefix) {
+    char value[sizeof(address) + 1];
+    memcpy(value, &address, sizeof(address));
+    value[sizeof(address)] = prefix;
+    addField(tag, value, sizeof(value));
+}
+
+/**
+ * @brief addAddress - IPv6 address without prefix (DNS6)
+ */
+void ControlMessage::addAddress(Tag tag, const in6_addr& address) {
+    addField(tag, &address, sizeof(address));
+}
+
+/**
+ * @brief setMtu - changes the MTU field or adds it
+ */
+void ControlMessage::setMtu(uint16_t mtu) {
+    size_t end = HEADER_SIZE + (((uint8_t)buffer[6] << 8) | (uint8_t)buffer[7]);
+    for(size_t offset = HEADER_SIZE; offset + 2 <= end;) {
+        uint8_t length = buffer[offset + 1];
+        if(buffer[offset] == MTU && length == sizeof(mtu)) {
+            buffer[offset + 2] = mtu >> 8;
+            buffer[offset + 3] = mtu & 0xFF;
+            return;
+        }
+        offset += 2 + length;
+    }
+    addMtu(mtu);
+}
+
+/**
+ * @brief pad - appends zero bytes up to 'size' bytes,
+ * no fields can be added after it
+ */
+void ControlMessage::pad(size_t size) {
+    if(buffer.size() < size)
+        buffer.resize(size, 0);
+}
+
+void ControlMessage::setSequence(uint16_t sequence) {
+    buffer[4] = sequence >> 8;
+    buffer[5] = sequence & 0xFF;
+}
+
+void ControlMessage::setFlags(uint8_t flags) {
+    buffer[3] = flags;
+}
+
+ControlMessage::Type ControlMessage::getType() const {
+    return static_cast<Type>((uint8_t)buffer[2]);
+}
+
+uint8_t ControlMessage::getFlags() const {
+    return buffer[3];
+}
+
+uint16_t ControlMessage::getSequence() const {
+    return ((uint8_t)buffer[4] << 8) | (uint8_t)buffer[5];
+}
+
+/**
+ * @brief getMtu - value of the MTU field, 0 if there is none
+ */
+uint16_t ControlMessage::getMtu() const {
+    for(const ControlField& field : getFields()) {
+        if(field.tag == MTU && field.length == sizeof(uint16_t))
+            return ((uint8_t)field.value[0] << 8) | (uint8_t)field.value[1];
+    }
+    return 0;
+}
+
+/**
+ * @brief getFields - fields in the order of the message,
+ * a tag may repeat (e.g. ROUTE)
+ */
+std::vector<ControlField> ControlMessage::getFields() const {
+    std::vector<ControlField> fields;
+    size_t end = HEADER_SIZE + (((uint8_t)buffer[6] << 8) | (uint8_t)buffer[7]);
+    for(size_t offset = HEADER_SIZE; offset + 2 <= end;) {
+        ControlField field;
+        field.tag    = buffer[offset];
+        field.length = buffer[offset + 1];
+        field.value  = &buffer[offset + 2];
+        fields.push_back(field);
+        offset += 2 + field.length;
+    }
+    return fields;
+}
+
+const char* ControlMessage::data() const {
+    return buffer.data();
+}
+
+int ControlMessage::size() const {
+    return buffer.size();
+}
+
+/**
+ * @brief parse - checks the header and the field lengths
+ * @param message - filled only if the message is valid
+ * @return false for IP packets, older 2-byte messages,
+ * unknown versions and truncated messages
+ */
+bool ControlMessage::parse(const char* data, int length, ControlMessage& message) {
+    if(!isControlMessage(data, length))
+        return false;
+
+    int bodyLength = ((uint8_t)data[6] << 8) | (uint8_t)data[7];
+    if(HEADER_SIZE + bodyLength > length)
+        return false;
+
+    for(int offset = HEADER_SIZE; offset < HEADER_SIZE + bodyLength;) {
+        if(offset + 2 > HEADER_SIZE + bodyLength)
+            return false;
+        offset += 2 + (uint8_t)data[offset + 1];
+        if(offset > HEADER_SIZE + bodyLength)
+            return false;
+    }
+
+    // trailing bytes (e.g. padding of a record) are dropped
+    message.buffer.assign(data, data + HEADER_SIZE + bodyLength);
+    return true;
+}
+
+/**
+ * @brief isControlMessage - the record has the header of this version
+ */
+bool ControlMessage::isControlMessage(const char* data, int length) {
+    return length >= HEADER_SIZE && data[0] == 0 && (uint8_t)data[1] == VERSION;
+}
+
+ControlMessage ControlMessage::ack(uint16_t sequence) {
+    return ControlMessage(ACK, sequence);
+}
+
+void ControlMessage::setLength() {
+    size_t length = buffer.size() - HEADER_SIZE;
+    buffer[6] = length >> 8;
+    buffer[7] = length & 0xFF;
+}
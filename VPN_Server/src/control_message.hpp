@@ -0,0 +1,99 @@
+#ifndef CONTROL_MESSAGE_HPP
+#define CONTROL_MESSAGE_HPP
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/**
+ * @brief The ControlField struct - one field of a parsed message,
+ * 'value' points into the buffer of the message
+ */
+struct ControlField {
+    uint8_t     tag;
+    uint8_t     length;
+    const char* value;
+};
+
+/**
+ * @brief The ControlMessage class<br>
+ * Binary control message of the tunnel, sent as a DTLS record:<br>
+ * {0, VERSION, type, flags, sequence (2 bytes), length (2 bytes)}<br>
+ * and 'length' bytes of fields {tag, value length, value}.<br>
+ * Numbers are in network byte order. The first zero byte tells<br>
+ * control messages from IP packets, VERSION has the high bit set,<br>
+ * so the messages differ from the older 2-byte messages {0, type}.<br>
+ * Unknown fields are skipped by the receiver, new fields<br>
+ * (IPv6, more routes, MTU hints) don't change the format.<br>
+ * A message with ACK_REQUESTED is sent again until the peer<br>
+ * answers with ACK of the same sequence number.<br>
+ * Bytes after the fields are padding, they are not parsed.<br>
+ */
+class ControlMessage {
+public:
+    static const uint8_t VERSION     = 0x81; // version 1
+    static const int     HEADER_SIZE = 8;
+    static const int     MAX_SIZE    = 512;  // fits any tunnel MTU
+
+    enum Type {
+        PARAMETERS = 1, // server -> client, tunnel settings
+        ACK        = 2, // sequence number of the acknowledged message
+        KEEPALIVE  = 3,
+        DISCONNECT = 4, // client -> server
+        PROBE      = 5  // path MTU probe, padded to the probed size
+    };
+
+    enum Flags {
+        ACK_REQUESTED = 1
+    };
+
+    enum Tag {
+        MTU      = 1, // 2 bytes
+        ADDRESS  = 2, // IPv4 address and prefix length (5 bytes)
+        DNS      = 3, // IPv4 address (4 bytes)
+        ROUTE    = 4, // IPv4 address and prefix length, may repeat
+        ADDRESS6 = 5, // IPv6 address and prefix length (17 bytes)
+        ROUTE6   = 6, // IPv6 address and prefix length, may repeat
+        DNS6     = 7  // IPv6 address (16 bytes)
+    };
+
+private:
+    std::vector<char> buffer;
+
+public:
+    explicit ControlMessage(Type type = KEEPALIVE,
+                            uint16_t sequence = 0, uint8_t flags = 0);
+
+    void addField(Tag tag, const void* value, size_t length);
+    void addMtu(uint16_t mtu);
+    void addAddress(Tag tag, in_addr_t address, uint8_t prefix);
+    void addAddress(Tag tag, in_addr_t address);
+    void addAddress(Tag tag, const in6_addr& address, uint8_t prefix);
+    void addAddress(Tag tag, const in6_addr& address);
+    void setMtu(uint16_t mtu);
+    void pad(size_t size);
+    void setSequence(uint16_t sequence);
+    void setFlags(uint8_t flags);
+
+    Type getType() const;
+    uint8_t getFlags() const;
+    uint16_t getSequence() const;
+    uint16_t getMtu() const;
+    std::vector<ControlField> getFields() const;
+    const char* data() const;
+    int size() const;
+
+    static bool parse(const char* data, int length, ControlMessage& message);
+    static bool isControlMessage(const char* data, int length);
+    static ControlMessage ack(uint16_t sequence);
+
+private:
+    void setLength();
+};
+
+#endif // CONTROL_MESSAGE_HPP
@@ -0,0 +1,216 @@
+#include "control_server.hpp"
+
+const size_t ControlServer::MAX_REQUEST;
+const size_t ControlServer::MAX_CONNECTIONS;
+
+/**
+ * @brief load - reads the settings from the configuration file
+ * @throws std::invalid_argument if the file cannot be read
+ * or a line is not a setting
+ */
+void ServerSettings::load(const std::string& path) {
+    std::ifstream file(path);
+    if(!file)
+        throw std::invalid_argument("Cannot open configuration file " + path);
+
+    std::string line;
+    for(int number = 1; std::getline(file, line); ++number) {
+        try {
+            add(line);
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(path + ":" + std::to_string(number) +
+                                        ": " + e.what());
+        }
+    }
+}
+
+/**
+ * @brief add - sets one setting, empty lines and comments are skipped
+ * @throws std::invalid_argument for an unknown key or a bad value
+ */
+void ServerSettings::add(const std::string& line) {
+    std::istringstream words(line.substr(0, line.find('#')));
+    std::string        key;
+    std::string        value;
+    std::string        mask;  // of a route
+    std::string        extra;
+    if(!(words >> key))
+        return;
+    words >> value >> mask >> extra;
+    if(!extra.empty() || (key != "route" && !mask.empty()))
+        throw std::invalid_argument("Unexpected " + (extra.empty() ? mask : extra));
+
+    in_addr  address;
+    in6_addr address6;
+    if(key == "mtu") {
+        int number = atoi(value.c_str());
+        if(number < 1000 || number > 2000)
+            throw std::invalid_argument("Invalid mtu");
+        mtu = std::to_string(number);
+    } else if(key == "dns") {
+        if(inet_pton(AF_INET6, value.c_str(), &address6) == 1)
+            dnsIp6 = value;
+        else if(inet_pton(AF_INET, value.c_str(), &address) == 1)
+            dnsIp = value;
+        else
+            throw std::invalid_argument("Invalid dns IP");
+    } else if(key == "route") {
+        bool ipv6 = inet_pton(AF_INET6, value.c_str(), &address6) == 1;
+        if(!ipv6 && inet_pton(AF_INET, value.c_str(), &address) != 1)
+            throw std::invalid_argument("Invalid route IP");
+        if(mask.empty() || atoi(mask.c_str()) < 0 || atoi(mask.c_str()) > (ipv6 ? 128 : 32))
+            throw std::invalid_argument("Invalid route mask");
+        (ipv6 ? routeIp6 : routeIp)     = value;
+        (ipv6 ? routeMask6 : routeMask) = std::to_string(atoi(mask.c_str()));
+    } else if(key == "interface") {
+        if(value.empty())
+            throw std::invalid_argument("No such network interface");
+        physInterface = value;
+    } else if(key == "rate") {
+        RateLimits().add(value); // throws for a bad host or rate
+        rateLimits.push_back(value);
+    } else {
+        throw std::invalid_argument("Unknown setting " + key);
+    }
+}
+
+/**
+ * @brief ControlServer - creates the socket at 'path',
+ * a stale socket of a previous run is replaced
+ * @param handler - runs a command, returns the response text
+ */
+ControlServer::ControlServer(const std::string& path, const CommandHandler& handler)
+    : path(path), loop(nullptr), handler(handler) {
+    if(!isValidPath(path))
+        throw std::invalid_argument("Invalid control socket path");
+
+    sd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() + "Control socket error: " +
+                                 strerror(errno));
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    unlink(path.c_str());
+    if(bind(sd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+       || chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0
+       || listen(sd, MAX_CONNECTIONS) < 0) {
+        int error = errno;
+        close(sd);
+        throw std::runtime_error("Cannot listen on control socket " + path +
+                                 ": " + strerror(error));
+    }
+}
+
+/**
+ * @brief ~ControlServer - the socket file is left, it may belong
+ * to the server that has taken over (see Handoff)
+ */
+ControlServer::~ControlServer() {
+    detach();
+    close(sd);
+}
+
+void ControlServer::attach(EventLoop& loop) {
+    this->loop = &loop;
+    loop.addFd(sd, EPOLLIN, [this](uint32_t) { onAccept(); });
+}
+
+/**
+ * @brief detach - closes connections and stops watching the socket
+ */
+void ControlServer::detach() {
+    if(loop == nullptr)
+        return;
+
+    while(!connections.empty())
+        closeClient(connections.begin()->first);
+    loop->removeFd(sd);
+    loop = nullptr;
+}
+
+/**
+ * @brief isValidPath - the path fits a Unix socket address
+ */
+bool ControlServer::isValidPath(const std::string& path) {
+    return !path.empty() && path.size() < sizeof(sockaddr_un::sun_path);
+}
+
+void ControlServer::onAccept() {
+    int fd = -1;
+    while((fd = accept4(sd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        ucred     credentials;
+        socklen_t length = sizeof(credentials);
+        if(connections.size() >= MAX_CONNECTIONS ||
+           getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0 ||
+           (credentials.uid != getuid() && credentials.uid != 0)) {
+            close(fd);
+            continue;
+        }
+        connections[fd].sent = 0;
+        loop->addFd(fd, EPOLLIN, [this, fd](uint32_t events) {
+            onClient(fd, events);
+        });
+    }
+}
+
+/**
+ * @brief onClient - reads the command until the end of the line,
+ * then writes the response and closes the connection
+ */
+void ControlServer::onClient(int fd, uint32_t events) {
+    Connection& connection = connections[fd];
+
+    if(connection.response.empty()) {
+        char buffer[1024];
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if(length < 0 || (events & EPOLLERR)) {
+            closeClient(fd);
+            return;
+        }
+
+        connection.request.append(buffer, length);
+        size_t end = connection.request.find('\n');
+        if(end == std::string::npos && length > 0 &&
+           connection.request.length() < MAX_REQUEST)
+            return; // wait for the rest of the command
+        if(connection.request.empty()) {
+            closeClient(fd);
+            return;
+        }
+
+        std::string command = connection.request.substr(0, end);
+        if(!command.empty() && command.back() == '\r')
+            command.pop_back();
+        connection.response = handler(command);
+        if(connection.response.empty())
+            connection.response = "\n";
+        loop->modifyFd(fd, EPOLLOUT);
+    }
+
+    while(connection.sent < connection.response.length()) {
+        ssize_t sent = send(fd, connection.response.data() + connection.sent,
+                            connection.response.length() - connection.sent,
+                            MSG_NOSIGNAL);
+        if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return; // wait for EPOLLOUT
+        if(sent <= 0) {
+            closeClient(fd);
+            return;
+        }
+        connection.sent += sent;
+    }
+    closeClient(fd);
+}
+
+void ControlServer::closeClient(int fd) {
+    loop->removeFd(fd);
+    close(fd);
+    connections.erase(fd);
+}
@@ -0,0 +1,102 @@
+#ifndef CONTROL_SERVER_HPP
+#define CONTROL_SERVER_HPP
+
+#include "event_loop.hpp"
+#include "traffic_shaper.hpp"
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * @brief The ServerSettings struct<br>
+ * Settings of the server that may be changed while it runs,<br>
+ * loaded from the configuration file or set by the control API.<br>
+ * A line of the file is "KEY VALUE...", '#' starts a comment:<br>
+ * mtu 1400<br>
+ * dns 8.8.8.8<br>
+ * route 0.0.0.0 0<br>
+ * dns 2001:4860:4860::8888 and route :: 0 are the IPv6 ones<br>
+ * interface eth0<br>
+ * rate 10m (or rate HOST=RATE, may be repeated)<br>
+ * Empty settings are not changed.<br>
+ */
+struct ServerSettings {
+    std::string              mtu;
+    std::string              dnsIp;
+    std::string              routeIp;
+    std::string              routeMask;
+    std::string              dnsIp6;
+    std::string              routeIp6;
+    std::string              routeMask6;
+    std::string              physInterface;
+    std::vector<std::string> rateLimits; // replace all limits if not empty
+
+    void load(const std::string& path);
+    void add(const std::string& line);
+};
+
+/**
+ * @brief The ControlServer class<br>
+ * Control API of the server on a Unix socket, served by the event<br>
+ * loop of the main thread. A connection sends one command line<br>
+ * (e.g. "sessions" or "set dns 1.1.1.1"), gets the text returned<br>
+ * by the command handler and is closed. The socket is accessible<br>
+ * by its owner only, connections of other users (but root)<br>
+ * are refused.<br>
+ */
+class ControlServer {
+public:
+    typedef std::function<std::string(const std::string& command)> CommandHandler;
+
+    static const size_t MAX_REQUEST     = 4096;
+    static const size_t MAX_CONNECTIONS = 16;
+
+private:
+    /**
+     * @brief The Connection struct - command being read
+     * and response being written
+     */
+    struct Connection {
+        std::string request;
+        std::string response;
+        size_t      sent;
+    };
+
+    int                                  sd;
+    std::string                          path;
+    EventLoop*                           loop;
+    CommandHandler                       handler;
+    std::unordered_map<int, Connection>  connections;
+
+public:
+    /* Forbid creating default copy ctor: */
+    ControlServer(ControlServer& that) = delete;
+
+    explicit ControlServer(const std::string& path, const CommandHandler& handler);
+    ~ControlServer();
+
+    void attach(EventLoop& loop);
+    void detach();
+
+    static bool isValidPath(const std::string& path);
+
+private:
+    void onAccept();
+    void onClient(int fd, uint32_t events);
+    void closeClient(int fd);
+};
+
+#endif // CONTROL_SERVER_HPP
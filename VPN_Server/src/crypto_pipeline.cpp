@@ -0,0 +1,564 @@
+#include "crypto_pipeline.hpp"
+
+const int      RecordKey::MAX_KEY_SIZE;
+const int      RecordKey::SALT_SIZE;
+const int      RecordCipher::HEADER_SIZE;
+const int      RecordCipher::NONCE_SIZE;
+const int      RecordCipher::TAG_SIZE;
+const int      RecordCipher::OVERHEAD;
+const uint8_t  RecordCipher::ALERT;
+const uint8_t  RecordCipher::APPLICATION_DATA;
+const uint64_t RecordCipher::MAX_SEQUENCE;
+const int      ReplayWindow::SIZE;
+const size_t   CryptoPool::MAX_THREADS;
+const int      CryptoPipeline::BATCH_SIZE;
+const int      CryptoPipeline::MAX_PAYLOAD;
+const int      CryptoPipeline::SLOT_SIZE;
+const size_t   CryptoPipeline::MAX_IN_FLIGHT;
+
+namespace {
+
+const unsigned char DTLS_MAJOR = 0xFE; // DTLS 1.2
+const unsigned char DTLS_MINOR = 0xFD;
+const int           AAD_SIZE   = 13;
+
+} // namespace
+
+RecordKey::RecordKey()
+    : keySize(0),
+      epoch(0) {
+    memset(key, 0, sizeof(key));
+    memset(salt, 0, sizeof(salt));
+}
+
+RecordKey::~RecordKey() {
+    memset(key, 0, sizeof(key));
+    memset(salt, 0, sizeof(salt));
+}
+
+RecordCipher::RecordCipher()
+    : ready(false),
+      epoch(0) {
+    memset(salt, 0, sizeof(salt));
+}
+
+RecordCipher::~RecordCipher() {
+    if(ready)
+        wc_AesFree(&aes);
+}
+
+/**
+ * @brief setKey - the key of the records of 'key.epoch'
+ * @return false if wolfCrypt refuses the key
+ */
+bool RecordCipher::setKey(const RecordKey& key) {
+    if(ready)
+        wc_AesFree(&aes);
+    ready = wc_AesInit(&aes, nullptr, INVALID_DEVID) == 0;
+    if(ready && wc_AesGcmSetKey(&aes, key.key, key.keySize) != 0) {
+        wc_AesFree(&aes);
+        ready = false;
+    }
+    memcpy(salt, key.salt, sizeof(salt));
+    epoch = key.epoch;
+    return ready;
+}
+
+/**
+ * @brief seal - encrypts the payload at HEADER_SIZE + NONCE_SIZE
+ * of 'record' and writes the header, the record buffer must have
+ * room for OVERHEAD bytes more than the payload
+ * @param length - payload length
+ * @return record length or -1
+ */
+int RecordCipher::seal(uint8_t type, uint64_t sequence, char* record, int length) {
+    if(!ready || sequence > MAX_SEQUENCE || length < 0)
+        return -1;
+
+    int fragment = NONCE_SIZE + length + TAG_SIZE;
+    record[0] = type;
+    record[1] = DTLS_MAJOR;
+    record[2] = DTLS_MINOR;
+    record[3] = epoch >> 8;
+    record[4] = epoch;
+    for(int i = 0; i < 6; ++i)
+        record[5 + i] = sequence >> (8 * (5 - i));
+    record[11] = fragment >> 8;
+    record[12] = fragment;
+    // epoch and sequence number are the explicit nonce:
+    memcpy(record + HEADER_SIZE, record + 3, NONCE_SIZE);
+
+    unsigned char nonce[RecordKey::SALT_SIZE + NONCE_SIZE];
+    unsigned char aad[AAD_SIZE];
+    makeNonce(record, nonce);
+    makeAad(record, length, aad);
+    unsigned char* payload = (unsigned char*)record + HEADER_SIZE + NONCE_SIZE;
+    if(wc_AesGcmEncrypt(&aes, payload, payload, length, nonce, sizeof(nonce),
+                        payload + length, TAG_SIZE, aad, sizeof(aad)) != 0)
+        return -1;
+    return HEADER_SIZE + fragment;
+}
+
+/**
+ * @brief open - checks and decrypts the record in place,
+ * the payload starts at HEADER_SIZE + NONCE_SIZE
+ * @param sequence - sequence number of the record
+ * @return payload length or -1 if the record is not authentic
+ */
+int RecordCipher::open(char* record, int length, uint64_t& sequence) {
+    RecordHeader header;
+    if(!ready || !parseHeader(record, length, header) || header.epoch != epoch
+       || header.length != length - HEADER_SIZE
+       || header.length < NONCE_SIZE + TAG_SIZE)
+        return -1;
+
+    int payloadLength = header.length - NONCE_SIZE - TAG_SIZE;
+    unsigned char nonce[RecordKey::SALT_SIZE + NONCE_SIZE];
+    unsigned char aad[AAD_SIZE];
+    makeNonce(record, nonce);
+    makeAad(record, payloadLength, aad);
+    unsigned char* payload = (unsigned char*)record + HEADER_SIZE + NONCE_SIZE;
+    if(wc_AesGcmDecrypt(&aes, payload, payload, payloadLength, nonce, sizeof(nonce),
+                        payload + payloadLength, TAG_SIZE, aad, sizeof(aad)) != 0)
+        return -1;
+    sequence = header.sequence;
+    return payloadLength;
+}
+
+/**
+ * @brief parseHeader - reads the header of the first record
+ * of a datagram
+ * @return false if it is not a DTLS 1.2 record
+ */
+bool RecordCipher::parseHeader(const char* record, int length, RecordHeader& header) {
+    if(length < HEADER_SIZE)
+        return false;
+
+    const unsigned char* bytes = (const unsigned char*)record;
+    if(bytes[1] != DTLS_MAJOR || bytes[2] != DTLS_MINOR)
+        return false;
+    header.type     = bytes[0];
+    header.epoch    = (bytes[3] << 8) | bytes[4];
+    header.sequence = 0;
+    for(int i = 5; i < 11; ++i)
+        header.sequence = (header.sequence << 8) | bytes[i];
+    header.length   = (bytes[11] << 8) | bytes[12];
+    return header.length <= length - HEADER_SIZE;
+}
+
+/**
+ * @brief makeNonce - salt and explicit nonce of the record (RFC 5288)
+ */
+void RecordCipher::makeNonce(const char* record, unsigned char* nonce) const {
+    memcpy(nonce, salt, sizeof(salt));
+    memcpy(nonce + sizeof(salt), record + HEADER_SIZE, NONCE_SIZE);
+}
+
+/**
+ * @brief makeAad - additional data of the record: epoch and sequence
+ * number, type, version and payload length (RFC 6347, 4.1.2.1)
+ */
+void RecordCipher::makeAad(const char* record, int length, unsigned char* aad) {
+    memcpy(aad, record + 3, 8);
+    memcpy(aad + 8, record, 3);
+    aad[11] = length >> 8;
+    aad[12] = length;
+}
+
+/**
+ * @brief ReplayWindow constructor - 'highest' and the numbers below it
+ * count as received
+ */
+ReplayWindow::ReplayWindow(uint64_t highest)
+    : highest(highest),
+      bitmap(~uint64_t(0)) { }
+
+/**
+ * @brief accept - marks the sequence number as received
+ * @return false if the record was received or is too old
+ */
+bool ReplayWindow::accept(uint64_t sequence) {
+    if(sequence > highest) {
+        uint64_t shift = sequence - highest;
+        bitmap  = shift < (uint64_t)SIZE ? (bitmap << shift) | 1 : 1;
+        highest = sequence;
+        return true;
+    }
+
+    uint64_t age = highest - sequence;
+    if(age >= (uint64_t)SIZE || (bitmap & (uint64_t(1) << age)))
+        return false;
+    bitmap |= uint64_t(1) << age;
+    return true;
+}
+
+CryptoPool::CryptoPool(size_t threadsCount)
+    : stopping(false),
+      pipelines(0) {
+    if(threadsCount < 1 || threadsCount > MAX_THREADS)
+        throw std::invalid_argument("Invalid crypto threads count");
+    for(size_t i = 0; i < threadsCount; ++i)
+        threads.emplace_back(&CryptoPool::run, this, i);
+}
+
+/**
+ * @brief CryptoPool destructor - the submitted jobs are finished
+ */
+CryptoPool::~CryptoPool() {
+    mutex.lock();
+        stopping = true;
+    mutex.unlock();
+    ready.notify_all();
+    for(std::thread& thread : threads)
+        thread.join();
+}
+
+void CryptoPool::submit(const Job& job) {
+    mutex.lock();
+        jobs.push_back(job);
+    mutex.unlock();
+    ready.notify_one();
+}
+
+size_t CryptoPool::size() const {
+    return threads.size();
+}
+
+size_t CryptoPool::pipelinesCount() const {
+    return pipelines;
+}
+
+void CryptoPool::run(size_t index) {
+    while(true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if(jobs.empty())
+                return; // stopping
+            job.swap(jobs.front());
+            jobs.pop_front();
+        }
+        job(index);
+    }
+}
+
+/**
+ * @brief CryptoPipeline constructor, see 'isReady'
+ * @param loop         - event loop of the worker of the tunnel
+ * @param metrics      - the pipeline adds the time spent in crypto
+ * @param readKey      - key of the client records
+ * @param writeKey     - key of the server records
+ * @param nextSequence - of the next record to the client
+ * @param lastReceived - highest sequence number of the received
+ *                       records, the older ones are replays
+ */
+CryptoPipeline::CryptoPipeline(CryptoPool& pool,
+                               EventLoop& loop,
+                               TunnelMetrics& metrics,
+                               const RecordKey& readKey,
+                               const RecordKey& writeKey,
+                               uint64_t nextSequence,
+                               uint64_t lastReceived)
+    : pool(pool),
+      loop(loop),
+      metrics(metrics),
+      epoch(readKey.epoch),
+      txSequence(nextSequence),
+      replay(lastReceived),
+      dropped(0),
+      wakeupPosted(false),
+      closed(false) {
+    ready = closer.setKey(writeKey);
+    for(size_t i = 0; i < pool.size(); ++i) {
+        sealers.emplace_back(new RecordCipher);
+        openers.emplace_back(new RecordCipher);
+        ready = sealers.back()->setKey(writeKey) && ready;
+        ready = openers.back()->setKey(readKey) && ready;
+    }
+    for(Stage& stage : stages) {
+        stage.gathered = nullptr;
+        stage.next     = 0;
+        stage.expected = 0;
+        stage.inFlight = 0;
+        for(Batch*& batch : stage.reorder)
+            batch = nullptr;
+    }
+    ++pool.pipelines;
+}
+
+CryptoPipeline::~CryptoPipeline() {
+    close();
+    for(Batch* batch : spare)
+        delete batch;
+    --pool.pipelines;
+}
+
+/**
+ * @brief isReady
+ * @return false if the keys cannot be used
+ */
+bool CryptoPipeline::isReady() const {
+    return ready;
+}
+
+/**
+ * @brief setHandlers - the handlers get the records in order
+ * @param onSealed - a record for the client
+ * @param onOpened - payload of an authentic record from the client
+ */
+void CryptoPipeline::setHandlers(const Handler& onSealed, const Handler& onOpened) {
+    stages[SEAL].handler = onSealed;
+    stages[OPEN].handler = onOpened;
+}
+
+/**
+ * @brief seal - adds the payload to the batch for the pool,
+ * the batch is dispatched when it is full or by 'dispatch'
+ * @return false if the record is dropped
+ */
+bool CryptoPipeline::seal(uint8_t type, const char* data, int length) {
+    Batch* batch = length <= MAX_PAYLOAD && txSequence <= RecordCipher::MAX_SEQUENCE
+                   ? gather(SEAL) : nullptr;
+    if(batch == nullptr) {
+        ++dropped;
+        return false;
+    }
+
+    int i = batch->count++;
+    memcpy(batch->slots[i] + RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE,
+           data, length);
+    batch->lengths[i]   = length;
+    batch->types[i]     = type;
+    batch->sequences[i] = txSequence++;
+    if(batch->count == BATCH_SIZE)
+        dispatch(SEAL);
+    return true;
+}
+
+/**
+ * @brief open - adds the record of the client to the batch
+ * for the pool, see 'seal'
+ * @return false if the record is dropped
+ */
+bool CryptoPipeline::open(const char* record, int length) {
+    Batch* batch = length <= SLOT_SIZE ? gather(OPEN) : nullptr;
+    if(batch == nullptr) {
+        ++dropped;
+        return false;
+    }
+
+    int i = batch->count++;
+    memcpy(batch->slots[i], record, length);
+    batch->lengths[i] = length;
+    if(batch->count == BATCH_SIZE)
+        dispatch(OPEN);
+    return true;
+}
+
+/**
+ * @brief accepts
+ * @return true if the datagram is one application data record
+ * of the pipeline keys, other records are left to wolfSSL
+ */
+bool CryptoPipeline::accepts(const char* record, int length) const {
+    RecordHeader header;
+    return RecordCipher::parseHeader(record, length, header)
+           && header.type == RecordCipher::APPLICATION_DATA
+           && header.epoch == epoch
+           && header.length == length - RecordCipher::HEADER_SIZE;
+}
+
+/**
+ * @brief sealNow - protects a record by the worker thread,
+ * for the last records of a closed tunnel
+ * @param record - room for 'length' + RecordCipher::OVERHEAD bytes
+ * @return record length or -1
+ */
+int CryptoPipeline::sealNow(uint8_t type, const char* data, int length, char* record) {
+    memcpy(record + RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE, data, length);
+    return closer.seal(type, txSequence++, record, length);
+}
+
+/**
+ * @brief dispatch - gives the batches being gathered to the pool,
+ * called when the worker has dispatched its events
+ */
+void CryptoPipeline::dispatch() {
+    dispatch(SEAL);
+    dispatch(OPEN);
+}
+
+/**
+ * @brief close - drops the records in the pipeline,
+ * the handlers are not called any more
+ */
+void CryptoPipeline::close() {
+    if(closed)
+        return;
+
+    std::vector<Batch*> left;
+    mutex.lock();
+        closed = true;
+        left.swap(done);
+    mutex.unlock();
+
+    for(Stage& stage : stages) {
+        left.push_back(stage.gathered);
+        stage.gathered = nullptr;
+        for(Batch*& batch : stage.reorder) {
+            left.push_back(batch);
+            batch = nullptr;
+        }
+    }
+    // batches in the pool are freed by their jobs:
+    for(Batch* batch : left)
+        delete batch;
+}
+
+/**
+ * @brief getDropped - records dropped by the full pipeline,
+ * not authentic and replayed records
+ */
+uint64_t CryptoPipeline::getDropped() const {
+    return dropped;
+}
+
+/**
+ * @brief gather - the batch being gathered
+ * @return nullptr if the pool has too many batches of the direction
+ */
+CryptoPipeline::Batch* CryptoPipeline::gather(Direction direction) {
+    Stage& stage = stages[direction];
+    if(closed || stage.gathered != nullptr)
+        return stage.gathered;
+    if(stage.inFlight >= MAX_IN_FLIGHT)
+        return nullptr;
+
+    Batch* batch = nullptr;
+    if(!spare.empty()) {
+        batch = spare.back();
+        spare.pop_back();
+    } else {
+        batch = new Batch;
+    }
+    batch->direction = direction;
+    batch->count     = 0;
+    batch->nanos     = 0;
+    stage.gathered   = batch;
+    return batch;
+}
+
+void CryptoPipeline::dispatch(Direction direction) {
+    Stage& stage = stages[direction];
+    Batch* batch = stage.gathered;
+    if(batch == nullptr || batch->count == 0)
+        return;
+
+    stage.gathered = nullptr;
+    batch->number  = stage.next++;
+    ++stage.inFlight;
+    std::shared_ptr<CryptoPipeline> self = shared_from_this();
+    pool.submit([self, batch](size_t thread) {
+        self->process(*batch, thread);
+        self->complete(batch);
+    });
+}
+
+/**
+ * @brief process - seals or opens the records of the batch
+ * by a thread of the pool
+ */
+void CryptoPipeline::process(Batch& batch, size_t thread) {
+    auto start = std::chrono::steady_clock::now();
+    if(batch.direction == SEAL) {
+        RecordCipher& cipher = *sealers[thread];
+        for(int i = 0; i < batch.count; ++i) {
+            batch.lengths[i] = cipher.seal(batch.types[i], batch.sequences[i],
+                                           batch.slots[i], batch.lengths[i]);
+        }
+    } else {
+        RecordCipher& cipher = *openers[thread];
+        for(int i = 0; i < batch.count; ++i)
+            batch.lengths[i] = cipher.open(batch.slots[i], batch.lengths[i],
+                                           batch.sequences[i]);
+    }
+    batch.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief complete - hands the done batch to the worker,
+ * one posted task collects all batches done until it runs
+ */
+void CryptoPipeline::complete(Batch* batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(closed) {
+        delete batch;
+        return;
+    }
+    done.push_back(batch);
+    if(!wakeupPosted) {
+        wakeupPosted = true;
+        std::shared_ptr<CryptoPipeline> self = shared_from_this();
+        loop.post([self]() { self->collect(); });
+    }
+}
+
+/**
+ * @brief collect - the reorder stage: puts the done batches
+ * to their places and delivers the batches that are next in order
+ */
+void CryptoPipeline::collect() {
+    std::vector<Batch*> batches;
+    mutex.lock();
+        batches.swap(done);
+        wakeupPosted = false;
+    mutex.unlock();
+
+    for(Batch* batch : batches)
+        stages[batch->direction].reorder[batch->number % MAX_IN_FLIGHT] = batch;
+
+    for(Stage& stage : stages) {
+        while(!closed) {
+            Batch*& slot  = stage.reorder[stage.expected % MAX_IN_FLIGHT];
+            Batch*  batch = slot;
+            if(batch == nullptr)
+                break;
+            slot = nullptr;
+            ++stage.expected;
+            --stage.inFlight;
+            deliver(*batch); // the handlers may close the pipeline
+            recycle(batch);
+        }
+    }
+}
+
+void CryptoPipeline::deliver(Batch& batch) {
+    const int offset = RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE;
+    Handler&  handler = stages[batch.direction].handler;
+
+    if(batch.direction == SEAL)
+        addCounter(metrics.encryptNanos, batch.nanos);
+    else
+        addCounter(metrics.decryptNanos, batch.nanos);
+
+    for(int i = 0; i < batch.count && !closed; ++i) {
+        if(batch.lengths[i] < 0) {
+            ++dropped;
+        } else if(batch.direction == SEAL) {
+            handler(batch.slots[i], batch.lengths[i]);
+        } else if(replay.accept(batch.sequences[i])) {
+            handler(batch.slots[i] + offset, batch.lengths[i]);
+        } else {
+            ++dropped;
+        }
+    }
+}
+
+void CryptoPipeline::recycle(Batch* batch) {
+    if(closed || spare.size() >= MAX_IN_FLIGHT)
+        delete batch;
+    else
+        spare.push_back(batch);
+}
@@ -0,0 +1,268 @@
+#ifndef CRYPTO_PIPELINE_HPP
+#define CRYPTO_PIPELINE_HPP
+
+#include "event_loop.hpp"
+#include "metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+#include <wolfssl/wolfcrypt/aes.h>
+
+/**
+ * @brief The RecordKey struct<br>
+ * AES-GCM key of one direction of a DTLS session: the key,<br>
+ * the implicit part of the nonce (salt) and the epoch of the key.<br>
+ */
+struct RecordKey {
+    static const int MAX_KEY_SIZE = 32; // AES-256
+    static const int SALT_SIZE    = 4;
+
+    unsigned char key[MAX_KEY_SIZE];
+    int           keySize;
+    unsigned char salt[SALT_SIZE];
+    uint16_t      epoch;
+
+    explicit RecordKey();
+    ~RecordKey();
+};
+
+/**
+ * @brief The RecordHeader struct - fields of a DTLS 1.2 record header
+ */
+struct RecordHeader {
+    uint8_t  type;
+    uint16_t epoch;
+    uint64_t sequence; // 48 bits
+    uint16_t length;   // of the fragment after the header
+};
+
+/**
+ * @brief The RecordCipher class<br>
+ * AES-GCM protection of DTLS 1.2 records of one direction<br>
+ * (RFC 6347, RFC 5288): 13-byte header, 8-byte explicit nonce,<br>
+ * ciphertext and 16-byte tag. The nonce is the salt followed by<br>
+ * the explicit part, the server puts epoch and sequence number<br>
+ * there, so a nonce is never repeated. Records are protected<br>
+ * in place. A cipher must not be used by two threads at once.<br>
+ */
+class RecordCipher {
+public:
+    static const int      HEADER_SIZE = 13;
+    static const int      NONCE_SIZE  = 8;  // explicit part
+    static const int      TAG_SIZE    = 16;
+    static const int      OVERHEAD    = HEADER_SIZE + NONCE_SIZE + TAG_SIZE;
+    static const uint8_t  ALERT            = 21;
+    static const uint8_t  APPLICATION_DATA = 23;
+    static const uint64_t MAX_SEQUENCE = (uint64_t(1) << 48) - 1;
+
+private:
+    Aes           aes;
+    bool          ready;
+    unsigned char salt[RecordKey::SALT_SIZE];
+    uint16_t      epoch;
+
+public:
+    /* Forbid creating default copy ctor: */
+    RecordCipher(RecordCipher& that) = delete;
+
+    explicit RecordCipher();
+    ~RecordCipher();
+
+    bool setKey(const RecordKey& key);
+    int seal(uint8_t type, uint64_t sequence, char* record, int length);
+    int open(char* record, int length, uint64_t& sequence);
+
+    static bool parseHeader(const char* record, int length, RecordHeader& header);
+
+private:
+    void makeNonce(const char* record, unsigned char* nonce) const;
+    static void makeAad(const char* record, int length, unsigned char* aad);
+};
+
+/**
+ * @brief The ReplayWindow class<br>
+ * Anti-replay window of received records (RFC 6347, 4.1.2.6):<br>
+ * the highest sequence number and a bitmap of the SIZE numbers<br>
+ * below it. Records older than the window are dropped.<br>
+ */
+class ReplayWindow {
+public:
+    static const int SIZE = 64;
+
+private:
+    uint64_t highest;
+    uint64_t bitmap; // bit i - 'highest - i' was received
+
+public:
+    explicit ReplayWindow(uint64_t highest = 0);
+
+    bool accept(uint64_t sequence);
+};
+
+/**
+ * @brief The CryptoPool class<br>
+ * Threads that encrypt and decrypt records of pipelined tunnels<br>
+ * (see CryptoPipeline) of all workers. Jobs are taken in the order<br>
+ * they are submitted, a job knows the index of its thread,<br>
+ * so it can use the cipher of the tunnel kept for that thread.<br>
+ */
+class CryptoPool {
+    friend class CryptoPipeline;
+
+public:
+    typedef std::function<void(size_t thread)> Job;
+
+    static const size_t MAX_THREADS = 64;
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex               mutex;
+    std::condition_variable  ready;
+    std::deque<Job>          jobs;
+    bool                     stopping;
+    std::atomic<size_t>      pipelines; // tunnels served by the pool
+
+public:
+    /* Forbid creating default copy ctor: */
+    CryptoPool(CryptoPool& that) = delete;
+
+    explicit CryptoPool(size_t threadsCount);
+    ~CryptoPool();
+
+    void submit(const Job& job);
+    size_t size() const;
+    size_t pipelinesCount() const;
+
+private:
+    void run(size_t index);
+};
+
+/**
+ * @brief The CryptoPipeline class<br>
+ * Records of one heavy tunnel protected by the threads of a CryptoPool,<br>
+ * so the tunnel is not limited to the core of its worker.<br>
+ * The worker stays the I/O stage: it gathers packets for the client<br>
+ * and datagrams from it in batches of BATCH_SIZE, numbers the batches<br>
+ * of each direction and gives them to the pool. Outgoing records get<br>
+ * their sequence numbers when they are gathered. Done batches come<br>
+ * back to the worker through its event loop and wait in the reorder<br>
+ * stage until the batches before them are done, so both directions<br>
+ * keep their order and the replay window of the client is not passed.<br>
+ * Incoming records are checked against the replay window<br>
+ * in that stage, after they are authenticated.<br>
+ * Up to MAX_IN_FLIGHT batches of a direction may be in the pool,<br>
+ * the records over that are dropped like on a congested path.<br>
+ * Only the worker thread calls the methods of the pipeline.<br>
+ */
+class CryptoPipeline : public std::enable_shared_from_this<CryptoPipeline> {
+public:
+    typedef std::function<void(char* data, int length)> Handler;
+
+    static const int    BATCH_SIZE    = 32;   // records per batch
+    static const int    MAX_PAYLOAD   = 2048; // larger packets are dropped
+    static const int    SLOT_SIZE     = MAX_PAYLOAD + RecordCipher::OVERHEAD;
+    static const size_t MAX_IN_FLIGHT = 16;   // batches per direction
+
+    enum Direction {
+        SEAL = 0, // to the client
+        OPEN = 1  // from the client
+    };
+
+private:
+    /**
+     * @brief The Batch struct - records of one direction, a payload
+     * starts at RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE
+     * of its slot. 'lengths' are of the input (payloads to seal,
+     * records to open), then of the output, -1 - failed.
+     */
+    struct Batch {
+        Direction direction;
+        uint64_t  number;
+        int       count;
+        uint64_t  nanos;
+        int       lengths[BATCH_SIZE];
+        uint64_t  sequences[BATCH_SIZE];
+        uint8_t   types[BATCH_SIZE];
+        char      slots[BATCH_SIZE][SLOT_SIZE];
+    };
+
+    /**
+     * @brief The Stage struct - batches of one direction
+     * owned by the worker thread
+     */
+    struct Stage {
+        Batch*   gathered; // being filled, nullptr - none
+        uint64_t next;     // number of the next dispatched batch
+        uint64_t expected; // number of the next delivered batch
+        size_t   inFlight;
+        Batch*   reorder[MAX_IN_FLIGHT]; // done, by number
+        Handler  handler;
+    };
+
+    CryptoPool&                                 pool;
+    EventLoop&                                  loop;
+    TunnelMetrics&                              metrics;
+    std::vector<std::unique_ptr<RecordCipher> > sealers; // by pool thread
+    std::vector<std::unique_ptr<RecordCipher> > openers;
+    RecordCipher                                closer;  // of the worker
+    bool                                        ready;   // all keys are set
+    uint16_t                                    epoch;   // of the records
+    uint64_t                                    txSequence; // of the next record
+    ReplayWindow                                replay;
+    Stage                                       stages[2];
+    std::vector<Batch*>                         spare;
+    uint64_t                                    dropped;
+    // shared with the pool:
+    std::mutex                                  mutex;
+    std::vector<Batch*>                         done;
+    bool                                        wakeupPosted;
+    bool                                        closed;
+
+public:
+    /* Forbid creating default copy ctor: */
+    CryptoPipeline(CryptoPipeline& that) = delete;
+
+    explicit CryptoPipeline(CryptoPool& pool,
+                            EventLoop& loop,
+                            TunnelMetrics& metrics,
+                            const RecordKey& readKey,
+                            const RecordKey& writeKey,
+                            uint64_t nextSequence,
+                            uint64_t lastReceived);
+    ~CryptoPipeline();
+
+    bool isReady() const;
+    void setHandlers(const Handler& onSealed, const Handler& onOpened);
+    bool seal(uint8_t type, const char* data, int length);
+    bool open(const char* record, int length);
+    bool accepts(const char* record, int length) const;
+    int sealNow(uint8_t type, const char* data, int length, char* record);
+    void dispatch();
+    void close();
+    uint64_t getDropped() const;
+
+private:
+    Batch* gather(Direction direction);
+    void dispatch(Direction direction);
+    void process(Batch& batch, size_t thread);
+    void complete(Batch* batch);
+    void collect();
+    void deliver(Batch& batch);
+    void recycle(Batch* batch);
+};
+
+#endif // CRYPTO_PIPELINE_HPP
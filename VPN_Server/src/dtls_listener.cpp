@@ -0,0 +1,696 @@
+#include "dtls_listener.hpp"
+#include "tunnel.hpp"
+
+#include <wolfssl/wolfcrypt/sha256.h>
+
+unsigned char  DtlsListener::cookieSecret[32];
+std::once_flag DtlsListener::cookieSecretFlag;
+
+PeerKey::PeerKey(const sockaddr_in6& peer) {
+    memcpy(addr, &peer.sin6_addr, sizeof(addr));
+    port = peer.sin6_port;
+}
+
+bool PeerKey::operator==(const PeerKey& that) const {
+    return port == that.port && memcmp(addr, that.addr, sizeof(addr)) == 0;
+}
+
+/**
+ * @brief PeerKeyHash - FNV-1a over address and port
+ */
+size_t PeerKeyHash::operator()(const PeerKey& key) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < sizeof(key.addr); ++i) {
+        hash = (hash ^ key.addr[i]) * 1099511628211ULL;
+    }
+    hash = (hash ^ (key.port & 0xFF)) * 1099511628211ULL;
+    hash = (hash ^ (key.port >> 8)) * 1099511628211ULL;
+    return static_cast<size_t>(hash);
+}
+
+const int DtlsListener::BATCH_SIZE;
+const int DtlsListener::DATAGRAM_SIZE;
+const int DtlsListener::MAX_QUEUED;
+const int DtlsListener::RX_BUFFERS;
+const int DtlsListener::RX_GROUP;
+const int DtlsListener::COOKIE_SIZE;
+
+namespace {
+
+// io_uring_recvmsg_out and the peer address precede the datagram:
+const size_t RX_HEADER_SIZE = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in6);
+
+// DTLS record and handshake message headers (RFC 6347):
+const int    RECORD_HEADER_SIZE    = 13;
+const int    HANDSHAKE_HEADER_SIZE = 12;
+const int    HELLO_HEADER_SIZE     = RECORD_HEADER_SIZE + HANDSHAKE_HEADER_SIZE;
+const int    RANDOM_SIZE           = 32;
+const int    MAX_SESSION_ID        = 32;
+const int    MAX_COOKIE            = 255;
+const char   HANDSHAKE_RECORD      = 22;
+const char   CLIENT_HELLO          = 1;
+const char   HELLO_VERIFY_REQUEST  = 3;
+
+uint32_t get24(const char* data) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+}
+
+void put24(char* data, uint32_t value) {
+    data[0] = (char)(value >> 16);
+    data[1] = (char)(value >> 8);
+    data[2] = (char)value;
+}
+
+} // namespace
+
+BatchStats::BatchStats()
+    : rxCalls(0), rxDatagrams(0), txCalls(0), txDatagrams(0), txDropped(0) { }
+
+double BatchStats::averageRxBatch() const {
+    uint64_t calls = rxCalls;
+    return calls == 0 ? 0.0 : (double)rxDatagrams / calls;
+}
+
+double BatchStats::averageTxBatch() const {
+    uint64_t calls = txCalls;
+    return calls == 0 ? 0.0 : (double)txDatagrams / calls;
+}
+
+/**
+ * @brief DtlsListener constructor
+ * Creates non-blocking datagram socket and binds it to 'port'.
+ * We use an IPv6 socket to cover both IPv4 and IPv6.
+ * @param port    - port to listen
+ * @param factory - creates a tunnel for a newly connected client
+ */
+DtlsListener::DtlsListener(const std::string& port,
+                           const SessionFactory& factory)
+    : DtlsListener(bindSocket(port), factory) { }
+
+/**
+ * @brief DtlsListener - listener of a bound socket,
+ * the listener owns the descriptor from now
+ */
+DtlsListener::DtlsListener(int sd, const SessionFactory& factory)
+    : sd(sd),
+      factory(factory),
+      loop(nullptr),
+      watchingWritable(false),
+      rxEvents(EPOLLIN),
+      uring(nullptr),
+      rxPool(RX_HEADER_SIZE + DATAGRAM_SIZE, RX_BUFFERS),
+      receiver(nullptr),
+      txPool(DATAGRAM_SIZE, BATCH_SIZE),
+      txFirst(nullptr),
+      txLast(nullptr),
+      txQueued(0),
+      txDelay(nullptr) {
+    memset(rxMsgs, 0, sizeof(rxMsgs));
+    memset(txMsgs, 0, sizeof(txMsgs));
+    memset(&rxHeader, 0, sizeof(rxHeader));
+    rxHeader.msg_namelen = sizeof(sockaddr_in6);
+    for(int i = 0; i < BATCH_SIZE; ++i) {
+        rxIov[i].iov_base              = rxBuffers[i];
+        rxIov[i].iov_len               = DATAGRAM_SIZE;
+        rxMsgs[i].msg_hdr.msg_iov      = &rxIov[i];
+        rxMsgs[i].msg_hdr.msg_iovlen   = 1;
+        rxMsgs[i].msg_hdr.msg_name     = &rxPeers[i];
+
+        txMsgs[i].msg_hdr.msg_iov      = &txIov[i];
+        txMsgs[i].msg_hdr.msg_iovlen   = 1;
+        txMsgs[i].msg_hdr.msg_namelen  = sizeof(sockaddr_in6);
+    }
+
+    std::call_once(cookieSecretFlag, &DtlsListener::initCookieSecret);
+}
+
+/**
+ * @brief bindSocket - UDP socket of a worker bound to the server port
+ * @throws std::runtime_error if the socket cannot be bound
+ */
+int DtlsListener::bindSocket(const std::string& port) {
+    int flag = 1;
+
+    int sd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot create socket: " + strerror(errno));
+    }
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    // every worker binds its own socket to the same port:
+    setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    flag = 0;
+    setsockopt(sd, IPPROTO_IPV6, IPV6_V6ONLY, &flag, sizeof(flag));
+    // records go with DF set and are not fragmented, so lost
+    // MTU probes show the path MTU (see PathMtu):
+    if(PathMtu::isEnabled()) {
+        flag = IP_PMTUDISC_PROBE;
+        setsockopt(sd, IPPROTO_IP, IP_MTU_DISCOVER, &flag, sizeof(flag));
+        flag = IPV6_PMTUDISC_PROBE;
+        setsockopt(sd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &flag, sizeof(flag));
+    }
+
+    // accept packets received on any local address.
+    sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port   = htons(atoi(port.c_str()));
+
+    if(bind(sd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        int error = errno;
+        close(sd);
+        throw std::runtime_error(std::string() +
+                                 "Cannot bind port " + port + ": " +
+                                 strerror(error));
+    }
+    return sd;
+}
+
+DtlsListener::~DtlsListener() {
+    stopReceiver();
+    releaseSent(txQueued);
+    close(sd);
+}
+
+int DtlsListener::getFd() const {
+    return sd;
+}
+
+/**
+ * @brief attach - starts watching the socket in the worker event loop.
+ * With io_uring engine only writability is watched, datagrams
+ * come in completions of the multishot receive.
+ */
+void DtlsListener::attach(EventLoop& loop) {
+    this->loop = &loop;
+    uring = dynamic_cast<UringEngine*>(&loop.getEngine());
+    rxEvents = startReceiver() ? 0u : (uint32_t)EPOLLIN;
+    loop.addFd(sd, rxEvents, [this](uint32_t events) {
+        if(events & EPOLLOUT)
+            onWritable();
+        if(events & (EPOLLIN | EPOLLERR))
+            onReadable();
+    });
+    // write packets decrypted while handling the events,
+    // then send what was queued:
+    loop.addFlushHandler([this]() {
+        flushReceivers();
+        flush();
+    });
+}
+
+/**
+ * @brief detach - sends queued datagrams (e.g. close notifications
+ * of just destroyed tunnels) and stops watching the socket
+ */
+void DtlsListener::detach() {
+    flushReceivers();
+    flush();
+    stopReceiver();
+    if(loop != nullptr)
+        loop->removeFd(sd);
+    loop  = nullptr;
+    uring = nullptr;
+}
+
+/**
+ * @brief onReadable - reads pending datagrams in batches and routes
+ * them to their tunnels. Unknown peers are accepted only
+ * after they return the cookie of the listener.
+ */
+void DtlsListener::onReadable() {
+    // don't starve other descriptors of the worker:
+    for(int round = 0; round < MAX_RX_ROUNDS; ++round) {
+        for(int i = 0; i < BATCH_SIZE; ++i)
+            rxMsgs[i].msg_hdr.msg_namelen = sizeof(rxPeers[i]);
+
+        int received = recvmmsg(sd, rxMsgs, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if(received < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                static LogLimiter limiter;
+                TunnelManager::log(std::string() + "recvmmsg() error: " +
+                                   strerror(errno), Logger::ERROR, limiter);
+            }
+            return;
+        }
+
+        stats.rxCalls.fetch_add(1, std::memory_order_relaxed);
+        stats.rxDatagrams.fetch_add(received, std::memory_order_relaxed);
+
+        for(int i = 0; i < received; ++i) {
+            if(rxMsgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                continue; // can't be a valid DTLS datagram
+            dispatch(rxPeers[i], rxBuffers[i], rxMsgs[i].msg_len);
+        }
+
+        if(received < BATCH_SIZE)
+            return; // socket is drained
+    }
+}
+
+/**
+ * @brief onWritable - sends the rest of the send queue
+ * and resumes tunnels that were blocked by the full socket buffer
+ */
+void DtlsListener::onWritable() {
+    if(!flush())
+        return;
+
+    watchWritable(false);
+
+    std::vector<Tunnel*> ready;
+    ready.swap(writers);
+    for(Tunnel* tunnel : ready)
+        tunnel->onWritable();
+}
+
+/**
+ * @brief queue - copies single datagram to the send queue,
+ * a full batch is sent at once
+ * @return false if the queue is full and cannot be flushed
+ * (socket buffer is full)
+ */
+bool DtlsListener::queue(const sockaddr_in6& peer,
+                         const char* buf, int length) {
+    if(length > DATAGRAM_SIZE) {
+        stats.txDropped.fetch_add(1, std::memory_order_relaxed);
+        return true; // DTLS never writes such records, drop it
+    }
+    if(txQueued >= MAX_QUEUED && !flush())
+        return false;
+
+    if(txFirst == nullptr && txDelay != nullptr)
+        txQueuedAt = std::chrono::steady_clock::now();
+
+    Packet* packet = txPool.acquire();
+    memcpy(packet->payload(), buf, length);
+    packet->length = length;
+    packet->peer   = peer;
+
+    if(txLast != nullptr)
+        txLast->next = packet;
+    else
+        txFirst = packet;
+    txLast = packet;
+    ++txQueued;
+
+    // don't retry while waiting for EPOLLOUT
+    if(txQueued >= BATCH_SIZE && !watchingWritable)
+        flush();
+    return true;
+}
+
+/**
+ * @brief flush - sends queued datagrams with sendmmsg(2)
+ * @return true if the send queue is empty,
+ * false if the socket is full (EPOLLOUT is watched then)
+ */
+bool DtlsListener::flush() {
+    bool queued = txFirst != nullptr;
+    while(txFirst != nullptr) {
+        int count = 0;
+        for(Packet* packet = txFirst;
+            packet != nullptr && count < BATCH_SIZE;
+            packet = packet->next, ++count) {
+            txIov[count].iov_base          = packet->payload();
+            txIov[count].iov_len           = packet->length;
+            txMsgs[count].msg_hdr.msg_name = &packet->peer;
+        }
+
+        int sent = sendmmsg(sd, txMsgs, count, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                watchWritable(true);
+                return false;
+            }
+            // the first datagram cannot be sent (e.g. no route), skip it
+            stats.txDropped.fetch_add(1, std::memory_order_relaxed);
+            releaseSent(1);
+            continue;
+        }
+        stats.txCalls.fetch_add(1, std::memory_order_relaxed);
+        stats.txDatagrams.fetch_add(sent, std::memory_order_relaxed);
+        releaseSent(sent);
+    }
+
+    if(queued && txDelay != nullptr)
+        txDelay->record(std::chrono::steady_clock::now() - txQueuedAt);
+    return true;
+}
+
+/**
+ * @brief waitWritable - 'tunnel' will be resumed by its 'onWritable'
+ * when the socket can send again
+ */
+void DtlsListener::waitWritable(Tunnel* tunnel) {
+    watchWritable(true);
+    writers.push_back(tunnel);
+}
+
+/**
+ * @brief flushLater - 'tunnel' will be flushed by its 'onFlush'
+ * when the worker has dispatched its events
+ */
+void DtlsListener::flushLater(Tunnel* tunnel) {
+    receivers.push_back(tunnel);
+}
+
+/**
+ * @brief addSession - routes the datagrams of the peer to 'tunnel'
+ * created without the factory (a tunnel taken over by Handoff)
+ */
+void DtlsListener::addSession(Tunnel* tunnel) {
+    sessions[PeerKey(tunnel->getPeer())] = tunnel;
+}
+
+void DtlsListener::removeSession(Tunnel* tunnel) {
+    sessions.erase(PeerKey(tunnel->getPeer()));
+    for(std::vector<Tunnel*>* list : { &writers, &receivers }) {
+        for(size_t i = 0; i < list->size(); ++i) {
+            if((*list)[i] == tunnel) {
+                list->erase(list->begin() + i);
+                break;
+            }
+        }
+    }
+}
+
+void DtlsListener::flushReceivers() {
+    std::vector<Tunnel*> ready;
+    ready.swap(receivers);
+    for(Tunnel* tunnel : ready)
+        tunnel->onFlush();
+}
+
+size_t DtlsListener::sessionsCount() const {
+    return sessions.size();
+}
+
+const BatchStats& DtlsListener::getStats() const {
+    return stats;
+}
+
+const PoolStats& DtlsListener::getPoolStats() const {
+    return txPool.getStats();
+}
+
+/**
+ * @brief setDelayHistogram - the time from queueing the first
+ * datagram to sending the whole queue is recorded to 'histogram'
+ */
+void DtlsListener::setDelayHistogram(Histogram* histogram) {
+    txDelay = histogram;
+}
+
+/**
+ * @brief dispatch - routes datagram to the tunnel of 'peer'.
+ * A ClientHello of an unknown peer without a valid cookie gets
+ * a HelloVerifyRequest, the one with the cookie creates the tunnel
+ * and starts its handshake. The CLIENT_WANT_CONNECT packet
+ * of the clients is not needed any more and is ignored.
+ */
+void DtlsListener::dispatch(const sockaddr_in6& peer,
+                            const char* data, int length) {
+    PeerKey key(peer);
+    auto it = sessions.find(key);
+    if(it != sessions.end()) {
+        it->second->onDatagram(data, length);
+        return;
+    }
+
+    const unsigned char* cookie = nullptr;
+    int cookieSize = getHelloCookie(data, length, cookie);
+    if(cookieSize < 0)
+        return; // not a ClientHello
+    if(!verifyCookie(peer, cookie, cookieSize)) {
+        sendHelloVerifyRequest(peer, data);
+        return;
+    }
+
+    Tunnel* tunnel = factory(*this, peer);
+    if(tunnel == nullptr)
+        return;
+    sessions[key] = tunnel;
+    // wolfSSL checks the cookie again and answers with ServerHello:
+    tunnel->onDatagram(data, length);
+}
+
+/**
+ * @brief sendHelloVerifyRequest - sends the cookie of 'peer'
+ * in reply to its ClientHello, no state is kept
+ */
+void DtlsListener::sendHelloVerifyRequest(const sockaddr_in6& peer,
+                                          const char* clientHello) {
+    unsigned char cookie[COOKIE_SIZE];
+    char          request[HELLO_HEADER_SIZE + 3 + COOKIE_SIZE];
+    if(generateCookie(peer, cookie, COOKIE_SIZE) != COOKIE_SIZE)
+        return;
+
+    int length = makeHelloVerifyRequest(clientHello, cookie, COOKIE_SIZE,
+                                        request, sizeof(request));
+    if(length > 0)
+        queue(peer, request, length);
+}
+
+void DtlsListener::releaseSent(int count) {
+    for(; count > 0 && txFirst != nullptr; --count) {
+        Packet* packet = txFirst;
+        txFirst = packet->next;
+        txPool.release(packet);
+        --txQueued;
+    }
+    if(txFirst == nullptr)
+        txLast = nullptr;
+}
+
+void DtlsListener::watchWritable(bool enable) {
+    if(enable == watchingWritable || loop == nullptr)
+        return;
+    watchingWritable = enable;
+    loop->modifyFd(sd, enable ? (rxEvents | EPOLLOUT) : rxEvents);
+}
+
+/**
+ * @brief startReceiver - provides the receive buffers to io_uring
+ * and submits the multishot receive
+ * @return false if the loop has no io_uring or the kernel
+ * has no provided buffer rings (recvmmsg is used then)
+ */
+bool DtlsListener::startReceiver() {
+    if(uring == nullptr)
+        return false;
+
+    try {
+        rxRing.reset(new BufferRing(*uring, rxPool, RX_GROUP, RX_BUFFERS));
+    } catch (const std::runtime_error& e) {
+        TunnelManager::log(std::string() + e.what() +
+                           ", receiving with recvmmsg", std::cerr);
+        return false;
+    }
+    receiver = new Receiver(this);
+    armReceiver();
+    return true;
+}
+
+/**
+ * @brief stopReceiver - cancels the multishot receive, the engine
+ * releases the request after its last completion
+ */
+void DtlsListener::stopReceiver() {
+    if(receiver != nullptr) {
+        receiver->listener = nullptr;
+        uring->cancel(receiver);
+        receiver = nullptr;
+    }
+    rxRing.reset();
+}
+
+void DtlsListener::armReceiver() {
+    uring->recvMultishot(sd, &rxHeader, rxRing->getGroup(), receiver);
+}
+
+DtlsListener::Receiver::Receiver(DtlsListener* listener) : listener(listener) { }
+
+void DtlsListener::Receiver::complete(int result, uint32_t flags) {
+    if(listener != nullptr)
+        listener->onReceived(result, flags);
+}
+
+/**
+ * @brief onReceived - completion of the multishot receive: one
+ * datagram in a provided buffer. The receive stops when the buffers
+ * run out (ENOBUFS) and is submitted again, kernels without multishot
+ * recvmsg reject it (EINVAL), then the socket is read on readiness.
+ */
+void DtlsListener::onReceived(int result, uint32_t flags) {
+    if(flags & IORING_CQE_F_BUFFER) {
+        uint16_t id  = flags >> IORING_CQE_BUFFER_SHIFT;
+        char*    buf = rxRing->buffer(id);
+        io_uring_recvmsg_out* out = reinterpret_cast<io_uring_recvmsg_out*>(buf);
+
+        if(result >= (int)RX_HEADER_SIZE && !(out->flags & MSG_TRUNC)) {
+            sockaddr_in6 peer;
+            memset(&peer, 0, sizeof(peer));
+            memcpy(&peer, buf + sizeof(*out),
+                   out->namelen < sizeof(peer) ? out->namelen : sizeof(peer));
+
+            stats.rxCalls.fetch_add(1, std::memory_order_relaxed);
+            stats.rxDatagrams.fetch_add(1, std::memory_order_relaxed);
+            dispatch(peer, buf + RX_HEADER_SIZE, result - RX_HEADER_SIZE);
+        }
+        rxRing->recycle(id);
+    }
+
+    if(flags & IORING_CQE_F_MORE)
+        return;
+
+    if(result == -EINVAL) {
+        TunnelManager::log("Multishot recvmsg is not supported, "
+                           "receiving with recvmmsg", std::cerr);
+        receiver->listener = nullptr;
+        uring->cancel(receiver);
+        receiver = nullptr;
+        rxEvents = EPOLLIN;
+        loop->modifyFd(sd, watchingWritable ? (rxEvents | EPOLLOUT) : rxEvents);
+        return;
+    }
+    if(result < 0 && result != -ENOBUFS) {
+        static LogLimiter limiter;
+        TunnelManager::log(std::string() + "io_uring recvmsg error: " +
+                           strerror(-result), Logger::ERROR, limiter);
+    }
+    armReceiver();
+}
+
+/**
+ * @brief generateCookie - stateless DTLS cookie (HelloVerifyRequest)
+ * for peer address. The default wolfSSL cookie callback takes the
+ * peer address from the socket, which we don't give to wolfSSL.
+ * @param peer - client transport address
+ * @param buf  - cookie buffer
+ * @param sz   - cookie buffer size
+ * @return cookie length or -1
+ */
+int DtlsListener::generateCookie(const sockaddr_in6& peer,
+                                 unsigned char* buf, int sz) {
+    unsigned char input[sizeof(cookieSecret) + sizeof(PeerKey)];
+    unsigned char digest[WC_SHA256_DIGEST_SIZE];
+    PeerKey key(peer);
+
+    memcpy(input, cookieSecret, sizeof(cookieSecret));
+    memcpy(input + sizeof(cookieSecret), key.addr, sizeof(key.addr));
+    memcpy(input + sizeof(cookieSecret) + sizeof(key.addr),
+           &key.port, sizeof(key.port));
+
+    if(wc_Sha256Hash(input, sizeof(cookieSecret) + sizeof(key.addr)
+                     + sizeof(key.port), digest) != 0)
+        return -1;
+
+    if(sz > (int)sizeof(digest))
+        sz = sizeof(digest);
+    memcpy(buf, digest, sz);
+    return sz;
+}
+
+/**
+ * @brief getHelloCookie - finds the cookie of a DTLS ClientHello
+ * that fits in one record and one fragment
+ * @param cookie - set to the cookie in 'data'
+ * @return cookie length (0 - no cookie) or -1 if 'data'
+ * is not such a ClientHello
+ */
+int DtlsListener::getHelloCookie(const char* data, int length,
+                                 const unsigned char*& cookie) {
+    if(length < HELLO_HEADER_SIZE + 2 + RANDOM_SIZE + 2
+       || data[0] != HANDSHAKE_RECORD || (unsigned char)data[1] != 0xfe
+       || data[3] != 0 || data[4] != 0 // epoch
+       || data[RECORD_HEADER_SIZE] != CLIENT_HELLO)
+        return -1;
+
+    int record  = ((unsigned char)data[11] << 8) | (unsigned char)data[12];
+    const char* message = data + RECORD_HEADER_SIZE;
+    uint32_t body = get24(message + 1);
+    if(record > length - RECORD_HEADER_SIZE
+       || record < HANDSHAKE_HEADER_SIZE + (int)body
+       || get24(message + 6) != 0 || get24(message + 9) != body)
+        return -1; // fragmented
+
+    int offset = HELLO_HEADER_SIZE + 2 + RANDOM_SIZE;
+    int end    = HELLO_HEADER_SIZE + body;
+    int sessionId = (unsigned char)data[offset];
+    if(sessionId > MAX_SESSION_ID || offset + 1 + sessionId >= end)
+        return -1;
+    offset += 1 + sessionId;
+
+    int cookieSize = (unsigned char)data[offset];
+    if(offset + 1 + cookieSize > end)
+        return -1;
+    cookie = reinterpret_cast<const unsigned char*>(data + offset + 1);
+    return cookieSize;
+}
+
+/**
+ * @brief makeHelloVerifyRequest - HelloVerifyRequest record with
+ * 'cookie' in reply to 'clientHello' (checked by 'getHelloCookie'),
+ * it takes the record version and sequence number of the ClientHello
+ * @return record length or -1 if 'buf' is too short
+ */
+int DtlsListener::makeHelloVerifyRequest(const char* clientHello,
+                                         const unsigned char* cookie, int cookieSize,
+                                         char* buf, int sz) {
+    int body = 3 + cookieSize;
+    if(cookieSize > MAX_COOKIE || sz < HELLO_HEADER_SIZE + body)
+        return -1;
+
+    memcpy(buf, clientHello, RECORD_HEADER_SIZE - 2); // type, version, epoch, seq
+    buf[11] = (char)((HANDSHAKE_HEADER_SIZE + body) >> 8);
+    buf[12] = (char)(HANDSHAKE_HEADER_SIZE + body);
+
+    char* message = buf + RECORD_HEADER_SIZE;
+    message[0] = HELLO_VERIFY_REQUEST;
+    put24(message + 1, body);
+    message[4] = message[5] = 0; // message_seq
+    put24(message + 6, 0);       // fragment_offset
+    put24(message + 9, body);    // fragment_length
+
+    // DTLS 1.0 version, as RFC 6347 asks for any DTLS version:
+    char* verify = message + HANDSHAKE_HEADER_SIZE;
+    verify[0] = (char)0xfe;
+    verify[1] = (char)0xff;
+    verify[2] = (char)cookieSize;
+    memcpy(verify + 3, cookie, cookieSize);
+    return HELLO_HEADER_SIZE + body;
+}
+
+/**
+ * @brief verifyCookie - the cookie was generated for 'peer'
+ * by this process, compared in constant time
+ */
+bool DtlsListener::verifyCookie(const sockaddr_in6& peer,
+                                const unsigned char* cookie, int cookieSize) {
+    unsigned char expected[COOKIE_SIZE];
+    if(cookieSize != COOKIE_SIZE
+       || generateCookie(peer, expected, COOKIE_SIZE) != COOKIE_SIZE)
+        return false;
+
+    unsigned char difference = 0;
+    for(int i = 0; i < COOKIE_SIZE; ++i)
+        difference |= expected[i] ^ cookie[i];
+    return difference == 0;
+}
+
+void DtlsListener::initCookieSecret() {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || read(fd, cookieSecret, sizeof(cookieSecret))
+                 != (ssize_t)sizeof(cookieSecret)) {
+        if(fd >= 0)
+            close(fd);
+        throw std::runtime_error("Cannot generate DTLS cookie secret");
+    }
+    close(fd);
+}
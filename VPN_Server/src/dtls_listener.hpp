@@ -0,0 +1,196 @@
+#ifndef DTLS_LISTENER_HPP
+#define DTLS_LISTENER_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "event_loop.hpp"
+#include "io_engine.hpp"
+#include "metrics.hpp"
+#include "packet_pool.hpp"
+#include "path_mtu.hpp"
+
+class Tunnel;
+
+/**
+ * @brief The PeerKey struct<br>
+ * Client transport address (IPv6 or IPv4-mapped address and port),<br>
+ * used as a key of the session table.<br>
+ */
+struct PeerKey {
+    uint8_t  addr[16];
+    uint16_t port;
+
+    explicit PeerKey(const sockaddr_in6& peer);
+    bool operator==(const PeerKey& that) const;
+};
+
+struct PeerKeyHash {
+    size_t operator()(const PeerKey& key) const;
+};
+
+/**
+ * @brief The BatchStats struct<br>
+ * Counters of batched socket calls: datagrams / calls<br>
+ * is the average batch size actually achieved.<br>
+ * With io_uring every received datagram is a completion of its own<br>
+ * and is counted as a call.<br>
+ * Updated by the worker thread, may be read from any thread.<br>
+ */
+struct BatchStats {
+    std::atomic<uint64_t> rxCalls;
+    std::atomic<uint64_t> rxDatagrams;
+    std::atomic<uint64_t> txCalls;
+    std::atomic<uint64_t> txDatagrams;
+    std::atomic<uint64_t> txDropped;
+
+    explicit BatchStats();
+    double averageRxBatch() const;
+    double averageTxBatch() const;
+};
+
+/**
+ * @brief The DtlsListener class<br>
+ * UDP socket listening on the server port. Every worker has its own<br>
+ * listener, all of them are bound to the same port with SO_REUSEPORT,<br>
+ * so the kernel always delivers datagrams of a given client<br>
+ * to the same worker. Datagrams are routed to their tunnel by<br>
+ * peer address. An unknown peer gets a HelloVerifyRequest with<br>
+ * a stateless cookie from the listener itself; its tunnel (and wolfSSL<br>
+ * object) is created only when its ClientHello returns the cookie,<br>
+ * so peers with spoofed addresses cost no state at all.<br>
+ * Datagrams are moved in batches: recvmmsg(2) fills the receive ring,<br>
+ * records written by wolfSSL are queued in pooled buffers and<br>
+ * sent by sendmmsg(2) when a batch is gathered or when the worker<br>
+ * event loop iteration ends. While the socket buffer is full<br>
+ * up to MAX_QUEUED datagrams wait in the queue.<br>
+ * Tunnels that cannot send because the socket buffer is full<br>
+ * are resumed when the socket becomes writable.<br>
+ * In a loop with io_uring engine datagrams are received by<br>
+ * the multishot recvmsg into RX_BUFFERS provided buffers of<br>
+ * the listener pool instead of the receive ring.<br>
+ * A socket inherited from the previous server process (see Handoff)<br>
+ * is adopted together with the sessions of its tunnels.<br>
+ */
+class DtlsListener {
+public:
+    typedef std::function<Tunnel*(DtlsListener& listener,
+                                  const sockaddr_in6& peer)> SessionFactory;
+
+    static const int BATCH_SIZE    = 32;   // datagrams per syscall
+    static const int DATAGRAM_SIZE = 4096; // max DTLS datagram size
+    static const int MAX_RX_ROUNDS = 8;    // batches per readiness event
+    static const int MAX_QUEUED    = 1024; // datagrams waiting for the socket
+    static const int RX_BUFFERS    = 256;  // provided buffers of io_uring
+    static const int RX_GROUP      = 1;    // buffer group of the listener
+    static const int COOKIE_SIZE   = 20;   // cookie length asked by wolfSSL
+
+private:
+    /**
+     * @brief The Receiver class - multishot recvmsg of the listener
+     */
+    class Receiver : public UringRequest {
+    public:
+        DtlsListener* listener;
+
+        explicit Receiver(DtlsListener* listener);
+        void complete(int result, uint32_t flags) override;
+    };
+
+    int                                              sd;
+    SessionFactory                                   factory;
+    EventLoop*                                       loop;
+    bool                                             watchingWritable;
+    std::unordered_map<PeerKey, Tunnel*, PeerKeyHash> sessions;
+    std::vector<Tunnel*>                             writers;
+    std::vector<Tunnel*>                             receivers; // to be flushed
+    BatchStats                                       stats;
+    // receive ring:
+    mmsghdr                                          rxMsgs[BATCH_SIZE];
+    iovec                                            rxIov[BATCH_SIZE];
+    sockaddr_in6                                     rxPeers[BATCH_SIZE];
+    char                                             rxBuffers[BATCH_SIZE][DATAGRAM_SIZE];
+    uint32_t                                         rxEvents; // EPOLLIN or 0
+    // multishot receive (io_uring):
+    UringEngine*                                     uring;
+    PacketPool                                       rxPool;
+    std::unique_ptr<BufferRing>                      rxRing;
+    Receiver*                                        receiver;
+    msghdr                                           rxHeader;
+    // send queue, the head is sent first:
+    PacketPool                                       txPool;
+    Packet*                                          txFirst;
+    Packet*                                          txLast;
+    int                                              txQueued;
+    std::chrono::steady_clock::time_point            txQueuedAt; // of the head
+    Histogram*                                       txDelay;
+    mmsghdr                                          txMsgs[BATCH_SIZE];
+    iovec                                            txIov[BATCH_SIZE];
+    static unsigned char                             cookieSecret[32];
+    static std::once_flag                            cookieSecretFlag;
+
+public:
+    /* Forbid creating default copy ctor: */
+    DtlsListener(DtlsListener& that) = delete;
+
+    explicit DtlsListener(const std::string& port,
+                          const SessionFactory& factory);
+    explicit DtlsListener(int sd, const SessionFactory& factory);
+    ~DtlsListener();
+
+    int  getFd() const;
+    void attach(EventLoop& loop);
+    void detach();
+    void onReadable();
+    void onWritable();
+    bool queue(const sockaddr_in6& peer, const char* buf, int length);
+    bool flush();
+    void waitWritable(Tunnel* tunnel);
+    void flushLater(Tunnel* tunnel);
+    void addSession(Tunnel* tunnel);
+    void removeSession(Tunnel* tunnel);
+    size_t sessionsCount() const;
+    const BatchStats& getStats() const;
+    const PoolStats& getPoolStats() const;
+    void setDelayHistogram(Histogram* histogram);
+
+    static int bindSocket(const std::string& port);
+    static int generateCookie(const sockaddr_in6& peer,
+                              unsigned char* buf, int sz);
+    static int getHelloCookie(const char* data, int length,
+                              const unsigned char*& cookie);
+    static int makeHelloVerifyRequest(const char* clientHello,
+                                      const unsigned char* cookie, int cookieSize,
+                                      char* buf, int sz);
+    static bool verifyCookie(const sockaddr_in6& peer,
+                             const unsigned char* cookie, int cookieSize);
+
+private:
+    void dispatch(const sockaddr_in6& peer, const char* data, int length);
+    void sendHelloVerifyRequest(const sockaddr_in6& peer, const char* clientHello);
+    bool startReceiver();
+    void stopReceiver();
+    void armReceiver();
+    void onReceived(int result, uint32_t flags);
+    void watchWritable(bool enable);
+    void flushReceivers();
+    void releaseSent(int count);
+    static void initCookieSecret();
+};
+
+#endif // DTLS_LISTENER_HPP
@@ -0,0 +1,203 @@
+#include "event_loop.hpp"
+
+/**
+ * @brief EventLoop constructor - the loop uses the default
+ * I/O engine, see IoEngine::setDefault
+ */
+EventLoop::EventLoop() : EventLoop(IoEngine::getDefault()) { }
+
+/**
+ * @brief EventLoop constructor
+ * @param engineName - "epoll" or "io_uring"
+ */
+EventLoop::EventLoop(const std::string& engineName) : running(false) {
+    engine = IoEngine::create(engineName);
+
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeupFd < 0) {
+        delete engine;
+        throw std::runtime_error(std::string() +
+                                 "eventfd error: " + strerror(errno));
+    }
+    addFd(wakeupFd, EPOLLIN, [this](uint32_t) { runPostedTasks(); });
+}
+
+EventLoop::~EventLoop() {
+    close(wakeupFd);
+    delete engine;
+}
+
+/**
+ * @brief addFd - starts watching descriptor 'fd'
+ * @param fd      - descriptor to watch (should be in non-blocking mode)
+ * @param events  - epoll event mask, e.g. EPOLLIN
+ * @param handler - called with the ready events mask
+ */
+void EventLoop::addFd(int fd, uint32_t events, const FdHandler& handler) {
+    engine->add(fd, events);
+    handlers[fd] = std::make_shared<FdHandler>(handler);
+}
+
+/**
+ * @brief modifyFd - changes the event mask of already watched descriptor
+ */
+void EventLoop::modifyFd(int fd, uint32_t events) {
+    engine->modify(fd, events);
+}
+
+/**
+ * @brief removeFd - stops watching descriptor 'fd'.
+ * It is safe to call it from inside of any handler.
+ */
+void EventLoop::removeFd(int fd) {
+    engine->remove(fd);
+    handlers.erase(fd);
+}
+
+/**
+ * @brief addTimer - creates periodic timer
+ * @param interval - timer period
+ * @param handler  - called once per expired period
+ * @return timer descriptor (use it to remove the timer)
+ */
+int EventLoop::addTimer(std::chrono::milliseconds interval,
+                        const TimerHandler& handler) {
+    int timerFd = addTimer(handler);
+
+    itimerspec spec;
+    spec.it_interval.tv_sec  = interval.count() / 1000;
+    spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+    spec.it_value            = spec.it_interval;
+    timerfd_settime(timerFd, 0, &spec, nullptr);
+
+    return timerFd;
+}
+
+/**
+ * @brief addTimer - creates one-shot timer, it is not armed
+ * until 'armTimer' is called
+ * @param handler - called when the timer expires
+ * @return timer descriptor (use it to arm or remove the timer)
+ */
+int EventLoop::addTimer(const TimerHandler& handler) {
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerFd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "timerfd_create error: " + strerror(errno));
+    }
+
+    addFd(timerFd, EPOLLIN, [timerFd, handler](uint32_t) {
+        uint64_t expirations = 0;
+        if(read(timerFd, &expirations, sizeof(expirations)) > 0)
+            handler();
+    });
+
+    return timerFd;
+}
+
+/**
+ * @brief armTimer - one-shot timer expires once after 'delay',
+ * the previous deadline is cancelled
+ */
+void EventLoop::armTimer(int timerFd, std::chrono::nanoseconds delay) {
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec  = delay.count() / 1000000000;
+    spec.it_value.tv_nsec = delay.count() % 1000000000;
+    if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1; // zero would disarm the timer
+    timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+void EventLoop::removeTimer(int timerFd) {
+    removeFd(timerFd);
+    close(timerFd);
+}
+
+/**
+ * @brief addFlushHandler - 'handler' will be called
+ * every time the loop has dispatched ready events
+ */
+void EventLoop::addFlushHandler(const Task& handler) {
+    flushHandlers.push_back(handler);
+}
+
+/**
+ * @brief addWakeHandler - 'handler' will be called after
+ * the posted tasks every time the loop is woken up
+ */
+void EventLoop::addWakeHandler(const Task& handler) {
+    wakeHandlers.push_back(handler);
+}
+
+/**
+ * @brief post - queues 'task' to be executed by the loop thread.
+ * May be called from any thread.
+ */
+void EventLoop::post(const Task& task) {
+    tasksMutex.lock();
+        tasks.push_back(task);
+    tasksMutex.unlock();
+
+    wake();
+}
+
+/**
+ * @brief wake - makes the loop thread run its posted tasks
+ * and wake handlers. May be called from any thread.
+ */
+void EventLoop::wake() {
+    uint64_t one = 1;
+    if(write(wakeupFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        throw std::runtime_error(std::string() +
+                                 "eventfd write error: " + strerror(errno));
+    }
+}
+
+void EventLoop::runPostedTasks() {
+    uint64_t counter = 0;
+    if(read(wakeupFd, &counter, sizeof(counter)) < 0)
+        return;
+
+    std::vector<Task> ready;
+    tasksMutex.lock();
+        ready.swap(tasks);
+    tasksMutex.unlock();
+
+    for(const Task& task : ready)
+        task();
+    for(const Task& handler : wakeHandlers)
+        handler();
+}
+
+/**
+ * @brief run - dispatches events until 'stop' is called
+ */
+void EventLoop::run() {
+    running = true;
+
+    while(running) {
+        engine->wait(events);
+
+        for(size_t i = 0; i < events.size() && running; ++i) {
+            auto it = handlers.find(events[i].fd);
+            if(it == handlers.end())
+                continue; // removed by one of previous handlers
+
+            // keep handler alive even if it removes itself:
+            std::shared_ptr<FdHandler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+
+        for(const Task& handler : flushHandlers)
+            handler();
+    }
+}
+
+void EventLoop::stop() {
+    running = false;
+}
+
+IoEngine& EventLoop::getEngine() {
+    return *engine;
+}
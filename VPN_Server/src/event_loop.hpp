@@ -0,0 +1,80 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include "io_engine.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+/**
+ * @brief The EventLoop class<br>
+ * Thin reactor. Descriptors are registered together with a handler<br>
+ * that is called when the I/O engine (epoll(7) or io_uring(7),<br>
+ * see IoEngine) reports an event on them.<br>
+ * Periodic and one-shot timers are backed by timerfd(2),<br>
+ * so the loop sleeps in the engine until either I/O<br>
+ * or a timer is ready.<br>
+ * Other threads can hand work to the loop thread via 'post',<br>
+ * or just 'wake' it to run its wake handlers (e.g. to drain<br>
+ * queues filled by other threads without a task per item).<br>
+ * Flush handlers run after every dispatched batch of events,<br>
+ * so output queued by handlers can be sent with one syscall.<br>
+ */
+class EventLoop {
+public:
+    typedef std::function<void(uint32_t events)> FdHandler;
+    typedef std::function<void()>                TimerHandler;
+    typedef std::function<void()>                Task;
+
+private:
+    IoEngine*                                            engine;
+    std::vector<IoEvent>                                 events;
+    bool                                                 running;
+    std::unordered_map<int, std::shared_ptr<FdHandler> > handlers;
+    int                                                  wakeupFd;
+    std::mutex                                           tasksMutex;
+    std::vector<Task>                                    tasks;
+    std::vector<Task>                                    flushHandlers;
+    std::vector<Task>                                    wakeHandlers;
+
+public:
+    /* Forbid creating default copy ctor: */
+    EventLoop(EventLoop& that) = delete;
+
+    explicit EventLoop();
+    explicit EventLoop(const std::string& engineName);
+    ~EventLoop();
+
+    void addFd(int fd, uint32_t events, const FdHandler& handler);
+    void modifyFd(int fd, uint32_t events);
+    void removeFd(int fd);
+    int  addTimer(std::chrono::milliseconds interval,
+                  const TimerHandler& handler);
+    int  addTimer(const TimerHandler& handler);
+    void armTimer(int timerFd, std::chrono::nanoseconds delay);
+    void removeTimer(int timerFd);
+    void addFlushHandler(const Task& handler);
+    void addWakeHandler(const Task& handler);
+    void post(const Task& task);
+    void wake();
+    void run();
+    void stop();
+    IoEngine& getEngine();
+
+private:
+    void runPostedTasks();
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,491 @@
+#include "handoff.hpp"
+
+const uint32_t Handoff::MAGIC;
+const uint16_t Handoff::VERSION;
+const size_t   Handoff::CHUNK;
+const size_t   Handoff::MAX_FDS;
+const int      Handoff::TIMEOUT;
+const char     Handoff::ACK;
+
+namespace {
+
+const uint32_t NO_FD = 0xFFFFFFFF;
+
+/**
+ * @brief The StateWriter struct - numbers in network byte order,
+ * strings with their length
+ */
+struct StateWriter {
+    std::string       data;
+    std::vector<int>& fds;
+
+    explicit StateWriter(std::vector<int>& fds) : fds(fds) { }
+
+    void u8(uint8_t value) {
+        data.push_back(value);
+    }
+    void u16(uint16_t value) {
+        u8(value >> 8);
+        u8(value & 0xFF);
+    }
+    void u32(uint32_t value) {
+        u16(value >> 16);
+        u16(value & 0xFFFF);
+    }
+    void bytes(const void* value, size_t length) {
+        data.append(static_cast<const char*>(value), length);
+    }
+    void string(const std::string& value) {
+        u32(value.size());
+        data.append(value);
+    }
+    void fd(int descriptor) {
+        if(descriptor < 0) {
+            u32(NO_FD);
+            return;
+        }
+        u32(fds.size());
+        fds.push_back(descriptor);
+    }
+    void iface(const TunInterface& value) {
+        u32(value.number);
+        string(value.name);
+        bytes(&value.serverAddr, sizeof(value.serverAddr));
+        bytes(&value.clientAddr, sizeof(value.clientAddr));
+    }
+};
+
+/**
+ * @brief The StateReader struct - reads what StateWriter wrote
+ * @throws std::runtime_error if the state is truncated
+ * or refers to a descriptor that was not received
+ */
+struct StateReader {
+    const std::string&      data;
+    const std::vector<int>& fds;
+    size_t                  offset;
+
+    explicit StateReader(const std::string& data, const std::vector<int>& fds)
+        : data(data), fds(fds), offset(0) { }
+
+    void need(size_t length) {
+        if(data.size() - offset < length)
+            throw std::runtime_error("Handoff state is truncated");
+    }
+    uint8_t u8() {
+        need(1);
+        return data[offset++];
+    }
+    uint16_t u16() {
+        uint16_t high = u8();
+        return (high << 8) | u8();
+    }
+    uint32_t u32() {
+        uint32_t high = u16();
+        return (high << 16) | u16();
+    }
+    void bytes(void* value, size_t length) {
+        need(length);
+        memcpy(value, data.data() + offset, length);
+        offset += length;
+    }
+    std::string string() {
+        uint32_t length = u32();
+        need(length);
+        std::string value = data.substr(offset, length);
+        offset += length;
+        return value;
+    }
+    int fd() {
+        uint32_t index = u32();
+        if(index == NO_FD)
+            return -1;
+        if(index >= fds.size())
+            throw std::runtime_error("Handoff state refers to a missing descriptor");
+        return fds[index];
+    }
+    TunInterface iface() {
+        TunInterface value;
+        value.number = u32();
+        value.name   = string();
+        bytes(&value.serverAddr, sizeof(value.serverAddr));
+        bytes(&value.clientAddr, sizeof(value.clientAddr));
+        return value;
+    }
+};
+
+} // namespace
+
+HandoffTunnel::HandoffTunnel()
+    : worker(0), interface(-1), vnetHeader(false),
+      controlSequence(0), mtu(0), clientAddr6(in6addr_any), clientPrefix6(0) {
+    memset(&peer, 0, sizeof(peer));
+    iface.number     = 0;
+    iface.serverAddr = 0;
+    iface.clientAddr = 0;
+}
+
+HandoffLease::HandoffLease()
+    : clientAddr(0), clientAddr6(in6addr_any), clientPrefix6(0), holdTime(0) { }
+
+HandoffState::HandoffState()
+    : sharedServerAddr(0), sharedVnetHeader(false) { }
+
+/**
+ * @brief closeDescriptors - closes the received descriptors
+ * that were not taken over
+ */
+void HandoffState::closeDescriptors() {
+    for(int fd : listeners)
+        close(fd);
+    for(int fd : sharedQueues)
+        close(fd);
+    for(const HandoffTunnel& tunnel : tunnels) {
+        if(tunnel.interface >= 0)
+            close(tunnel.interface);
+    }
+    listeners.clear();
+    sharedQueues.clear();
+    tunnels.clear();
+}
+
+/**
+ * @brief listen - binds the handoff socket of the running server,
+ * the previous socket file at 'path' is replaced
+ * @throws std::runtime_error if the socket cannot be bound
+ */
+int Handoff::listen(const std::string& path) {
+    sockaddr_un addr = address(path);
+    int sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot create handoff socket: " + strerror(errno));
+    }
+
+    unlink(path.c_str());
+    if(bind(sd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(sd, 1) < 0) {
+        int error = errno;
+        close(sd);
+        throw std::runtime_error("Cannot bind handoff socket " + path + ": " +
+                                 strerror(error));
+    }
+    return sd;
+}
+
+/**
+ * @brief accept - takes a connection of a new server process
+ * @return blocking connection with timeouts or -1 if there is
+ * no connection or it is not a process of our user
+ */
+int Handoff::accept(int sd) {
+    int client = accept4(sd, nullptr, nullptr, SOCK_CLOEXEC);
+    if(client < 0)
+        return -1;
+
+    ucred     credentials;
+    socklen_t length = sizeof(credentials);
+    if(getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0 ||
+       credentials.uid != getuid()) {
+        TunnelManager::log("Handoff request of another user is refused", std::cerr);
+        close(client);
+        return -1;
+    }
+    setTimeout(client);
+    return client;
+}
+
+/**
+ * @brief connect - connects to the running server at 'path'
+ * @return connection or -1 if no server listens on 'path'
+ */
+int Handoff::connect(const std::string& path) {
+    sockaddr_un addr = address(path);
+    int sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot create handoff socket: " + strerror(errno));
+    }
+
+    if(::connect(sd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sd);
+        return -1;
+    }
+    setTimeout(sd);
+    return sd;
+}
+
+/**
+ * @brief send - header {MAGIC, VERSION, descriptors, state length},
+ * the descriptors in groups of MAX_FDS and the encoded state
+ * in messages of up to CHUNK bytes
+ * @throws std::runtime_error if a message cannot be sent
+ */
+void Handoff::send(int sd, const HandoffState& state) {
+    std::vector<int> fds;
+    std::string      data = encode(state, fds);
+
+    std::vector<int> none;
+    StateWriter header(none);
+    header.u32(MAGIC);
+    header.u16(VERSION);
+    header.u32(fds.size());
+    header.u32(data.size());
+    sendMessage(sd, header.data.data(), header.data.size(), nullptr, 0);
+
+    for(size_t i = 0; i < fds.size(); i += MAX_FDS) {
+        uint32_t count = std::min(MAX_FDS, fds.size() - i);
+        sendMessage(sd, &count, sizeof(count), &fds[i], count);
+    }
+    for(size_t i = 0; i < data.size(); i += CHUNK)
+        sendMessage(sd, data.data() + i, std::min(CHUNK, data.size() - i), nullptr, 0);
+}
+
+/**
+ * @brief receive - reads what 'send' wrote, the received descriptors
+ * belong to the caller (see 'HandoffState::closeDescriptors')
+ * @throws std::runtime_error if the state cannot be received
+ */
+void Handoff::receive(int sd, HandoffState& state) {
+    std::vector<int> fds;
+    char             header[14];
+    try {
+        if(receiveMessage(sd, header, sizeof(header), fds) != sizeof(header))
+            throw std::runtime_error("Broken handoff header");
+
+        std::string headerData(header, sizeof(header));
+        std::vector<int> none;
+        StateReader reader(headerData, none);
+        if(reader.u32() != MAGIC || reader.u16() != VERSION)
+            throw std::runtime_error("Unknown handoff protocol version");
+        uint32_t fdCount = reader.u32();
+        uint32_t size    = reader.u32();
+
+        while(fds.size() < fdCount) {
+            uint32_t count = 0;
+            size_t   before = fds.size();
+            if(receiveMessage(sd, &count, sizeof(count), fds) != sizeof(count) ||
+               fds.size() - before != count)
+                throw std::runtime_error("Handoff descriptors are lost");
+        }
+
+        std::string data(size, 0);
+        for(size_t offset = 0; offset < size;) {
+            size_t received = receiveMessage(sd, &data[offset],
+                                             std::min(CHUNK, size - offset), fds);
+            if(received == 0)
+                throw std::runtime_error("Handoff state is truncated");
+            offset += received;
+        }
+        decode(data, fds, state);
+    } catch (...) {
+        for(int fd : fds)
+            close(fd);
+        throw;
+    }
+}
+
+void Handoff::sendAck(int sd) {
+    sendMessage(sd, &ACK, sizeof(ACK), nullptr, 0);
+}
+
+/**
+ * @brief waitAck - the new process has taken over the state
+ * @return false if it is gone or timed out
+ */
+bool Handoff::waitAck(int sd) {
+    char reply = 0;
+    std::vector<int> fds;
+    try {
+        if(receiveMessage(sd, &reply, sizeof(reply), fds) != sizeof(reply))
+            return false;
+    } catch (const std::exception&) {
+        return false;
+    }
+    for(int fd : fds)
+        close(fd);
+    return reply == ACK;
+}
+
+/**
+ * @brief encode - the state without descriptors, they are
+ * appended to 'fds' and referred to by index
+ */
+std::string Handoff::encode(const HandoffState& state, std::vector<int>& fds) {
+    StateWriter writer(fds);
+    writer.string(state.port);
+    writer.bytes(&state.sharedServerAddr, sizeof(state.sharedServerAddr));
+    writer.u8(state.sharedVnetHeader);
+
+    writer.u32(state.listeners.size());
+    for(int fd : state.listeners)
+        writer.fd(fd);
+    writer.u32(state.sharedQueues.size());
+    for(int fd : state.sharedQueues)
+        writer.fd(fd);
+    writer.u32(state.readyInterfaces.size());
+    for(const TunInterface& iface : state.readyInterfaces)
+        writer.iface(iface);
+
+    writer.u32(state.tunnels.size());
+    for(const HandoffTunnel& tunnel : state.tunnels) {
+        writer.u32(tunnel.worker);
+        writer.bytes(&tunnel.peer.sin6_addr, sizeof(tunnel.peer.sin6_addr));
+        writer.bytes(&tunnel.peer.sin6_port, sizeof(tunnel.peer.sin6_port));
+        writer.fd(tunnel.interface);
+        writer.u8(tunnel.vnetHeader);
+        writer.iface(tunnel.iface);
+        writer.u16(tunnel.controlSequence);
+        writer.u16(tunnel.mtu);
+        writer.bytes(&tunnel.clientAddr6, sizeof(tunnel.clientAddr6));
+        writer.u8(tunnel.clientPrefix6);
+        writer.string(tunnel.session);
+    }
+
+    writer.u32(state.leases.size());
+    for(const HandoffLease& lease : state.leases) {
+        writer.string(lease.identity);
+        writer.bytes(&lease.clientAddr, sizeof(lease.clientAddr));
+        writer.bytes(&lease.clientAddr6, sizeof(lease.clientAddr6));
+        writer.u8(lease.clientPrefix6);
+        writer.u32(lease.holdTime);
+    }
+    return writer.data;
+}
+
+/**
+ * @brief decode - fills 'state' from 'encode' output,
+ * descriptor indexes are replaced by the received 'fds'
+ * @throws std::runtime_error if the data is broken
+ */
+void Handoff::decode(const std::string& data, const std::vector<int>& fds,
+                     HandoffState& state) {
+    StateReader reader(data, fds);
+    state.port = reader.string();
+    reader.bytes(&state.sharedServerAddr, sizeof(state.sharedServerAddr));
+    state.sharedVnetHeader = reader.u8() != 0;
+
+    for(uint32_t i = reader.u32(); i > 0; --i)
+        state.listeners.push_back(reader.fd());
+    for(uint32_t i = reader.u32(); i > 0; --i)
+        state.sharedQueues.push_back(reader.fd());
+    for(uint32_t i = reader.u32(); i > 0; --i)
+        state.readyInterfaces.push_back(reader.iface());
+
+    for(uint32_t i = reader.u32(); i > 0; --i) {
+        HandoffTunnel tunnel;
+        tunnel.worker = reader.u32();
+        tunnel.peer.sin6_family = AF_INET6;
+        reader.bytes(&tunnel.peer.sin6_addr, sizeof(tunnel.peer.sin6_addr));
+        reader.bytes(&tunnel.peer.sin6_port, sizeof(tunnel.peer.sin6_port));
+        tunnel.interface       = reader.fd();
+        tunnel.vnetHeader      = reader.u8() != 0;
+        tunnel.iface           = reader.iface();
+        tunnel.controlSequence = reader.u16();
+        tunnel.mtu             = reader.u16();
+        reader.bytes(&tunnel.clientAddr6, sizeof(tunnel.clientAddr6));
+        tunnel.clientPrefix6   = reader.u8();
+        tunnel.session         = reader.string();
+        state.tunnels.push_back(tunnel);
+    }
+
+    for(uint32_t i = reader.u32(); i > 0; --i) {
+        HandoffLease lease;
+        lease.identity = reader.string();
+        reader.bytes(&lease.clientAddr, sizeof(lease.clientAddr));
+        reader.bytes(&lease.clientAddr6, sizeof(lease.clientAddr6));
+        lease.clientPrefix6 = reader.u8();
+        lease.holdTime      = reader.u32();
+        state.leases.push_back(lease);
+    }
+}
+
+/**
+ * @brief isValidPath - the path fits a Unix socket address
+ */
+bool Handoff::isValidPath(const std::string& path) {
+    return !path.empty() && path.size() < sizeof(sockaddr_un::sun_path);
+}
+
+sockaddr_un Handoff::address(const std::string& path) {
+    if(!isValidPath(path))
+        throw std::invalid_argument("Invalid handoff socket path");
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return addr;
+}
+
+void Handoff::setTimeout(int sd) {
+    timeval timeout;
+    timeout.tv_sec  = TIMEOUT / 1000;
+    timeout.tv_usec = (TIMEOUT % 1000) * 1000;
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+void Handoff::sendMessage(int sd, const void* data, size_t size,
+                          const int* fds, size_t count) {
+    iovec  iov;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base   = const_cast<void*>(data);
+    iov.iov_len    = size;
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control;
+    if(count > 0) {
+        control.resize(CMSG_SPACE(count * sizeof(int)));
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr* header    = CMSG_FIRSTHDR(&msg);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type  = SCM_RIGHTS;
+        header->cmsg_len   = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(header), fds, count * sizeof(int));
+    }
+
+    if(sendmsg(sd, &msg, MSG_NOSIGNAL) != (ssize_t)size) {
+        throw std::runtime_error(std::string() +
+                                 "Handoff send error: " + strerror(errno));
+    }
+}
+
+/**
+ * @brief receiveMessage - reads one message, received
+ * descriptors are appended to 'fds'
+ * @return message length, 0 if the peer is gone
+ */
+size_t Handoff::receiveMessage(int sd, void* data, size_t size,
+                               std::vector<int>& fds) {
+    iovec  iov;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base   = data;
+    iov.iov_len    = size;
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(MAX_FDS * sizeof(int)));
+    msg.msg_control    = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t received = recvmsg(sd, &msg, MSG_CMSG_CLOEXEC);
+    if(received < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Handoff receive error: " + strerror(errno));
+    }
+    for(cmsghdr* header = CMSG_FIRSTHDR(&msg); header != nullptr;
+        header = CMSG_NXTHDR(&msg, header)) {
+        if(header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* descriptors = reinterpret_cast<const int*>(CMSG_DATA(header));
+        fds.insert(fds.end(), descriptors, descriptors + count);
+    }
+    if(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+        throw std::runtime_error("Handoff message is truncated");
+    return received;
+}
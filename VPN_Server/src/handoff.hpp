@@ -0,0 +1,118 @@
+#ifndef HANDOFF_HPP
+#define HANDOFF_HPP
+
+#include "tunnel_mgr.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * @brief The HandoffTunnel struct<br>
+ * Established tunnel passed to the new server process:<br>
+ * client address, interface and the DTLS session state.<br>
+ */
+struct HandoffTunnel {
+    uint32_t     worker;     // index of the worker that served it
+    sockaddr_in6 peer;
+    int          interface;  // descriptor, -1 - shared TUN device
+    bool         vnetHeader;
+    TunInterface iface;      // number, name and tunnel addresses
+    uint16_t     controlSequence;
+    uint16_t     mtu;        // current MTU of the tunnel
+    in6_addr     clientAddr6;
+    uint8_t      clientPrefix6; // 0 - no IPv6 address
+    std::string  session;    // wolfSSL_dtls_export
+
+    explicit HandoffTunnel();
+};
+
+/**
+ * @brief The HandoffLease struct<br>
+ * Lease of a gone client passed to the new server process,<br>
+ * so the client gets its addresses back there too.<br>
+ */
+struct HandoffLease {
+    std::string identity;
+    in_addr_t   clientAddr;    // 0 - no IPv4 lease
+    in6_addr    clientAddr6;
+    uint8_t     clientPrefix6; // 0 - no IPv6 lease
+    uint32_t    holdTime;      // s left, 0 - the lease doesn't expire
+
+    explicit HandoffLease();
+};
+
+/**
+ * @brief The HandoffState struct<br>
+ * Everything the new server process takes over: listener sockets<br>
+ * of the workers (one per worker), queues of the shared TUN device,<br>
+ * ready interfaces of the pool, established tunnels<br>
+ * and leases of gone clients.<br>
+ */
+struct HandoffState {
+    std::string                port;
+    in_addr_t                  sharedServerAddr; // 0 - no shared TUN device
+    bool                       sharedVnetHeader;
+    std::vector<int>           listeners;
+    std::vector<int>           sharedQueues;
+    std::vector<TunInterface>  readyInterfaces;
+    std::vector<HandoffTunnel> tunnels;
+    std::vector<HandoffLease>  leases;
+
+    explicit HandoffState();
+    void closeDescriptors();
+};
+
+/**
+ * @brief The Handoff class<br>
+ * Graceful upgrade of the server. The running process listens on<br>
+ * a Unix socket; a new process started with the same socket path<br>
+ * connects to it and gets the HandoffState: the descriptors are<br>
+ * passed with SCM_RIGHTS, the rest is encoded in messages of<br>
+ * a SOCK_SEQPACKET connection. The old process exits without<br>
+ * removing interfaces, forwarding and NAT when the new one has<br>
+ * acknowledged the state, so clients keep their sessions.<br>
+ * Only processes of the same user may take over.<br>
+ */
+class Handoff {
+public:
+    static const uint32_t MAGIC   = 0x56504e48; // "VPNH"
+    static const uint16_t VERSION = 3;
+    static const size_t   CHUNK   = 65536; // bytes of the state per message
+    static const size_t   MAX_FDS = 192;   // descriptors per message (SCM_MAX_FD is 253)
+    static const int      TIMEOUT = 5000;  // ms to send or receive a message
+    static const char     ACK     = 'A';
+
+    static int listen(const std::string& path);
+    static int accept(int sd);
+    static int connect(const std::string& path);
+    static void send(int sd, const HandoffState& state);
+    static void receive(int sd, HandoffState& state);
+    static void sendAck(int sd);
+    static bool waitAck(int sd);
+
+    static std::string encode(const HandoffState& state, std::vector<int>& fds);
+    static void decode(const std::string& data, const std::vector<int>& fds,
+                       HandoffState& state);
+    static bool isValidPath(const std::string& path);
+
+private:
+    static sockaddr_un address(const std::string& path);
+    static void setTimeout(int sd);
+    static void sendMessage(int sd, const void* data, size_t size,
+                            const int* fds, size_t count);
+    static size_t receiveMessage(int sd, void* data, size_t size,
+                                 std::vector<int>& fds);
+};
+
+#endif // HANDOFF_HPP
@@ -0,0 +1,513 @@
+#include "io_engine.hpp"
+
+std::string IoEngine::defaultName = "epoll";
+
+const int      EpollEngine::MAX_EVENTS;
+const unsigned UringEngine::ENTRIES;
+
+/**
+ * @brief create - creates engine by its name
+ * @param name - "epoll" or "io_uring"
+ * @throws std::invalid_argument for unknown names,
+ * std::runtime_error if the engine is not supported by the kernel
+ */
+IoEngine* IoEngine::create(const std::string& name) {
+    if(name == "epoll")
+        return new EpollEngine;
+    if(name == "io_uring")
+        return new UringEngine;
+    throw std::invalid_argument("Unknown I/O engine: " + name);
+}
+
+bool IoEngine::isEngineName(const std::string& name) {
+    return name == "epoll" || name == "io_uring";
+}
+
+/**
+ * @brief setDefault - engine of the loops created from now,
+ * must be called before the worker threads are started
+ */
+void IoEngine::setDefault(const std::string& name) {
+    if(!isEngineName(name))
+        throw std::invalid_argument("Unknown I/O engine: " + name);
+    defaultName = name;
+}
+
+const std::string& IoEngine::getDefault() {
+    return defaultName;
+}
+
+EpollEngine::EpollEngine() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "epoll_create1 error: " + strerror(errno));
+    }
+}
+
+EpollEngine::~EpollEngine() {
+    close(epollFd);
+}
+
+void EpollEngine::add(int fd, uint32_t events) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
+
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error(std::string() +
+                                 "epoll_ctl(EPOLL_CTL_ADD) error: " +
+                                 strerror(errno));
+    }
+}
+
+void EpollEngine::modify(int fd, uint32_t events) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollEngine::remove(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EpollEngine::wait(std::vector<IoEvent>& ready) {
+    epoll_event events[MAX_EVENTS];
+    ready.clear();
+
+    int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    if(count < 0) {
+        if(errno == EINTR)
+            return;
+        throw std::runtime_error(std::string() +
+                                 "epoll_wait error: " + strerror(errno));
+    }
+
+    for(int i = 0; i < count; ++i) {
+        IoEvent event = { events[i].data.fd, events[i].events };
+        ready.push_back(event);
+    }
+}
+
+const char* EpollEngine::getName() const {
+    return "epoll";
+}
+
+UringEngine::Watch::Watch(UringEngine* engine, int fd, uint32_t events)
+    : engine(engine), fd(fd), events(events), armed(false), removed(false) { }
+
+/**
+ * @brief complete - poll result is the ready events mask (poll bits
+ * are the same as epoll bits). The poll is armed again by the next
+ * 'wait', after the loop has handled the event.
+ */
+void UringEngine::Watch::complete(int result, uint32_t) {
+    armed = false;
+    if(removed) {
+        engine->destroy(this);
+        return;
+    }
+
+    if(result >= 0) {
+        IoEvent event = { fd, (uint32_t)result };
+        engine->ready->push_back(event);
+    } else if(result != -ECANCELED) { // cancelled by 'modify'
+        IoEvent event = { fd, EPOLLERR };
+        engine->ready->push_back(event);
+    }
+    engine->rearm.push_back(this);
+}
+
+/**
+ * @brief UringEngine constructor - sets up the rings
+ * @param entries - size of the submission queue
+ * @throws std::runtime_error if io_uring is disabled or too old
+ * (single mapping of the rings and no dropped completions are required)
+ */
+UringEngine::UringEngine(unsigned entries)
+    : ringFd(-1),
+      rings(MAP_FAILED),
+      ringsSize(0),
+      sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+      sqesSize(0),
+      unsubmitted(0),
+      ready(nullptr) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "io_uring_setup error: " + strerror(errno));
+    }
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP)
+       || !(params.features & IORING_FEAT_NODROP)) {
+        release();
+        throw std::runtime_error("io_uring of the kernel is too old");
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    rings = mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+               mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+    if(rings == MAP_FAILED || sqes == MAP_FAILED) {
+        int error = errno;
+        release();
+        throw std::runtime_error(std::string() +
+                                 "io_uring mmap error: " + strerror(error));
+    }
+
+    char* base = static_cast<char*>(rings);
+    sqHead    = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail    = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask    = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqArray   = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    cqHead    = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail    = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask    = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes      = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+}
+
+UringEngine::~UringEngine() {
+    // pending requests are cancelled by closing the ring.
+    release();
+    for(Watch* watch : allWatches)
+        delete watch;
+    for(UringRequest* request : cancelled)
+        delete request;
+}
+
+/**
+ * @brief add - starts polling descriptor 'fd'
+ * @param events - epoll event mask, edge-triggered mode is not supported
+ */
+void UringEngine::add(int fd, uint32_t events) {
+    if(watches.count(fd) != 0) {
+        throw std::runtime_error("io_uring poll error: descriptor " +
+                                 std::to_string(fd) + " is already watched");
+    }
+    Watch* watch = new Watch(this, fd, events);
+    watches[fd] = watch;
+    allWatches.insert(watch);
+    arm(watch);
+}
+
+/**
+ * @brief modify - an armed poll is removed,
+ * its cancellation arms it again with the new mask
+ */
+void UringEngine::modify(int fd, uint32_t events) {
+    auto it = watches.find(fd);
+    if(it == watches.end())
+        return;
+
+    Watch* watch = it->second;
+    watch->events = events;
+    if(watch->armed) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode    = IORING_OP_POLL_REMOVE;
+        sqe->addr      = reinterpret_cast<uintptr_t>(watch);
+        sqe->user_data = 0;
+    }
+}
+
+/**
+ * @brief remove - stops polling 'fd', the poll request
+ * is released after its last completion
+ */
+void UringEngine::remove(int fd) {
+    auto it = watches.find(fd);
+    if(it == watches.end())
+        return;
+
+    Watch* watch = it->second;
+    watches.erase(it);
+    watch->removed = true;
+    if(watch->armed) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode    = IORING_OP_POLL_REMOVE;
+        sqe->addr      = reinterpret_cast<uintptr_t>(watch);
+        sqe->user_data = 0;
+    }
+}
+
+/**
+ * @brief wait - arms the polls of handled events, submits all queued
+ * requests and sleeps until at least one completion is ready.
+ * Completions of other requests are handled right here, only poll
+ * completions are returned in 'ready' (which may be empty then).
+ */
+void UringEngine::wait(std::vector<IoEvent>& ready) {
+    ready.clear();
+
+    std::vector<Watch*> handled;
+    handled.swap(rearm);
+    for(Watch* watch : handled) {
+        if(watch->removed)
+            destroy(watch);
+        else
+            arm(watch);
+    }
+
+    // don't sleep if something has completed since the last 'wait'
+    bool completed = *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if(submit(completed ? 0 : 1) < 0
+       && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw std::runtime_error(std::string() +
+                                 "io_uring_enter error: " + strerror(errno));
+    }
+
+    this->ready = &ready;
+    reap();
+    this->ready = nullptr;
+}
+
+const char* UringEngine::getName() const {
+    return "io_uring";
+}
+
+/**
+ * @brief recvMultishot - receives datagrams of 'fd' into provided
+ * buffers until the request is cancelled or fails. Every completion
+ * is one datagram in buffer (flags >> IORING_CQE_BUFFER_SHIFT)
+ * of 'group' that starts with io_uring_recvmsg_out.
+ * @param header - only msg_namelen and msg_controllen are used,
+ *                 must live until the request is submitted
+ */
+void UringEngine::recvMultishot(int fd, msghdr* header, uint16_t group,
+                                UringRequest* request) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uintptr_t>(header);
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = reinterpret_cast<uintptr_t>(request);
+}
+
+/**
+ * @brief cancel - stops 'request'. The engine takes the ownership
+ * of it: it is deleted after its last completion, which is not
+ * given to the request anymore.
+ */
+void UringEngine::cancel(UringRequest* request) {
+    cancelled.insert(request);
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->addr      = reinterpret_cast<uintptr_t>(request);
+    sqe->user_data = 0;
+}
+
+/**
+ * @brief registerBufferRing - gives the kernel a ring of provided buffers
+ * @param ring    - page aligned io_uring_buf_ring
+ * @param entries - power of two
+ */
+void UringEngine::registerBufferRing(void* ring, unsigned entries,
+                                     uint16_t group) {
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = reinterpret_cast<uintptr_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid         = group;
+
+    if(syscall(__NR_io_uring_register, ringFd,
+               IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        throw std::runtime_error(std::string() +
+                                 "IORING_REGISTER_PBUF_RING error: " +
+                                 strerror(errno));
+    }
+}
+
+void UringEngine::unregisterBufferRing(uint16_t group) {
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = group;
+    syscall(__NR_io_uring_register, ringFd,
+            IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
+
+int UringEngine::getFd() const {
+    return ringFd;
+}
+
+/**
+ * @brief getSqe - next free submission entry, zeroed.
+ * The kernel reads entries only in io_uring_enter(2) of this
+ * thread, so the entry is queued before it is filled.
+ */
+io_uring_sqe* UringEngine::getSqe() {
+    unsigned tail = *sqTail;
+    if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        if(submit(0) < 0 || tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)
+                            >= sqEntries)
+            throw std::runtime_error("io_uring submission queue is full");
+    }
+
+    unsigned index = tail & sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted;
+    return sqe;
+}
+
+/**
+ * @brief submit - io_uring_enter(2)
+ * @param waitFor - completions to wait for
+ * @return submitted entries or -1 (errno is set)
+ */
+int UringEngine::submit(unsigned waitFor) {
+    if(unsubmitted == 0 && waitFor == 0)
+        return 0;
+
+    unsigned flags  = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int      result = syscall(__NR_io_uring_enter, ringFd, unsubmitted,
+                              waitFor, flags, nullptr, 0);
+    if(result > 0)
+        unsubmitted -= result;
+    return result;
+}
+
+/**
+ * @brief reap - empties the completion queue first, so handlers
+ * may submit new requests while the completions are dispatched
+ */
+void UringEngine::reap() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+    reaped.clear();
+    for(; head != tail; ++head)
+        reaped.push_back(cqes[head & cqMask]);
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+    for(const io_uring_cqe& cqe : reaped) {
+        UringRequest* request = reinterpret_cast<UringRequest*>(cqe.user_data);
+        if(request == nullptr)
+            continue; // result of a cancellation
+
+        if(!cancelled.empty() && cancelled.count(request) != 0) {
+            if(!(cqe.flags & IORING_CQE_F_MORE)) {
+                cancelled.erase(request);
+                delete request;
+            }
+            continue;
+        }
+        request->complete(cqe.res, cqe.flags);
+    }
+}
+
+void UringEngine::arm(Watch* watch) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = watch->fd;
+    sqe->poll32_events = watch->events;
+    sqe->user_data     = reinterpret_cast<uintptr_t>(watch);
+    watch->armed = true;
+}
+
+void UringEngine::destroy(Watch* watch) {
+    allWatches.erase(watch);
+    delete watch;
+}
+
+void UringEngine::release() {
+    if(sqes != MAP_FAILED)
+        munmap(sqes, sqesSize);
+    if(rings != MAP_FAILED)
+        munmap(rings, ringsSize);
+    if(ringFd >= 0)
+        close(ringFd);
+}
+
+/**
+ * @brief BufferRing constructor - registers the ring
+ * and provides 'count' packets of 'pool' to the kernel
+ * @param group - buffer group ID, unique in the engine
+ * @param count - power of two up to 32768
+ */
+BufferRing::BufferRing(UringEngine& engine, PacketPool& pool,
+                       uint16_t group, uint16_t count)
+    : engine(engine),
+      pool(pool),
+      group(group),
+      mask(count - 1),
+      tail(0) {
+    if(count == 0 || (count & (count - 1)) != 0 || count > 32768)
+        throw std::invalid_argument("Buffer ring size must be a power of two");
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    ringSize = (count * sizeof(io_uring_buf) + page - 1) / page * page;
+    void* memory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        throw std::runtime_error(std::string() +
+                                 "Buffer ring mmap error: " + strerror(errno));
+    }
+    ring = static_cast<io_uring_buf_ring*>(memory);
+
+    try {
+        engine.registerBufferRing(ring, count, group);
+    } catch (...) {
+        munmap(ring, ringSize);
+        throw;
+    }
+
+    for(size_t id = 0; id < count; ++id) {
+        buffers.push_back(pool.acquire());
+        provide(id);
+    }
+}
+
+BufferRing::~BufferRing() {
+    engine.unregisterBufferRing(group);
+    munmap(ring, ringSize);
+    for(Packet* packet : buffers)
+        pool.release(packet);
+}
+
+char* BufferRing::buffer(uint16_t id) {
+    return buffers[id & mask]->payload();
+}
+
+size_t BufferRing::bufferSize() const {
+    return pool.getCapacity();
+}
+
+/**
+ * @brief recycle - gives buffer 'id' back to the kernel
+ */
+void BufferRing::recycle(uint16_t id) {
+    provide(id & mask);
+}
+
+uint16_t BufferRing::getGroup() const {
+    return group;
+}
+
+uint16_t BufferRing::size() const {
+    return mask + 1;
+}
+
+void BufferRing::provide(uint16_t id) {
+    // not ring->bufs: the flexible array is moved by C++ padding
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(ring) + (tail & mask);
+    buf->addr = reinterpret_cast<uintptr_t>(buffers[id]->payload());
+    buf->len  = pool.getCapacity();
+    buf->bid  = id;
+    ++tail;
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
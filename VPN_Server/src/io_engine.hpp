@@ -0,0 +1,214 @@
+#ifndef IO_ENGINE_HPP
+#define IO_ENGINE_HPP
+
+#include "packet_pool.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief The IoEvent struct - descriptor and its ready events (epoll mask)
+ */
+struct IoEvent {
+    int      fd;
+    uint32_t events;
+};
+
+/**
+ * @brief The IoEngine class<br>
+ * Source of I/O events of an event loop. Descriptors are watched<br>
+ * with an epoll(7) event mask, 'wait' sleeps until some of them<br>
+ * are ready. Watching is level-triggered with both engines.<br>
+ * Selected by name: "epoll" or "io_uring", the engine of new<br>
+ * loops is chosen once at startup, see 'setDefault'.<br>
+ */
+class IoEngine {
+private:
+    static std::string defaultName;
+
+public:
+    virtual ~IoEngine() { }
+
+    virtual void add(int fd, uint32_t events) = 0;
+    virtual void modify(int fd, uint32_t events) = 0;
+    virtual void remove(int fd) = 0;
+    virtual void wait(std::vector<IoEvent>& ready) = 0;
+    virtual const char* getName() const = 0;
+
+    static IoEngine* create(const std::string& name);
+    static bool isEngineName(const std::string& name);
+    static void setDefault(const std::string& name);
+    static const std::string& getDefault();
+};
+
+/**
+ * @brief The EpollEngine class - readiness from epoll_wait(2)
+ */
+class EpollEngine : public IoEngine {
+private:
+    static const int MAX_EVENTS = 64;
+
+    int epollFd;
+
+public:
+    /* Forbid creating default copy ctor: */
+    EpollEngine(EpollEngine& that) = delete;
+
+    explicit EpollEngine();
+    ~EpollEngine();
+
+    void add(int fd, uint32_t events) override;
+    void modify(int fd, uint32_t events) override;
+    void remove(int fd) override;
+    void wait(std::vector<IoEvent>& ready) override;
+    const char* getName() const override;
+};
+
+/**
+ * @brief The UringRequest class<br>
+ * Operation submitted to io_uring, 'complete' is called by 'wait'<br>
+ * for every completion of it (multishot operations complete many<br>
+ * times while IORING_CQE_F_MORE is set). The request must live<br>
+ * until its last completion or until the engine is destroyed.<br>
+ */
+class UringRequest {
+public:
+    virtual ~UringRequest() { }
+    virtual void complete(int result, uint32_t flags) = 0;
+};
+
+/**
+ * @brief The UringEngine class<br>
+ * io_uring(7) instance of one event loop: a submission and<br>
+ * a completion ring shared by all descriptors of the loop.<br>
+ * Watched descriptors are polled with IORING_OP_POLL_ADD that is<br>
+ * armed again after the loop has dispatched the event, so readiness<br>
+ * behaves as with epoll. Owners of descriptors may submit their I/O<br>
+ * to the same ring instead ('recvMultishot'), then data is delivered<br>
+ * in completions without readiness events and extra syscalls:<br>
+ * submissions are sent and completions are reaped by the same<br>
+ * io_uring_enter(2) the loop sleeps in.<br>
+ * Uses raw syscalls, liburing is not required.<br>
+ */
+class UringEngine : public IoEngine {
+public:
+    static const unsigned ENTRIES = 256;
+
+private:
+    /**
+     * @brief The Watch class - poll request of a watched descriptor
+     */
+    class Watch : public UringRequest {
+    public:
+        UringEngine* engine;
+        int          fd;
+        uint32_t     events;
+        bool         armed;
+        bool         removed;
+
+        explicit Watch(UringEngine* engine, int fd, uint32_t events);
+        void complete(int result, uint32_t flags) override;
+    };
+
+    int                               ringFd;
+    void*                             rings;      // both rings in one mapping
+    size_t                            ringsSize;
+    io_uring_sqe*                     sqes;
+    size_t                            sqesSize;
+    unsigned*                         sqHead;
+    unsigned*                         sqTail;
+    unsigned                          sqMask;
+    unsigned*                         sqArray;
+    unsigned                          sqEntries;
+    unsigned*                         cqHead;
+    unsigned*                         cqTail;
+    unsigned                          cqMask;
+    io_uring_cqe*                     cqes;
+    unsigned                          unsubmitted;
+    std::unordered_map<int, Watch*>   watches;
+    std::unordered_set<Watch*>        allWatches; // including removed ones
+    std::unordered_set<UringRequest*> cancelled;  // owned by the engine
+    std::vector<Watch*>               rearm;      // to be polled again
+    std::vector<IoEvent>*             ready;      // output of current 'wait'
+    std::vector<io_uring_cqe>         reaped;
+
+public:
+    /* Forbid creating default copy ctor: */
+    UringEngine(UringEngine& that) = delete;
+
+    explicit UringEngine(unsigned entries = ENTRIES);
+    ~UringEngine();
+
+    void add(int fd, uint32_t events) override;
+    void modify(int fd, uint32_t events) override;
+    void remove(int fd) override;
+    void wait(std::vector<IoEvent>& ready) override;
+    const char* getName() const override;
+
+    void recvMultishot(int fd, msghdr* header, uint16_t group,
+                       UringRequest* request);
+    void cancel(UringRequest* request);
+    void registerBufferRing(void* ring, unsigned entries, uint16_t group);
+    void unregisterBufferRing(uint16_t group);
+    int getFd() const;
+
+private:
+    io_uring_sqe* getSqe();
+    int submit(unsigned waitFor);
+    void reap();
+    void arm(Watch* watch);
+    void destroy(Watch* watch);
+    void release();
+};
+
+/**
+ * @brief The BufferRing class<br>
+ * Provided buffers of io_uring (IORING_REGISTER_PBUF_RING) taken<br>
+ * from a packet pool: the kernel picks a free buffer of the group<br>
+ * only when data arrives, so many pending receives share a few<br>
+ * buffers. A buffer is given back with 'recycle' after its data<br>
+ * is consumed.<br>
+ */
+class BufferRing {
+private:
+    UringEngine&         engine;
+    PacketPool&          pool;
+    uint16_t             group;
+    uint16_t             mask;
+    io_uring_buf_ring*   ring;
+    size_t               ringSize;
+    std::vector<Packet*> buffers;
+    uint16_t             tail;
+
+public:
+    /* Forbid creating default copy ctor: */
+    BufferRing(BufferRing& that) = delete;
+
+    explicit BufferRing(UringEngine& engine, PacketPool& pool,
+                        uint16_t group, uint16_t count);
+    ~BufferRing();
+
+    char* buffer(uint16_t id);
+    size_t bufferSize() const;
+    void recycle(uint16_t id);
+    uint16_t getGroup() const;
+    uint16_t size() const;
+
+private:
+    void provide(uint16_t id);
+};
+
+#endif // IO_ENGINE_HPP
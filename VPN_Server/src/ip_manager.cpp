@@ -1,81 +1,394 @@
 #include "ip_manager.hpp"
 
+const size_t IPManager::MAX_LEASES;
+
+namespace {
+
+/**
+ * @brief holdTimeLeft - whole seconds until the lease expires,
+ * at least one, 0 if it doesn't expire
+ */
+std::chrono::seconds holdTimeLeft(bool expiring,
+                                  std::chrono::steady_clock::time_point expiresAt,
+                                  std::chrono::steady_clock::time_point now) {
+    if(!expiring)
+        return std::chrono::seconds(0);
+    auto left = std::chrono::duration_cast<std::chrono::seconds>(expiresAt - now);
+    return std::max(left + std::chrono::seconds(1), std::chrono::seconds(1));
+}
+
+} // namespace
+
+/**
+ * @brief AddressBitmap constructor - all addresses are free
+ * @param size - count of addresses
+ */
+AddressBitmap::AddressBitmap(size_t size) : size(size), freeCount(size) {
+    size_t count = size;
+    do {
+        size_t words = (count + 63) / 64;
+        if(words == 0) { // empty bitmap
+            levels.push_back(std::vector<uint64_t>(1, 0));
+            break;
+        }
+
+        std::vector<uint64_t> level(words, ~0ULL);
+        if(count % 64 != 0)
+            level.back() = (1ULL << (count % 64)) - 1;
+        levels.push_back(level);
+        count = words;
+    } while(count > 1);
+}
+
+/**
+ * @brief acquire - takes the first free address
+ * @param index - index of the taken address
+ * @return false if all addresses are taken
+ */
+bool AddressBitmap::acquire(size_t& index) {
+    if(levels.back()[0] == 0)
+        return false;
+
+    // bit of a level is the word of the level below:
+    size_t position = 0;
+    for(size_t level = levels.size(); level-- > 0; )
+        position = position * 64 + __builtin_ctzll(levels[level][position]);
+
+    index = position;
+    for(size_t level = 0; level < levels.size(); ++level) {
+        uint64_t& word = levels[level][position / 64];
+        word &= ~(1ULL << (position % 64));
+        if(word != 0)
+            break; // upper levels are not changed
+        position /= 64;
+    }
+    --freeCount;
+    return true;
+}
+
+/**
+ * @brief acquireAt - takes the given address
+ * @return false if the address is already taken
+ */
+bool AddressBitmap::acquireAt(size_t index) {
+    if(!isFree(index))
+        return false;
+
+    for(size_t level = 0; level < levels.size(); ++level) {
+        uint64_t& word = levels[level][index / 64];
+        word &= ~(1ULL << (index % 64));
+        if(word != 0)
+            break;
+        index /= 64;
+    }
+    --freeCount;
+    return true;
+}
+
+/**
+ * @brief release - marks the address as free
+ * @return false if the address was not taken
+ */
+bool AddressBitmap::release(size_t index) {
+    if(index >= size || isFree(index))
+        return false;
+
+    for(size_t level = 0; level < levels.size(); ++level) {
+        uint64_t& word = levels[level][index / 64];
+        bool wasEmpty = word == 0;
+        word |= 1ULL << (index % 64);
+        if(!wasEmpty)
+            break; // upper levels already have the bit
+        index /= 64;
+    }
+    ++freeCount;
+    return true;
+}
+
+bool AddressBitmap::isFree(size_t index) const {
+    return index < size && (levels[0][index / 64] >> (index % 64)) & 1;
+}
+
+size_t AddressBitmap::getFreeCount() const {
+    return freeCount;
+}
+
+IPManager::Shard::Shard(uint32_t first, size_t count)
+    : bitmap(count), first(first) { }
+
 /**
  * @brief IPManager constructor
  * @param ipAndMask - contains ip address and mask bits
  *  like "x.x.x.x/y" where y is bit count (from 0 to 32)
+ * @param shardsCount - count of independently locked parts
+ *  of the address space, e.g. count of workers
  */
-IPManager::IPManager(std::string ipAndMask, size_t poolInitSize) {
+IPManager::IPManager(std::string ipAndMask, size_t shardsCount)
+    : usedAddrCounter(0) {
     size_t slashPos = ipAndMask.find('/');
 
     if(slashPos == std::string::npos ||
         ipAndMask.at(slashPos) == ipAndMask.at(ipAndMask.length() - 1)) {
         std::cerr << "Bit mask was not found. Using default: 255.255.255.0"
                   << std::endl;
-        ipaddr = inet_addr(ipAndMask.c_str());
-        networkAddress = ipaddr;
+        networkAddress = inet_addr(ipAndMask.substr(0, slashPos).c_str());
         netmask = inet_addr("255.255.255.0");
     } else {
         std::string ip = ipAndMask.substr(0, slashPos);
         uint32_t networkMaskBitCount = atoi(ipAndMask.substr(slashPos + 1).c_str());
+        if(networkMaskBitCount > 32)
+            throw std::invalid_argument("Wrong network mask: " + ipAndMask);
 
-        ipaddr         = inet_addr(ip.c_str());
-        networkAddress = ipaddr;
+        networkAddress = inet_addr(ip.c_str());
 
-        in_addr_t tempmask = (0xffffffff >> (32 - networkMaskBitCount )) << (32 - networkMaskBitCount);
+        in_addr_t tempmask = networkMaskBitCount == 0 ? 0 :
+            (0xffffffff >> (32 - networkMaskBitCount )) << (32 - networkMaskBitCount);
         netmask = htonl(tempmask);
+    }
 
-        // address pool init:
-        usedAddrCounter = 0;
-        addrPoolPtr = new std::queue<in_addr_t>();
-        for(size_t i = 0; i < poolInitSize; ++i) {
-            addrPoolPtr->push(genNextIp());
-        }
+    // network and broadcast addresses are not given to hosts:
+    uint32_t capacity = networkCapacity();
+    firstHost = capacity >= 3 ? 1 : 0;
+    lastHost  = capacity >= 3 ? capacity - 1 : capacity;
+    ipaddr    = htonl(ntohl(networkAddress & netmask) + firstHost);
+
+    // address pool init:
+    size_t hosts = static_cast<size_t>(lastHost) - firstHost + 1;
+    if(shardsCount == 0)
+        shardsCount = 1;
+    if(shardsCount > hosts)
+        shardsCount = hosts;
+    shardSize = (hosts + shardsCount - 1) / shardsCount;
+
+    for(size_t offset = 0; offset < hosts; offset += shardSize) {
+        size_t count = std::min<size_t>(shardSize, hosts - offset);
+        shards.push_back(new Shard(firstHost + offset, count));
     }
 }
 
 
 IPManager::~IPManager() {
-    delete addrPoolPtr;
+    for(Shard* shard : shards)
+        delete shard;
 }
 
 /**
  * @brief getAddrFromPool
- * @return IP address from the pool of addresses
+ * Starts from the shard of the calling thread,
+ * other shards are used when it is exhausted.
+ * When the whole pool is exhausted the address of the oldest
+ * lease of a gone client is taken.
+ * @return IP address from the pool of addresses,
+ * 0 if there are no free addresses
  */
 in_addr_t IPManager::getAddrFromPool() {
+    size_t start = std::hash<std::thread::id>()(std::this_thread::get_id())
+                   % shards.size();
 
-    mutex.lock();
+    for(size_t i = 0; i < shards.size(); ++i) {
+        Shard* shard = shards[(start + i) % shards.size()];
+        size_t index = 0;
 
-    if(addrPoolPtr->empty()) {
-        if(usedAddrCounter < networkCapacity()) {
-            for(size_t i = 0; i < usedAddrCounter; ++i) {
-                addrPoolPtr->push(genNextIp());
-            }
-        } else {
-            return 0; // can't give IP address
-            // throw std::runtime_error("usedAddrCounter > networkCapacity");
-        }
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        if(!shard->bitmap.acquire(index))
+            continue;
+        lock.unlock();
+
+        ++usedAddrCounter; // counter of addresses that are already using by tunnels
+        return htonl(ntohl(networkAddress & netmask) + shard->first + index);
     }
-    in_addr_t result = addrPoolPtr->front();
-    addrPoolPtr->pop();
-    ++usedAddrCounter; // counter of addresses that are already using by tunnels
+    return reclaimLease(); // 0 if there are no leases of gone clients
+}
 
-    mutex.unlock();
-    return result;
+/**
+ * @brief reserveAddr - takes the given address from the pool
+ * @return false if the address is not free or not in the network
+ */
+bool IPManager::reserveAddr(in_addr_t ip) {
+    size_t index = 0;
+    Shard* shard = findShard(ip, index);
+    if(shard == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if(!shard->bitmap.acquireAt(index))
+        return false;
+    ++usedAddrCounter;
+    return true;
 }
 
 /**
  * @brief returnAddrToPool
  * Pushes back freed IP-address back<br>
  * to the pool of IP addresses
- * @param ip - ip address to push into queue
+ * @param ip - ip address to mark as free
  */
 void IPManager::returnAddrToPool(in_addr_t ip) {
-    mutex.lock();
-        addrPoolPtr->push(ip);
+    size_t index = 0;
+    Shard* shard = findShard(ip, index);
+    if(shard == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if(shard->bitmap.release(index))
         --usedAddrCounter;
-    mutex.unlock();
+}
+
+size_t IPManager::usedAddrCount() const {
+    return usedAddrCounter;
+}
+
+/**
+ * @brief getLeasedAddr - gives the client identity the address
+ * its lease keeps since the client is gone
+ * @param identity - e.g. address of the client host
+ * @return leased address, 0 if there is no lease or the address
+ * is used by another connection of the identity
+ */
+in_addr_t IPManager::getLeasedAddr(const std::string& identity) {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.connected)
+        return 0;
+
+    // the client is back, its lease doesn't expire:
+    leasesOrder.erase(lease->second.order);
+    lease->second.connected = true;
+    lease->second.expiring  = false;
+    return lease->second.ip;
+}
+
+/**
+ * @brief setLease - remembers the address of the connected client
+ * identity, 'ip' is taken from the pool by the caller.
+ * An address kept by the previous lease of a gone client is returned
+ * to the pool, the one of a connected client is returned
+ * by its 'releaseLease'.
+ */
+void IPManager::setLease(const std::string& identity, in_addr_t ip) {
+    in_addr_t previous = 0;
+
+    leasesMutex.lock();
+        auto lease = leases.find(identity);
+        if(lease == leases.end()) {
+            lease = leases.emplace(identity, Lease()).first;
+        } else if(!lease->second.connected) {
+            leasesOrder.erase(lease->second.order);
+            if(lease->second.ip != ip)
+                previous = lease->second.ip;
+        }
+        lease->second.ip        = ip;
+        lease->second.connected = true;
+        lease->second.expiring  = false;
+    leasesMutex.unlock();
+
+    if(previous != 0)
+        returnAddrToPool(previous);
+}
+
+/**
+ * @brief releaseLease - the client of the identity is gone,
+ * its lease keeps 'ip' taken for it. The oldest lease of a gone
+ * client is forgotten if there are MAX_LEASES of them.
+ * @return false if 'ip' is not the leased address (e.g. another
+ * connection of the identity took the lease), the caller
+ * returns it to the pool then
+ */
+bool IPManager::releaseLease(const std::string& identity, in_addr_t ip) {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.ip != ip)
+        return false;
+    if(!lease->second.connected)
+        return true; // released already
+
+    lease->second.connected = false;
+    lease->second.order     = leasesOrder.insert(leasesOrder.end(), identity);
+    if(leasesOrder.size() > MAX_LEASES)
+        forgetLease(leases.find(leasesOrder.front()));
+    return true;
+}
+
+/**
+ * @brief holdLease - the client is gone, its lease expires
+ * after 'holdTime' unless the client connects again
+ */
+void IPManager::holdLease(const std::string& identity, std::chrono::seconds holdTime) {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.connected)
+        return;
+    lease->second.expiring  = true;
+    lease->second.expiresAt = std::chrono::steady_clock::now() + holdTime;
+}
+
+/**
+ * @brief expireLease - forgets the lease of the identity if its
+ * hold time is over, called by the timer set when it was held.
+ * The address of the lease is free again.
+ * @return true if the lease is forgotten
+ */
+bool IPManager::expireLease(const std::string& identity,
+                            std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.connected ||
+       !lease->second.expiring || now < lease->second.expiresAt)
+        return false; // the client came back or was held again later
+    forgetLease(lease);
+    return true;
+}
+
+/**
+ * @brief getGoneLeases - calls 'handler' for every lease of a gone
+ * client, oldest first, e.g. to hand them to a new server process
+ */
+void IPManager::getGoneLeases(const GoneLeaseHandler& handler) {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+
+    auto now = std::chrono::steady_clock::now();
+    for(const std::string& identity : leasesOrder) {
+        const Lease& lease = leases.at(identity);
+        handler(identity, lease.ip, holdTimeLeft(lease.expiring, lease.expiresAt, now));
+    }
+}
+
+/**
+ * @brief restoreLease - takes 'ip' for the lease of a gone client,
+ * e.g. one kept by the previous server process
+ * @param holdTime - the lease expires after it, 0 - doesn't expire
+ * @return false if the address is taken or the identity has a lease
+ */
+bool IPManager::restoreLease(const std::string& identity, in_addr_t ip,
+                             std::chrono::seconds holdTime) {
+    if(!reserveAddr(ip))
+        return false;
+
+    std::unique_lock<std::mutex> lock(leasesMutex);
+    if(leases.count(identity) != 0) {
+        lock.unlock();
+        returnAddrToPool(ip);
+        return false;
+    }
+
+    Lease& added    = leases[identity];
+    added.ip        = ip;
+    added.connected = false;
+    added.expiring  = holdTime.count() > 0;
+    added.expiresAt = std::chrono::steady_clock::now() + holdTime;
+    added.order     = leasesOrder.insert(leasesOrder.end(), identity);
+    if(leasesOrder.size() > MAX_LEASES)
+        forgetLease(leases.find(leasesOrder.front()));
+    return true;
+}
+
+size_t IPManager::leasesCount() {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+    return leases.size();
 }
 
 in_addr_t IPManager::getSockaddrIn() {
@@ -143,3 +456,352 @@ std::string IPManager::getIpString(in_addr_t ip) {
     char buffer[INET_ADDRSTRLEN];
     return inet_ntop(AF_INET, &ip, buffer, INET_ADDRSTRLEN);
 }
+
+/**
+ * @brief findShard - finds the shard of the host address
+ * @param index - index of the address in the shard
+ * @return nullptr if the address is not a host of the network
+ */
+IPManager::Shard* IPManager::findShard(in_addr_t ip, size_t& index) {
+    if(!isInRange(ip))
+        return nullptr;
+
+    uint32_t offset = ntohl(ip) - ntohl(networkAddress & netmask);
+    if(offset < firstHost || offset > lastHost)
+        return nullptr;
+
+    size_t host = offset - firstHost;
+    index = host % shardSize;
+    return shards[host / shardSize];
+}
+
+/**
+ * @brief reclaimLease - forgets the oldest lease of a gone client
+ * @return its address, still taken from the pool, 0 if there are none
+ */
+in_addr_t IPManager::reclaimLease() {
+    std::lock_guard<std::mutex> lock(leasesMutex);
+    if(leasesOrder.empty())
+        return 0;
+
+    auto lease = leases.find(leasesOrder.front());
+    in_addr_t ip = lease->second.ip;
+    leasesOrder.pop_front();
+    leases.erase(lease);
+    return ip;
+}
+
+/**
+ * @brief forgetLease - forgets the lease of a gone client and returns
+ * its address to the pool, called with 'leasesMutex' locked
+ */
+void IPManager::forgetLease(std::unordered_map<std::string, Lease>::iterator lease) {
+    in_addr_t ip = lease->second.ip;
+    leasesOrder.erase(lease->second.order);
+    leases.erase(lease);
+    returnAddrToPool(ip); // locks only the shard
+}
+
+const size_t  IP6Manager::MAX_PREFIXES;
+const uint8_t IP6Manager::CLIENT_PREFIX;
+const uint8_t IP6Manager::MAX_NETWORK_PREFIX;
+
+namespace {
+
+size_t prefixesCount(int prefixLength) {
+    int bits = (prefixLength < IP6Manager::CLIENT_PREFIX ? IP6Manager::CLIENT_PREFIX : 128)
+               - prefixLength;
+    return bits >= 24 ? IP6Manager::MAX_PREFIXES : (size_t)1 << bits;
+}
+
+} // namespace
+
+/**
+ * @brief IP6Manager constructor
+ * @param networkAddress - e.g. "fd00:1::"
+ * @param prefixLength   - bits of the network (from 0 to MAX_NETWORK_PREFIX)
+ * @throws std::invalid_argument for a bad address or prefix length
+ */
+IP6Manager::IP6Manager(const std::string& networkAddress, int prefixLength)
+    : prefixLength(prefixLength),
+      clientPrefix(prefixLength < CLIENT_PREFIX ? CLIENT_PREFIX : 128),
+      capacity(prefixesCount(prefixLength)),
+      bitmap(prefixLength >= 0 && prefixLength <= MAX_NETWORK_PREFIX
+             ? prefixesCount(prefixLength) : 0) {
+    if(prefixLength < 0 || prefixLength > MAX_NETWORK_PREFIX)
+        throw std::invalid_argument("Wrong IPv6 network mask: " + std::to_string(prefixLength));
+    if(!parse(networkAddress, network))
+        throw std::invalid_argument("Wrong IPv6 network: " + networkAddress);
+
+    for(int bit = prefixLength; bit < 128; ++bit)
+        network.s6_addr[bit / 8] &= ~(0x80 >> (bit % 8));
+
+    // the first prefix (or the address of the network) is not given:
+    bitmap.acquireAt(0);
+}
+
+/**
+ * @brief acquire - gives the client the prefix kept by its lease,
+ * otherwise the first free one. When all prefixes are taken
+ * the prefix of the oldest lease of a gone client is taken.
+ * @param identity - e.g. address of the client host
+ * @param address  - address of the client in its prefix
+ * @return false if there are no free prefixes
+ */
+bool IP6Manager::acquire(const std::string& identity, in6_addr& address) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t index = 0;
+    auto lease = leases.find(identity);
+    if(lease != leases.end() && !lease->second.connected) {
+        index = lease->second.index;
+    } else if(!bitmap.acquire(index)) {
+        if(leasesOrder.empty())
+            return false;
+        auto oldest = leases.find(leasesOrder.front());
+        index = oldest->second.index; // still taken
+        leasesOrder.pop_front();
+        leases.erase(oldest);
+    }
+    setLease(identity, index);
+    address = addressAt(index);
+    return true;
+}
+
+/**
+ * @brief reserve - takes the prefix of the address for the client,
+ * e.g. a prefix of a tunnel handed off by the previous process
+ * @return false if the prefix is taken or not in the network
+ */
+bool IP6Manager::reserve(const std::string& identity, const in6_addr& address) {
+    size_t index = 0;
+    if(!indexOf(address, index))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!bitmap.acquireAt(index))
+        return false;
+    setLease(identity, index);
+    return true;
+}
+
+/**
+ * @brief release - the client of the identity is gone, its lease keeps
+ * the prefix of the address taken. The prefix is free again if it
+ * is not the leased one (e.g. another connection of the identity
+ * took the lease). The oldest lease of a gone client is forgotten
+ * if there are MAX_LEASES of them.
+ */
+void IP6Manager::release(const std::string& identity, const in6_addr& address) {
+    size_t index = 0;
+    if(!indexOf(address, index) || index == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.index != index) {
+        bitmap.release(index);
+        return;
+    }
+    if(!lease->second.connected)
+        return; // released already
+
+    lease->second.connected = false;
+    lease->second.order     = leasesOrder.insert(leasesOrder.end(), identity);
+    if(leasesOrder.size() > IPManager::MAX_LEASES)
+        forgetLease(leases.find(leasesOrder.front()));
+}
+
+/**
+ * @brief holdLease - the client is gone, its lease expires
+ * after 'holdTime' unless the client connects again
+ */
+void IP6Manager::holdLease(const std::string& identity, std::chrono::seconds holdTime) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.connected)
+        return;
+    lease->second.expiring  = true;
+    lease->second.expiresAt = std::chrono::steady_clock::now() + holdTime;
+}
+
+/**
+ * @brief expireLease - forgets the lease of the identity
+ * if its hold time is over, its prefix is free again
+ * @return true if the lease is forgotten
+ */
+bool IP6Manager::expireLease(const std::string& identity,
+                             std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto lease = leases.find(identity);
+    if(lease == leases.end() || lease->second.connected ||
+       !lease->second.expiring || now < lease->second.expiresAt)
+        return false;
+    forgetLease(lease);
+    return true;
+}
+
+/**
+ * @brief getGoneLeases - calls 'handler' for every lease of a gone
+ * client, oldest first, with the address of the client in its prefix
+ */
+void IP6Manager::getGoneLeases(const GoneLeaseHandler& handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto now = std::chrono::steady_clock::now();
+    for(const std::string& identity : leasesOrder) {
+        const Lease& lease = leases.at(identity);
+        handler(identity, addressAt(lease.index),
+                holdTimeLeft(lease.expiring, lease.expiresAt, now));
+    }
+}
+
+/**
+ * @brief restoreLease - takes the prefix of the address for the lease
+ * of a gone client, e.g. one kept by the previous server process
+ * @param holdTime - the lease expires after it, 0 - doesn't expire
+ * @return false if the prefix is taken or not in the network
+ * or the identity has a lease
+ */
+bool IP6Manager::restoreLease(const std::string& identity, const in6_addr& address,
+                              std::chrono::seconds holdTime) {
+    size_t index = 0;
+    if(!indexOf(address, index))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(leases.count(identity) != 0 || !bitmap.acquireAt(index))
+        return false;
+
+    Lease& added    = leases[identity];
+    added.index     = index;
+    added.connected = false;
+    added.expiring  = holdTime.count() > 0;
+    added.expiresAt = std::chrono::steady_clock::now() + holdTime;
+    added.order     = leasesOrder.insert(leasesOrder.end(), identity);
+    if(leasesOrder.size() > IPManager::MAX_LEASES)
+        forgetLease(leases.find(leasesOrder.front()));
+    return true;
+}
+
+/**
+ * @brief usedCount - prefixes given to clients
+ */
+size_t IP6Manager::usedCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return capacity - 1 - bitmap.getFreeCount();
+}
+
+size_t IP6Manager::leasesCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return leases.size();
+}
+
+/**
+ * @brief indexOf - index of the prefix that contains the address
+ * @return false if the address is not in the network
+ */
+bool IP6Manager::indexOf(const in6_addr& address, size_t& index) const {
+    for(int bit = 0; bit < prefixLength; ++bit) {
+        uint8_t mask = 0x80 >> (bit % 8);
+        if((address.s6_addr[bit / 8] ^ network.s6_addr[bit / 8]) & mask)
+            return false;
+    }
+
+    // the bits of the index end with the client prefix:
+    uint64_t value = 0;
+    for(int byte = clientPrefix / 8 - 8; byte < clientPrefix / 8; ++byte)
+        value = (value << 8) | address.s6_addr[byte];
+    int bits = clientPrefix - prefixLength;
+    if(bits < 64)
+        value &= (1ULL << bits) - 1;
+    if(value >= capacity)
+        return false;
+    index = value;
+    return true;
+}
+
+/**
+ * @brief addressAt - address of the client of the prefix:
+ * the first address of a /64, the address itself otherwise
+ */
+in6_addr IP6Manager::addressAt(size_t index) const {
+    in6_addr address = network;
+    uint64_t value   = index;
+    for(int byte = clientPrefix / 8 - 1; value != 0; --byte, value >>= 8)
+        address.s6_addr[byte] |= value & 0xFF;
+    if(clientPrefix == CLIENT_PREFIX)
+        address.s6_addr[15] |= 1;
+    return address;
+}
+
+size_t IP6Manager::getCapacity() const {
+    return capacity;
+}
+
+uint8_t IP6Manager::getClientPrefix() const {
+    return clientPrefix;
+}
+
+/**
+ * @brief isUniqueLocal - the network is in fc00::/7 and is not
+ * routed in the Internet, its packets must be masqueraded
+ */
+bool IP6Manager::isUniqueLocal() const {
+    return (network.s6_addr[0] & 0xFE) == 0xFC;
+}
+
+std::string IP6Manager::getNetworkString() const {
+    return getIpString(network) + '/' + std::to_string(prefixLength);
+}
+
+std::string IP6Manager::getIpString(const in6_addr& ip) {
+    char buffer[INET6_ADDRSTRLEN];
+    return inet_ntop(AF_INET6, &ip, buffer, INET6_ADDRSTRLEN);
+}
+
+/**
+ * @brief getPrefixString - "network/length" of the prefix
+ * that contains the address, e.g. the route of a client
+ */
+std::string IP6Manager::getPrefixString(const in6_addr& ip, uint8_t prefixLength) {
+    in6_addr prefix = ip;
+    for(int bit = prefixLength; bit < 128; ++bit)
+        prefix.s6_addr[bit / 8] &= ~(0x80 >> (bit % 8));
+    return getIpString(prefix) + '/' + std::to_string(prefixLength);
+}
+
+bool IP6Manager::parse(const std::string& ip, in6_addr& address) {
+    return inet_pton(AF_INET6, ip.c_str(), &address) == 1;
+}
+
+/**
+ * @brief setLease - remembers the prefix of the connected client
+ * identity, a prefix kept by the previous lease of a gone client
+ * is free again, called with the lock taken
+ */
+void IP6Manager::setLease(const std::string& identity, size_t index) {
+    auto lease = leases.find(identity);
+    if(lease == leases.end()) {
+        lease = leases.emplace(identity, Lease()).first;
+    } else if(!lease->second.connected) {
+        leasesOrder.erase(lease->second.order);
+        if(lease->second.index != index)
+            bitmap.release(lease->second.index);
+    }
+    lease->second.index     = index;
+    lease->second.connected = true;
+    lease->second.expiring  = false;
+}
+
+/**
+ * @brief forgetLease - forgets the lease of a gone client and frees
+ * its prefix, called with the lock taken
+ */
+void IP6Manager::forgetLease(std::unordered_map<std::string, Lease>::iterator lease) {
+    bitmap.release(lease->second.index);
+    leasesOrder.erase(lease->second.order);
+    leases.erase(lease);
+}
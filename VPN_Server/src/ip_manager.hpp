@@ -2,39 +2,133 @@
 #define IP_MANAGER_HPP
 
 #include <iostream>
-#include <queue>
 #include <string>
+#include <vector>
+#include <list>
+#include <chrono>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdexcept>
+#include <stdint.h>
 #include <mutex>
 
+/**
+ * @brief The AddressBitmap class<br>
+ * Hierarchical bitmap of free addresses: a set bit of the<br>
+ * lowest level is a free address, a set bit of an upper level<br>
+ * means its word of the level below has a free address.<br>
+ * Lookup and update touch one word per level, so they<br>
+ * take constant time, and a /8 network takes about 2 MB.<br>
+ */
+class AddressBitmap {
+private:
+    std::vector<std::vector<uint64_t>> levels; // levels[0] - addresses
+    size_t                             size;
+    size_t                             freeCount;
+
+public:
+    explicit AddressBitmap(size_t size);
+
+    bool acquire(size_t& index);
+    bool acquireAt(size_t index);
+    bool release(size_t index);
+    bool isFree(size_t index) const;
+    size_t getFreeCount() const;
+};
 
 /**
  * @brief The IPManager class
  *        Contains IPv4 network info, such as\r\n
  *        network address, network mask and last\r\n
  *        generated client IP address.\r\n
+ *        Free host addresses of the network are kept\r\n
+ *        in bitmaps, split into shards with own locks\r\n
+ *        so workers rarely wait for each other.\r\n
+ *        Remembers the last address given to every client\r\n
+ *        identity to give it back on reconnect: the address\r\n
+ *        of a gone client stays taken by its lease until the lease\r\n
+ *        is forgotten, so other clients don't get it meanwhile.\r\n
+ *        Leases of gone clients are forgotten oldest first when\r\n
+ *        the pool is exhausted or there are MAX_LEASES of them.\r\n
+ *        A lease of a gone client may expire after a hold\r\n
+ *        time, see 'holdLease' and 'expireLease'.\r\n
  */
 class IPManager {
+public:
+    static const size_t MAX_LEASES = 65536;
+
+    // hold time left, 0 - the lease doesn't expire
+    typedef std::function<void(const std::string& identity, in_addr_t ip,
+                               std::chrono::seconds holdTime)> GoneLeaseHandler;
+
 private:
+    /**
+     * @brief The Shard struct - part of network hosts
+     * starting at host offset 'first'
+     */
+    struct Shard {
+        std::mutex    mutex;
+        AddressBitmap bitmap;
+        uint32_t      first;
+
+        Shard(uint32_t first, size_t count);
+    };
+
+    /**
+     * @brief The Lease struct - address of a client identity,
+     * 'order' and 'expiresAt' are set while the client is gone
+     */
+    struct Lease {
+        in_addr_t                             ip;
+        bool                                  connected;
+        bool                                  expiring;
+        std::chrono::steady_clock::time_point expiresAt;
+        std::list<std::string>::iterator      order;
+    };
+
     in_addr_t              networkAddress;
     in_addr_t              ipaddr;
     in_addr_t              netmask; // subnet mask
-    std::mutex             mutex;
-    std::queue<in_addr_t>* addrPoolPtr;
-    size_t                 usedAddrCounter;
+    uint32_t               firstHost; // host offsets of the network
+    uint32_t               lastHost;
+    uint32_t               shardSize; // hosts in every shard
+    std::vector<Shard*>    shards;
+    std::atomic<size_t>    usedAddrCounter;
+
+    std::mutex                                 leasesMutex;
+    std::unordered_map<std::string, Lease>     leases;
+    std::list<std::string>                     leasesOrder; // gone clients, oldest first
 
 public:
     /* Forbid copy ctor and standart ctor: */
     IPManager() = delete;
     IPManager(IPManager& that) = delete;
-    explicit IPManager(std::string ipAndMask, size_t poolInitSize = 100);
+    explicit IPManager(std::string ipAndMask, size_t shardsCount = 1);
     ~IPManager();
 
     in_addr_t getAddrFromPool();
+    bool reserveAddr(in_addr_t ip);
     void returnAddrToPool(in_addr_t ip);
+    size_t usedAddrCount() const;
+
+    in_addr_t getLeasedAddr(const std::string& identity);
+    void setLease(const std::string& identity, in_addr_t ip);
+    bool releaseLease(const std::string& identity, in_addr_t ip);
+    void holdLease(const std::string& identity, std::chrono::seconds holdTime);
+    bool expireLease(const std::string& identity,
+                     std::chrono::steady_clock::time_point now =
+                        std::chrono::steady_clock::now());
+    void getGoneLeases(const GoneLeaseHandler& handler);
+    bool restoreLease(const std::string& identity, in_addr_t ip,
+                      std::chrono::seconds holdTime);
+    size_t leasesCount();
+
     in_addr_t getSockaddrIn();
     in_addr_t genNextIp();
     uint32_t networkCapacity();
@@ -45,6 +139,92 @@ public:
 
     static std::string getIpString(in_addr_t ip);
 
+private:
+    Shard* findShard(in_addr_t ip, size_t& index);
+    in_addr_t reclaimLease();
+    void forgetLease(std::unordered_map<std::string, Lease>::iterator lease);
+};
+
+/**
+ * @brief The IP6Manager class<br>
+ * IPv6 prefixes of the clients in the virtual IPv6 network.<br>
+ * A network shorter than /64 is split into /64 prefixes, so every<br>
+ * client may use any address of its own /64 (e.g. privacy addresses),<br>
+ * a longer one gives a single address (/128) to every client.<br>
+ * Prefixes are kept by their index in the network in an AddressBitmap,<br>
+ * the first one is not given to clients. At most MAX_PREFIXES of them<br>
+ * are used, so a /48 costs 8 KB of bitmap and a /32 2 MB.<br>
+ * Like IPManager it remembers the prefix of every client identity<br>
+ * to give it back on reconnect: the prefix of a gone client stays<br>
+ * taken by its lease until the lease is forgotten, a lease of a gone<br>
+ * client may expire after a hold time.<br>
+ * Lookups of the index of an address don't take locks.<br>
+ */
+class IP6Manager {
+public:
+    static const size_t  MAX_PREFIXES  = 1 << 24;
+    static const uint8_t CLIENT_PREFIX = 64;
+    static const uint8_t MAX_NETWORK_PREFIX = 124; // 15 clients
+
+    // hold time left, 0 - the lease doesn't expire
+    typedef std::function<void(const std::string& identity, const in6_addr& address,
+                               std::chrono::seconds holdTime)> GoneLeaseHandler;
+
+private:
+    /**
+     * @brief The Lease struct - prefix index of a client identity,
+     * 'order' and 'expiresAt' are set while the client is gone
+     */
+    struct Lease {
+        size_t                                index;
+        bool                                  connected;
+        bool                                  expiring;
+        std::chrono::steady_clock::time_point expiresAt;
+        std::list<std::string>::iterator      order;
+    };
+
+    in6_addr               network;
+    uint8_t                prefixLength;
+    uint8_t                clientPrefix; // CLIENT_PREFIX or 128
+    size_t                 capacity;     // prefixes of the network
+    std::mutex             mutex;
+    AddressBitmap          bitmap;
+    std::unordered_map<std::string, Lease> leases;
+    std::list<std::string>                 leasesOrder; // gone clients, oldest first
+
+public:
+    /* Forbid copy ctor and standart ctor: */
+    IP6Manager() = delete;
+    IP6Manager(IP6Manager& that) = delete;
+    explicit IP6Manager(const std::string& networkAddress, int prefixLength);
+
+    bool acquire(const std::string& identity, in6_addr& address);
+    bool reserve(const std::string& identity, const in6_addr& address);
+    void release(const std::string& identity, const in6_addr& address);
+    void holdLease(const std::string& identity, std::chrono::seconds holdTime);
+    bool expireLease(const std::string& identity,
+                     std::chrono::steady_clock::time_point now =
+                        std::chrono::steady_clock::now());
+    void getGoneLeases(const GoneLeaseHandler& handler);
+    bool restoreLease(const std::string& identity, const in6_addr& address,
+                      std::chrono::seconds holdTime);
+    size_t usedCount();
+    size_t leasesCount();
+
+    bool indexOf(const in6_addr& address, size_t& index) const;
+    in6_addr addressAt(size_t index) const;
+    size_t getCapacity() const;
+    uint8_t getClientPrefix() const;
+    bool isUniqueLocal() const;
+    std::string getNetworkString() const;
+
+    static std::string getIpString(const in6_addr& ip);
+    static std::string getPrefixString(const in6_addr& ip, uint8_t prefixLength);
+    static bool parse(const std::string& ip, in6_addr& address);
+
+private:
+    void setLease(const std::string& identity, size_t index);
+    void forgetLease(std::unordered_map<std::string, Lease>::iterator lease);
 };
 
 #endif // IP_MANAGER_HPP
@@ -0,0 +1,128 @@
+#include "keepalive.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+#include <stdlib.h>
+
+int Keepalive::minInterval = Keepalive::DEFAULT_INTERVAL * 1000;
+int Keepalive::maxInterval = Keepalive::DEFAULT_INTERVAL * 1000;
+
+const int Keepalive::DEFAULT_INTERVAL;
+const int Keepalive::MAX_INTERVAL;
+const int Keepalive::ACK_TIMEOUT;
+const int Keepalive::TIMEOUT_LIMIT;
+
+/**
+ * @brief Keepalive constructor - the shortest interval
+ * is used until the client answers a probe
+ */
+Keepalive::Keepalive()
+    : interval(minInterval),
+      confirmed(0),
+      probing(false),
+      settled(minInterval == maxInterval) {
+}
+
+/**
+ * @brief onSent - the tunnel sends a keepalive now
+ * @param idle - nothing was received for the interval either
+ * @return true if the keepalive is a probe and must ask for ACK
+ */
+bool Keepalive::onSent(TimePoint now, bool idle) {
+    if(settled || probing || !idle)
+        return false;
+
+    probing = true;
+    sentAt  = now;
+    return true;
+}
+
+/**
+ * @brief onAck - the client answered the probe,
+ * the binding survives the current interval
+ * @return true if the interval has changed
+ */
+bool Keepalive::onAck() {
+    if(!probing)
+        return false;
+
+    probing   = false;
+    confirmed = interval;
+    if(interval >= maxInterval) {
+        settled = true;
+        return false;
+    }
+    interval = std::min(interval * 2, maxInterval);
+    return true;
+}
+
+/**
+ * @brief onTimeout - checks the probe in flight
+ * @return true if the probe is lost and the interval has changed
+ */
+bool Keepalive::onTimeout(TimePoint now) {
+    if(!probing || now < getAckDeadline())
+        return false;
+
+    // the binding (or the client) is gone, stay with what worked:
+    probing  = false;
+    settled  = true;
+    interval = confirmed != 0 ? confirmed : minInterval;
+    return true;
+}
+
+bool Keepalive::isProbing() const {
+    return probing;
+}
+
+Keepalive::TimePoint Keepalive::getAckDeadline() const {
+    return sentAt + std::chrono::milliseconds(ACK_TIMEOUT);
+}
+
+std::chrono::milliseconds Keepalive::getInterval() const {
+    return std::chrono::milliseconds(interval);
+}
+
+/**
+ * @brief configure - range of the keepalive intervals of new tunnels,
+ * equal bounds turn the adaptation off
+ */
+void Keepalive::configure(int minSeconds, int maxSeconds) {
+    minInterval = minSeconds * 1000;
+    maxInterval = std::max(minSeconds, maxSeconds) * 1000;
+}
+
+/**
+ * @brief parse - reads the option "MIN" or "MIN:MAX" in seconds
+ * @return false if the option is not valid
+ */
+bool Keepalive::parse(const std::string& option, int& minSeconds, int& maxSeconds) {
+    size_t separator = option.find(':');
+    std::string low  = option.substr(0, separator);
+    std::string high = separator == std::string::npos ? low
+                                                      : option.substr(separator + 1);
+    for(const std::string* part : { &low, &high }) {
+        if(part->empty() || part->size() > 4 ||
+           part->find_first_not_of("0123456789") != std::string::npos)
+            return false;
+    }
+
+    minSeconds = atoi(low.c_str());
+    maxSeconds = atoi(high.c_str());
+    return minSeconds >= 1 && minSeconds <= maxSeconds && maxSeconds <= MAX_INTERVAL;
+}
+
+bool Keepalive::isAdaptive() {
+    return maxInterval > minInterval;
+}
+
+/**
+ * @brief getDeadPeerTimeout - time without incoming data until
+ * the client is gone, long enough for a quiet client that only
+ * answers probes of the longest interval
+ */
+std::chrono::milliseconds Keepalive::getDeadPeerTimeout() {
+    return std::chrono::milliseconds(std::max(TIMEOUT_LIMIT,
+                                              2 * maxInterval + ACK_TIMEOUT));
+}
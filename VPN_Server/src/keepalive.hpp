@@ -0,0 +1,54 @@
+#ifndef KEEPALIVE_HPP
+#define KEEPALIVE_HPP
+
+#include <chrono>
+#include <string>
+
+/**
+ * @brief The Keepalive class<br>
+ * Keepalive interval of one tunnel, adapted to the NAT binding<br>
+ * timeout of the client. The server sends a keepalive when it has<br>
+ * sent nothing for the interval. If the client was quiet as well,<br>
+ * the keepalive is a probe: it asks for ACK, an answer shows that<br>
+ * the binding of the client survives an idle interval of this length,<br>
+ * and the interval grows. A probe without answer falls back to the<br>
+ * longest interval that was answered and the interval stays there.<br>
+ * Longer intervals wake the radios of mobile clients less often.<br>
+ * The range of the intervals is set at startup, see 'configure'.<br>
+ */
+class Keepalive {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const int DEFAULT_INTERVAL = 10;    // s
+    static const int MAX_INTERVAL     = 3600;  // s, upper limit of the option
+    static const int ACK_TIMEOUT      = 3000;  // ms to wait for ACK of a probe
+    static const int TIMEOUT_LIMIT    = 60000; // ms without incoming data
+
+private:
+    static int minInterval; // ms
+    static int maxInterval; // ms
+
+    int       interval;  // ms, current
+    int       confirmed; // ms, longest answered interval
+    bool      probing;   // probe waits for ACK
+    bool      settled;   // the interval doesn't grow any more
+    TimePoint sentAt;
+
+public:
+    explicit Keepalive();
+
+    bool onSent(TimePoint now, bool idle);
+    bool onAck();
+    bool onTimeout(TimePoint now);
+    bool isProbing() const;
+    TimePoint getAckDeadline() const;
+    std::chrono::milliseconds getInterval() const;
+
+    static void configure(int minSeconds, int maxSeconds);
+    static bool parse(const std::string& option, int& minSeconds, int& maxSeconds);
+    static bool isAdaptive();
+    static std::chrono::milliseconds getDeadPeerTimeout();
+};
+
+#endif // KEEPALIVE_HPP
@@ -0,0 +1,269 @@
+#include "logger.hpp"
+
+#include <sstream>
+
+const size_t LogRecord::TEXT_SIZE;
+const size_t LogRing::CAPACITY;
+const int    Logger::DRAIN_INTERVAL;
+
+namespace {
+
+/**
+ * @brief The RingHolder struct - ring of the current thread,
+ * given to the logger thread when the thread exits
+ */
+struct RingHolder {
+    Logger*  owner;
+    LogRing* ring;
+
+    RingHolder() : owner(nullptr), ring(nullptr) { }
+    ~RingHolder() {
+        if(ring != nullptr)
+            ring->setOrphaned();
+    }
+};
+
+thread_local RingHolder holder;
+
+const char* levelName(uint8_t level) {
+    switch(level) {
+        case Logger::DEBUG:   return "DEBUG";
+        case Logger::INFO:    return "INFO";
+        case Logger::WARNING: return "WARNING";
+        default:              return "ERROR";
+    }
+}
+
+} // namespace
+
+LogRing::LogRing() : head(0), tail(0), dropped(0), orphaned(false) { }
+
+/**
+ * @brief push - copies the message to the ring, called by the owner thread
+ * @return false if the ring is full and the message is dropped
+ */
+bool LogRing::push(uint8_t level, const std::string& msg) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    if(position - head.load(std::memory_order_acquire) >= CAPACITY) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    LogRecord& record = records[position % CAPACITY];
+    record.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    record.thread = std::this_thread::get_id();
+    record.level  = level;
+    record.length = msg.length() < LogRecord::TEXT_SIZE ?
+                    msg.length() : LogRecord::TEXT_SIZE;
+    memcpy(record.text, msg.data(), record.length);
+
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief pop - takes the oldest message, called by the logger thread
+ * @return false if the ring is empty
+ */
+bool LogRing::pop(LogRecord& record) {
+    size_t position = head.load(std::memory_order_relaxed);
+    if(position == tail.load(std::memory_order_acquire))
+        return false;
+
+    record = records[position % CAPACITY];
+    head.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::empty() const {
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_acquire);
+}
+
+size_t LogRing::takeDropped() {
+    return dropped.exchange(0, std::memory_order_relaxed);
+}
+
+void LogRing::setOrphaned() {
+    orphaned.store(true, std::memory_order_release);
+}
+
+bool LogRing::isOrphaned() const {
+    return orphaned.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief LogLimiter constructor
+ * @param perSecond - messages allowed a second
+ */
+LogLimiter::LogLimiter(uint32_t perSecond)
+    : perSecond(perSecond), second(0), count(0), suppressed(0) { }
+
+/**
+ * @brief allow - checks the limit of the current second
+ * @param suppressedBefore - count of messages suppressed
+ * since the last allowed one
+ * @return true if the message can be written
+ */
+bool LogLimiter::allow(uint32_t& suppressedBefore) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    int64_t current = second.load(std::memory_order_relaxed);
+    if(now != current &&
+       second.compare_exchange_strong(current, now, std::memory_order_relaxed)) {
+        count.store(0, std::memory_order_relaxed);
+    }
+
+    if(count.fetch_add(1, std::memory_order_relaxed) < perSecond) {
+        suppressedBefore = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief Logger constructor - starts the logger thread
+ */
+Logger::Logger() : running(true) {
+    thread = std::thread([this]() { run(); });
+}
+
+Logger::~Logger() {
+    running = false;
+    thread.join();
+
+    for(LogRing* ring : rings)
+        delete ring;
+    if(holder.owner == this)
+        holder.ring = nullptr;
+}
+
+/**
+ * @brief instance
+ * @return logger of the application
+ */
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+/**
+ * @brief write - puts the message to the ring of the calling thread.
+ * Doesn't wait for output, so it can be used on the data path.
+ */
+void Logger::write(Level level, const std::string& msg) {
+    if(!enabled(level))
+        return;
+    threadRing().push(level, msg);
+}
+
+/**
+ * @brief write - rate limited message, e.g. an error that can be
+ * repeated for every packet
+ * @param limiter - limiter of the call site
+ */
+void Logger::write(Level level, const std::string& msg, LogLimiter& limiter) {
+    uint32_t suppressed = 0;
+    if(!enabled(level) || !limiter.allow(suppressed))
+        return;
+
+    if(suppressed == 0)
+        threadRing().push(level, msg);
+    else
+        threadRing().push(level, msg + " (" + std::to_string(suppressed) +
+                                 " similar messages suppressed)");
+}
+
+/**
+ * @brief flush - writes out all queued messages
+ */
+void Logger::flush() {
+    drain();
+}
+
+LogRing& Logger::threadRing() {
+    if(holder.owner != this || holder.ring == nullptr) {
+        if(holder.ring != nullptr)
+            holder.ring->setOrphaned();
+
+        LogRing* ring = new LogRing;
+        ringsMutex.lock();
+            rings.push_back(ring);
+        ringsMutex.unlock();
+
+        holder.owner = this;
+        holder.ring  = ring;
+    }
+    return *holder.ring;
+}
+
+/**
+ * @brief drain - prints messages of all rings,
+ * removes rings of exited threads
+ * @return true if something was printed
+ */
+bool Logger::drain() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    bool printed = false;
+
+    for(size_t i = 0; i < rings.size(); ) {
+        LogRing* ring = rings[i];
+        bool orphaned = ring->isOrphaned(); // before the last messages are read
+
+        LogRecord record;
+        while(ring->pop(record)) {
+            print(record);
+            printed = true;
+        }
+
+        if(size_t dropped = ring->takeDropped()) {
+            fprintf(stderr, "<logger> %zu messages dropped, ring is full\n",
+                    dropped);
+            printed = true;
+        }
+
+        if(orphaned) {
+            delete ring;
+            rings.erase(rings.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+
+    if(printed) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return printed;
+}
+
+void Logger::run() {
+    while(running) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL));
+    }
+    drain();
+}
+
+/**
+ * @brief print - formats the record like
+ * "<dd.mm.yy hh:mm:ss.ms> <THREAD ID: id> <LEVEL> message"
+ */
+void Logger::print(const LogRecord& record) {
+    time_t seconds = record.time / 1000;
+    tm     local;
+    char   date[32];
+    localtime_r(&seconds, &local);
+    strftime(date, sizeof(date), "%d.%m.%y %H:%M:%S", &local);
+
+    std::ostringstream thread;
+    thread << record.thread;
+
+    fprintf(record.level >= WARNING ? stderr : stdout,
+            "<%s.%03d> <THREAD ID: %s> <%s> %.*s\n",
+            date, static_cast<int>(record.time % 1000), thread.str().c_str(),
+            levelName(record.level), record.length, record.text);
+}
@@ -0,0 +1,129 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Messages below the level are compiled out, e.g. -DLOG_LEVEL=0 for debug
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 1
+#endif
+
+/**
+ * @brief The LogRecord struct<br>
+ * One message in a ring: formatted by the logger thread.<br>
+ */
+struct LogRecord {
+    static const size_t TEXT_SIZE = 232;
+
+    int64_t         time;   // ms since epoch
+    std::thread::id thread;
+    uint8_t         level;
+    uint16_t        length;
+    char            text[TEXT_SIZE];
+};
+
+/**
+ * @brief The LogRing class<br>
+ * Single-producer single-consumer ring of one thread.<br>
+ * The producer never waits: a message is dropped if the ring is full.<br>
+ */
+class LogRing {
+public:
+    static const size_t CAPACITY = 1024; // power of two
+
+private:
+    LogRecord           records[CAPACITY];
+    std::atomic<size_t> head;    // next record to read
+    std::atomic<size_t> tail;    // next record to write
+    std::atomic<size_t> dropped;
+    std::atomic<bool>   orphaned; // the thread has exited
+
+public:
+    /* Forbid creating default copy ctor: */
+    LogRing(LogRing& that) = delete;
+
+    explicit LogRing();
+
+    bool push(uint8_t level, const std::string& msg);
+    bool pop(LogRecord& record);
+    bool empty() const;
+    size_t takeDropped();
+    void setOrphaned();
+    bool isOrphaned() const;
+};
+
+/**
+ * @brief The LogLimiter class<br>
+ * Rate limit of one call site: allows 'perSecond' messages<br>
+ * a second and counts the suppressed ones.<br>
+ */
+class LogLimiter {
+private:
+    uint32_t              perSecond;
+    std::atomic<int64_t>  second;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+
+public:
+    explicit LogLimiter(uint32_t perSecond = 5);
+
+    bool allow(uint32_t& suppressedBefore);
+};
+
+/**
+ * @brief The Logger class<br>
+ * Asynchronous log: threads put messages to their own rings<br>
+ * without locks or syscalls, a background thread formats them<br>
+ * and writes to stdout (stderr for warnings and errors).<br>
+ */
+class Logger {
+public:
+    enum Level {
+        DEBUG   = 0,
+        INFO    = 1,
+        WARNING = 2,
+        ERROR   = 3
+    };
+
+    static const int DRAIN_INTERVAL = 10; // ms
+
+private:
+    std::mutex             ringsMutex; // taken to add or remove a ring
+    std::vector<LogRing*>  rings;
+    std::atomic<bool>      running;
+    std::thread            thread;
+
+public:
+    /* Forbid creating default copy ctor: */
+    Logger(Logger& that) = delete;
+
+    explicit Logger();
+    ~Logger();
+
+    static Logger& instance();
+    static constexpr bool enabled(Level level) {
+        return level >= LOG_LEVEL;
+    }
+
+    void write(Level level, const std::string& msg);
+    void write(Level level, const std::string& msg, LogLimiter& limiter);
+    void flush();
+
+private:
+    LogRing& threadRing();
+    bool drain();
+    void run();
+    static void print(const LogRecord& record);
+};
+
+#endif // LOGGER_HPP
@@ -20,7 +20,31 @@
  * [8, 9]   -d 8.8.8.8  - DNS-server address      (optional, default = 8.8.8.8)
  * [10, 11] -r 0.0.0.0  - routing address         (optional, default = 0.0.0.0)
  * [12]     0           - routing address mask    (optional, default = 0)
- * [13, 14] -i wlan0    - physical network interface (opt., default = eth0)<br></pre>
+ * [13, 14] -i wlan0    - physical network interface (opt., default = eth0)
+ * [15, 16] -w 4        - worker threads count (opt., default = CPU cores)
+ * [17]     -q          - multi-queue TUN interfaces (opt., default = off)
+ * [18]     -g          - TUN vnet header and TSO offloads (opt., default = off)
+ * [19, 20] -n netlink  - network backend, netlink or shell (opt., default = netlink)
+ * [21, 22] -p 4        - interfaces created in advance (opt., default = 4)
+ * [23]     -s          - one shared TUN interface for all clients (opt., default = off)
+ * [24, 25] -e 9100     - metrics endpoint port on 127.0.0.1 (opt., default = off)
+ * [26, 27] -c 20000    - session cache size, 0 - off (opt., default = 20000)
+ * [28, 29] -k 3600     - session ticket key rotation, s, 0 - off (opt., default = 3600)
+ * [30, 31] -x auto     - cipher policy: auto, aes-gcm, chacha20 or default (opt., default = auto)
+ * [32, 33] -o 4500     - ESP-in-UDP port of the kernel data path (opt., default = off)
+ * [34, 35] -u epoll    - I/O engine of the workers, epoll or io_uring (opt., default = epoll)
+ * [36]     -t          - path MTU discovery, MTU of every tunnel (opt., default = off)
+ * [37, 38] -f acl.txt  - access rules for packets of the clients (opt., default = off)
+ * [39, 40] -b 10m      - rate limit of the clients in bit/s, HOST=RATE for one client (opt., default = off)
+ * [41, 42] -l vpn.sock  - handoff socket, a new server takes over the clients (opt., default = off)
+ * [43, 44] -y vpn.conf  - configuration file, reloaded by the control API (opt., default = none)
+ * [45, 46] -j ctl.sock  - control socket: reload, set, sessions, kick, drain (opt., default = off)
+ * [47, 48] -z 300       - seconds without packets until a tunnel hibernates (opt., default = never)
+ * [49, 50] -v 10:120    - keepalive interval, s, grows up to MAX behind NAT (opt., default = 10)
+ * [51, 52] -h 3600      - seconds a gone client keeps its address lease (opt., default = always)
+ * [53, 54] -C 2         - crypto threads for heavy tunnels (opt., default = off)
+ * [55, 56] -6 fd00:1::  - virtual IPv6 network, clients are dual-stack (opt., default = off)
+ * [57]     48           - virtual IPv6 network prefix length, /64 per client up to /63<br></pre>
  * <h3>Enter 'exitvpn' in terminal to close the server.<h3><br>
  */
 
@@ -39,7 +63,31 @@ int main(int argc, char **argv) {
         "* [7, 8]   -d 8.8.8.8  - DNS-server address      (optional, default = 8.8.8.8)\n"
         "* [9, 10]  -r 0.0.0.0  - routing address         (optional, default = 0.0.0.0)\n"
         "* [11]     0           - routing address mask    (optional, default = 0)\n"
-        "* [12, 13] -i wlan0    - physical network interface (opt., default = eth0)\n*\n";
+        "* [12, 13] -i wlan0    - physical network interface (opt., default = eth0)\n"
+        "* [14, 15] -w 4        - worker threads count (opt., default = CPU cores)\n"
+        "* [16]     -q          - multi-queue TUN interfaces (opt., default = off)\n"
+        "* [17]     -g          - TUN vnet header and TSO offloads (opt., default = off)\n"
+        "* [18, 19] -n netlink  - network backend, netlink or shell (opt., default = netlink)\n"
+        "* [20, 21] -p 4        - interfaces created in advance (opt., default = 4)\n"
+        "* [22]     -s          - one shared TUN interface for all clients (opt., default = off)\n"
+        "* [23, 24] -e 9100     - metrics endpoint port on 127.0.0.1 (opt., default = off)\n"
+        "* [25, 26] -c 20000    - session cache size, 0 - off (opt., default = 20000)\n"
+        "* [27, 28] -k 3600     - session ticket key rotation, s, 0 - off (opt., default = 3600)\n"
+        "* [29, 30] -x auto     - cipher policy: auto, aes-gcm, chacha20 or default (opt., default = auto)\n"
+        "* [31, 32] -o 4500     - ESP-in-UDP port of the kernel data path (opt., default = off)\n"
+        "* [33, 34] -u epoll    - I/O engine of the workers, epoll or io_uring (opt., default = epoll)\n"
+        "* [35]     -t          - path MTU discovery, MTU of every tunnel (opt., default = off)\n"
+        "* [36, 37] -f acl.txt  - access rules for packets of the clients (opt., default = off)\n"
+        "* [38, 39] -b 10m      - rate limit of the clients in bit/s, HOST=RATE for one client (opt., default = off)\n"
+        "* [40, 41] -l vpn.sock  - handoff socket, a new server takes over the clients (opt., default = off)\n"
+        "* [42, 43] -y vpn.conf  - configuration file, reloaded by the control API (opt., default = none)\n"
+        "* [44, 45] -j ctl.sock  - control socket: reload, set, sessions, kick, drain (opt., default = off)\n"
+        "* [46, 47] -z 300       - seconds without packets until a tunnel hibernates (opt., default = never)\n"
+        "* [48, 49] -v 10:120    - keepalive interval, s, grows up to MAX behind NAT (opt., default = 10)\n"
+        "* [50, 51] -h 3600      - seconds a gone client keeps its address lease (opt., default = always)\n"
+        "* [52, 53] -C 2         - crypto threads for heavy tunnels (opt., default = off)\n"
+        "* [54, 55] -6 fd00:1::  - virtual IPv6 network, clients are dual-stack (opt., default = off)\n"
+        "* [56]     48           - virtual IPv6 network prefix length, /64 per client up to /63\n*\n";
         return EXIT_FAILURE;
     }
 
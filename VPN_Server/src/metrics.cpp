@@ -0,0 +1,524 @@
+#include "metrics.hpp"
+
+const size_t Histogram::SUB_BUCKETS;
+const size_t Histogram::MAGNITUDES;
+const size_t Histogram::BUCKETS;
+const int    Metrics::MAX_SSL_ERROR;
+const size_t MetricsServer::MAX_REQUEST;
+const size_t MetricsServer::MAX_CONNECTIONS;
+
+Histogram::Histogram() : count(0), sum(0) {
+    for(size_t i = 0; i < BUCKETS; ++i)
+        counts[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::record(uint64_t micros) {
+    addCounter(counts[bucketIndex(micros)], 1);
+    addCounter(count, 1);
+    addCounter(sum, micros);
+}
+
+void Histogram::record(std::chrono::steady_clock::duration duration) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+    record(micros.count() > 0 ? static_cast<uint64_t>(micros.count()) : 0);
+}
+
+/**
+ * @brief addTo - adds the values to merged buckets
+ * @param buckets - BUCKETS counters
+ */
+void Histogram::addTo(std::vector<uint64_t>& buckets,
+                      uint64_t& totalCount, uint64_t& totalSum) const {
+    buckets.resize(BUCKETS, 0);
+    for(size_t i = 0; i < BUCKETS; ++i)
+        buckets[i] += counts[i].load(std::memory_order_relaxed);
+    totalCount += count.load(std::memory_order_relaxed);
+    totalSum   += sum.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief bucketIndex - values below SUB_BUCKETS have own buckets,
+ * larger values are found by their highest bit and the next bits
+ */
+size_t Histogram::bucketIndex(uint64_t micros) {
+    if(micros < SUB_BUCKETS)
+        return micros;
+
+    unsigned magnitude = 63 - __builtin_clzll(micros);
+    size_t index = (magnitude - 2) * SUB_BUCKETS +
+                   ((micros >> (magnitude - 3)) & (SUB_BUCKETS - 1));
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+/**
+ * @brief upperBound
+ * @return the first value after the bucket
+ */
+uint64_t Histogram::upperBound(size_t index) {
+    if(index < SUB_BUCKETS)
+        return index + 1;
+
+    size_t magnitude = index / SUB_BUCKETS + 2;
+    size_t sub       = index % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub + 1) << (magnitude - 3);
+}
+
+/**
+ * @brief percentile
+ * @param fraction - e.g. 0.99
+ * @return upper bound of the bucket with the percentile, 0 if empty
+ */
+uint64_t Histogram::percentile(const std::vector<uint64_t>& buckets,
+                               double fraction) {
+    uint64_t total = 0;
+    for(uint64_t value : buckets)
+        total += value;
+    if(total == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(fraction * total);
+    if(rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if(seen >= rank)
+            return upperBound(i);
+    }
+    return upperBound(buckets.size() - 1);
+}
+
+TunnelMetrics::TunnelMetrics()
+    : rxPackets(0), rxBytes(0), txPackets(0), txBytes(0),
+      encryptNanos(0), decryptNanos(0), tunWriteErrors(0),
+      keepalivesSent(0), sslErrors(0), rxMalformed(0), rxSpoofed(0),
+      rxDenied(0), rxRateLimited(0), txQueued(0), txQueueDrops(0) { }
+
+/**
+ * @brief addTo - adds counters to 'total', called with
+ * the metrics lock held (so 'total' has a single writer)
+ */
+void TunnelMetrics::addTo(TunnelMetrics& total) const {
+    addCounter(total.rxPackets,      rxPackets.load(std::memory_order_relaxed));
+    addCounter(total.rxBytes,        rxBytes.load(std::memory_order_relaxed));
+    addCounter(total.txPackets,      txPackets.load(std::memory_order_relaxed));
+    addCounter(total.txBytes,        txBytes.load(std::memory_order_relaxed));
+    addCounter(total.encryptNanos,   encryptNanos.load(std::memory_order_relaxed));
+    addCounter(total.decryptNanos,   decryptNanos.load(std::memory_order_relaxed));
+    addCounter(total.tunWriteErrors, tunWriteErrors.load(std::memory_order_relaxed));
+    addCounter(total.keepalivesSent, keepalivesSent.load(std::memory_order_relaxed));
+    addCounter(total.sslErrors,      sslErrors.load(std::memory_order_relaxed));
+    addCounter(total.rxMalformed,    rxMalformed.load(std::memory_order_relaxed));
+    addCounter(total.rxSpoofed,      rxSpoofed.load(std::memory_order_relaxed));
+    addCounter(total.rxDenied,       rxDenied.load(std::memory_order_relaxed));
+    addCounter(total.rxRateLimited,  rxRateLimited.load(std::memory_order_relaxed));
+    addCounter(total.txQueued,       txQueued.load(std::memory_order_relaxed));
+    addCounter(total.txQueueDrops,   txQueueDrops.load(std::memory_order_relaxed));
+}
+
+Metrics::Metrics()
+    : fullHandshakes(0),
+      resumedHandshakes(0) {
+    for(int i = 0; i <= MAX_SSL_ERROR; ++i)
+        sslErrorCodes[i].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief instance
+ * @return metrics of the application
+ */
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::addTunnel(TunnelMetrics* tunnel) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tunnels.push_back(tunnel);
+}
+
+/**
+ * @brief removeTunnel - the tunnel is closed,
+ * its counters are kept in the totals
+ */
+void Metrics::removeTunnel(TunnelMetrics* tunnel) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t i = 0; i < tunnels.size(); ++i) {
+        if(tunnels[i] == tunnel) {
+            tunnel->addTo(closed);
+            tunnels[i] = tunnels.back();
+            tunnels.pop_back();
+            return;
+        }
+    }
+}
+
+void Metrics::addWorker(WorkerMetrics* worker) {
+    std::lock_guard<std::mutex> lock(mutex);
+    workers.push_back(worker);
+}
+
+void Metrics::removeWorker(WorkerMetrics* worker) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t i = 0; i < workers.size(); ++i) {
+        if(workers[i] == worker) {
+            workers.erase(workers.begin() + i);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief addGauge - 'reader' is called from the endpoint thread
+ * when the metrics are rendered, until 'clearGauges'
+ */
+void Metrics::addGauge(const std::string& name, const std::string& help,
+                       const GaugeReader& reader) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Gauge gauge;
+    gauge.name   = name;
+    gauge.type   = "gauge";
+    gauge.help   = help;
+    gauge.reader = reader;
+    gauges.push_back(gauge);
+}
+
+/**
+ * @brief addCounterReader - like 'addGauge' for a counter
+ * kept by its owner (e.g. hits of the session cache)
+ */
+void Metrics::addCounterReader(const std::string& name, const std::string& help,
+                               const GaugeReader& reader) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Gauge counter;
+    counter.name   = name;
+    counter.type   = "counter";
+    counter.help   = help;
+    counter.reader = reader;
+    gauges.push_back(counter);
+}
+
+void Metrics::clearGauges() {
+    std::lock_guard<std::mutex> lock(mutex);
+    gauges.clear();
+}
+
+/**
+ * @brief countSslError - counts an error code of wolfSSL_get_error
+ */
+void Metrics::countSslError(int code) {
+    int index = -code;
+    if(index <= 0 || index > MAX_SSL_ERROR)
+        index = MAX_SSL_ERROR;
+    sslErrorCodes[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief countHandshake - counts an established tunnel
+ * @param resumed - the session was resumed by ID or ticket
+ */
+void Metrics::countHandshake(bool resumed) {
+    (resumed ? resumedHandshakes : fullHandshakes).fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief render
+ * @return all metrics in Prometheus text format
+ */
+std::string Metrics::render() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+
+    auto family = [&out](const std::string& name, const char* type,
+                         const std::string& help) {
+        out << "# HELP " << name << ' ' << help << '\n'
+            << "# TYPE " << name << ' ' << type << '\n';
+    };
+    auto labels = [](const TunnelMetrics* tunnel) {
+        return "tunnel=\"" + tunnel->tunnel + "\",client=\"" + tunnel->client + "\"";
+    };
+
+    TunnelMetrics total;
+    closed.addTo(total);
+    for(const TunnelMetrics* tunnel : tunnels)
+        tunnel->addTo(total);
+
+    family("vpn_packets_total", "counter", "Packets forwarded by all tunnels.");
+    out << "vpn_packets_total{direction=\"rx\"} " << total.rxPackets << '\n'
+        << "vpn_packets_total{direction=\"tx\"} " << total.txPackets << '\n';
+    family("vpn_bytes_total", "counter", "Bytes forwarded by all tunnels.");
+    out << "vpn_bytes_total{direction=\"rx\"} " << total.rxBytes << '\n'
+        << "vpn_bytes_total{direction=\"tx\"} " << total.txBytes << '\n';
+    family("vpn_tun_write_errors_total", "counter", "Failed writes to TUN interfaces.");
+    out << "vpn_tun_write_errors_total " << total.tunWriteErrors << '\n';
+    family("vpn_keepalives_sent_total", "counter", "Keepalive messages sent.");
+    out << "vpn_keepalives_sent_total " << total.keepalivesSent << '\n';
+    family("vpn_rx_dropped_total", "counter",
+           "Packets of clients dropped by the packet filter or the rate limit.");
+    out << "vpn_rx_dropped_total{reason=\"malformed\"} " << total.rxMalformed << '\n'
+        << "vpn_rx_dropped_total{reason=\"spoofed\"} " << total.rxSpoofed << '\n'
+        << "vpn_rx_dropped_total{reason=\"denied\"} " << total.rxDenied << '\n'
+        << "vpn_rx_dropped_total{reason=\"rate_limit\"} " << total.rxRateLimited << '\n';
+    family("vpn_tx_queued_packets", "gauge",
+           "Packets waiting in the egress queues of open tunnels.");
+    out << "vpn_tx_queued_packets " << total.txQueued << '\n';
+    family("vpn_tx_queue_dropped_total", "counter",
+           "Packets for clients dropped because their egress queue was full.");
+    out << "vpn_tx_queue_dropped_total " << total.txQueueDrops << '\n';
+
+    family("vpn_ssl_errors_total", "counter", "wolfSSL errors by code.");
+    for(int i = 1; i <= MAX_SSL_ERROR; ++i) {
+        uint64_t errors = sslErrorCodes[i].load(std::memory_order_relaxed);
+        if(errors == 0)
+            continue;
+        out << "vpn_ssl_errors_total{code=\""
+            << (i == MAX_SSL_ERROR ? std::string("other") : std::to_string(-i))
+            << "\"} " << errors << '\n';
+    }
+
+    family("vpn_handshakes_total", "counter", "Established tunnels by handshake type.");
+    out << "vpn_handshakes_total{type=\"full\"} " << fullHandshakes << '\n'
+        << "vpn_handshakes_total{type=\"resumed\"} " << resumedHandshakes << '\n';
+
+    family("vpn_tunnel_packets_total", "counter", "Packets forwarded by the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_packets_total{" << labels(tunnel) << ",direction=\"rx\"} "
+            << tunnel->rxPackets << '\n'
+            << "vpn_tunnel_packets_total{" << labels(tunnel) << ",direction=\"tx\"} "
+            << tunnel->txPackets << '\n';
+    }
+    family("vpn_tunnel_bytes_total", "counter", "Bytes forwarded by the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_bytes_total{" << labels(tunnel) << ",direction=\"rx\"} "
+            << tunnel->rxBytes << '\n'
+            << "vpn_tunnel_bytes_total{" << labels(tunnel) << ",direction=\"tx\"} "
+            << tunnel->txBytes << '\n';
+    }
+    family("vpn_tunnel_crypto_seconds_total", "counter",
+           "Time spent in wolfSSL to encrypt and decrypt records.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_crypto_seconds_total{" << labels(tunnel)
+            << ",operation=\"encrypt\"} " << tunnel->encryptNanos / 1e9 << '\n'
+            << "vpn_tunnel_crypto_seconds_total{" << labels(tunnel)
+            << ",operation=\"decrypt\"} " << tunnel->decryptNanos / 1e9 << '\n';
+    }
+    family("vpn_tunnel_tun_write_errors_total", "counter",
+           "Failed writes to the TUN interface of the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_tun_write_errors_total{" << labels(tunnel) << "} "
+            << tunnel->tunWriteErrors << '\n';
+    }
+    family("vpn_tunnel_ssl_errors_total", "counter", "wolfSSL errors of the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_ssl_errors_total{" << labels(tunnel) << "} "
+            << tunnel->sslErrors << '\n';
+    }
+    family("vpn_tunnel_keepalives_sent_total", "counter",
+           "Keepalive messages sent by the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_keepalives_sent_total{" << labels(tunnel) << "} "
+            << tunnel->keepalivesSent << '\n';
+    }
+
+    family("vpn_tunnel_rx_dropped_total", "counter",
+           "Packets of the client dropped by the packet filter.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_rx_dropped_total{" << labels(tunnel)
+            << ",reason=\"malformed\"} " << tunnel->rxMalformed << '\n'
+            << "vpn_tunnel_rx_dropped_total{" << labels(tunnel)
+            << ",reason=\"spoofed\"} " << tunnel->rxSpoofed << '\n'
+            << "vpn_tunnel_rx_dropped_total{" << labels(tunnel)
+            << ",reason=\"denied\"} " << tunnel->rxDenied << '\n'
+            << "vpn_tunnel_rx_dropped_total{" << labels(tunnel)
+            << ",reason=\"rate_limit\"} " << tunnel->rxRateLimited << '\n';
+    }
+    family("vpn_tunnel_tx_queued_packets", "gauge",
+           "Packets waiting in the egress queue of the tunnel.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_tx_queued_packets{" << labels(tunnel) << "} "
+            << tunnel->txQueued << '\n';
+    }
+    family("vpn_tunnel_tx_queue_dropped_total", "counter",
+           "Packets for the client dropped because the egress queue was full.");
+    for(const TunnelMetrics* tunnel : tunnels) {
+        out << "vpn_tunnel_tx_queue_dropped_total{" << labels(tunnel) << "} "
+            << tunnel->txQueueDrops << '\n';
+    }
+
+    for(const Gauge& gauge : gauges) {
+        family(gauge.name, gauge.type, gauge.help);
+        out << gauge.name << ' ' << gauge.reader() << '\n';
+    }
+
+    renderHistogram(out, "vpn_handshake_duration_seconds",
+                    "Time from the first datagram to the established tunnel.",
+                    &WorkerMetrics::handshake);
+    renderHistogram(out, "vpn_forward_duration_seconds",
+                    "Time from reading a packet from TUN to queueing its record.",
+                    &WorkerMetrics::forward);
+    renderHistogram(out, "vpn_tx_queue_delay_seconds",
+                    "Time records wait in the send queue of a listener.",
+                    &WorkerMetrics::txQueueDelay);
+    return out.str();
+}
+
+/**
+ * @brief renderHistogram - merges the histogram of all workers,
+ * buckets are written for every power of two microseconds
+ */
+void Metrics::renderHistogram(std::ostringstream& out, const std::string& name,
+                              const std::string& help,
+                              Histogram WorkerMetrics::* histogram) {
+    std::vector<uint64_t> buckets(Histogram::BUCKETS, 0);
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    for(const WorkerMetrics* worker : workers)
+        (worker->*histogram).addTo(buckets, count, sum);
+
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << " histogram\n";
+
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < Histogram::BUCKETS; ++i) {
+        cumulative += buckets[i];
+        if((i + 1) % Histogram::SUB_BUCKETS != 0)
+            continue;
+        out << name << "_bucket{le=\"" << Histogram::upperBound(i) / 1e6 << "\"} "
+            << cumulative << '\n';
+    }
+    out << name << "_bucket{le=\"+Inf\"} " << count << '\n'
+        << name << "_sum " << sum / 1e6 << '\n'
+        << name << "_count " << count << '\n';
+}
+
+/**
+ * @brief MetricsServer constructor - listens on 127.0.0.1:port
+ */
+MetricsServer::MetricsServer(uint16_t port) : loop(nullptr) {
+    sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() + "Metrics socket error: " +
+                                 strerror(errno));
+    }
+
+    int reuse = 1;
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(sd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+       || listen(sd, MAX_CONNECTIONS) < 0) {
+        int error = errno;
+        close(sd);
+        throw std::runtime_error("Cannot listen on metrics port " +
+                                 std::to_string(port) + ": " + strerror(error));
+    }
+}
+
+MetricsServer::~MetricsServer() {
+    detach();
+    close(sd);
+}
+
+void MetricsServer::attach(EventLoop& loop) {
+    this->loop = &loop;
+    loop.addFd(sd, EPOLLIN, [this](uint32_t) { onAccept(); });
+}
+
+/**
+ * @brief detach - closes connections and stops watching the socket
+ */
+void MetricsServer::detach() {
+    if(loop == nullptr)
+        return;
+
+    while(!connections.empty())
+        closeClient(connections.begin()->first);
+    loop->removeFd(sd);
+    loop = nullptr;
+}
+
+/**
+ * @brief respond - builds the response to an HTTP request
+ */
+std::string MetricsServer::respond(const std::string& request) {
+    std::string status = "404 Not Found";
+    std::string body   = "Not Found\n";
+
+    if(request.compare(0, 13, "GET /metrics ") == 0 ||
+       request.compare(0, 13, "GET /metrics?") == 0) {
+        status = "200 OK";
+        body   = Metrics::instance().render();
+    }
+
+    return "HTTP/1.0 " + status + "\r\n"
+           "Content-Type: text/plain; version=0.0.4\r\n"
+           "Content-Length: " + std::to_string(body.length()) + "\r\n"
+           "Connection: close\r\n\r\n" + body;
+}
+
+void MetricsServer::onAccept() {
+    int fd = -1;
+    while((fd = accept4(sd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if(connections.size() >= MAX_CONNECTIONS) {
+            close(fd);
+            continue;
+        }
+        connections[fd].sent = 0;
+        loop->addFd(fd, EPOLLIN, [this, fd](uint32_t events) {
+            onClient(fd, events);
+        });
+    }
+}
+
+/**
+ * @brief onClient - reads the request until the empty line,
+ * then writes the response and closes the connection
+ */
+void MetricsServer::onClient(int fd, uint32_t events) {
+    Connection& connection = connections[fd];
+
+    if(connection.response.empty()) {
+        char buffer[1024];
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if(length <= 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            closeClient(fd);
+            return;
+        }
+
+        connection.request.append(buffer, length);
+        if(connection.request.find("\r\n\r\n") == std::string::npos &&
+           connection.request.find("\n\n") == std::string::npos &&
+           connection.request.length() < MAX_REQUEST)
+            return; // wait for the rest of the request
+
+        connection.response = respond(connection.request);
+        loop->modifyFd(fd, EPOLLOUT);
+    }
+
+    while(connection.sent < connection.response.length()) {
+        ssize_t sent = write(fd, connection.response.data() + connection.sent,
+                             connection.response.length() - connection.sent);
+        if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return; // wait for EPOLLOUT
+        if(sent <= 0) {
+            closeClient(fd);
+            return;
+        }
+        connection.sent += sent;
+    }
+    closeClient(fd);
+}
+
+void MetricsServer::closeClient(int fd) {
+    loop->removeFd(fd);
+    close(fd);
+    connections.erase(fd);
+}
@@ -0,0 +1,210 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "event_loop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * @brief addCounter - increments a counter of a single writer
+ * without a locked instruction, readers may be on any thread
+ */
+inline void addCounter(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+/**
+ * @brief The Histogram class<br>
+ * Log-linear histogram of durations in microseconds: every power<br>
+ * of two is split into SUB_BUCKETS buckets, so the relative error<br>
+ * is below 12.5% from 1 us up to days. Updated by one thread<br>
+ * (e.g. its worker), read by the metrics endpoint.<br>
+ */
+class Histogram {
+public:
+    static const size_t SUB_BUCKETS = 8;
+    static const size_t MAGNITUDES  = 38; // up to 2^40 us
+    static const size_t BUCKETS     = SUB_BUCKETS * MAGNITUDES;
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum; // us
+
+public:
+    /* Forbid creating default copy ctor: */
+    Histogram(Histogram& that) = delete;
+
+    explicit Histogram();
+
+    void record(uint64_t micros);
+    void record(std::chrono::steady_clock::duration duration);
+    void addTo(std::vector<uint64_t>& buckets,
+               uint64_t& totalCount, uint64_t& totalSum) const;
+
+    static size_t bucketIndex(uint64_t micros);
+    static uint64_t upperBound(size_t index);
+    static uint64_t percentile(const std::vector<uint64_t>& buckets,
+                               double fraction);
+};
+
+/**
+ * @brief The TunnelMetrics struct<br>
+ * Counters of one tunnel, updated by its worker only.<br>
+ * "rx" is traffic from the client, "tx" traffic to the client.<br>
+ */
+struct TunnelMetrics {
+    std::string           tunnel;
+    std::string           client;
+    std::atomic<uint64_t> rxPackets;
+    std::atomic<uint64_t> rxBytes;
+    std::atomic<uint64_t> txPackets;
+    std::atomic<uint64_t> txBytes;
+    std::atomic<uint64_t> encryptNanos;
+    std::atomic<uint64_t> decryptNanos;
+    std::atomic<uint64_t> tunWriteErrors;
+    std::atomic<uint64_t> keepalivesSent;
+    std::atomic<uint64_t> sslErrors;
+    std::atomic<uint64_t> rxMalformed; // dropped by PacketFilter
+    std::atomic<uint64_t> rxSpoofed;
+    std::atomic<uint64_t> rxDenied;
+    std::atomic<uint64_t> rxRateLimited; // over the rate limit of the client
+    std::atomic<uint64_t> txQueued;      // packets in the egress queue (gauge)
+    std::atomic<uint64_t> txQueueDrops;  // egress queue was full
+
+    explicit TunnelMetrics();
+    void addTo(TunnelMetrics& total) const;
+};
+
+/**
+ * @brief The WorkerMetrics struct<br>
+ * Latency histograms of the tunnels of one worker.<br>
+ */
+struct WorkerMetrics {
+    Histogram handshake;    // first datagram -> established
+    Histogram forward;      // TUN read -> record queued to the socket
+    Histogram txQueueDelay; // record queued -> sendmmsg(2)
+};
+
+/**
+ * @brief The Metrics class<br>
+ * Registry of server metrics, rendered in Prometheus text format.<br>
+ * Tunnels and workers register their metrics for their lifetime,<br>
+ * counters of closed tunnels stay in the totals. Gauges are read<br>
+ * from their owners when the metrics are rendered.<br>
+ */
+class Metrics {
+public:
+    typedef std::function<double()> GaugeReader;
+
+    static const int MAX_SSL_ERROR = 512; // wolfSSL error codes are negative
+
+private:
+    /**
+     * @brief The Gauge struct - name, type, help text and reader
+     * of a value owned by another object (gauge or counter)
+     */
+    struct Gauge {
+        std::string name;
+        const char* type;
+        std::string help;
+        GaugeReader reader;
+    };
+
+    std::mutex                  mutex;
+    std::vector<TunnelMetrics*> tunnels;
+    std::vector<WorkerMetrics*> workers;
+    std::vector<Gauge>          gauges;
+    TunnelMetrics               closed; // totals of closed tunnels
+    std::atomic<uint64_t>       sslErrorCodes[MAX_SSL_ERROR + 1]; // last - others
+    std::atomic<uint64_t>       fullHandshakes;
+    std::atomic<uint64_t>       resumedHandshakes;
+
+public:
+    /* Forbid creating default copy ctor: */
+    Metrics(Metrics& that) = delete;
+
+    explicit Metrics();
+
+    static Metrics& instance();
+
+    void addTunnel(TunnelMetrics* tunnel);
+    void removeTunnel(TunnelMetrics* tunnel);
+    void addWorker(WorkerMetrics* worker);
+    void removeWorker(WorkerMetrics* worker);
+    void addGauge(const std::string& name, const std::string& help,
+                  const GaugeReader& reader);
+    void addCounterReader(const std::string& name, const std::string& help,
+                          const GaugeReader& reader);
+    void clearGauges();
+    void countSslError(int code);
+    void countHandshake(bool resumed);
+    std::string render();
+
+private:
+    void renderHistogram(std::ostringstream& out, const std::string& name,
+                         const std::string& help,
+                         Histogram WorkerMetrics::* histogram);
+};
+
+/**
+ * @brief The MetricsServer class<br>
+ * Minimal HTTP/1.0 endpoint: GET /metrics returns 'Metrics::render'.<br>
+ * Listens on the loopback interface only and is served by an event loop.<br>
+ */
+class MetricsServer {
+public:
+    static const size_t MAX_REQUEST     = 4096;
+    static const size_t MAX_CONNECTIONS = 16;
+
+private:
+    /**
+     * @brief The Connection struct - request being read
+     * and response being written
+     */
+    struct Connection {
+        std::string request;
+        std::string response;
+        size_t      sent;
+    };
+
+    int                                  sd;
+    EventLoop*                           loop;
+    std::unordered_map<int, Connection>  connections;
+
+public:
+    /* Forbid creating default copy ctor: */
+    MetricsServer(MetricsServer& that) = delete;
+
+    explicit MetricsServer(uint16_t port);
+    ~MetricsServer();
+
+    void attach(EventLoop& loop);
+    void detach();
+
+    static std::string respond(const std::string& request);
+
+private:
+    void onAccept();
+    void onClient(int fd, uint32_t events);
+    void closeClient(int fd);
+};
+
+#endif // METRICS_HPP
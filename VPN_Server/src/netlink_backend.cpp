@@ -0,0 +1,665 @@
+#include "netlink_backend.hpp"
+#include "tunnel_mgr.hpp"
+
+const char* const NetlinkNetworkBackend::NAT_TABLE = "vpn_server";
+const char* const NetlinkNetworkBackend::NAT_CHAIN = "postrouting";
+
+namespace {
+
+const int NETLINK_TIMEOUT = 2; // s to wait for acknowledgements
+
+std::string errorString(int error) {
+    return strerror(error < 0 ? -error : error);
+}
+
+/**
+ * @brief parseNetwork6 - parses "address/prefix" of an IPv6 network
+ * @return false if the address is not IPv6
+ */
+bool parseNetwork6(const std::string& network, in6_addr& address, int& prefix) {
+    size_t slashPos = network.find('/');
+    prefix = slashPos == std::string::npos ? 128
+             : atoi(network.substr(slashPos + 1).c_str());
+    if(prefix < 0 || prefix > 128)
+        return false;
+    return inet_pton(AF_INET6, network.substr(0, slashPos).c_str(), &address) == 1;
+}
+
+} // namespace
+
+NetlinkMessage::NetlinkMessage() : current(0) { }
+
+/**
+ * @brief begin - starts a new message of the request
+ * @param header - family specific header (e.g. ifinfomsg)
+ */
+void NetlinkMessage::begin(uint16_t type, uint16_t flags,
+                           const void* header, size_t length) {
+    current = buffer.size();
+
+    nlmsghdr nlh;
+    memset(&nlh, 0, sizeof(nlh));
+    nlh.nlmsg_type  = type;
+    nlh.nlmsg_flags = flags;
+    append(&nlh, sizeof(nlh));
+    append(header, length);
+}
+
+void NetlinkMessage::put(uint16_t type, const void* data, size_t length) {
+    nlattr attr;
+    attr.nla_type = type;
+    attr.nla_len  = NLA_HDRLEN + length;
+    append(&attr, sizeof(attr));
+    append(data, length);
+}
+
+void NetlinkMessage::putU32(uint16_t type, uint32_t value) {
+    put(type, &value, sizeof(value));
+}
+
+void NetlinkMessage::putBe32(uint16_t type, uint32_t value) {
+    putU32(type, htonl(value));
+}
+
+void NetlinkMessage::putString(uint16_t type, const std::string& value) {
+    put(type, value.c_str(), value.size() + 1);
+}
+
+/**
+ * @brief beginNested - starts attribute with nested attributes
+ * @return offset to pass to 'endNested'
+ */
+size_t NetlinkMessage::beginNested(uint16_t type) {
+    size_t offset = buffer.size();
+    put(type | NLA_F_NESTED, nullptr, 0);
+    return offset;
+}
+
+void NetlinkMessage::endNested(size_t offset) {
+    nlattr* attr  = reinterpret_cast<nlattr*>(&buffer[offset]);
+    attr->nla_len = buffer.size() - offset;
+}
+
+char* NetlinkMessage::data() {
+    return buffer.data();
+}
+
+size_t NetlinkMessage::size() const {
+    return buffer.size();
+}
+
+void NetlinkMessage::append(const void* data, size_t length) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + NLMSG_ALIGN(length), 0);
+    if(length != 0)
+        memcpy(&buffer[offset], data, length);
+
+    nlmsghdr* nlh  = reinterpret_cast<nlmsghdr*>(&buffer[current]);
+    nlh->nlmsg_len = buffer.size() - current;
+}
+
+NetlinkSocket::NetlinkSocket(int protocol) : sequence(0) {
+    sd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+    if(sd < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot create netlink socket: " +
+                                 strerror(errno));
+    }
+
+    timeval timeout;
+    timeout.tv_sec  = NETLINK_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if(bind(sd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        int error = errno;
+        close(sd);
+        throw std::runtime_error(std::string() +
+                                 "Cannot bind netlink socket: " +
+                                 strerror(error));
+    }
+}
+
+NetlinkSocket::~NetlinkSocket() {
+    close(sd);
+}
+
+/**
+ * @brief request - sends all messages of 'message' and waits
+ * for acknowledgements of the ones with NLM_F_ACK flag
+ * @return 0 or negative errno of the first failed message
+ */
+int NetlinkSocket::request(NetlinkMessage& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t first = sequence + 1;
+    int      acks  = 0;
+
+    for(size_t offset = 0; offset < message.size(); ) {
+        nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(message.data() + offset);
+        nlh->nlmsg_seq = ++sequence;
+        if(nlh->nlmsg_flags & NLM_F_ACK)
+            ++acks;
+        offset += NLMSG_ALIGN(nlh->nlmsg_len);
+    }
+
+    sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if(sendto(sd, message.data(), message.size(), 0,
+              (sockaddr *)&kernel, sizeof(kernel)) < 0)
+        return -errno;
+
+    char reply[8192];
+    while(acks > 0) {
+        ssize_t length = recv(sd, reply, sizeof(reply), 0);
+        if(length < 0) {
+            if(errno == EINTR)
+                continue;
+            return -errno;
+        }
+
+        for(nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(reply);
+            NLMSG_OK(nlh, (size_t)length);
+            nlh = NLMSG_NEXT(nlh, length)) {
+            // replies to previous (failed) requests
+            if(nlh->nlmsg_seq < first || nlh->nlmsg_seq > sequence)
+                continue;
+            if(nlh->nlmsg_type != NLMSG_ERROR)
+                continue;
+
+            nlmsgerr* error = static_cast<nlmsgerr*>(NLMSG_DATA(nlh));
+            if(error->error != 0)
+                return error->error;
+            --acks;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief NetlinkNetworkBackend constructor
+ * Opens rtnetlink and nfnetlink sockets, throws if netlink
+ * is not available.
+ */
+NetlinkNetworkBackend::NetlinkNetworkBackend()
+    : route(NETLINK_ROUTE),
+      netfilter(NETLINK_NETFILTER) { }
+
+/**
+ * @brief createTunnel - creates persistent TUN interface,
+ * assigns point-to-point addresses and brings it up
+ */
+void NetlinkNetworkBackend::createTunnel(const std::string& tunStr,
+                                         const std::string& serverTunAddr,
+                                         const std::string& clientTunAddr,
+                                         bool multiQueue) {
+    unsigned index = createDevice(tunStr, multiQueue);
+    try {
+        addAddress(index, inet_addr(serverTunAddr.c_str()),
+                   inet_addr(clientTunAddr.c_str()));
+        setLinkUp(index, true);
+    } catch (const std::exception&) {
+        deleteLink(tunStr);
+        throw;
+    }
+    TunnelManager::log("[" + tunStr + "] " + serverTunAddr +
+                       " peer " + clientTunAddr + " is up");
+}
+
+/**
+ * @brief createSharedTunnel - creates persistent TUN interface
+ * for all clients: the server address with the prefix of the virtual
+ * network, so the kernel routes the whole network to the interface
+ */
+void NetlinkNetworkBackend::createSharedTunnel(const std::string& tunStr,
+                                               const std::string& serverTunAddr,
+                                               uint32_t prefixLength,
+                                               bool multiQueue) {
+    unsigned index = createDevice(tunStr, multiQueue);
+    try {
+        in_addr_t local = inet_addr(serverTunAddr.c_str());
+        addAddress(index, local, local, prefixLength);
+        setLinkUp(index, true);
+    } catch (const std::exception&) {
+        deleteLink(tunStr);
+        throw;
+    }
+    TunnelManager::log("[" + tunStr + "] " + serverTunAddr + "/" +
+                       std::to_string(prefixLength) + " is up");
+}
+
+/**
+ * @brief createDevice - creates persistent TUN interface
+ * @return index of the interface
+ */
+unsigned NetlinkNetworkBackend::createDevice(const std::string& tunStr,
+                                             bool multiQueue) {
+    int interface = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if(interface < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot open /dev/net/tun: " + strerror(errno));
+    }
+
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+    if(multiQueue)
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+    strncpy(ifr.ifr_name, tunStr.c_str(), sizeof(ifr.ifr_name) - 1);
+
+    // the interface outlives the descriptor, like 'ip tuntap add':
+    if(ioctl(interface, TUNSETIFF, &ifr) < 0
+       || ioctl(interface, TUNSETPERSIST, 1) < 0) {
+        int error = errno;
+        close(interface);
+        throw std::runtime_error("Cannot create " + tunStr + ": " +
+                                 strerror(error));
+    }
+    close(interface);
+
+    unsigned index = if_nametoindex(tunStr.c_str());
+    if(index == 0) {
+        deleteLink(tunStr);
+        throw std::runtime_error("Cannot find " + tunStr);
+    }
+    return index;
+}
+
+void NetlinkNetworkBackend::deleteLink(const std::string& name) {
+    unsigned index = if_nametoindex(name.c_str());
+    if(index == 0)
+        return; // already gone
+
+    ifinfomsg ifi;
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index  = index;
+
+    NetlinkMessage message;
+    message.begin(RTM_DELLINK, NLM_F_REQUEST | NLM_F_ACK, &ifi, sizeof(ifi));
+    if(int error = route.request(message)) {
+        TunnelManager::log("Cannot delete " + name + ": " +
+                           errorString(error), std::cerr);
+    }
+}
+
+/**
+ * @brief resetLink - takes the interface down and up again,
+ * which drops routes cache and queued packets of the previous client
+ * @return false if the interface is gone or cannot be reset
+ */
+bool NetlinkNetworkBackend::resetLink(const std::string& name) {
+    unsigned index = if_nametoindex(name.c_str());
+    if(index == 0)
+        return false;
+
+    try {
+        setLinkUp(index, false);
+        setLinkUp(index, true);
+    } catch (const std::exception& e) {
+        TunnelManager::log("[" + name + "] " + e.what(), std::cerr);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief changePeer - replaces the client address of the interface
+ * @return false if the interface is gone or cannot be changed
+ */
+bool NetlinkNetworkBackend::changePeer(const std::string& name,
+                                       const std::string& serverTunAddr,
+                                       const std::string& oldClientAddr,
+                                       const std::string& newClientAddr) {
+    unsigned index = if_nametoindex(name.c_str());
+    if(index == 0)
+        return false;
+
+    in_addr_t local = inet_addr(serverTunAddr.c_str());
+    try {
+        removeAddress(index, local, inet_addr(oldClientAddr.c_str()));
+        addAddress(index, local, inet_addr(newClientAddr.c_str()));
+    } catch (const std::exception& e) {
+        TunnelManager::log("[" + name + "] " + e.what(), std::cerr);
+        return false;
+    }
+    return true;
+}
+
+void NetlinkNetworkBackend::setForwarding(bool enable) {
+    int fd = open("/proc/sys/net/ipv4/ip_forward", O_WRONLY | O_CLOEXEC);
+    if(fd < 0 || write(fd, enable ? "1" : "0", 1) != 1) {
+        TunnelManager::log(std::string() + "Cannot change IP forwarding: " +
+                           strerror(errno), std::cerr);
+    }
+    if(fd >= 0)
+        close(fd);
+}
+
+void NetlinkNetworkBackend::setForwarding6(bool enable) {
+    int fd = open("/proc/sys/net/ipv6/conf/all/forwarding", O_WRONLY | O_CLOEXEC);
+    if(fd < 0 || write(fd, enable ? "1" : "0", 1) != 1) {
+        TunnelManager::log(std::string() + "Cannot change IPv6 forwarding: " +
+                           strerror(errno), std::cerr);
+    }
+    if(fd >= 0)
+        close(fd);
+}
+
+/**
+ * @brief addRoute6 - routes the IPv6 prefix to the interface
+ * @param prefix - e.g. "fd00:1:0:1::/64"
+ */
+void NetlinkNetworkBackend::addRoute6(const std::string& iface,
+                                      const std::string& prefix) {
+    int error = changeRoute6(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE,
+                             iface, prefix);
+    if(error != 0) {
+        TunnelManager::log("Cannot add route " + prefix + " via " + iface +
+                           ": " + errorString(error), std::cerr);
+    }
+}
+
+/**
+ * @brief removeRoute6 - removes the route of the prefix,
+ * it's already gone if the interface was deleted
+ */
+void NetlinkNetworkBackend::removeRoute6(const std::string& iface,
+                                         const std::string& prefix) {
+    int error = changeRoute6(RTM_DELROUTE, 0, iface, prefix);
+    if(error != 0 && error != -ESRCH && error != -ENODEV) {
+        TunnelManager::log("Cannot remove route " + prefix + " via " + iface +
+                           ": " + errorString(error), std::cerr);
+    }
+}
+
+/**
+ * @brief addMasquerade - creates own nf_tables table with
+ * 'ip saddr network oifname iface masquerade' rule
+ * (or 'ip6 saddr' one for an IPv6 network)
+ * @param network - virtual network, e.g. "10.0.0.0/8" or "fd00:1::/48"
+ * @param iface   - physical network interface
+ */
+void NetlinkNetworkBackend::addMasquerade(const std::string& network,
+                                          const std::string& iface) {
+    // address and mask of the source in the network byte order:
+    bool          ipv6 = isIpv6(network);
+    unsigned char address[sizeof(in6_addr)];
+    unsigned char mask[sizeof(in6_addr)];
+    unsigned char zero[sizeof(in6_addr)];
+    size_t        length = ipv6 ? sizeof(in6_addr) : sizeof(in_addr_t);
+    int           prefix = 0;
+    memset(zero, 0, sizeof(zero));
+
+    if(ipv6) {
+        in6_addr network6;
+        if(!parseNetwork6(network, network6, prefix)) {
+            TunnelManager::log("Cannot add NAT rule for " + network +
+                               ": wrong network", std::cerr);
+            return;
+        }
+        memcpy(address, &network6, length);
+    } else {
+        size_t slashPos = network.find('/');
+        in_addr_t network4 = inet_addr(network.substr(0, slashPos).c_str());
+        prefix = slashPos == std::string::npos ? 32
+                 : atoi(network.substr(slashPos + 1).c_str());
+        memcpy(address, &network4, length);
+    }
+    for(size_t i = 0; i < length; ++i) {
+        int bits  = prefix - 8 * (int)i;
+        mask[i]   = bits >= 8 ? 0xFF : bits <= 0 ? 0 : (0xFF << (8 - bits)) & 0xFF;
+        address[i] &= mask[i];
+    }
+
+    char ifname[IFNAMSIZ];
+    memset(ifname, 0, sizeof(ifname));
+    strncpy(ifname, iface.c_str(), sizeof(ifname) - 1);
+
+    nfgenmsg nfg;
+    memset(&nfg, 0, sizeof(nfg));
+    nfg.nfgen_family = ipv6 ? NFPROTO_IPV6 : NFPROTO_IPV4;
+    nfg.version      = NFNETLINK_V0;
+
+    uint16_t create = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_ACK;
+    NetlinkMessage message;
+    beginBatch(message);
+
+    message.begin((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWTABLE,
+                  create, &nfg, sizeof(nfg));
+    message.putString(NFTA_TABLE_NAME, NAT_TABLE);
+
+    message.begin((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWCHAIN,
+                  create, &nfg, sizeof(nfg));
+    message.putString(NFTA_CHAIN_TABLE, NAT_TABLE);
+    message.putString(NFTA_CHAIN_NAME, NAT_CHAIN);
+    size_t hook = message.beginNested(NFTA_CHAIN_HOOK);
+    message.putBe32(NFTA_HOOK_HOOKNUM, NF_INET_POST_ROUTING);
+    message.putBe32(NFTA_HOOK_PRIORITY, 100); // srcnat
+    message.endNested(hook);
+    message.putString(NFTA_CHAIN_TYPE, "nat");
+
+    message.begin((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWRULE,
+                  create | NLM_F_APPEND, &nfg, sizeof(nfg));
+    message.putString(NFTA_RULE_TABLE, NAT_TABLE);
+    message.putString(NFTA_RULE_CHAIN, NAT_CHAIN);
+    size_t expressions = message.beginNested(NFTA_RULE_EXPRESSIONS);
+    size_t element, data, value;
+
+    // ip saddr & mask == network (the source is at 12 of IPv4 header, 8 of IPv6 one)
+    beginExpression(message, "payload", element, data);
+    message.putBe32(NFTA_PAYLOAD_DREG, NFT_REG_1);
+    message.putBe32(NFTA_PAYLOAD_BASE, NFT_PAYLOAD_NETWORK_HEADER);
+    message.putBe32(NFTA_PAYLOAD_OFFSET, ipv6 ? 8 : 12);
+    message.putBe32(NFTA_PAYLOAD_LEN, length);
+    endExpression(message, element, data);
+
+    beginExpression(message, "bitwise", element, data);
+    message.putBe32(NFTA_BITWISE_SREG, NFT_REG_1);
+    message.putBe32(NFTA_BITWISE_DREG, NFT_REG_1);
+    message.putBe32(NFTA_BITWISE_LEN, length);
+    value = message.beginNested(NFTA_BITWISE_MASK);
+    message.put(NFTA_DATA_VALUE, mask, length);
+    message.endNested(value);
+    value = message.beginNested(NFTA_BITWISE_XOR);
+    message.put(NFTA_DATA_VALUE, zero, length);
+    message.endNested(value);
+    endExpression(message, element, data);
+
+    addCompare(message, address, length);
+
+    // oifname == iface
+    beginExpression(message, "meta", element, data);
+    message.putBe32(NFTA_META_DREG, NFT_REG_1);
+    message.putBe32(NFTA_META_KEY, NFT_META_OIFNAME);
+    endExpression(message, element, data);
+
+    addCompare(message, ifname, sizeof(ifname));
+
+    beginExpression(message, "masq", element, data);
+    endExpression(message, element, data);
+
+    message.endNested(expressions);
+    endBatch(message);
+
+    if(int error = netfilter.request(message)) {
+        TunnelManager::log("Cannot add NAT rule for " + network + ": " +
+                           errorString(error), std::cerr);
+    } else {
+        TunnelManager::log("NAT " + network + " via " + iface + ": (OK)");
+    }
+}
+
+/**
+ * @brief removeMasquerade - removes the table of the server
+ * of the family of the network with all its rules
+ */
+void NetlinkNetworkBackend::removeMasquerade(const std::string& network,
+                                             const std::string&) {
+    nfgenmsg nfg;
+    memset(&nfg, 0, sizeof(nfg));
+    nfg.nfgen_family = isIpv6(network) ? NFPROTO_IPV6 : NFPROTO_IPV4;
+    nfg.version      = NFNETLINK_V0;
+
+    NetlinkMessage message;
+    beginBatch(message);
+    message.begin((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_DELTABLE,
+                  NLM_F_REQUEST | NLM_F_ACK, &nfg, sizeof(nfg));
+    message.putString(NFTA_TABLE_NAME, NAT_TABLE);
+    endBatch(message);
+
+    int error = netfilter.request(message);
+    if(error != 0 && error != -ENOENT) {
+        TunnelManager::log("Cannot remove NAT rule for " + network + ": " +
+                           errorString(error), std::cerr);
+    }
+}
+
+/**
+ * @brief addAddress - point-to-point address if 'peer' differs
+ * from 'local', otherwise address of the network with 'prefixLength'
+ */
+void NetlinkNetworkBackend::addAddress(unsigned index,
+                                       in_addr_t local,
+                                       in_addr_t peer,
+                                       uint32_t prefixLength) {
+    ifaddrmsg ifa;
+    memset(&ifa, 0, sizeof(ifa));
+    ifa.ifa_family    = AF_INET;
+    ifa.ifa_prefixlen = prefixLength;
+    ifa.ifa_scope     = RT_SCOPE_UNIVERSE;
+    ifa.ifa_index     = index;
+
+    NetlinkMessage message;
+    message.begin(RTM_NEWADDR,
+                  NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE,
+                  &ifa, sizeof(ifa));
+    message.put(IFA_LOCAL, &local, sizeof(local));
+    message.put(IFA_ADDRESS, &peer, sizeof(peer));
+
+    if(int error = route.request(message))
+        throw std::runtime_error("Cannot set address: " + errorString(error));
+}
+
+void NetlinkNetworkBackend::removeAddress(unsigned index,
+                                          in_addr_t local,
+                                          in_addr_t peer) {
+    ifaddrmsg ifa;
+    memset(&ifa, 0, sizeof(ifa));
+    ifa.ifa_family    = AF_INET;
+    ifa.ifa_prefixlen = 32;
+    ifa.ifa_index     = index;
+
+    NetlinkMessage message;
+    message.begin(RTM_DELADDR, NLM_F_REQUEST | NLM_F_ACK, &ifa, sizeof(ifa));
+    message.put(IFA_LOCAL, &local, sizeof(local));
+    message.put(IFA_ADDRESS, &peer, sizeof(peer));
+
+    if(int error = route.request(message))
+        throw std::runtime_error("Cannot remove address: " + errorString(error));
+}
+
+void NetlinkNetworkBackend::setLinkUp(unsigned index, bool up) {
+    ifinfomsg ifi;
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index  = index;
+    ifi.ifi_flags  = up ? IFF_UP : 0;
+    ifi.ifi_change = IFF_UP;
+
+    NetlinkMessage message;
+    message.begin(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK, &ifi, sizeof(ifi));
+
+    if(int error = route.request(message))
+        throw std::runtime_error("Cannot set link state: " + errorString(error));
+}
+
+/**
+ * @brief changeRoute6 - adds or removes the route of the IPv6 prefix
+ * via the interface
+ * @return 0 or negative errno
+ */
+int NetlinkNetworkBackend::changeRoute6(uint16_t type, uint16_t flags,
+                                        const std::string& iface,
+                                        const std::string& prefix) {
+    unsigned index = if_nametoindex(iface.c_str());
+    if(index == 0)
+        return -ENODEV;
+    in6_addr destination;
+    int      length = 0;
+    if(!parseNetwork6(prefix, destination, length))
+        return -EINVAL;
+
+    rtmsg rtm;
+    memset(&rtm, 0, sizeof(rtm));
+    rtm.rtm_family   = AF_INET6;
+    rtm.rtm_dst_len  = length;
+    rtm.rtm_table    = RT_TABLE_MAIN;
+    rtm.rtm_protocol = RTPROT_STATIC;
+    rtm.rtm_scope    = RT_SCOPE_UNIVERSE;
+    rtm.rtm_type     = RTN_UNICAST;
+
+    uint32_t oif = index;
+    NetlinkMessage message;
+    message.begin(type, NLM_F_REQUEST | NLM_F_ACK | flags, &rtm, sizeof(rtm));
+    message.put(RTA_DST, &destination, sizeof(destination));
+    message.put(RTA_OIF, &oif, sizeof(oif));
+    return route.request(message);
+}
+
+/**
+ * @brief beginBatch - nf_tables changes are applied
+ * as one transaction between batch begin and end messages
+ */
+void NetlinkNetworkBackend::beginBatch(NetlinkMessage& message) {
+    nfgenmsg nfg;
+    memset(&nfg, 0, sizeof(nfg));
+    nfg.nfgen_family = AF_UNSPEC;
+    nfg.version      = NFNETLINK_V0;
+    nfg.res_id       = htons(NFNL_SUBSYS_NFTABLES);
+    message.begin(NFNL_MSG_BATCH_BEGIN, NLM_F_REQUEST, &nfg, sizeof(nfg));
+}
+
+void NetlinkNetworkBackend::endBatch(NetlinkMessage& message) {
+    nfgenmsg nfg;
+    memset(&nfg, 0, sizeof(nfg));
+    nfg.nfgen_family = AF_UNSPEC;
+    nfg.version      = NFNETLINK_V0;
+    nfg.res_id       = htons(NFNL_SUBSYS_NFTABLES);
+    message.begin(NFNL_MSG_BATCH_END, NLM_F_REQUEST, &nfg, sizeof(nfg));
+}
+
+void NetlinkNetworkBackend::beginExpression(NetlinkMessage& message,
+                                            const char* name,
+                                            size_t& element,
+                                            size_t& data) {
+    element = message.beginNested(NFTA_LIST_ELEM);
+    message.putString(NFTA_EXPR_NAME, name);
+    data = message.beginNested(NFTA_EXPR_DATA);
+}
+
+void NetlinkNetworkBackend::endExpression(NetlinkMessage& message,
+                                          size_t element,
+                                          size_t data) {
+    message.endNested(data);
+    message.endNested(element);
+}
+
+/**
+ * @brief addCompare - 'register 1 == value' expression
+ */
+void NetlinkNetworkBackend::addCompare(NetlinkMessage& message,
+                                       const void* value,
+                                       size_t length) {
+    size_t element, data;
+    beginExpression(message, "cmp", element, data);
+    message.putBe32(NFTA_CMP_SREG, NFT_REG_1);
+    message.putBe32(NFTA_CMP_OP, NFT_CMP_EQ);
+    size_t nested = message.beginNested(NFTA_CMP_DATA);
+    message.put(NFTA_DATA_VALUE, value, length);
+    message.endNested(nested);
+    endExpression(message, element, data);
+}
@@ -0,0 +1,141 @@
+#ifndef NETLINK_BACKEND_HPP
+#define NETLINK_BACKEND_HPP
+
+#include "network_backend.hpp"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/if_tun.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+/**
+ * @brief The NetlinkMessage class<br>
+ * Builder of netlink requests: one or more messages<br>
+ * (e.g. an nf_tables batch) with their attributes.<br>
+ */
+class NetlinkMessage {
+private:
+    std::vector<char> buffer;
+    size_t            current; // offset of the last message header
+
+public:
+    explicit NetlinkMessage();
+
+    void begin(uint16_t type, uint16_t flags,
+               const void* header, size_t length);
+    void put(uint16_t type, const void* data, size_t length);
+    void putU32(uint16_t type, uint32_t value);
+    void putBe32(uint16_t type, uint32_t value);
+    void putString(uint16_t type, const std::string& value);
+    size_t beginNested(uint16_t type);
+    void endNested(size_t offset);
+
+    char* data();
+    size_t size() const;
+
+private:
+    void append(const void* data, size_t length);
+};
+
+/**
+ * @brief The NetlinkSocket class<br>
+ * Synchronous netlink socket: every request waits<br>
+ * for the acknowledgements of its messages.<br>
+ * Requests of several threads (e.g. workers setting up tunnels)<br>
+ * are sent one by one.<br>
+ */
+class NetlinkSocket {
+private:
+    int        sd;
+    uint32_t   sequence;
+    std::mutex mutex;
+
+public:
+    /* Forbid creating default copy ctor: */
+    NetlinkSocket(NetlinkSocket& that) = delete;
+
+    explicit NetlinkSocket(int protocol);
+    ~NetlinkSocket();
+
+    int request(NetlinkMessage& message);
+};
+
+/**
+ * @brief The NetlinkNetworkBackend class<br>
+ * Configures the host network in-process: TUN interfaces are created<br>
+ * with ioctl(2), addresses and link state are set via rtnetlink,<br>
+ * NAT is a masquerade rule in an own nf_tables table (one table<br>
+ * per address family), so<br>
+ * connecting a client costs a few syscalls instead of fork/exec.<br>
+ */
+class NetlinkNetworkBackend : public NetworkBackend {
+public:
+    static const char* const NAT_TABLE;
+    static const char* const NAT_CHAIN;
+
+private:
+    NetlinkSocket route;
+    NetlinkSocket netfilter;
+
+public:
+    explicit NetlinkNetworkBackend();
+
+    void createTunnel(const std::string& tunStr,
+                      const std::string& serverTunAddr,
+                      const std::string& clientTunAddr,
+                      bool multiQueue) override;
+    void createSharedTunnel(const std::string& tunStr,
+                            const std::string& serverTunAddr,
+                            uint32_t prefixLength,
+                            bool multiQueue) override;
+    void deleteLink(const std::string& name) override;
+    bool resetLink(const std::string& name) override;
+    bool changePeer(const std::string& name,
+                    const std::string& serverTunAddr,
+                    const std::string& oldClientAddr,
+                    const std::string& newClientAddr) override;
+    void addRoute6(const std::string& iface,
+                   const std::string& prefix) override;
+    void removeRoute6(const std::string& iface,
+                      const std::string& prefix) override;
+    void setForwarding(bool enable) override;
+    void setForwarding6(bool enable) override;
+    void addMasquerade(const std::string& network,
+                       const std::string& iface) override;
+    void removeMasquerade(const std::string& network,
+                          const std::string& iface) override;
+
+private:
+    unsigned createDevice(const std::string& tunStr, bool multiQueue);
+    void addAddress(unsigned index, in_addr_t local, in_addr_t peer,
+                    uint32_t prefixLength = 32);
+    void removeAddress(unsigned index, in_addr_t local, in_addr_t peer);
+    void setLinkUp(unsigned index, bool up);
+    int changeRoute6(uint16_t type, uint16_t flags,
+                     const std::string& iface, const std::string& prefix);
+    void beginBatch(NetlinkMessage& message);
+    void endBatch(NetlinkMessage& message);
+    void beginExpression(NetlinkMessage& message, const char* name,
+                         size_t& element, size_t& data);
+    void endExpression(NetlinkMessage& message, size_t element, size_t data);
+    void addCompare(NetlinkMessage& message, const void* value, size_t length);
+};
+
+#endif // NETLINK_BACKEND_HPP
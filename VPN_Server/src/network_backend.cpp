@@ -0,0 +1,125 @@
+#include "network_backend.hpp"
+#include "netlink_backend.hpp"
+#include "tunnel_mgr.hpp"
+
+/**
+ * @brief create - creates backend by its name
+ * @param name - "netlink" or "shell". If netlink socket cannot
+ *               be opened the shell backend is used.
+ */
+NetworkBackend* NetworkBackend::create(const std::string& name) {
+    if(name == "shell")
+        return new ShellNetworkBackend;
+
+    if(name != "netlink")
+        throw std::invalid_argument("Unknown network backend: " + name);
+
+    try {
+        return new NetlinkNetworkBackend;
+    } catch (const std::exception& e) {
+        TunnelManager::log(std::string() + e.what() +
+                           ", falling back to shell commands", std::cerr);
+        return new ShellNetworkBackend;
+    }
+}
+
+bool NetworkBackend::isBackendName(const std::string& name) {
+    return name == "netlink" || name == "shell";
+}
+
+bool NetworkBackend::isIpv6(const std::string& network) {
+    return network.find(':') != std::string::npos;
+}
+
+void ShellNetworkBackend::createTunnel(const std::string& tunStr,
+                                       const std::string& serverTunAddr,
+                                       const std::string& clientTunAddr,
+                                       bool multiQueue) {
+    std::string tunInterfaceSetup = "ip tuntap add dev " + tunStr +  " mode tun";
+    if (multiQueue) {
+        // queues of the device must be opened with IFF_MULTI_QUEUE
+        tunInterfaceSetup += " multi_queue";
+    }
+    TunnelManager::execTerminalCommand(tunInterfaceSetup);
+
+    std::string ifconfig = "ifconfig " + tunStr + " " + serverTunAddr +
+                      " dstaddr " + clientTunAddr + " up";
+    TunnelManager::execTerminalCommand(ifconfig);
+}
+
+void ShellNetworkBackend::createSharedTunnel(const std::string& tunStr,
+                                             const std::string& serverTunAddr,
+                                             uint32_t prefixLength,
+                                             bool multiQueue) {
+    std::string tunInterfaceSetup = "ip tuntap add dev " + tunStr +  " mode tun";
+    if (multiQueue)
+        tunInterfaceSetup += " multi_queue";
+    TunnelManager::execTerminalCommand(tunInterfaceSetup);
+
+    TunnelManager::execTerminalCommand("ip addr add " + serverTunAddr + "/" +
+                                       std::to_string(prefixLength) +
+                                       " dev " + tunStr);
+    TunnelManager::execTerminalCommand("ip link set dev " + tunStr + " up");
+}
+
+void ShellNetworkBackend::deleteLink(const std::string& name) {
+    TunnelManager::execTerminalCommand("ip link delete " + name);
+}
+
+bool ShellNetworkBackend::resetLink(const std::string& name) {
+    return system(("ip link set dev " + name + " down && "
+                   "ip link set dev " + name + " up").c_str()) == 0;
+}
+
+bool ShellNetworkBackend::changePeer(const std::string& name,
+                                     const std::string& serverTunAddr,
+                                     const std::string& oldClientAddr,
+                                     const std::string& newClientAddr) {
+    return system(("ip addr del " + serverTunAddr + " peer " + oldClientAddr +
+                   " dev " + name + " && ip addr add " + serverTunAddr +
+                   " peer " + newClientAddr + " dev " + name).c_str()) == 0;
+}
+
+void ShellNetworkBackend::addRoute6(const std::string& iface,
+                                    const std::string& prefix) {
+    TunnelManager::execTerminalCommand("ip -6 route replace " + prefix +
+                                       " dev " + iface);
+}
+
+void ShellNetworkBackend::removeRoute6(const std::string& iface,
+                                       const std::string& prefix) {
+    // the route is gone together with a deleted interface:
+    if(system(("ip -6 route del " + prefix + " dev " + iface +
+               " 2>/dev/null").c_str()) != 0) {
+        TunnelManager::log("No route " + prefix + " via " + iface,
+                           Logger::DEBUG);
+    }
+}
+
+void ShellNetworkBackend::setForwarding(bool enable) {
+    TunnelManager::execTerminalCommand(std::string() + "echo " +
+                                       (enable ? "1" : "0") +
+                                       " > /proc/sys/net/ipv4/ip_forward");
+}
+
+void ShellNetworkBackend::setForwarding6(bool enable) {
+    TunnelManager::execTerminalCommand(std::string() + "echo " +
+                                       (enable ? "1" : "0") +
+                                       " > /proc/sys/net/ipv6/conf/all/forwarding");
+}
+
+void ShellNetworkBackend::addMasquerade(const std::string& network,
+                                        const std::string& iface) {
+    TunnelManager::execTerminalCommand(std::string(isIpv6(network) ? "ip6tables" : "iptables") +
+                                       " -t nat -A POSTROUTING -s " +
+                                       network + " -o " + iface +
+                                       " -j MASQUERADE");
+}
+
+void ShellNetworkBackend::removeMasquerade(const std::string& network,
+                                           const std::string& iface) {
+    TunnelManager::execTerminalCommand(std::string(isIpv6(network) ? "ip6tables" : "iptables") +
+                                       " -t nat -D POSTROUTING -s " +
+                                       network + " -o " + iface +
+                                       " -j MASQUERADE");
+}
@@ -0,0 +1,85 @@
+#ifndef NETWORK_BACKEND_HPP
+#define NETWORK_BACKEND_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include <stdint.h>
+
+/**
+ * @brief The NetworkBackend class<br>
+ * Configures the host network for the server: TUN interfaces<br>
+ * of the tunnels, IP forwarding and NAT of the virtual network.<br>
+ * IPv6 prefixes of clients are routed to their interfaces,<br>
+ * a network is IPv6 if its string contains ':'.<br>
+ * Selected at startup, see 'create'.<br>
+ */
+class NetworkBackend {
+public:
+    virtual ~NetworkBackend() { }
+
+    virtual void createTunnel(const std::string& tunStr,
+                              const std::string& serverTunAddr,
+                              const std::string& clientTunAddr,
+                              bool multiQueue) = 0;
+    virtual void createSharedTunnel(const std::string& tunStr,
+                                    const std::string& serverTunAddr,
+                                    uint32_t prefixLength,
+                                    bool multiQueue) = 0;
+    virtual void deleteLink(const std::string& name) = 0;
+    virtual bool resetLink(const std::string& name) = 0;
+    virtual bool changePeer(const std::string& name,
+                            const std::string& serverTunAddr,
+                            const std::string& oldClientAddr,
+                            const std::string& newClientAddr) = 0;
+    virtual void addRoute6(const std::string& iface,
+                           const std::string& prefix) = 0;
+    virtual void removeRoute6(const std::string& iface,
+                              const std::string& prefix) = 0;
+    virtual void setForwarding(bool enable) = 0;
+    virtual void setForwarding6(bool enable) = 0;
+    virtual void addMasquerade(const std::string& network,
+                               const std::string& iface) = 0;
+    virtual void removeMasquerade(const std::string& network,
+                                  const std::string& iface) = 0;
+
+    static NetworkBackend* create(const std::string& name);
+    static bool isBackendName(const std::string& name);
+    static bool isIpv6(const std::string& network);
+};
+
+/**
+ * @brief The ShellNetworkBackend class<br>
+ * Runs ip, ifconfig, iptables and ip6tables through the shell.<br>
+ * Every call costs a fork and exec, kept as a fallback<br>
+ * for systems without nf_tables.<br>
+ */
+class ShellNetworkBackend : public NetworkBackend {
+public:
+    void createTunnel(const std::string& tunStr,
+                      const std::string& serverTunAddr,
+                      const std::string& clientTunAddr,
+                      bool multiQueue) override;
+    void createSharedTunnel(const std::string& tunStr,
+                            const std::string& serverTunAddr,
+                            uint32_t prefixLength,
+                            bool multiQueue) override;
+    void deleteLink(const std::string& name) override;
+    bool resetLink(const std::string& name) override;
+    bool changePeer(const std::string& name,
+                    const std::string& serverTunAddr,
+                    const std::string& oldClientAddr,
+                    const std::string& newClientAddr) override;
+    void addRoute6(const std::string& iface,
+                   const std::string& prefix) override;
+    void removeRoute6(const std::string& iface,
+                      const std::string& prefix) override;
+    void setForwarding(bool enable) override;
+    void setForwarding6(bool enable) override;
+    void addMasquerade(const std::string& network,
+                       const std::string& iface) override;
+    void removeMasquerade(const std::string& network,
+                          const std::string& iface) override;
+};
+
+#endif // NETWORK_BACKEND_HPP
@@ -0,0 +1,357 @@
+#include "packet_filter.hpp"
+
+const size_t PacketFilter::BATCH;
+
+namespace {
+
+const int IPV4_HEADER = 20;
+const int IPV6_HEADER = 40;
+
+/* 32-bit word with the bytes in memory order, as loaded from a packet */
+uint32_t bytesWord(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+    uint8_t  bytes[4] = { b0, b1, b2, b3 };
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+} // namespace
+
+AccessRule::AccessRule()
+    : allow(true), network(0), mask(0), protocol(0), port(0) { }
+
+void AccessList::add(const AccessRule& rule) {
+    rules.push_back(rule);
+}
+
+void AccessList::append(const AccessList& list) {
+    rules.insert(rules.end(), list.rules.begin(), list.rules.end());
+}
+
+/**
+ * @brief allows - result of the first matching rule
+ * @param port - destination port, 0 if unknown (not TCP/UDP,
+ * IP fragment), it matches only rules without port
+ */
+bool AccessList::allows(in_addr_t destination, uint8_t protocol,
+                        uint16_t port) const {
+    for(const AccessRule& rule : rules) {
+        if((destination & rule.mask) == rule.network
+           && (rule.protocol == 0 || rule.protocol == protocol)
+           && (rule.port == 0 || rule.port == port))
+            return rule.allow;
+    }
+    return true;
+}
+
+bool AccessList::empty() const {
+    return rules.empty();
+}
+
+size_t AccessList::size() const {
+    return rules.size();
+}
+
+/**
+ * @brief parseRule - allow|deny NETWORK/PREFIX [tcp|udp|icmp|any] [PORT]
+ * @throws std::invalid_argument if the words are not a rule
+ */
+AccessRule AccessList::parseRule(std::istream& words) {
+    AccessRule  rule;
+    std::string action, network, protocol, port, extra;
+    words >> action >> network >> protocol >> port >> extra;
+
+    if(action != "allow" && action != "deny")
+        throw std::invalid_argument("Invalid access rule action: " + action);
+    rule.allow = action == "allow";
+
+    int prefix = 32;
+    size_t slash = network.find('/');
+    if(slash != std::string::npos) {
+        std::string bits = network.substr(slash + 1);
+        prefix = atoi(bits.c_str());
+        if(bits.empty() || bits.find_first_not_of("0123456789") != std::string::npos
+           || prefix > 32)
+            throw std::invalid_argument("Invalid access rule prefix: " + network);
+        network.resize(slash);
+    }
+    in_addr addr;
+    if(network == "any") {
+        addr.s_addr = INADDR_ANY;
+        prefix = 0;
+    } else if(inet_pton(AF_INET, network.c_str(), &addr) != 1) {
+        throw std::invalid_argument("Invalid access rule network: " + network);
+    }
+    rule.mask    = prefix == 0 ? 0 : htonl(0xFFFFFFFFu << (32 - prefix));
+    rule.network = addr.s_addr & rule.mask;
+
+    if(protocol == "tcp")
+        rule.protocol = IPPROTO_TCP;
+    else if(protocol == "udp")
+        rule.protocol = IPPROTO_UDP;
+    else if(protocol == "icmp")
+        rule.protocol = IPPROTO_ICMP;
+    else if(!protocol.empty() && protocol != "any")
+        throw std::invalid_argument("Invalid access rule protocol: " + protocol);
+
+    if(!port.empty()) {
+        int number = atoi(port.c_str());
+        if(rule.protocol != IPPROTO_TCP && rule.protocol != IPPROTO_UDP)
+            throw std::invalid_argument("Access rule port needs tcp or udp");
+        if(number < 1 || number > 0xFFFF
+           || port.find_first_not_of("0123456789") != std::string::npos)
+            throw std::invalid_argument("Invalid access rule port: " + port);
+        rule.port = number;
+    }
+    if(!extra.empty())
+        throw std::invalid_argument("Unexpected words in access rule: " + extra);
+    return rule;
+}
+
+/**
+ * @brief load - adds the rules of the file
+ * @throws std::invalid_argument if the file cannot be read
+ * or has an invalid rule
+ */
+void AccessPolicy::load(const std::string& path) {
+    std::ifstream file(path);
+    if(!file)
+        throw std::invalid_argument("Cannot open access list " + path);
+
+    std::string line;
+    for(int number = 1; std::getline(file, line); ++number) {
+        try {
+            add(line);
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(path + ":" + std::to_string(number) +
+                                        ": " + e.what());
+        }
+    }
+}
+
+/**
+ * @brief add - adds a rule, empty lines and comments are skipped
+ * @throws std::invalid_argument if the line is not a rule
+ */
+void AccessPolicy::add(const std::string& line) {
+    std::string        text = line.substr(0, line.find('#'));
+    std::istringstream words(text);
+    std::string        first;
+    if(!(words >> first))
+        return;
+
+    if(first == "client") {
+        std::string host;
+        words >> host;
+        std::string key = hostKey(host);
+        clients[key].add(AccessList::parseRule(words));
+        return;
+    }
+    std::istringstream rule(text);
+    common.add(AccessList::parseRule(rule));
+}
+
+/**
+ * @brief forClient - rules of the client then rules of all clients
+ * @param host - client host address as in leases ("::ffff:a.b.c.d")
+ */
+AccessList AccessPolicy::forClient(const std::string& host) const {
+    AccessList list;
+    auto found = clients.find(host);
+    if(found != clients.end())
+        list.append(found->second);
+    list.append(common);
+    return list;
+}
+
+bool AccessPolicy::empty() const {
+    return common.empty() && clients.empty();
+}
+
+/**
+ * @brief hostKey - IPv4 and IPv6 host in the form of inet_ntop(AF_INET6)
+ */
+std::string AccessPolicy::hostKey(const std::string& host) {
+    in6_addr addr;
+    in_addr  addr4;
+    if(inet_pton(AF_INET, host.c_str(), &addr4) == 1) {
+        memset(&addr, 0, sizeof(addr));
+        addr.s6_addr[10] = 0xFF;
+        addr.s6_addr[11] = 0xFF;
+        memcpy(&addr.s6_addr[12], &addr4, sizeof(addr4));
+    } else if(inet_pton(AF_INET6, host.c_str(), &addr) != 1) {
+        throw std::invalid_argument("Invalid client host: " + host);
+    }
+    char text[INET6_ADDRSTRLEN];
+    return inet_ntop(AF_INET6, &addr, text, sizeof(text));
+}
+
+PacketFilter::PacketFilter(in_addr_t clientAddr, const AccessList& access)
+    : clientAddr(clientAddr), clientPrefix6(0), access(access) {
+    memset(&clientAddr6, 0, sizeof(clientAddr6));
+}
+
+/**
+ * @brief setClientAddr6 - IPv6 packets of the client must come
+ * from the prefix of 'addr'
+ * @param prefixLength - e.g. 64 if the client got a /64 (from 1 to 128)
+ */
+void PacketFilter::setClientAddr6(const in6_addr& addr, uint8_t prefixLength) {
+    clientAddr6   = addr;
+    clientPrefix6 = prefixLength;
+}
+
+/**
+ * @brief check - verdicts of a batch of packets
+ * @param verdicts - class of every passed packet or reason of the drop
+ */
+void PacketFilter::check(char* const* packets, const int* lengths, size_t count,
+                         uint8_t* verdicts) const {
+    for(size_t i = 0; i < count; i += 4) {
+        char* const* group = packets + i;
+        const int*   sizes = lengths + i;
+        char*        tail[4];
+        int          tailSizes[4] = { 0, 0, 0, 0 }; // too short: not passed
+        size_t       lanes = count - i < 4 ? count - i : 4;
+        if(lanes < 4) {
+            for(size_t j = 0; j < 4; ++j)
+                tail[j] = packets[i + (j < lanes ? j : 0)];
+            memcpy(tailSizes, sizes, lanes * sizeof(int));
+            group = tail;
+            sizes = tailSizes;
+        }
+
+        uint32_t passed = validate4(group, sizes);
+        for(size_t j = 0; j < lanes; ++j) {
+            const char* packet = packets[i + j];
+            int         length = lengths[i + j];
+            if(!(passed & (1u << j)))
+                verdicts[i + j] = checkOther(packet, length);
+            else if(!access.empty())
+                verdicts[i + j] = checkAccess(packet, length);
+            else
+                verdicts[i + j] = classOf(packet[1]);
+        }
+    }
+}
+
+bool PacketFilter::isDrop(uint8_t verdict) {
+    return verdict >= CLASSES;
+}
+
+/**
+ * @brief classOf - QoS class of DSCP of the TOS (traffic class) byte
+ */
+PacketFilter::Verdict PacketFilter::classOf(uint8_t tos) {
+    uint8_t dscp = tos >> 2;
+    if(dscp >= 40) // CS5, VOICE-ADMIT, EF, CS6, CS7
+        return HIGH;
+    if(dscp == 8 || dscp == 1) // CS1, LE (RFC 8622)
+        return LOW;
+    return NORMAL;
+}
+
+/**
+ * @brief validate4 - checks four IPv4 headers at once: version 4,
+ * header length >= 20, total length equal to the record length,
+ * source is the client address
+ * @return bit mask of the passed packets
+ */
+uint32_t PacketFilter::validate4(char* const* packets, const int* lengths) const {
+    uint32_t heads[4], sources[4], expected[4], headerWords[4];
+    for(int i = 0; i < 4; ++i) {
+        int length = lengths[i];
+        if(length >= IPV4_HEADER) {
+            memcpy(&heads[i], packets[i], sizeof(heads[i]));
+            memcpy(&sources[i], packets[i] + 12, sizeof(sources[i]));
+            headerWords[i] = packets[i][0] & 0x0F;
+        } else {
+            heads[i] = sources[i] = headerWords[i] = 0;
+        }
+        expected[i] = bytesWord(0x40, 0, length >> 8, length & 0xFF);
+    }
+    const uint32_t mask = bytesWord(0xF0, 0, 0xFF, 0xFF); // version, total length
+
+#if defined(__SSE2__)
+    __m128i head = _mm_and_si128(_mm_loadu_si128((const __m128i*)heads),
+                                 _mm_set1_epi32(mask));
+    __m128i ok = _mm_cmpeq_epi32(head, _mm_loadu_si128((const __m128i*)expected));
+    ok = _mm_and_si128(ok, _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)headerWords),
+                                           _mm_set1_epi32(4)));
+    ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)sources),
+                                           _mm_set1_epi32(clientAddr)));
+    return _mm_movemask_ps(_mm_castsi128_ps(ok));
+#elif defined(__ARM_NEON)
+    uint32x4_t head = vandq_u32(vld1q_u32(heads), vdupq_n_u32(mask));
+    uint32x4_t ok   = vceqq_u32(head, vld1q_u32(expected));
+    ok = vandq_u32(ok, vcgtq_u32(vld1q_u32(headerWords), vdupq_n_u32(4)));
+    ok = vandq_u32(ok, vceqq_u32(vld1q_u32(sources), vdupq_n_u32(clientAddr)));
+    return (vgetq_lane_u32(ok, 0) & 1) | (vgetq_lane_u32(ok, 1) & 2)
+         | (vgetq_lane_u32(ok, 2) & 4) | (vgetq_lane_u32(ok, 3) & 8);
+#else
+    uint32_t passed = 0;
+    for(int i = 0; i < 4; ++i) {
+        if((heads[i] & mask) == expected[i] && headerWords[i] > 4
+           && sources[i] == clientAddr)
+            passed |= 1u << i;
+    }
+    return passed;
+#endif
+}
+
+/**
+ * @brief checkOther - packets that are not valid IPv4 packets
+ * of the client: IPv6 packets, spoofed and malformed ones
+ */
+uint8_t PacketFilter::checkOther(const char* packet, int length) const {
+    uint8_t version = length > 0 ? (uint8_t)packet[0] >> 4 : 0;
+
+    if(version == 6) {
+        if(length < IPV6_HEADER)
+            return MALFORMED;
+        if(IPV6_HEADER + (((uint8_t)packet[4] << 8) | (uint8_t)packet[5]) != length)
+            return MALFORMED;
+        if(!isClientAddr6(packet + 8))
+            return SPOOFED;
+        if(!access.empty())
+            return DENIED; // the rules are for IPv4 destinations
+        return classOf(((packet[0] & 0x0F) << 4) | ((uint8_t)packet[1] >> 4));
+    }
+
+    if(version != 4 || length < IPV4_HEADER || (packet[0] & 0x0F) < 5
+       || (((uint8_t)packet[2] << 8) | (uint8_t)packet[3]) != length)
+        return MALFORMED;
+    return SPOOFED;
+}
+
+uint8_t PacketFilter::checkAccess(const char* packet, int length) const {
+    in_addr_t destination;
+    memcpy(&destination, packet + 16, sizeof(destination));
+    uint8_t  protocol = packet[9];
+    uint16_t port     = 0;
+    int      header   = (packet[0] & 0x0F) * 4;
+    bool     first    = ((((uint8_t)packet[6] << 8) | (uint8_t)packet[7]) & 0x1FFF) == 0;
+    if((protocol == IPPROTO_TCP || protocol == IPPROTO_UDP)
+       && first && length >= header + 4)
+        port = ((uint8_t)packet[header + 2] << 8) | (uint8_t)packet[header + 3];
+
+    if(!access.allows(destination, protocol, port))
+        return DENIED;
+    return classOf(packet[1]);
+}
+
+/**
+ * @brief isClientAddr6 - the source address is in the prefix of the client
+ */
+bool PacketFilter::isClientAddr6(const char* source) const {
+    if(clientPrefix6 == 0)
+        return false;
+
+    size_t bytes = clientPrefix6 / 8;
+    if(memcmp(source, &clientAddr6, bytes) != 0)
+        return false;
+    if(clientPrefix6 % 8 == 0)
+        return true;
+    uint8_t mask = 0xFF << (8 - clientPrefix6 % 8);
+    return ((source[bytes] ^ clientAddr6.s6_addr[bytes]) & mask) == 0;
+}
@@ -0,0 +1,131 @@
+#ifndef PACKET_FILTER_HPP
+#define PACKET_FILTER_HPP
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * @brief The AccessRule struct - destination network, protocol and port
+ */
+struct AccessRule {
+    bool      allow;
+    in_addr_t network;  // network byte order
+    in_addr_t mask;
+    uint8_t   protocol; // IPPROTO_*, 0 - any
+    uint16_t  port;     // TCP/UDP destination port, 0 - any
+
+    explicit AccessRule();
+};
+
+/**
+ * @brief The AccessList class<br>
+ * Rules for packets of a client, the first matching rule wins,<br>
+ * packets without a matching rule are allowed.<br>
+ */
+class AccessList {
+private:
+    std::vector<AccessRule> rules;
+
+public:
+    void add(const AccessRule& rule);
+    void append(const AccessList& list);
+    bool allows(in_addr_t destination, uint8_t protocol, uint16_t port) const;
+    bool empty() const;
+    size_t size() const;
+
+    static AccessRule parseRule(std::istream& words);
+};
+
+/**
+ * @brief The AccessPolicy class<br>
+ * Access lists of the server loaded from a file, a line is a rule:<br>
+ * [client HOST] allow|deny NETWORK/PREFIX [tcp|udp|icmp|any] [PORT]<br>
+ * Rules with 'client' apply to the client connecting from HOST<br>
+ * and are checked before the rules of all clients.<br>
+ * Every tunnel gets a copy of its list, see 'forClient'.<br>
+ * '#' starts a comment.<br>
+ */
+class AccessPolicy {
+private:
+    AccessList                                  common;
+    std::unordered_map<std::string, AccessList> clients; // by client host
+
+public:
+    void load(const std::string& path);
+    void add(const std::string& line);
+    AccessList forClient(const std::string& host) const;
+    bool empty() const;
+
+    static std::string hostKey(const std::string& host);
+};
+
+/**
+ * @brief The PacketFilter class<br>
+ * Checks packets decrypted from a client before they are written<br>
+ * to TUN: IPv4 header (version, header and total length), source<br>
+ * address against the address leased to the client (no spoofing<br>
+ * of other clients or hosts), access list of the client.<br>
+ * Passed packets get a QoS class from their DSCP.<br>
+ * Packets are checked in batches: the fields of four headers<br>
+ * are compared at once with SSE2 or NEON, so the filter costs<br>
+ * a few instructions per packet.<br>
+ * IPv6 packets must come from the prefix of the client (see<br>
+ * 'setClientAddr6'), a client without one is not allowed to send<br>
+ * them. Access rules are IPv4 rules, so IPv6 packets of a client<br>
+ * with an access list are denied.<br>
+ */
+class PacketFilter {
+public:
+    static const size_t BATCH = 32;
+
+    enum Verdict {
+        HIGH      = 0, // EF, CS5-CS7: voice, network control
+        NORMAL    = 1,
+        LOW       = 2, // CS1, LE: background
+        CLASSES   = 3,
+        MALFORMED = CLASSES, // verdicts from here are drops
+        SPOOFED,
+        DENIED
+    };
+
+private:
+    in_addr_t  clientAddr;
+    in6_addr   clientAddr6;
+    uint8_t    clientPrefix6; // 0 - no IPv6 address
+    AccessList access;
+
+public:
+    explicit PacketFilter(in_addr_t clientAddr,
+                          const AccessList& access = AccessList());
+
+    void setClientAddr6(const in6_addr& addr, uint8_t prefixLength = 128);
+    void check(char* const* packets, const int* lengths, size_t count,
+               uint8_t* verdicts) const;
+
+    static bool isDrop(uint8_t verdict);
+    static Verdict classOf(uint8_t tos);
+
+private:
+    uint32_t validate4(char* const* packets, const int* lengths) const;
+    uint8_t checkOther(const char* packet, int length) const;
+    uint8_t checkAccess(const char* packet, int length) const;
+    bool isClientAddr6(const char* source) const;
+};
+
+#endif // PACKET_FILTER_HPP
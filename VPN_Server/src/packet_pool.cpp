@@ -0,0 +1,154 @@
+#include "packet_pool.hpp"
+
+const size_t PacketPool::CACHE_LINE;
+const size_t PacketPool::HEADROOM;
+const size_t PacketRing::DEFAULT_SIZE;
+
+namespace {
+
+size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+char* Packet::payload() {
+    return data + PacketPool::HEADROOM;
+}
+
+PoolStats::PoolStats() : allocated(0), inUse(0), highWater(0) { }
+
+/**
+ * @brief PacketPool constructor
+ * @param capacity - payload size of every buffer
+ * @param slabSize - count of buffers allocated at once
+ */
+PacketPool::PacketPool(size_t capacity, size_t slabSize)
+    : capacity(capacity),
+      stride(alignUp(sizeof(Packet), CACHE_LINE)
+             + alignUp(HEADROOM + capacity, CACHE_LINE)),
+      slabSize(slabSize == 0 ? 1 : slabSize),
+      freeList(nullptr) { }
+
+PacketPool::~PacketPool() {
+    for(void* slab : slabs)
+        free(slab);
+}
+
+/**
+ * @brief acquire - takes a buffer from the free list,
+ * allocates a new slab if the list is empty
+ * @return packet with zero length
+ */
+Packet* PacketPool::acquire() {
+    if(freeList == nullptr)
+        grow();
+
+    Packet* packet = freeList;
+    freeList       = packet->next;
+    packet->next   = nullptr;
+    packet->length = 0;
+
+    size_t inUse = stats.inUse.load(std::memory_order_relaxed) + 1;
+    stats.inUse.store(inUse, std::memory_order_relaxed);
+    if(inUse > stats.highWater.load(std::memory_order_relaxed))
+        stats.highWater.store(inUse, std::memory_order_relaxed);
+    return packet;
+}
+
+void PacketPool::release(Packet* packet) {
+    packet->next = freeList;
+    freeList     = packet;
+    stats.inUse.store(stats.inUse.load(std::memory_order_relaxed) - 1,
+                      std::memory_order_relaxed);
+}
+
+size_t PacketPool::getCapacity() const {
+    return capacity;
+}
+
+const PoolStats& PacketPool::getStats() const {
+    return stats;
+}
+
+void PacketPool::grow() {
+    void* slab = nullptr;
+    if(posix_memalign(&slab, CACHE_LINE, stride * slabSize) != 0)
+        throw std::bad_alloc();
+    slabs.push_back(slab);
+
+    char* base = static_cast<char*>(slab);
+    for(size_t i = 0; i < slabSize; ++i) {
+        Packet* packet = reinterpret_cast<Packet*>(base + i * stride);
+        packet->data   = base + i * stride + alignUp(sizeof(Packet), CACHE_LINE);
+        packet->next   = freeList;
+        freeList       = packet;
+    }
+
+    stats.allocated.store(stats.allocated.load(std::memory_order_relaxed) + slabSize,
+                          std::memory_order_relaxed);
+}
+
+/**
+ * @brief PacketRing constructor
+ * @param size - count of slots, rounded up to a power of two
+ */
+PacketRing::PacketRing(size_t size)
+    : tail(0),
+      head(0),
+      reclaimed(0) {
+    size_t slotsCount = 1;
+    while(slotsCount < size)
+        slotsCount <<= 1;
+    slots.resize(slotsCount, nullptr);
+    mask = slotsCount - 1;
+}
+
+/**
+ * @brief push - queues 'packet' for the consumer, called by the producer
+ * @param pool - pool of the producer, 'packet' is taken from it
+ * @return false if the ring is full, 'packet' stays with the caller
+ */
+bool PacketRing::push(Packet* packet, PacketPool& pool) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    if(position - reclaimed == slots.size()) {
+        reclaim(pool);
+        if(position - reclaimed == slots.size())
+            return false; // the consumer is behind
+    }
+
+    slots[position & mask] = packet;
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief reclaim - gives the packets drained by the consumer
+ * back to 'pool', called by the producer
+ */
+void PacketRing::reclaim(PacketPool& pool) {
+    size_t drained = head.load(std::memory_order_acquire);
+    for(; reclaimed != drained; ++reclaimed)
+        pool.release(slots[reclaimed & mask]);
+}
+
+/**
+ * @brief drain - passes all queued packets to 'handler',
+ * called by the consumer. The packets must not be used after
+ * 'handler' returns, their slots are published to the producer.
+ * @return count of drained packets
+ */
+size_t PacketRing::drain(const PacketHandler& handler) {
+    size_t first = head.load(std::memory_order_relaxed);
+    size_t last  = tail.load(std::memory_order_acquire);
+    for(size_t position = first; position != last; ++position)
+        handler(slots[position & mask]);
+
+    if(last != first)
+        head.store(last, std::memory_order_release);
+    return last - first;
+}
+
+size_t PacketRing::getSize() const {
+    return slots.size();
+}
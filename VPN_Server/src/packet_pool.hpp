@@ -0,0 +1,118 @@
+#ifndef PACKET_POOL_HPP
+#define PACKET_POOL_HPP
+
+#include <atomic>
+#include <functional>
+#include <new>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+
+/**
+ * @brief The Packet struct<br>
+ * Descriptor of one pooled buffer. 'data' has HEADROOM bytes<br>
+ * reserved in front of the payload, so a record header can be<br>
+ * prepended in place. 'next' links packets in the free list<br>
+ * and in the queues of the owner.<br>
+ */
+struct Packet {
+    Packet*      next;
+    char*        data;
+    int          length; // payload length
+    sockaddr_in6 peer;   // destination of a queued datagram
+    int64_t      queuedAt; // ns of the steady clock, set by queues of the owner
+
+    char* payload();
+};
+
+/**
+ * @brief The PoolStats struct<br>
+ * Buffers allocated by the pool and buffers in use,<br>
+ * 'highWater' is the maximum of 'inUse' since start.<br>
+ * Updated by the owner thread, may be read from any thread.<br>
+ */
+struct PoolStats {
+    std::atomic<size_t> allocated;
+    std::atomic<size_t> inUse;
+    std::atomic<size_t> highWater;
+
+    explicit PoolStats();
+};
+
+/**
+ * @brief The PacketPool class<br>
+ * Allocator of fixed size packet buffers, owned by one worker,<br>
+ * so 'acquire' and 'release' are a pop and a push of the free list<br>
+ * without any locks. Buffers are allocated in cache-line aligned<br>
+ * slabs and are not returned to the system until the pool is destroyed.<br>
+ */
+class PacketPool {
+public:
+    static const size_t CACHE_LINE = 64;
+    static const size_t HEADROOM   = 64; // DTLS record header and nonce
+
+private:
+    size_t             capacity;  // payload bytes of every buffer
+    size_t             stride;    // bytes between buffers in a slab
+    size_t             slabSize;  // buffers per slab
+    Packet*            freeList;
+    std::vector<void*> slabs;
+    PoolStats          stats;
+
+public:
+    /* Forbid creating default copy ctor: */
+    PacketPool(PacketPool& that) = delete;
+
+    explicit PacketPool(size_t capacity, size_t slabSize = 16);
+    ~PacketPool();
+
+    Packet* acquire();
+    void release(Packet* packet);
+    size_t getCapacity() const;
+    const PoolStats& getStats() const;
+
+private:
+    void grow();
+};
+
+/**
+ * @brief The PacketRing class<br>
+ * Bounded queue of pooled packets from one thread (the producer)<br>
+ * to another (the consumer) without locks. The packets stay owned<br>
+ * by the pool of the producer: slots drained by the consumer are<br>
+ * given back to that pool by 'reclaim' of the producer, so neither<br>
+ * side touches the pool of the other. The consumer drains all<br>
+ * queued packets at once and publishes their slots once.<br>
+ */
+class PacketRing {
+public:
+    typedef std::function<void(Packet* packet)> PacketHandler;
+
+    static const size_t DEFAULT_SIZE = 256;
+
+private:
+    std::vector<Packet*> slots;
+    size_t               mask;
+    // written by the producer and the consumer, on own cache lines:
+    std::atomic<size_t>  tail;
+    char                 tailPadding[PacketPool::CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>  head;
+    char                 headPadding[PacketPool::CACHE_LINE - sizeof(std::atomic<size_t>)];
+    size_t               reclaimed; // producer only
+
+public:
+    /* Forbid creating default copy ctor: */
+    PacketRing(PacketRing& that) = delete;
+
+    explicit PacketRing(size_t size = DEFAULT_SIZE);
+
+    bool push(Packet* packet, PacketPool& pool);
+    void reclaim(PacketPool& pool);
+    size_t drain(const PacketHandler& handler);
+    size_t getSize() const;
+};
+
+#endif // PACKET_POOL_HPP
@@ -0,0 +1,108 @@
+#include "path_mtu.hpp"
+
+bool PathMtu::enabled = false;
+
+const int PathMtu::BASE_MTU;
+const int PathMtu::PROBE_TIMEOUT;
+const int PathMtu::MAX_PROBES;
+const int PathMtu::SEARCH_STEP;
+const int PathMtu::RAISE_INTERVAL;
+
+/**
+ * @brief PathMtu constructor - the configured MTU
+ * is used until the search shows that it is too big
+ */
+PathMtu::PathMtu(int maxMtu)
+    : maxMtu(maxMtu < BASE_MTU ? BASE_MTU : maxMtu),
+      mtu(this->maxMtu),
+      low(BASE_MTU),
+      high(this->maxMtu),
+      next(this->maxMtu),
+      probing(0),
+      lost(0),
+      searching(true) {
+}
+
+/**
+ * @brief nextProbe - called periodically by the tunnel
+ * @return size of the probe to be sent now, 0 - nothing to send
+ */
+int PathMtu::nextProbe(TimePoint now) {
+    if(!searching) {
+        if(mtu < maxMtu &&
+           now - searchedAt >= std::chrono::milliseconds(RAISE_INTERVAL))
+            startSearch(mtu);
+        else
+            return 0;
+    }
+
+    if(probing != 0) {
+        if(now - sentAt < std::chrono::milliseconds(PROBE_TIMEOUT))
+            return 0;
+        if(++lost < MAX_PROBES) {
+            sentAt = now;
+            return probing; // the probe itself may be lost, send it again
+        }
+        // the size does not get through:
+        high    = probing - 1;
+        next    = (low + high + 1) / 2;
+        probing = 0;
+        lost    = 0;
+    }
+
+    if(high - low < SEARCH_STEP) {
+        searching  = false;
+        searchedAt = now;
+        mtu        = low;
+        return 0;
+    }
+
+    probing = next;
+    sentAt  = now;
+    return probing;
+}
+
+/**
+ * @brief onAck - the probe in flight is acknowledged
+ */
+void PathMtu::onAck() {
+    if(probing == 0)
+        return;
+    low     = probing;
+    next    = (low + high + 1) / 2;
+    probing = 0;
+    lost    = 0;
+}
+
+int PathMtu::getMtu() const {
+    return mtu;
+}
+
+int PathMtu::getMaxMtu() const {
+    return maxMtu;
+}
+
+bool PathMtu::isSearching() const {
+    return searching;
+}
+
+/**
+ * @brief setEnabled - discovery of the tunnels established from now,
+ * must be called before the worker threads are started
+ */
+void PathMtu::setEnabled(bool enable) {
+    enabled = enable;
+}
+
+bool PathMtu::isEnabled() {
+    return enabled;
+}
+
+void PathMtu::startSearch(int from) {
+    searching = true;
+    low       = from;
+    high      = maxMtu;
+    next      = maxMtu;
+    probing   = 0;
+    lost      = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef PATH_MTU_HPP
+#define PATH_MTU_HPP
+
+#include <chrono>
+
+/**
+ * @brief The PathMtu class<br>
+ * Packetization layer path MTU discovery (RFC 8899) of one tunnel.<br>
+ * The server sends PROBE control messages of the size of a tunnel<br>
+ * packet, a probe answered by ACK shows that DTLS records of that<br>
+ * size get to the client without IP fragmentation. The first probe<br>
+ * has the configured MTU, if it is lost MAX_PROBES times the MTU<br>
+ * is found by binary search between BASE_MTU and the lost size.<br>
+ * ICMP is not needed, so it works behind NATs that drop it.<br>
+ * After RAISE_INTERVAL larger sizes are probed again, the path<br>
+ * of a mobile client may change.<br>
+ * Enabled for all tunnels at startup, see 'setEnabled'.<br>
+ */
+class PathMtu {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const int BASE_MTU       = 576;    // assumed to get through
+    static const int PROBE_TIMEOUT  = 1000;   // ms to wait for ACK
+    static const int MAX_PROBES     = 3;      // lost probes of one size
+    static const int SEARCH_STEP    = 16;     // accuracy of the search
+    static const int RAISE_INTERVAL = 600000; // ms until sizes are probed again
+
+private:
+    static bool enabled;
+
+    int       maxMtu;  // configured MTU
+    int       mtu;     // MTU of the tunnel
+    int       low;     // largest acknowledged size
+    int       high;    // smallest lost size - 1
+    int       next;    // size of the next probe
+    int       probing; // size of the probe in flight, 0 - none
+    int       lost;
+    bool      searching;
+    TimePoint sentAt;
+    TimePoint searchedAt;
+
+public:
+    explicit PathMtu(int maxMtu);
+
+    int nextProbe(TimePoint now);
+    void onAck();
+    int getMtu() const;
+    int getMaxMtu() const;
+    bool isSearching() const;
+
+    static void setEnabled(bool enable);
+    static bool isEnabled();
+
+private:
+    void startSearch(int from);
+};
+
+#endif // PATH_MTU_HPP
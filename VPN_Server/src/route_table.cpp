@@ -0,0 +1,170 @@
+#include "route_table.hpp"
+
+#include <initializer_list>
+
+const size_t RouteTable::PAGE_SIZE;
+
+/**
+ * @brief RouteTable constructor - no routes
+ * @param networkAddress - virtual network address
+ * @param prefixLength   - virtual network mask bits (from 0 to 32)
+ * @param prefixes       - prefixes of the virtual IPv6 network,
+ *                         nullptr - no IPv6 routes
+ */
+RouteTable::RouteTable(in_addr_t networkAddress, uint32_t prefixLength,
+                       const IP6Manager* prefixes)
+    : prefixes(prefixes) {
+    if(prefixLength > 32)
+        prefixLength = 32;
+
+    uint64_t mask = prefixLength == 0 ? 0 :
+        (0xffffffffULL << (32 - prefixLength)) & 0xffffffffULL;
+    network = ntohl(networkAddress) & mask;
+    size    = 1ULL << (32 - prefixLength);
+    createPages(pages, size);
+    createPages(pages6, prefixes != nullptr ? prefixes->getCapacity() : 0);
+}
+
+RouteTable::~RouteTable() {
+    deletePages(pages);
+    deletePages(pages6);
+}
+
+/**
+ * @brief add - routes packets to 'ip' to the tunnel
+ * @param loop - event loop of the worker that serves the tunnel
+ * @return false if the address is not in the network
+ */
+bool RouteTable::add(in_addr_t ip, Tunnel* tunnel, EventLoop* loop) {
+    size_t index = 0;
+    if(!getIndex(ip, index))
+        return false;
+
+    addAt(pages, index, tunnel, loop);
+    return true;
+}
+
+/**
+ * @brief remove - removes the route if it still leads to the tunnel
+ */
+void RouteTable::remove(in_addr_t ip, Tunnel* tunnel) {
+    size_t index = 0;
+    if(getIndex(ip, index))
+        removeAt(pages, index, tunnel);
+}
+
+/**
+ * @brief find - looks up the tunnel of the destination address.
+ * The tunnel may be used only by the thread of 'loop',
+ * other threads must hand the packet to that loop.
+ * @param loop - event loop of the worker that serves the tunnel
+ * @return tunnel or nullptr if there's no route
+ */
+Tunnel* RouteTable::find(in_addr_t ip, EventLoop*& loop) const {
+    size_t index = 0;
+    if(!getIndex(ip, index))
+        return nullptr;
+    return findAt(pages, index, loop);
+}
+
+/**
+ * @brief add - routes packets to the prefix of 'ip' to the tunnel
+ * @return false if the address is not in the IPv6 network
+ */
+bool RouteTable::add(const in6_addr& ip, Tunnel* tunnel, EventLoop* loop) {
+    size_t index = 0;
+    if(prefixes == nullptr || !prefixes->indexOf(ip, index))
+        return false;
+
+    addAt(pages6, index, tunnel, loop);
+    return true;
+}
+
+void RouteTable::remove(const in6_addr& ip, Tunnel* tunnel) {
+    size_t index = 0;
+    if(prefixes != nullptr && prefixes->indexOf(ip, index))
+        removeAt(pages6, index, tunnel);
+}
+
+/**
+ * @brief find - looks up the tunnel of the prefix that contains
+ * the destination address, see 'find' of IPv4 addresses
+ */
+Tunnel* RouteTable::find(const in6_addr& ip, EventLoop*& loop) const {
+    size_t index = 0;
+    if(prefixes == nullptr || !prefixes->indexOf(ip, index))
+        return nullptr;
+    return findAt(pages6, index, loop);
+}
+
+size_t RouteTable::allocatedPages() const {
+    size_t count = 0;
+    for(const Pages* table : { &pages, &pages6 }) {
+        for(size_t i = 0; i < table->count; ++i) {
+            if(table->routes[i].load(std::memory_order_relaxed) != nullptr)
+                ++count;
+        }
+    }
+    return count;
+}
+
+bool RouteTable::getIndex(in_addr_t ip, size_t& index) const {
+    uint32_t host = ntohl(ip);
+    if(host < network || host - network >= size)
+        return false;
+    index = host - network;
+    return true;
+}
+
+void RouteTable::addAt(Pages& table, size_t index, Tunnel* tunnel, EventLoop* loop) {
+    std::atomic<Route*>& page = table.routes[index / PAGE_SIZE];
+    Route* routes = page.load(std::memory_order_acquire);
+    if(routes == nullptr) {
+        std::lock_guard<std::mutex> lock(pagesMutex);
+        routes = page.load(std::memory_order_acquire);
+        if(routes == nullptr) {
+            routes = new Route[PAGE_SIZE];
+            for(size_t i = 0; i < PAGE_SIZE; ++i) {
+                routes[i].tunnel.store(nullptr, std::memory_order_relaxed);
+                routes[i].loop.store(nullptr, std::memory_order_relaxed);
+            }
+            page.store(routes, std::memory_order_release);
+        }
+    }
+
+    // the loop is published together with the tunnel:
+    Route& route = routes[index % PAGE_SIZE];
+    route.loop.store(loop, std::memory_order_relaxed);
+    route.tunnel.store(tunnel, std::memory_order_release);
+}
+
+void RouteTable::removeAt(Pages& table, size_t index, Tunnel* tunnel) {
+    Route* routes = table.routes[index / PAGE_SIZE].load(std::memory_order_acquire);
+    if(routes == nullptr)
+        return;
+    routes[index % PAGE_SIZE].tunnel.compare_exchange_strong(tunnel, nullptr);
+}
+
+Tunnel* RouteTable::findAt(const Pages& table, size_t index, EventLoop*& loop) const {
+    Route* routes = table.routes[index / PAGE_SIZE].load(std::memory_order_acquire);
+    if(routes == nullptr)
+        return nullptr;
+
+    Route& route = routes[index % PAGE_SIZE];
+    Tunnel* tunnel = route.tunnel.load(std::memory_order_acquire);
+    loop = route.loop.load(std::memory_order_relaxed);
+    return tunnel;
+}
+
+void RouteTable::createPages(Pages& table, size_t size) {
+    table.count  = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    table.routes = new std::atomic<Route*>[table.count];
+    for(size_t i = 0; i < table.count; ++i)
+        table.routes[i].store(nullptr, std::memory_order_relaxed);
+}
+
+void RouteTable::deletePages(Pages& table) {
+    for(size_t i = 0; i < table.count; ++i)
+        delete[] table.routes[i].load(std::memory_order_relaxed);
+    delete[] table.routes;
+}
@@ -0,0 +1,82 @@
+#ifndef ROUTE_TABLE_HPP
+#define ROUTE_TABLE_HPP
+
+#include "ip_manager.hpp"
+
+#include <atomic>
+#include <mutex>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+class EventLoop;
+class Tunnel;
+
+/**
+ * @brief The RouteTable class<br>
+ * Maps tunnel addresses of clients to their tunnels when all<br>
+ * clients share one TUN device. Routes are indexed directly by<br>
+ * the host offset inside the virtual network and are kept in pages<br>
+ * allocated on first use, so a /8 costs only the pages of addresses<br>
+ * given to clients. IPv6 routes are indexed the same way by the index<br>
+ * of the prefix of the client (see IP6Manager).<br>
+ * Every worker looks routes up without locks,<br>
+ * a route is changed only by the worker that serves its tunnel.<br>
+ */
+class RouteTable {
+public:
+    static const size_t PAGE_SIZE = 4096; // routes per page
+
+private:
+    /**
+     * @brief The Route struct - tunnel and event loop of its worker
+     */
+    struct Route {
+        std::atomic<Tunnel*>    tunnel;
+        std::atomic<EventLoop*> loop;
+    };
+
+    /**
+     * @brief The Pages struct - routes of one address family by index
+     */
+    struct Pages {
+        size_t               count;
+        std::atomic<Route*>* routes;
+    };
+
+    uint32_t             network; // host byte order
+    size_t               size;    // addresses in the network
+    Pages                pages;
+    const IP6Manager*    prefixes; // nullptr - no IPv6 routes
+    Pages                pages6;
+    std::mutex           pagesMutex; // taken to allocate a page
+
+public:
+    /* Forbid creating default copy ctor: */
+    RouteTable(RouteTable& that) = delete;
+
+    explicit RouteTable(in_addr_t networkAddress, uint32_t prefixLength,
+                        const IP6Manager* prefixes = nullptr);
+    ~RouteTable();
+
+    bool add(in_addr_t ip, Tunnel* tunnel, EventLoop* loop);
+    void remove(in_addr_t ip, Tunnel* tunnel);
+    Tunnel* find(in_addr_t ip, EventLoop*& loop) const;
+    bool add(const in6_addr& ip, Tunnel* tunnel, EventLoop* loop);
+    void remove(const in6_addr& ip, Tunnel* tunnel);
+    Tunnel* find(const in6_addr& ip, EventLoop*& loop) const;
+    size_t allocatedPages() const;
+
+private:
+    bool getIndex(in_addr_t ip, size_t& index) const;
+    void addAt(Pages& table, size_t index, Tunnel* tunnel, EventLoop* loop);
+    void removeAt(Pages& table, size_t index, Tunnel* tunnel);
+    Tunnel* findAt(const Pages& table, size_t index, EventLoop*& loop) const;
+
+    static void createPages(Pages& table, size_t size);
+    static void deletePages(Pages& table);
+};
+
+#endif // ROUTE_TABLE_HPP
@@ -0,0 +1,423 @@
+#include "session_cache.hpp"
+#include "tunnel_mgr.hpp"
+
+const size_t SessionCache::SHARDS;
+const int    SessionCache::LIFETIME;
+const size_t TicketKeys::NAME_SIZE;
+const size_t TicketKeys::KEY_SIZE;
+const size_t TicketKeys::NONCE_SIZE;
+const size_t TicketKeys::TAG_SIZE;
+const int    TicketKeys::ROTATION;
+
+SessionCache* SessionCache::attached = nullptr;
+
+namespace {
+
+void randomBytes(unsigned char* buffer, size_t size) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || read(fd, buffer, size) != (ssize_t)size) {
+        if(fd >= 0)
+            close(fd);
+        throw std::runtime_error("Cannot generate session ticket key");
+    }
+    close(fd);
+}
+
+} // namespace
+
+/**
+ * @brief SessionCache constructor
+ * @param capacity - max count of sessions, split between shards
+ * @param lifetime - seconds a session can be resumed
+ */
+SessionCache::SessionCache(size_t capacity, int lifetime)
+    : shardCapacity(capacity / SHARDS > 0 ? capacity / SHARDS : 1),
+      lifetime(lifetime),
+      hits(0),
+      misses(0),
+      evictions(0),
+      entriesCount(0) { }
+
+SessionCache::~SessionCache() {
+    if(attached == this)
+        attached = nullptr;
+}
+
+/**
+ * @brief attach - the context stores and looks up
+ * server sessions in this cache only
+ */
+void SessionCache::attach(WOLFSSL_CTX* ctx) {
+    attached = this;
+    wolfSSL_CTX_set_timeout(ctx, lifetime.count());
+#ifdef HAVE_EXT_CACHE
+    wolfSSL_CTX_set_session_cache_mode(ctx, WOLFSSL_SESS_CACHE_SERVER |
+                                            WOLFSSL_SESS_CACHE_NO_INTERNAL);
+    wolfSSL_CTX_sess_set_new_cb(ctx, &SessionCache::onNewSession);
+    wolfSSL_CTX_sess_set_get_cb(ctx, &SessionCache::onGetSession);
+    wolfSSL_CTX_sess_set_remove_cb(ctx, &SessionCache::onRemoveSession);
+#endif
+}
+
+/**
+ * @brief store - adds or replaces the session,
+ * the least recently used session of the shard is evicted if it is full
+ * @param id   - session ID
+ * @param data - serialized session
+ */
+void SessionCache::store(const std::string& id, const std::vector<unsigned char>& data) {
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.entries.find(id);
+    if(found != shard.entries.end()) {
+        found->second.data    = data;
+        found->second.expires = std::chrono::steady_clock::now() + lifetime;
+        shard.ages.splice(shard.ages.end(), shard.ages, found->second.age);
+        return;
+    }
+
+    if(shard.entries.size() >= shardCapacity) {
+        shard.entries.erase(shard.ages.front());
+        shard.ages.pop_front();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        --entriesCount;
+    }
+
+    Entry& entry  = shard.entries[id];
+    entry.data    = data;
+    entry.expires = std::chrono::steady_clock::now() + lifetime;
+    entry.age     = shard.ages.insert(shard.ages.end(), id);
+    ++entriesCount;
+}
+
+/**
+ * @brief find - looks up a session to resume, expired sessions are removed
+ * @param data - serialized session if it is found
+ * @return true on cache hit
+ */
+bool SessionCache::find(const std::string& id, std::vector<unsigned char>& data) {
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.entries.find(id);
+    if(found == shard.entries.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if(found->second.expires <= std::chrono::steady_clock::now()) {
+        shard.ages.erase(found->second.age);
+        shard.entries.erase(found);
+        --entriesCount;
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    data = found->second.data;
+    shard.ages.splice(shard.ages.end(), shard.ages, found->second.age);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void SessionCache::remove(const std::string& id) {
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.entries.find(id);
+    if(found == shard.entries.end())
+        return;
+    shard.ages.erase(found->second.age);
+    shard.entries.erase(found);
+    --entriesCount;
+}
+
+size_t SessionCache::size() const {
+    return entriesCount;
+}
+
+size_t SessionCache::capacity() const {
+    return shardCapacity * SHARDS;
+}
+
+uint64_t SessionCache::getHits() const {
+    return hits;
+}
+
+uint64_t SessionCache::getMisses() const {
+    return misses;
+}
+
+uint64_t SessionCache::getEvictions() const {
+    return evictions;
+}
+
+/**
+ * @brief hitRatio
+ * @return share of lookups that found a session, 0 without lookups
+ */
+double SessionCache::hitRatio() const {
+    uint64_t lookups = hits + misses;
+    return lookups == 0 ? 0 : double(hits) / lookups;
+}
+
+SessionCache::Shard& SessionCache::shardOf(const std::string& id) {
+    return shards[std::hash<std::string>()(id) % SHARDS];
+}
+
+#ifdef HAVE_EXT_CACHE
+/**
+ * @brief onNewSession - wolfSSL callback of a full handshake,
+ * the session is copied, so wolfSSL keeps its own reference
+ * @return 0 - no reference to 'session' is kept
+ */
+int SessionCache::onNewSession(WOLFSSL*, WOLFSSL_SESSION* session) {
+    unsigned int         idLength = 0;
+    const unsigned char* id       = wolfSSL_SESSION_get_id(session, &idLength);
+    int                  length   = wolfSSL_i2d_SSL_SESSION(session, nullptr);
+    if(attached == nullptr || id == nullptr || length <= 0)
+        return 0;
+
+    std::vector<unsigned char> data(length);
+    unsigned char* out = data.data();
+    if(wolfSSL_i2d_SSL_SESSION(session, &out) != length)
+        return 0;
+
+    attached->store(std::string(reinterpret_cast<const char*>(id), idLength), data);
+    return 0;
+}
+
+/**
+ * @brief onGetSession - wolfSSL callback of a client hello
+ * with a session ID
+ * @param copy - set to 0: wolfSSL frees the returned session
+ * @return new session or nullptr on cache miss
+ */
+WOLFSSL_SESSION* SessionCache::onGetSession(WOLFSSL*, const unsigned char* id,
+                                            int length, int* copy) {
+    *copy = 0;
+    std::vector<unsigned char> data;
+    if(attached == nullptr
+       || !attached->find(std::string(reinterpret_cast<const char*>(id), length), data))
+        return nullptr;
+
+    const unsigned char* in = data.data();
+    return wolfSSL_d2i_SSL_SESSION(nullptr, &in, data.size());
+}
+
+void SessionCache::onRemoveSession(WOLFSSL_CTX*, WOLFSSL_SESSION* session) {
+    unsigned int         idLength = 0;
+    const unsigned char* id       = wolfSSL_SESSION_get_id(session, &idLength);
+    if(attached != nullptr && id != nullptr)
+        attached->remove(std::string(reinterpret_cast<const char*>(id), idLength));
+}
+#endif
+
+/**
+ * @brief TicketKeys constructor - generates the first key
+ * @param rotation - seconds between key changes
+ */
+TicketKeys::TicketKeys(int rotation)
+    : hasPrevious(false),
+      rotation(rotation),
+      issued(0),
+      accepted(0),
+      renewed(0),
+      rejected(0) {
+    generate(current);
+}
+
+/**
+ * @brief attach - the context issues and accepts tickets of these keys,
+ * the lifetime hint tells clients when the ticket is renewed
+ */
+void TicketKeys::attach(WOLFSSL_CTX* ctx) {
+#ifdef HAVE_SESSION_TICKET
+    static_assert(WOLFSSL_TICKET_NAME_SZ >= NAME_SIZE &&
+                  WOLFSSL_TICKET_IV_SZ >= NONCE_SIZE &&
+                  WOLFSSL_TICKET_MAC_SZ >= TAG_SIZE,
+                  "ticket fields of wolfSSL are too small");
+    wolfSSL_CTX_set_TicketEncCb(ctx, &TicketKeys::onTicket);
+    wolfSSL_CTX_set_TicketEncCtx(ctx, this);
+    wolfSSL_CTX_set_TicketHint(ctx, rotation.count());
+#else
+    (void)ctx;
+#endif
+}
+
+/**
+ * @brief rotate - new tickets are encrypted with a new key,
+ * tickets of the current key will be renewed
+ */
+void TicketKeys::rotate() {
+    Key key;
+    generate(key);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    previous    = current;
+    current     = key;
+    hasPrevious = true;
+}
+
+/**
+ * @brief encrypt - encrypts the ticket in place with the current key
+ * @param name   - receives NAME_SIZE bytes, name of the key
+ * @param nonce  - receives NONCE_SIZE bytes
+ * @param tag    - receives TAG_SIZE bytes of the authentication tag
+ * @return false if the cipher failed
+ */
+bool TicketKeys::encrypt(unsigned char* name, unsigned char* nonce, unsigned char* tag,
+                         unsigned char* ticket, int length) {
+    unsigned char secret[KEY_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rotateIfExpired(std::chrono::steady_clock::now());
+        memcpy(name, current.name, NAME_SIZE);
+        memcpy(secret, current.secret, KEY_SIZE);
+        memcpy(nonce, current.noncePrefix, sizeof(current.noncePrefix));
+        memcpy(nonce + sizeof(current.noncePrefix), &current.counter,
+               sizeof(current.counter));
+        ++current.counter;
+    }
+
+    Aes aes;
+    bool done = wc_AesInit(&aes, nullptr, INVALID_DEVID) == 0;
+    done = done && wc_AesGcmSetKey(&aes, secret, KEY_SIZE) == 0
+                && wc_AesGcmEncrypt(&aes, ticket, ticket, length, nonce, NONCE_SIZE,
+                                    tag, TAG_SIZE, name, NAME_SIZE) == 0;
+    wc_AesFree(&aes);
+    memset(secret, 0, sizeof(secret));
+
+    if(done)
+        issued.fetch_add(1, std::memory_order_relaxed);
+    return done;
+}
+
+/**
+ * @brief decrypt - decrypts the ticket in place with the key of 'name'
+ * @return REJECTED if the key is unknown or the ticket is broken
+ */
+TicketKeys::Result TicketKeys::decrypt(const unsigned char* name,
+                                       const unsigned char* nonce,
+                                       const unsigned char* tag,
+                                       unsigned char* ticket, int length) {
+    unsigned char secret[KEY_SIZE];
+    Result        result = REJECTED;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rotateIfExpired(std::chrono::steady_clock::now());
+        if(memcmp(name, current.name, NAME_SIZE) == 0) {
+            memcpy(secret, current.secret, KEY_SIZE);
+            result = ACCEPTED;
+        } else if(hasPrevious && memcmp(name, previous.name, NAME_SIZE) == 0) {
+            memcpy(secret, previous.secret, KEY_SIZE);
+            result = RENEW;
+        }
+    }
+    if(result == REJECTED) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return REJECTED;
+    }
+
+    Aes aes;
+    bool done = wc_AesInit(&aes, nullptr, INVALID_DEVID) == 0;
+    done = done && wc_AesGcmSetKey(&aes, secret, KEY_SIZE) == 0
+                && wc_AesGcmDecrypt(&aes, ticket, ticket, length, nonce, NONCE_SIZE,
+                                    tag, TAG_SIZE, name, NAME_SIZE) == 0;
+    wc_AesFree(&aes);
+    memset(secret, 0, sizeof(secret));
+
+    if(!done) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return REJECTED;
+    }
+    (result == ACCEPTED ? accepted : renewed).fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t TicketKeys::getIssued() const {
+    return issued;
+}
+
+uint64_t TicketKeys::getAccepted() const {
+    return accepted;
+}
+
+uint64_t TicketKeys::getRenewed() const {
+    return renewed;
+}
+
+uint64_t TicketKeys::getRejected() const {
+    return rejected;
+}
+
+/**
+ * @brief rotateIfExpired - must be called with 'mutex' locked
+ */
+void TicketKeys::rotateIfExpired(TimePoint now) {
+    if(now - current.created < rotation)
+        return;
+
+    Key next;
+    try {
+        generate(next);
+    }
+    catch(const std::runtime_error& e) {
+        // keep the current key, the rotation is retried with the next ticket
+        static LogLimiter limiter;
+        TunnelManager::log(std::string() + e.what() + ", the ticket key is not rotated",
+                           Logger::ERROR, limiter);
+        return;
+    }
+
+    previous    = current;
+    current     = next;
+    hasPrevious = true;
+}
+
+void TicketKeys::generate(Key& key) {
+    randomBytes(key.name, NAME_SIZE);
+    randomBytes(key.secret, KEY_SIZE);
+    randomBytes(key.noncePrefix, sizeof(key.noncePrefix));
+    key.counter = 0;
+    key.created = std::chrono::steady_clock::now();
+}
+
+#ifdef HAVE_SESSION_TICKET
+/**
+ * @brief onTicket - wolfSSL callback to encrypt a new ticket
+ * or to decrypt a ticket of a client hello
+ * @param enc - 1 to encrypt
+ * @param ctx - TicketKeys
+ */
+int TicketKeys::onTicket(WOLFSSL*, unsigned char keyName[WOLFSSL_TICKET_NAME_SZ],
+                         unsigned char iv[WOLFSSL_TICKET_IV_SZ],
+                         unsigned char mac[WOLFSSL_TICKET_MAC_SZ],
+                         int enc, unsigned char* ticket, int inLength,
+                         int* outLength, void* ctx) {
+    TicketKeys* keys = static_cast<TicketKeys*>(ctx);
+    *outLength = inLength; // GCM doesn't change the length
+
+    // called from C code of wolfSSL, nothing may be thrown from here
+    try {
+        if(enc) {
+            return keys->encrypt(keyName, iv, mac, ticket, inLength) ?
+                        WOLFSSL_TICKET_RET_OK : WOLFSSL_TICKET_RET_FATAL;
+        }
+
+        switch (keys->decrypt(keyName, iv, mac, ticket, inLength)) {
+            case ACCEPTED:
+                return WOLFSSL_TICKET_RET_OK;
+            case RENEW:
+                return WOLFSSL_TICKET_RET_CREATE;
+            default:
+                return WOLFSSL_TICKET_RET_REJECT;
+        }
+    }
+    catch(const std::exception& e) {
+        static LogLimiter limiter;
+        TunnelManager::log(std::string() + "Session ticket error: " + e.what(),
+                           Logger::ERROR, limiter);
+        return enc ? WOLFSSL_TICKET_RET_FATAL : WOLFSSL_TICKET_RET_REJECT;
+    }
+}
+#endif
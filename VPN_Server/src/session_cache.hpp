@@ -0,0 +1,173 @@
+#ifndef SESSION_CACHE_HPP
+#define SESSION_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+#include <wolfssl/wolfcrypt/aes.h>
+
+/**
+ * @brief The SessionCache class<br>
+ * Server-side cache of DTLS sessions for resumption by session ID.<br>
+ * Sessions are kept serialized in shards with own locks and LRU<br>
+ * order, so the size is bounded and workers rarely wait for each other.<br>
+ * Replaces the internal cache of wolfSSL (needs HAVE_EXT_CACHE),<br>
+ * the callbacks of the context use the cache attached last.<br>
+ */
+class SessionCache {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const size_t SHARDS   = 16;
+    static const int    LIFETIME = 3600; // s, sessions of mobile clients
+
+private:
+    /**
+     * @brief The Entry struct - serialized session, its
+     * expiration time and position in the LRU list of the shard
+     */
+    struct Entry {
+        std::vector<unsigned char>       data;
+        TimePoint                        expires;
+        std::list<std::string>::iterator age;
+    };
+
+    /**
+     * @brief The Shard struct - sessions with IDs of the same hash
+     */
+    struct Shard {
+        std::mutex                             mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string>                 ages;  // least recently used first
+    };
+
+    Shard                 shards[SHARDS];
+    size_t                shardCapacity;
+    std::chrono::seconds  lifetime;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    std::atomic<size_t>   entriesCount;
+    static SessionCache*  attached;
+
+public:
+    /* Forbid creating default copy ctor: */
+    SessionCache(SessionCache& that) = delete;
+
+    explicit SessionCache(size_t capacity, int lifetime = LIFETIME);
+    ~SessionCache();
+
+    void attach(WOLFSSL_CTX* ctx);
+    void store(const std::string& id, const std::vector<unsigned char>& data);
+    bool find(const std::string& id, std::vector<unsigned char>& data);
+    void remove(const std::string& id);
+
+    size_t size() const;
+    size_t capacity() const;
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    uint64_t getEvictions() const;
+    double hitRatio() const;
+
+private:
+    Shard& shardOf(const std::string& id);
+#ifdef HAVE_EXT_CACHE
+    static int onNewSession(WOLFSSL* ssl, WOLFSSL_SESSION* session);
+    static WOLFSSL_SESSION* onGetSession(WOLFSSL* ssl, const unsigned char* id,
+                                         int length, int* copy);
+    static void onRemoveSession(WOLFSSL_CTX* ctx, WOLFSSL_SESSION* session);
+#endif
+};
+
+/**
+ * @brief The TicketKeys class<br>
+ * Keys of stateless session tickets: the session state is encrypted<br>
+ * by the server with AES-GCM and kept by the client.<br>
+ * The key is replaced every 'rotation' seconds, tickets of<br>
+ * the previous key are still accepted and renewed with the new one,<br>
+ * so a ticket lives from one to two rotation periods.<br>
+ * Needs HAVE_SESSION_TICKET, see 'attach'.<br>
+ */
+class TicketKeys {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const size_t NAME_SIZE   = 16;
+    static const size_t KEY_SIZE    = 32; // AES-256
+    static const size_t NONCE_SIZE  = 12;
+    static const size_t TAG_SIZE    = 16;
+    static const int    ROTATION    = 3600; // s
+
+    enum Result {
+        REJECTED, // unknown key or broken ticket: full handshake
+        ACCEPTED, // current key
+        RENEW     // previous key: accept and issue a new ticket
+    };
+
+private:
+    /**
+     * @brief The Key struct - secret, its public name and nonces:
+     * a random prefix and a counter, so a nonce is never reused
+     */
+    struct Key {
+        unsigned char name[NAME_SIZE];
+        unsigned char secret[KEY_SIZE];
+        unsigned char noncePrefix[4];
+        uint64_t      counter;
+        TimePoint     created;
+    };
+
+    std::mutex            mutex;
+    Key                   current;
+    Key                   previous;
+    bool                  hasPrevious;
+    std::chrono::seconds  rotation;
+    std::atomic<uint64_t> issued;
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> renewed;
+    std::atomic<uint64_t> rejected;
+
+public:
+    /* Forbid creating default copy ctor: */
+    TicketKeys(TicketKeys& that) = delete;
+
+    explicit TicketKeys(int rotation = ROTATION);
+
+    void attach(WOLFSSL_CTX* ctx);
+    void rotate();
+    bool encrypt(unsigned char* name, unsigned char* nonce, unsigned char* tag,
+                 unsigned char* ticket, int length);
+    Result decrypt(const unsigned char* name, const unsigned char* nonce,
+                   const unsigned char* tag, unsigned char* ticket, int length);
+
+    uint64_t getIssued() const;
+    uint64_t getAccepted() const;
+    uint64_t getRenewed() const;
+    uint64_t getRejected() const;
+
+private:
+    void rotateIfExpired(TimePoint now);
+    void generate(Key& key);
+#ifdef HAVE_SESSION_TICKET
+    static int onTicket(WOLFSSL* ssl, unsigned char keyName[WOLFSSL_TICKET_NAME_SZ],
+                        unsigned char iv[WOLFSSL_TICKET_IV_SZ],
+                        unsigned char mac[WOLFSSL_TICKET_MAC_SZ],
+                        int enc, unsigned char* ticket, int inLength,
+                        int* outLength, void* ctx);
+#endif
+};
+
+#endif // SESSION_CACHE_HPP
@@ -0,0 +1,216 @@
+#include "timer_wheel.hpp"
+
+const int TimerWheel::LEVEL_BITS;
+const int TimerWheel::SLOTS;
+const int TimerWheel::LEVELS;
+
+WheelTimer::WheelTimer(const Handler& handler)
+    : handler(handler),
+      wheel(nullptr),
+      slot(nullptr),
+      prev(nullptr),
+      next(nullptr),
+      expires(0),
+      owned(false) { }
+
+WheelTimer::~WheelTimer() {
+    cancel();
+}
+
+void WheelTimer::setHandler(const Handler& handler) {
+    this->handler = handler;
+}
+
+void WheelTimer::cancel() {
+    if(wheel != nullptr)
+        wheel->cancel(*this);
+}
+
+bool WheelTimer::isScheduled() const {
+    return wheel != nullptr;
+}
+
+/**
+ * @brief TimerWheel constructor
+ * @param tick - resolution of the wheel, deadlines are rounded up to it
+ * @param now  - time of tick zero
+ */
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, TimePoint now)
+    : tick(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+      start(now),
+      current(0),
+      count(0) {
+    for(int level = 0; level < LEVELS; ++level) {
+        for(int i = 0; i < SLOTS; ++i)
+            slots[level][i] = nullptr;
+    }
+}
+
+/**
+ * @brief TimerWheel destructor - pending timers are cancelled
+ * without running them, posted tasks are dropped
+ */
+TimerWheel::~TimerWheel() {
+    for(int level = 0; level < LEVELS; ++level) {
+        for(int i = 0; i < SLOTS; ++i) {
+            while(WheelTimer* timer = slots[level][i]) {
+                unlink(*timer);
+                timer->wheel = nullptr;
+                if(timer->owned)
+                    delete timer;
+            }
+        }
+    }
+}
+
+/**
+ * @brief schedule - the timer expires on the first tick after
+ * 'deadline', a scheduled timer is moved
+ */
+void TimerWheel::schedule(WheelTimer& timer, TimePoint deadline) {
+    if(timer.wheel != nullptr)
+        timer.wheel->cancel(timer);
+
+    uint64_t expires = toTick(deadline);
+    timer.expires = expires > current ? expires : current + 1;
+    timer.wheel   = this;
+    insert(timer);
+    ++count;
+}
+
+/**
+ * @brief schedule - the timer expires 'delay' from now
+ */
+void TimerWheel::schedule(WheelTimer& timer, std::chrono::milliseconds delay) {
+    schedule(timer, std::chrono::steady_clock::now() + delay);
+}
+
+/**
+ * @brief post - runs 'task' once 'delay' from now, the task
+ * cannot be cancelled and is dropped with the wheel
+ */
+void TimerWheel::post(std::chrono::milliseconds delay, const Task& task) {
+    WheelTimer* timer = new WheelTimer(task);
+    timer->owned = true;
+    schedule(*timer, delay);
+}
+
+void TimerWheel::cancel(WheelTimer& timer) {
+    if(timer.wheel != this)
+        return;
+
+    unlink(timer);
+    timer.wheel = nullptr;
+    --count;
+}
+
+/**
+ * @brief advance - turns the wheel up to 'now' and runs
+ * the handlers of the expired timers. Handlers may schedule
+ * and cancel any timers, including their own.
+ * @return count of expired timers
+ */
+size_t TimerWheel::advance(TimePoint now) {
+    if(now < start)
+        return 0;
+    uint64_t target = (now - start) / tick;
+    size_t   fired  = 0;
+
+    while(current < target) {
+        ++current;
+        // the lower wheel turned over, spread the next slot above:
+        for(int level = 1; level < LEVELS; ++level) {
+            uint64_t mask = (uint64_t(1) << (LEVEL_BITS * level)) - 1;
+            if((current & mask) != 0)
+                break;
+            cascade(level);
+        }
+
+        // timers scheduled by the handlers never get into this slot
+        WheelTimer** head = &slots[0][current & (SLOTS - 1)];
+        while(WheelTimer* timer = *head) {
+            unlink(*timer);
+            timer->wheel = nullptr;
+            --count;
+            ++fired;
+            // the handler may destroy the timer:
+            WheelTimer::Handler handler = timer->handler;
+            if(timer->owned)
+                delete timer;
+            if(handler)
+                handler();
+        }
+    }
+    return fired;
+}
+
+size_t TimerWheel::size() const {
+    return count;
+}
+
+std::chrono::milliseconds TimerWheel::getTick() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tick);
+}
+
+/**
+ * @brief insert - puts the timer into its slot on the lowest
+ * level that reaches its expiry tick
+ */
+void TimerWheel::insert(WheelTimer& timer) {
+    const uint64_t range = uint64_t(1) << (LEVEL_BITS * LEVELS);
+    uint64_t delta = timer.expires - current;
+    if(delta >= range) {
+        delta         = range - 1;
+        timer.expires = current + delta;
+    }
+
+    int level = 0;
+    while(delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1))))
+        ++level;
+    size_t index = (timer.expires >> (LEVEL_BITS * level)) & (SLOTS - 1);
+
+    timer.slot = &slots[level][index];
+    timer.prev = nullptr;
+    timer.next = *timer.slot;
+    if(timer.next != nullptr)
+        timer.next->prev = &timer;
+    *timer.slot = &timer;
+}
+
+void TimerWheel::unlink(WheelTimer& timer) {
+    if(timer.prev != nullptr)
+        timer.prev->next = timer.next;
+    else
+        *timer.slot = timer.next;
+    if(timer.next != nullptr)
+        timer.next->prev = timer.prev;
+    timer.slot = nullptr;
+    timer.prev = timer.next = nullptr;
+}
+
+/**
+ * @brief cascade - moves the timers of the current slot
+ * of 'level' to the levels below, they expire within
+ * one turn of the lower wheel
+ */
+void TimerWheel::cascade(int level) {
+    size_t      index = (current >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    WheelTimer* timer = slots[level][index];
+    slots[level][index] = nullptr;
+
+    while(timer != nullptr) {
+        WheelTimer* next = timer->next;
+        insert(*timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief toTick - the first tick at or after 'time'
+ */
+uint64_t TimerWheel::toTick(TimePoint time) const {
+    if(time <= start)
+        return 0;
+    auto elapsed = time - start;
+    return (elapsed + tick - std::chrono::nanoseconds(1)) / tick;
+}
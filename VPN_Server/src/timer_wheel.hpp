@@ -0,0 +1,97 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class TimerWheel;
+
+/**
+ * @brief The WheelTimer class<br>
+ * One-shot timer of a TimerWheel, usually a member of its owner.<br>
+ * Timers are linked into the slots of the wheel directly,<br>
+ * so scheduling and cancelling don't allocate.<br>
+ * A destroyed timer is cancelled.<br>
+ */
+class WheelTimer {
+public:
+    typedef std::function<void()> Handler;
+
+private:
+    friend class TimerWheel;
+
+    Handler      handler;
+    TimerWheel*  wheel;   // null - not scheduled
+    WheelTimer** slot;    // head of the list the timer is in
+    WheelTimer*  prev;
+    WheelTimer*  next;
+    uint64_t     expires; // tick of the wheel
+    bool         owned;   // posted task, deleted by the wheel
+
+public:
+    /* Forbid creating default copy ctor: */
+    WheelTimer(WheelTimer& that) = delete;
+
+    explicit WheelTimer(const Handler& handler = Handler());
+    ~WheelTimer();
+
+    void setHandler(const Handler& handler);
+    void cancel();
+    bool isScheduled() const;
+};
+
+/**
+ * @brief The TimerWheel class<br>
+ * Hierarchical timing wheel of one worker (Varghese and Lauck).<br>
+ * LEVELS wheels of SLOTS lists: a timer is put into the slot<br>
+ * of its expiry tick on the lowest level that reaches it, and<br>
+ * the slots of upper levels are spread over the levels below<br>
+ * when the lower wheel turns over. Scheduling and cancelling<br>
+ * take constant time, an expired timer is touched once per level<br>
+ * at most, whatever the number of timers. Deadlines are rounded<br>
+ * up to the tick, deadlines beyond the range expire at its end.<br>
+ * Not thread safe, the wheel is turned by its worker via 'advance'.<br>
+ */
+class TimerWheel {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    typedef std::function<void()>                 Task;
+
+    static const int LEVEL_BITS = 6;
+    static const int SLOTS      = 1 << LEVEL_BITS;
+    static const int LEVELS     = 4; // 2^24 ticks, ~19 days of 100 ms ticks
+
+private:
+    std::chrono::nanoseconds tick;
+    TimePoint                start;
+    uint64_t                 current; // ticks since 'start' that are done
+    size_t                   count;   // scheduled timers
+    WheelTimer*              slots[LEVELS][SLOTS];
+
+public:
+    /* Forbid creating default copy ctor: */
+    TimerWheel(TimerWheel& that) = delete;
+
+    explicit TimerWheel(std::chrono::milliseconds tick,
+                        TimePoint now = std::chrono::steady_clock::now());
+    ~TimerWheel();
+
+    void schedule(WheelTimer& timer, TimePoint deadline);
+    void schedule(WheelTimer& timer, std::chrono::milliseconds delay);
+    void post(std::chrono::milliseconds delay, const Task& task);
+    void cancel(WheelTimer& timer);
+    size_t advance(TimePoint now = std::chrono::steady_clock::now());
+    size_t size() const;
+    std::chrono::milliseconds getTick() const;
+
+private:
+    void insert(WheelTimer& timer);
+    void unlink(WheelTimer& timer);
+    void cascade(int level);
+    uint64_t toTick(TimePoint time) const;
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,421 @@
+#include "traffic_shaper.hpp"
+
+const int      TokenBucket::BURST_TIME;
+const uint64_t TokenBucket::MIN_BURST;
+const size_t   EgressQueue::LIMIT;
+const int      EgressScheduler::QUANTUM;
+const size_t   EgressScheduler::BUDGET;
+const size_t   EgressScheduler::PACKET_SIZE;
+const int      EgressScheduler::MIN_DELAY;
+
+TokenBucket::TokenBucket(uint64_t rate)
+    : rate(0), burst(0), tokens(0), updated(std::chrono::steady_clock::now()) {
+    setRate(rate);
+}
+
+/**
+ * @brief setRate - new rate in bytes per second (0 - unlimited),
+ * the bucket starts full
+ */
+void TokenBucket::setRate(uint64_t rate) {
+    this->rate = rate;
+    burst   = std::max<double>(MIN_BURST, rate * BURST_TIME / 1000.0);
+    tokens  = burst;
+    updated = std::chrono::steady_clock::now();
+}
+
+uint64_t TokenBucket::getRate() const {
+    return rate;
+}
+
+/**
+ * @brief consume - takes tokens for a packet of 'bytes'
+ * @return false if the bucket is empty, nothing is taken then
+ */
+bool TokenBucket::consume(int bytes, TimePoint now) {
+    if(rate == 0)
+        return true;
+
+    refill(now);
+    if(tokens <= 0)
+        return false;
+    tokens -= bytes;
+    return true;
+}
+
+/**
+ * @brief delay - time till the bucket has tokens again
+ */
+std::chrono::nanoseconds TokenBucket::delay(TimePoint now) const {
+    if(rate == 0)
+        return std::chrono::nanoseconds(0);
+
+    double elapsed = std::chrono::duration<double>(now - updated).count();
+    double missing = -(tokens + elapsed * rate);
+    if(missing < 0)
+        return std::chrono::nanoseconds(0);
+    return std::chrono::nanoseconds((int64_t)(missing * 1e9 / rate) + 1);
+}
+
+void TokenBucket::refill(TimePoint now) {
+    if(now <= updated)
+        return;
+    double elapsed = std::chrono::duration<double>(now - updated).count();
+    tokens  = std::min(burst, tokens + elapsed * rate);
+    updated = now;
+}
+
+RateLimits::RateLimits()
+    : defaultRate(0) { }
+
+/**
+ * @brief add - limit from the command line: RATE for all clients
+ * or HOST=RATE for the client connecting from HOST
+ * @throws std::invalid_argument for a bad host or rate
+ */
+void RateLimits::add(const std::string& limit) {
+    size_t separator = limit.find('=');
+    if(separator == std::string::npos)
+        setDefault(parseRate(limit));
+    else
+        set(limit.substr(0, separator), parseRate(limit.substr(separator + 1)));
+}
+
+void RateLimits::setDefault(uint64_t rate) {
+    std::lock_guard<std::mutex> lock(mutex);
+    defaultRate = rate;
+}
+
+/**
+ * @brief replace - all limits by 'limits' in the format of 'add'
+ * at once, so a reader never sees a part of them
+ * @throws std::invalid_argument for a bad limit, nothing is changed then
+ */
+void RateLimits::replace(const std::vector<std::string>& limits) {
+    RateLimits next;
+    for(const std::string& limit : limits)
+        next.add(limit);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    defaultRate = next.defaultRate;
+    clients.swap(next.clients);
+}
+
+/**
+ * @brief set - limit of the client connecting from 'host',
+ * replaces the default limit for this client
+ * @throws std::invalid_argument if 'host' is not an address
+ */
+void RateLimits::set(const std::string& host, uint64_t rate) {
+    std::string key = AccessPolicy::hostKey(host);
+    std::lock_guard<std::mutex> lock(mutex);
+    clients[key] = rate;
+}
+
+/**
+ * @brief forClient - bytes per second, 0 - unlimited
+ * @param host - client host address as in leases ("::ffff:a.b.c.d")
+ */
+uint64_t RateLimits::forClient(const std::string& host) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = clients.find(host);
+    return found != clients.end() ? found->second : defaultRate;
+}
+
+/**
+ * @brief parseRate - bits per second with an optional k, m or g
+ * suffix (decimal multiples), 0 - unlimited
+ * @return bytes per second
+ * @throws std::invalid_argument for anything else
+ */
+uint64_t RateLimits::parseRate(const std::string& text) {
+    char* end = nullptr;
+    if(text.empty() || !isdigit((unsigned char)text[0]))
+        throw std::invalid_argument("Invalid rate limit");
+    uint64_t rate = strtoull(text.c_str(), &end, 10);
+
+    uint64_t multiplier = 1;
+    switch(tolower((unsigned char)*end)) {
+    case '\0':
+        break;
+    case 'k':
+        multiplier = 1000;
+        break;
+    case 'm':
+        multiplier = 1000000;
+        break;
+    case 'g':
+        multiplier = 1000000000;
+        break;
+    default:
+        throw std::invalid_argument("Invalid rate limit");
+    }
+    if(*end != '\0' && end[1] != '\0')
+        throw std::invalid_argument("Invalid rate limit");
+    if(rate > UINT64_MAX / multiplier)
+        throw std::invalid_argument("Invalid rate limit");
+
+    return rate * multiplier / 8;
+}
+
+EgressQueue::EgressQueue()
+    : metrics(nullptr),
+      first(nullptr),
+      last(nullptr),
+      count(0),
+      deficit(0),
+      state(IDLE),
+      paused(false) { }
+
+/**
+ * @brief setSender - 'sender' encrypts and sends a packet of the queue,
+ * depth and drops of the queue are counted in 'metrics'
+ */
+void EgressQueue::setSender(const Sender& sender, TunnelMetrics& metrics) {
+    this->sender  = sender;
+    this->metrics = &metrics;
+}
+
+void EgressQueue::setResumeHandler(const ResumeHandler& handler) {
+    resumeHandler = handler;
+}
+
+/**
+ * @brief setRate - bytes per second, 0 - unlimited
+ */
+void EgressQueue::setRate(uint64_t rate) {
+    bucket.setRate(rate);
+}
+
+uint64_t EgressQueue::getRate() const {
+    return bucket.getRate();
+}
+
+/**
+ * @brief full - the producer must stop until the resume handler is called
+ */
+bool EgressQueue::full() {
+    if(count < LIMIT)
+        return false;
+    paused = true;
+    return true;
+}
+
+size_t EgressQueue::size() const {
+    return count;
+}
+
+EgressScheduler::EgressScheduler()
+    : packets(PACKET_SIZE),
+      loop(nullptr),
+      delayHistogram(nullptr),
+      timer(-1),
+      timerArmed(false),
+      wakeupPosted(false),
+      queued(0) { }
+
+EgressScheduler::~EgressScheduler() {
+    while(!round.empty())
+        remove(*round.front());
+    while(!waiting.empty())
+        remove(*waiting.front());
+}
+
+/**
+ * @brief attach - the scheduler runs after every batch of events
+ * of 'loop', must be attached before the listener so records
+ * are sent by the same iteration
+ */
+void EgressScheduler::attach(EventLoop& loop) {
+    this->loop = &loop;
+    loop.addFlushHandler([this]() { run(); });
+    timer = loop.addTimer([this]() { timerArmed = false; });
+}
+
+void EgressScheduler::detach() {
+    if(timer >= 0)
+        loop->removeTimer(timer);
+    timer = -1;
+}
+
+/**
+ * @brief enqueue - copies the packet to the queue
+ * @return false if the queue is full or the packet is longer
+ * than PACKET_SIZE (never for TUN MTU), the packet is dropped then
+ */
+bool EgressScheduler::enqueue(EgressQueue& queue, const char* data, int length) {
+    if(length > (int)PACKET_SIZE || queue.count >= EgressQueue::LIMIT) {
+        addCounter(queue.metrics->txQueueDrops, 1);
+        return false;
+    }
+
+    Packet* packet = packets.acquire();
+    memcpy(packet->payload(), data, length);
+    packet->length   = length;
+    packet->queuedAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    if(queue.last != nullptr)
+        queue.last->next = packet;
+    else
+        queue.first = packet;
+    queue.last = packet;
+    ++queue.count;
+    ++queued;
+    queue.metrics->txQueued.store(queue.count, std::memory_order_relaxed);
+
+    if(queue.state == EgressQueue::IDLE) {
+        queue.state   = EgressQueue::ACTIVE;
+        queue.deficit = 0;
+        round.push_back(&queue);
+    }
+    return true;
+}
+
+/**
+ * @brief remove - drops the packets of the queue,
+ * called before the owner of the queue is destroyed
+ */
+void EgressScheduler::remove(EgressQueue& queue) {
+    if(queue.state == EgressQueue::ACTIVE)
+        round.erase(std::find(round.begin(), round.end(), &queue));
+    else if(queue.state == EgressQueue::WAITING)
+        waiting.erase(std::find(waiting.begin(), waiting.end(), &queue));
+    release(queue);
+}
+
+/**
+ * @brief run - serves the round until it is empty
+ * or BUDGET packets are sent
+ */
+void EgressScheduler::run() {
+    if(round.empty() && waiting.empty())
+        return;
+
+    TimePoint now    = std::chrono::steady_clock::now();
+    size_t    budget = BUDGET;
+    wakeWaiting(now);
+    while(budget > 0 && !round.empty()) {
+        EgressQueue* queue = round.front();
+        round.pop_front();
+        serve(*queue, now, budget);
+    }
+
+    // the rest is sent by the next iteration:
+    if(!round.empty() && !wakeupPosted) {
+        wakeupPosted = true;
+        loop->post([this]() { wakeupPosted = false; });
+    }
+    if(!waiting.empty())
+        armTimer(now);
+}
+
+/**
+ * @brief size - packets waiting in all queues
+ */
+size_t EgressScheduler::size() const {
+    return queued;
+}
+
+/**
+ * @brief setDelayHistogram - the time from queueing a packet
+ * to sending its record is recorded to 'histogram'
+ */
+void EgressScheduler::setDelayHistogram(Histogram* histogram) {
+    delayHistogram = histogram;
+}
+
+/**
+ * @brief serve - one turn of the queue in the round
+ */
+void EgressScheduler::serve(EgressQueue& queue, TimePoint now, size_t& budget) {
+    int64_t nowNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now.time_since_epoch()).count();
+
+    queue.deficit += QUANTUM;
+    while(queue.first != nullptr && budget > 0 &&
+          queue.first->length <= queue.deficit) {
+        if(!queue.bucket.consume(queue.first->length, now)) {
+            queue.state = EgressQueue::WAITING;
+            waiting.push_back(&queue);
+            break;
+        }
+
+        Packet* packet = queue.first;
+        queue.first = packet->next;
+        if(queue.first == nullptr)
+            queue.last = nullptr;
+        --queue.count;
+        --queued;
+        queue.deficit -= packet->length;
+        --budget;
+
+        queue.sender(packet->payload(), packet->length);
+        if(delayHistogram != nullptr)
+            delayHistogram->record(std::chrono::nanoseconds(nowNanos - packet->queuedAt));
+        packets.release(packet);
+    }
+    queue.metrics->txQueued.store(queue.count, std::memory_order_relaxed);
+
+    if(queue.first == nullptr) {
+        queue.state   = EgressQueue::IDLE;
+        queue.deficit = 0;
+    } else if(queue.state == EgressQueue::ACTIVE) {
+        round.push_back(&queue);
+    }
+
+    if(queue.paused && queue.count <= EgressQueue::LIMIT / 2) {
+        queue.paused = false;
+        if(queue.resumeHandler)
+            queue.resumeHandler();
+    }
+}
+
+/**
+ * @brief wakeWaiting - queues with tokens again join the round
+ */
+void EgressScheduler::wakeWaiting(TimePoint now) {
+    for(size_t i = 0; i < waiting.size();) {
+        EgressQueue* queue = waiting[i];
+        if(queue->bucket.delay(now).count() > 0) {
+            ++i;
+            continue;
+        }
+        queue->state = EgressQueue::ACTIVE;
+        round.push_back(queue);
+        waiting[i] = waiting.back();
+        waiting.pop_back();
+    }
+}
+
+/**
+ * @brief armTimer - wakes the loop when the first waiting queue
+ * has tokens, but not earlier than MIN_DELAY
+ */
+void EgressScheduler::armTimer(TimePoint now) {
+    if(timerArmed || timer < 0)
+        return;
+
+    std::chrono::nanoseconds delay = waiting.front()->bucket.delay(now);
+    for(EgressQueue* queue : waiting)
+        delay = std::min(delay, queue->bucket.delay(now));
+    delay = std::max<std::chrono::nanoseconds>(delay,
+                std::chrono::milliseconds(MIN_DELAY));
+    loop->armTimer(timer, delay);
+    timerArmed = true;
+}
+
+void EgressScheduler::release(EgressQueue& queue) {
+    while(queue.first != nullptr) {
+        Packet* packet = queue.first;
+        queue.first = packet->next;
+        packets.release(packet);
+        --queued;
+    }
+    queue.last    = nullptr;
+    queue.count   = 0;
+    queue.deficit = 0;
+    queue.state   = EgressQueue::IDLE;
+    queue.paused  = false;
+    if(queue.metrics != nullptr)
+        queue.metrics->txQueued.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,189 @@
+#ifndef TRAFFIC_SHAPER_HPP
+#define TRAFFIC_SHAPER_HPP
+
+#include "event_loop.hpp"
+#include "metrics.hpp"
+#include "packet_filter.hpp"
+#include "packet_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief The TokenBucket class<br>
+ * Rate limit of one direction of a client. Tokens are bytes<br>
+ * refilled at 'rate' up to the burst of BURST_TIME of traffic.<br>
+ * A packet is passed while there are tokens left, so the bucket<br>
+ * may go below zero by one packet and no packet size is too big.<br>
+ */
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const int      BURST_TIME = 20;    // ms of traffic passed at once
+    static const uint64_t MIN_BURST  = 16384; // bytes
+
+private:
+    uint64_t  rate;  // bytes per second, 0 - unlimited
+    double    burst;
+    double    tokens;
+    TimePoint updated;
+
+public:
+    explicit TokenBucket(uint64_t rate = 0);
+
+    void setRate(uint64_t rate);
+    uint64_t getRate() const;
+    bool consume(int bytes, TimePoint now);
+    std::chrono::nanoseconds delay(TimePoint now) const;
+
+private:
+    void refill(TimePoint now);
+};
+
+/**
+ * @brief The RateLimits class<br>
+ * Rate limits of the clients in bytes per second (0 - unlimited):<br>
+ * the default one and limits of single clients by host address.<br>
+ * Limits are set at startup (see 'add') and may be changed<br>
+ * by the control API while the server runs, so the class<br>
+ * may be used from any thread.<br>
+ */
+class RateLimits {
+private:
+    mutable std::mutex                        mutex;
+    uint64_t                                  defaultRate;
+    std::unordered_map<std::string, uint64_t> clients; // by client host
+
+public:
+    /* Forbid creating default copy ctor: */
+    RateLimits(RateLimits& that) = delete;
+
+    explicit RateLimits();
+
+    void add(const std::string& limit);
+    void setDefault(uint64_t rate);
+    void replace(const std::vector<std::string>& limits);
+    void set(const std::string& host, uint64_t rate);
+    uint64_t forClient(const std::string& host) const;
+
+    static uint64_t parseRate(const std::string& text);
+};
+
+/**
+ * @brief The EgressQueue class<br>
+ * Packets read from TUN for one client, waiting to be encrypted.<br>
+ * The queue is served by the EgressScheduler of the worker,<br>
+ * its sender encrypts a packet and queues the record to the socket.<br>
+ * The producer stops reading when the queue is full and is resumed<br>
+ * by its resume handler when the queue is half empty again.<br>
+ */
+class EgressQueue {
+    friend class EgressScheduler;
+
+public:
+    typedef std::function<void(const char* data, int length)> Sender;
+    typedef std::function<void()>                              ResumeHandler;
+
+    static const size_t LIMIT = 128; // packets
+
+private:
+    enum State {
+        IDLE,    // empty
+        ACTIVE,  // in the round of the scheduler
+        WAITING  // backlogged, out of tokens
+    };
+
+    Sender         sender;
+    ResumeHandler  resumeHandler;
+    TunnelMetrics* metrics;
+    TokenBucket    bucket;
+    Packet*        first;
+    Packet*        last;
+    size_t         count;
+    int            deficit; // bytes the queue may send in this round
+    State          state;
+    bool           paused;  // the producer was told the queue is full
+
+public:
+    /* Forbid creating default copy ctor: */
+    EgressQueue(EgressQueue& that) = delete;
+
+    explicit EgressQueue();
+
+    void setSender(const Sender& sender, TunnelMetrics& metrics);
+    void setResumeHandler(const ResumeHandler& handler);
+    void setRate(uint64_t rate);
+    uint64_t getRate() const;
+    bool full();
+    size_t size() const;
+};
+
+/**
+ * @brief The EgressScheduler class<br>
+ * Deficit round robin over the egress queues of the tunnels<br>
+ * of one worker (M. Shreedhar, G. Varghese, 1995): every round<br>
+ * a backlogged queue may send QUANTUM bytes more, so a bulk<br>
+ * download gets the same share of the worker as an interactive<br>
+ * client and small packets wait at most one round.<br>
+ * Queues out of tokens leave the round until their bucket<br>
+ * is refilled, a one-shot timer resumes them.<br>
+ * The scheduler runs after the worker has dispatched its events<br>
+ * and sends up to BUDGET packets per loop iteration, the rest<br>
+ * is sent by the next iteration, so new events are not delayed<br>
+ * by long queues.<br>
+ */
+class EgressScheduler {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const int    QUANTUM     = 1500; // bytes per queue and round
+    static const size_t BUDGET      = 256;  // packets per loop iteration
+    static const size_t PACKET_SIZE = 2048; // larger packets are dropped
+    static const int    MIN_DELAY   = 1;    // ms, resolution of the timer
+
+private:
+    PacketPool                packets;
+    EventLoop*                loop;
+    Histogram*                delayHistogram;
+    std::deque<EgressQueue*>  round;
+    std::vector<EgressQueue*> waiting; // for tokens
+    int                       timer;
+    bool                      timerArmed;
+    bool                      wakeupPosted;
+    size_t                    queued; // packets of all queues
+
+public:
+    /* Forbid creating default copy ctor: */
+    EgressScheduler(EgressScheduler& that) = delete;
+
+    explicit EgressScheduler();
+    ~EgressScheduler();
+
+    void attach(EventLoop& loop);
+    void detach();
+    bool enqueue(EgressQueue& queue, const char* data, int length);
+    void remove(EgressQueue& queue);
+    void run();
+    size_t size() const;
+    void setDelayHistogram(Histogram* histogram);
+
+private:
+    void serve(EgressQueue& queue, TimePoint now, size_t& budget);
+    void wakeWaiting(TimePoint now);
+    void armTimer(TimePoint now);
+    void release(EgressQueue& queue);
+};
+
+#endif // TRAFFIC_SHAPER_HPP
@@ -0,0 +1,274 @@
+#include "tun_device.hpp"
+#include "tunnel_mgr.hpp"
+
+#include <algorithm>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+
+const int TunDevice::VNET_HEADER_SIZE;
+const int TunDevice::MAX_PACKET;
+const int TunDevice::MAX_FRAME;
+const int TunDevice::MAX_HEADERS;
+
+namespace {
+
+const uint8_t TCP_FLAG_FIN = 0x01;
+const uint8_t TCP_FLAG_PSH = 0x08;
+const uint8_t TCP_FLAG_CWR = 0x80;
+const size_t  TCP_FLAGS_OFFSET = 13;
+
+uint64_t sumWords(const uint8_t* data, size_t length, uint64_t sum) {
+    for(; length > 1; data += 2, length -= 2)
+        sum += (data[0] << 8) | data[1];
+    if(length == 1)
+        sum += data[0] << 8;
+    return sum;
+}
+
+void closeQueues(std::vector<int>& queues) {
+    for(int fd : queues)
+        close(fd);
+    queues.clear();
+}
+
+} // namespace
+
+/**
+ * @brief open - opens TUN interface with 'name'
+ * @param name   - interface name (e.g. "vpn_tun0")
+ * @param queues - count of queues to open, more than one
+ *                 needs MULTI_QUEUE flag
+ * @param flags  - combination of TunDevice::Flags
+ * @return descriptors of the queues
+ */
+std::vector<int> TunDevice::open(const std::string& name,
+                                 size_t queues,
+                                 int flags) {
+    if(queues == 0 || (queues > 1 && !(flags & MULTI_QUEUE)))
+        throw std::invalid_argument("Invalid TUN queues count");
+
+    std::vector<int> result;
+    for(size_t i = 0; i < queues; ++i) {
+        int interface = ::open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+        if(interface < 0) {
+            closeQueues(result);
+            throw std::runtime_error(std::string() +
+                                     "Cannot open /dev/net/tun: " +
+                                     strerror(errno));
+        }
+
+        ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+        if(flags & MULTI_QUEUE)
+            ifr.ifr_flags |= IFF_MULTI_QUEUE;
+        if(flags & VNET_HEADER)
+            ifr.ifr_flags |= IFF_VNET_HDR;
+        strncpy(ifr.ifr_name, name.c_str(), sizeof(ifr.ifr_name) - 1);
+
+        if (int status = ioctl(interface, TUNSETIFF, &ifr)) {
+            close(interface);
+            closeQueues(result);
+            throw std::runtime_error("Cannot get TUN interface\nStatus is: " +
+                                     std::to_string(status));
+        }
+        result.push_back(interface);
+
+        if(!(flags & VNET_HEADER))
+            continue;
+
+        int headerSize = VNET_HEADER_SIZE;
+        if(ioctl(interface, TUNSETVNETHDRSZ, &headerSize) < 0) {
+            closeQueues(result);
+            throw std::runtime_error(std::string() +
+                                     "Cannot set vnet header size: " +
+                                     strerror(errno));
+        }
+
+        // let the kernel pass TCP super-packets with partial checksums.
+        // Without offloads the device still works, packets are just small.
+        unsigned offloads = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN;
+        if(ioctl(interface, TUNSETOFFLOAD, offloads) < 0) {
+            TunnelManager::log(std::string() + "[" + name + "] "
+                               "TUN offloads are not supported: " +
+                               strerror(errno), std::cerr);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief segment - splits a frame read from IFF_VNET_HDR device
+ * into packets which fit the interface MTU. Per segment IP length, id,
+ * checksums, TCP sequence number and flags are fixed up.<br>
+ * Headers of every segment are written over the payload of
+ * the previous one, so 'handler' must consume the packet at once.
+ * @param frame   - vnet header followed by the packet
+ * @param length  - frame length
+ * @param handler - called for every resulting packet
+ * @return count of packets or -1 if the frame is malformed
+ */
+int TunDevice::segment(char* frame, int length, const PacketHandler& handler) {
+    if(length < VNET_HEADER_SIZE)
+        return -1;
+
+    VnetHeader vnet;
+    memcpy(&vnet, frame, sizeof(vnet));
+
+    char*  packet       = frame + VNET_HEADER_SIZE;
+    size_t packetLength = length - VNET_HEADER_SIZE;
+    int    gsoType      = vnet.gsoType & ~VnetHeader::GSO_ECN;
+
+    if(gsoType == VnetHeader::GSO_NONE) {
+        if((vnet.flags & VnetHeader::NEEDS_CSUM)
+           && !completeChecksum(packet, packetLength,
+                                vnet.csumStart, vnet.csumOffset))
+            return -1;
+        handler(packet, packetLength);
+        return 1;
+    }
+
+    if(gsoType != VnetHeader::GSO_TCPV4 && gsoType != VnetHeader::GSO_TCPV6)
+        return -1; // we didn't ask for UDP offloads
+
+    bool   ipv4      = gsoType == VnetHeader::GSO_TCPV4;
+    size_t l4Offset  = vnet.csumStart;
+    size_t mss       = vnet.gsoSize;
+    size_t ipMinimum = ipv4 ? sizeof(iphdr) : sizeof(ip6_hdr);
+
+    if(mss == 0 || l4Offset < ipMinimum || l4Offset + sizeof(tcphdr) > packetLength)
+        return -1;
+
+    size_t tcpLength     = ((uint8_t)packet[l4Offset + 12] >> 4) * 4;
+    size_t headersLength = l4Offset + tcpLength;
+    if(tcpLength < sizeof(tcphdr) || headersLength > packetLength
+       || headersLength > (size_t)MAX_HEADERS)
+        return -1;
+
+    char headers[MAX_HEADERS];
+    memcpy(headers, packet, headersLength);
+
+    tcphdr   tcp;
+    memcpy(&tcp, headers + l4Offset, sizeof(tcp));
+    uint32_t sequence = ntohl(tcp.seq);
+    uint8_t  tcpFlags = headers[l4Offset + TCP_FLAGS_OFFSET];
+    uint16_t ipId     = 0;
+    if(ipv4) {
+        iphdr ip;
+        memcpy(&ip, headers, sizeof(ip));
+        ipId = ntohs(ip.id);
+    }
+
+    size_t payloadLength = packetLength - headersLength;
+    int    count         = 0;
+
+    for(size_t offset = 0; offset < payloadLength; offset += mss, ++count) {
+        size_t chunk         = std::min(mss, payloadLength - offset);
+        size_t segmentLength = headersLength + chunk;
+        bool   last          = offset + chunk == payloadLength;
+        char*  segment       = packet + offset;
+        uint64_t pseudo      = 0;
+
+        memcpy(segment, headers, headersLength);
+
+        if(ipv4) {
+            iphdr* ip   = reinterpret_cast<iphdr*>(segment);
+            ip->tot_len = htons(segmentLength);
+            ip->id      = htons(ipId + count);
+            ip->check   = 0;
+            ip->check   = htons(checksum(ip, ip->ihl * 4));
+            pseudo      = sumWords((const uint8_t*)&ip->saddr, 8, 0);
+        } else {
+            ip6_hdr* ip = reinterpret_cast<ip6_hdr*>(segment);
+            ip->ip6_plen = htons(segmentLength - sizeof(ip6_hdr));
+            pseudo       = sumWords((const uint8_t*)&ip->ip6_src, 32, 0);
+        }
+        pseudo += IPPROTO_TCP + tcpLength + chunk;
+
+        tcphdr* segmentTcp = reinterpret_cast<tcphdr*>(segment + l4Offset);
+        uint8_t flags      = tcpFlags;
+        if(!last)
+            flags &= ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+        if(count != 0)
+            flags &= ~TCP_FLAG_CWR;
+        segment[l4Offset + TCP_FLAGS_OFFSET] = flags;
+        segmentTcp->seq   = htonl(sequence + offset);
+        segmentTcp->check = 0;
+        segmentTcp->check = htons(checksum(segmentTcp, tcpLength + chunk, pseudo));
+
+        handler(segment, segmentLength);
+    }
+
+    return count;
+}
+
+/**
+ * @brief write - writes single packet to TUN queue,
+ * prepends empty vnet header if the queue has one
+ */
+ssize_t TunDevice::write(int fd, bool vnetHeader,
+                         const char* packet, int length) {
+    if(!vnetHeader)
+        return ::write(fd, packet, length);
+
+    VnetHeader vnet;
+    memset(&vnet, 0, sizeof(vnet)); // GSO_NONE, checksum is valid
+
+    iovec iov[2];
+    iov[0].iov_base = &vnet;
+    iov[0].iov_len  = sizeof(vnet);
+    iov[1].iov_base = const_cast<char*>(packet);
+    iov[1].iov_len  = length;
+    return writev(fd, iov, 2);
+}
+
+/**
+ * @brief setMtu - MTU of the interface (SIOCSIFMTU)
+ * @return false if the kernel refuses it, errno is set
+ */
+bool TunDevice::setMtu(const std::string& name, int mtu) {
+    int sd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(sd < 0)
+        return false;
+
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name.c_str(), sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_mtu = mtu;
+    int status = ioctl(sd, SIOCSIFMTU, &ifr);
+    int error  = errno;
+    close(sd);
+    errno = error;
+    return status == 0;
+}
+
+/**
+ * @brief checksum - internet checksum (RFC 1071)
+ * @param initial - sum of words to include, e.g. of pseudo header
+ * @return checksum in host byte order
+ */
+uint16_t TunDevice::checksum(const void* data, size_t length,
+                             uint32_t initial) {
+    uint64_t sum = sumWords(static_cast<const uint8_t*>(data), length, initial);
+    while(sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+/**
+ * @brief completeChecksum - finishes partial (CHECKSUM_PARTIAL) checksum,
+ * the field already holds the pseudo header sum
+ */
+bool TunDevice::completeChecksum(char* packet, int length,
+                                 size_t start, size_t offset) {
+    if(start + offset + 2 > (size_t)length)
+        return false;
+
+    uint16_t sum = htons(checksum(packet + start, length - start));
+    memcpy(packet + start + offset, &sum, sizeof(sum));
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef TUN_DEVICE_HPP
+#define TUN_DEVICE_HPP
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/if_tun.h>
+
+/**
+ * @brief The VnetHeader struct<br>
+ * struct virtio_net_hdr (linux/virtio_net.h) prepended to packets<br>
+ * of IFF_VNET_HDR devices. The kernel header is not C++ clean.<br>
+ */
+struct VnetHeader {
+    enum Flags {
+        NEEDS_CSUM = 1 // checksum from csumStart must be completed
+    };
+
+    enum GsoType {
+        GSO_NONE  = 0,
+        GSO_TCPV4 = 1,
+        GSO_UDP   = 3,
+        GSO_TCPV6 = 4,
+        GSO_ECN   = 0x80
+    };
+
+    uint8_t  flags;
+    uint8_t  gsoType;
+    uint16_t hdrLen;     // length of IP + TCP headers
+    uint16_t gsoSize;    // payload of every segment (MSS)
+    uint16_t csumStart;  // offset of TCP header
+    uint16_t csumOffset; // offset of checksum field from csumStart
+};
+
+/**
+ * @brief The TunDevice class<br>
+ * Opens queues of TUN interfaces and handles the virtio-net<br>
+ * header of IFF_VNET_HDR devices.<br>
+ * With the vnet header the kernel may hand us a TCP super-packet<br>
+ * (up to 64 KB, GSO) in a single read(); 'segment' cuts it into<br>
+ * MSS-sized packets right before they are encrypted, so<br>
+ * bulk downloads need one TUN syscall per super-packet<br>
+ * instead of one per packet.<br>
+ */
+class TunDevice {
+public:
+    typedef std::function<void(const char* packet, int length)> PacketHandler;
+
+    enum Flags {
+        MULTI_QUEUE = 1, // IFF_MULTI_QUEUE, one queue per worker
+        VNET_HEADER = 2  // IFF_VNET_HDR with TSO/checksum offloads
+    };
+
+    static const int VNET_HEADER_SIZE = sizeof(VnetHeader);
+    static const int MAX_PACKET       = 65535;
+    static const int MAX_FRAME        = VNET_HEADER_SIZE + MAX_PACKET;
+    static const int MAX_HEADERS      = 256; // IP + TCP headers of GSO packet
+
+    /* Static helpers only: */
+    TunDevice() = delete;
+
+    static std::vector<int> open(const std::string& name,
+                                 size_t queues,
+                                 int flags);
+    static int segment(char* frame, int length, const PacketHandler& handler);
+    static ssize_t write(int fd, bool vnetHeader,
+                         const char* packet, int length);
+    static bool setMtu(const std::string& name, int mtu);
+    static uint16_t checksum(const void* data, size_t length,
+                             uint32_t initial = 0);
+
+private:
+    static bool completeChecksum(char* packet, int length,
+                                 size_t start, size_t offset);
+};
+
+#endif // TUN_DEVICE_HPP
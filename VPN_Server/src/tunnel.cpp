@@ -0,0 +1,1460 @@
+#include "tunnel.hpp"
+
+const int Tunnel::HANDSHAKE_TIMEOUT;
+const int Tunnel::CONTROL_RETRANSMIT;
+const int Tunnel::CONTROL_RETRIES;
+const int Tunnel::PIPELINE_CHECK;
+const uint64_t Tunnel::HEAVY_RATE;
+
+std::atomic<size_t> Tunnel::hibernatedCount(0);
+
+Tunnel::Tunnel(WOLFSSL* ssl,
+               DtlsListener& listener,
+               const sockaddr_in6& peer)
+    : interface(-1),
+      ownsInterface(false),
+      vnetHeader(false),
+      ssl(ssl),
+      listener(listener),
+      peer(peer),
+      serTunAddr(0),
+      cliTunAddr(0),
+      cliTunAddr6(in6addr_any),
+      cliPrefix6(0),
+      tunNumber(0),
+      loop(nullptr),
+      timers(nullptr),
+      packets(nullptr),
+      scheduler(nullptr),
+      workerMetrics(nullptr),
+      state(HANDSHAKE),
+      waitingWritable(false),
+      rxCount(0),
+      rxScheduled(false),
+      rxData(nullptr),
+      rxLength(0),
+      controlSequence(0),
+      parametersRetries(0),
+      parametersConfirmed(false),
+      probeSequence(0),
+      tunnelMtu(0),
+      sslContext(nullptr),
+      idleTime(0),
+      keepaliveSequence(0),
+      cryptoPool(nullptr),
+      checkedBytes(0),
+      recordEpoch(0),
+      sentRecord(0),
+      receivedRecord(0) {
+    created = retransmitAt = lastSent = lastReceived = parametersSentAt =
+            lastPacket = std::chrono::steady_clock::now();
+    bindSession();
+}
+
+Tunnel::~Tunnel() {
+    for(size_t i = 0; i < rxCount; ++i)
+        packets->release(rxBatch[i]);
+    if(scheduler != nullptr)
+        scheduler->remove(egress);
+    if(state == ESTABLISHED)
+        Metrics::instance().removeTunnel(&metrics);
+    if(pipeline)
+        stopPipeline();
+    else if(interface >= 0 && ssl != nullptr)
+        wolfSSL_shutdown(ssl);
+    if(ssl != nullptr)
+        wolfSSL_free(ssl);
+    if(!hibernated.empty())
+        --hibernatedCount;
+    if(interface >= 0 && ownsInterface)
+        ::close(interface);
+}
+
+/**
+ * @brief start - attaches the tunnel to the worker event loop,
+ * the DTLS handshake is driven by incoming datagrams
+ * @param loop          - event loop of the worker that serves the tunnel
+ * @param timers        - timer wheel of the worker
+ * @param packets       - packet buffers of the worker, must hold
+ *                        TunDevice::MAX_FRAME bytes
+ * @param scheduler     - serves the egress queues of the worker
+ * @param workerMetrics - latency histograms of the worker
+ * @param onEstablished - called when the handshake is done, must attach
+ *                        TUN interface to the tunnel (returns false if
+ *                        it cannot be done)
+ * @param onClose       - called once when the tunnel must be closed
+ */
+void Tunnel::start(EventLoop& loop,
+                   TimerWheel& timers,
+                   PacketPool& packets,
+                   EgressScheduler& scheduler,
+                   WorkerMetrics& workerMetrics,
+                   const EstablishHandler& onEstablished,
+                   const CloseHandler& onClose) {
+    this->loop          = &loop;
+    this->timers        = &timers;
+    this->packets       = &packets;
+    this->scheduler     = &scheduler;
+    this->workerMetrics = &workerMetrics;
+    establishHandler = onEstablished;
+    closeHandler     = onClose;
+
+    egress.setSender([this](const char* data, int length) {
+        sendPacket(data, length);
+    }, metrics);
+    egress.setResumeHandler([this]() { resumeInterface(); });
+
+    handshakeTimer.setHandler([this]() { onHandshakeTimer(); });
+    keepaliveTimer.setHandler([this]() { onKeepaliveTimer(); });
+    deadPeerTimer.setHandler([this]() { onDeadPeerTimer(); });
+    controlTimer.setHandler([this]() { onControlTimer(); });
+    probeTimer.setHandler([this]() { onProbeTimer(); });
+    idleTimer.setHandler([this]() { onIdleTimer(); });
+    pipelineTimer.setHandler([this]() { onPipelineTimer(); });
+    // no flight is sent yet:
+    retransmitAt = created + std::chrono::milliseconds(HANDSHAKE_TIMEOUT);
+    timers.schedule(handshakeTimer, retransmitAt);
+}
+
+/**
+ * @brief attachInterface - gives the tunnel its TUN interface,
+ * the tunnel owns the interface descriptor from now
+ * @param interface  - descriptor or -1 if the tunnel uses the shared
+ *                     TUN device, see 'useSharedQueue'
+ * @param vnetHeader - the interface was opened with IFF_VNET_HDR
+ */
+void Tunnel::attachInterface(int interface,
+                             bool vnetHeader,
+                             const std::string& tunStr,
+                             in_addr_t serTunAddr,
+                             in_addr_t cliTunAddr,
+                             size_t tunNumber,
+                             ClientParameters* cliParams) {
+    this->interface     = interface;
+    this->ownsInterface = interface >= 0;
+    this->vnetHeader    = vnetHeader;
+    this->tunStr     = tunStr;
+    this->serTunAddr = serTunAddr;
+    this->cliTunAddr = cliTunAddr;
+    this->tunNumber  = tunNumber;
+    this->cliParams.reset(cliParams);
+    filter.reset(new PacketFilter(cliTunAddr));
+}
+
+/**
+ * @brief setClientAddr6 - IPv6 address of the client and the length
+ * of its prefix, the client may send from any address of the prefix,
+ * called after 'attachInterface'
+ */
+void Tunnel::setClientAddr6(const in6_addr& address, uint8_t prefixLength) {
+    cliTunAddr6 = address;
+    cliPrefix6  = prefixLength;
+    filter->setClientAddr6(address, prefixLength);
+}
+
+/**
+ * @brief setAccessList - rules for packets of the client,
+ * called after 'attachInterface'
+ */
+void Tunnel::setAccessList(const AccessList& access) {
+    filter.reset(new PacketFilter(cliTunAddr, access));
+    if(cliPrefix6 != 0)
+        filter->setClientAddr6(cliTunAddr6, cliPrefix6);
+}
+
+/**
+ * @brief setRateLimit - limits both directions of the client
+ * @param rate - bytes per second, 0 - unlimited
+ */
+void Tunnel::setRateLimit(uint64_t rate) {
+    egress.setRate(rate);
+    ingress.setRate(rate);
+}
+
+/**
+ * @brief setParameters - new parameters of the client (DNS, route,
+ * MTU) while the tunnel runs, the established tunnel sends them
+ * until the client acknowledges them. A new MTU restarts
+ * the path MTU search. The tunnel owns 'cliParams' from now.
+ */
+void Tunnel::setParameters(ClientParameters* cliParams) {
+    this->cliParams.reset(cliParams);
+    if(state != ESTABLISHED)
+        return;
+
+    int mtu = cliParams->parametersToSend.getMtu();
+    if(pathMtu && pathMtu->getMaxMtu() != mtu) {
+        pathMtu.reset(new PathMtu(mtu));
+        timers->schedule(probeTimer, std::chrono::milliseconds(0));
+    }
+    if(pathMtu)
+        mtu = pathMtu->getMtu();
+    if(mtu != tunnelMtu)
+        setTunnelMtu(mtu);
+    updateParameters();
+}
+
+/**
+ * @brief setHibernation - the established tunnel hibernates
+ * after 'idleTime' without packets, needs wolfSSL with
+ * WOLFSSL_SESSION_EXPORT (the tunnel stays awake without it)
+ * @param sslContext - context of the sessions of the server
+ */
+void Tunnel::setHibernation(WOLFSSL_CTX* sslContext, std::chrono::seconds idleTime) {
+    this->sslContext = sslContext;
+    this->idleTime   = idleTime;
+}
+
+/**
+ * @brief setCryptoPool - the established tunnel moves its records
+ * to the pool when it forwards more than HEAVY_RATE, needs wolfSSL
+ * with ATOMIC_USER and an AES-GCM cipher suite (the tunnel stays
+ * on its worker without them)
+ */
+void Tunnel::setCryptoPool(CryptoPool* pool) {
+    cryptoPool = pool;
+}
+
+/**
+ * @brief useSharedQueue - incoming packets of the client are written
+ * to the queue of the shared TUN device, the worker owns the queue
+ * @param vnetHeader - the queue was opened with IFF_VNET_HDR
+ */
+void Tunnel::useSharedQueue(int queue, bool vnetHeader) {
+    this->interface     = queue;
+    this->ownsInterface = false;
+    this->vnetHeader    = vnetHeader;
+}
+
+/**
+ * @brief setOffloadHandler - the handler installs the kernel data path
+ * of an offload request, without it the requests are refused
+ */
+void Tunnel::setOffloadHandler(const OffloadHandler& handler) {
+    offloadHandler = handler;
+}
+
+/**
+ * @brief forward - sends the packet routed to the client
+ * by the worker from the shared TUN device
+ */
+void Tunnel::forward(const char* data, int length) {
+    if(state != ESTABLISHED)
+        return;
+
+    queuePacket(data, length);
+    lastSent = lastPacket = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief onDatagram - processes one datagram from the client
+ * @param data   - datagram payload
+ * @param length - payload length
+ */
+void Tunnel::onDatagram(const char* data, int length) {
+    if(state == CLOSED)
+        return;
+
+    // client repeats connect request in case of packet loss.
+    if(length == 2 && data[0] == ZERO_PACKET)
+        return;
+
+    rxData       = data;
+    rxLength     = length;
+    lastReceived = std::chrono::steady_clock::now();
+
+    if(state == ESTABLISHED) {
+        if(pipeline && pipeline->accepts(data, length)) {
+            if(pipeline->open(data, length))
+                flushLater();
+        } else if(wake()) {
+            readRecords();
+        }
+    } else if(!waitingWritable)
+        continueHandshake();
+
+    rxData = nullptr;
+}
+
+/**
+ * @brief onWritable - listener send queue has room again,
+ * resumes the handshake flight that was cut by WANT_WRITE
+ */
+void Tunnel::onWritable() {
+    waitingWritable = false;
+    if(state == HANDSHAKE)
+        continueHandshake();
+}
+
+/**
+ * @brief close - notifies the client, closes the interface descriptor
+ * (so the interface can be given to another client right away)
+ * and notifies the owner. The session is released by the destructor.
+ */
+void Tunnel::close() {
+    if(state == CLOSED)
+        return;
+
+    if(state == ESTABLISHED) {
+        flushReceived();
+        scheduler->remove(egress);
+        Metrics::instance().removeTunnel(&metrics);
+        if(pipeline)
+            stopPipeline();
+        else if(ssl != nullptr)
+            wolfSSL_shutdown(ssl);
+        if(ownsInterface) {
+            loop->removeFd(interface);
+            ::close(interface);
+        }
+        interface = -1;
+        TunnelManager::log("Client has been disconnected from tunnel [" +
+                           tunStr + "]");
+    }
+    state = CLOSED;
+    cancelTimers();
+    closeHandler(this);
+}
+
+/**
+ * @brief exportState - the session, interface and addresses
+ * of the tunnel for the new server process, the received packets
+ * are written to TUN before. The tunnel keeps working until
+ * 'handOff' is called.
+ * @return false if the tunnel is not established, its packets are
+ * forwarded by the kernel or by a crypto pipeline or wolfSSL cannot
+ * export the session
+ */
+bool Tunnel::exportState(HandoffTunnel& handoff) {
+    if(state != ESTABLISHED || offload || pipeline)
+        return false;
+
+    flushReceived();
+    if(!hibernated.empty())
+        handoff.session = hibernated;
+    else if(!exportSession(handoff.session))
+        return false;
+    handoff.peer             = peer;
+    handoff.interface        = ownsInterface ? interface : -1;
+    handoff.vnetHeader       = vnetHeader;
+    handoff.iface.number     = tunNumber;
+    handoff.iface.name       = tunStr;
+    handoff.iface.serverAddr = serTunAddr;
+    handoff.iface.clientAddr = cliTunAddr;
+    handoff.controlSequence  = controlSequence;
+    handoff.mtu              = tunnelMtu;
+    handoff.clientAddr6      = cliTunAddr6;
+    handoff.clientPrefix6    = cliPrefix6;
+    return true;
+}
+
+/**
+ * @brief restore - continues the session handed off by the previous
+ * server process instead of the handshake, called after 'start'
+ * and 'attachInterface'. The parameters were acknowledged
+ * by the client already.
+ * @return false if the session cannot be imported
+ */
+bool Tunnel::restore(const HandoffTunnel& handoff) {
+    if(state != HANDSHAKE || !importSession(handoff.session))
+        return false;
+
+    state = ESTABLISHED;
+    lastSent = lastReceived = std::chrono::steady_clock::now();
+    controlSequence     = handoff.controlSequence;
+    parametersConfirmed = true;
+    parametersRetries   = 0;
+
+    ControlMessage& parameters = cliParams->parametersToSend;
+    if(PathMtu::isEnabled())
+        pathMtu.reset(new PathMtu(parameters.getMtu()));
+    tunnelMtu = handoff.mtu != 0 ? handoff.mtu : parameters.getMtu();
+    parameters.setMtu(tunnelMtu);
+    startForwarding();
+
+    TunnelManager::log("Client of [" + tunStr + "] has been taken over");
+    return true;
+}
+
+/**
+ * @brief handOff - the new server process serves the client from now:
+ * the session is not shut down and the interface is not closed
+ * when the tunnel is destroyed
+ */
+void Tunnel::handOff() {
+    if(state == ESTABLISHED && ownsInterface)
+        loop->removeFd(interface);
+    interface     = -1;
+    ownsInterface = false;
+}
+
+Tunnel::State Tunnel::getState() const {
+    return state;
+}
+
+/**
+ * @brief hasInterface
+ * @return true if the interface was attached to the tunnel
+ * (even if its descriptor is closed already)
+ */
+bool Tunnel::hasInterface() const {
+    return !tunStr.empty();
+}
+
+/**
+ * @brief isSharedInterface
+ * @return true if the tunnel uses the shared TUN device
+ */
+bool Tunnel::isSharedInterface() const {
+    return hasInterface() && !ownsInterface;
+}
+
+const std::string& Tunnel::getTunStr() const {
+    return tunStr;
+}
+
+in_addr_t Tunnel::getServerAddr() const {
+    return serTunAddr;
+}
+
+in_addr_t Tunnel::getClientAddr() const {
+    return cliTunAddr;
+}
+
+bool Tunnel::hasClientAddr6() const {
+    return cliPrefix6 != 0;
+}
+
+const in6_addr& Tunnel::getClientAddr6() const {
+    return cliTunAddr6;
+}
+
+uint8_t Tunnel::getClientPrefix6() const {
+    return cliPrefix6;
+}
+
+size_t Tunnel::getTunNumber() const {
+    return tunNumber;
+}
+
+const TunnelMetrics& Tunnel::getMetrics() const {
+    return metrics;
+}
+
+const sockaddr_in6& Tunnel::getPeer() const {
+    return peer;
+}
+
+/**
+ * @brief getPeerHost - client host address as in leases ("::ffff:a.b.c.d")
+ */
+std::string Tunnel::getPeerHost() const {
+    char host[INET6_ADDRSTRLEN];
+    return inet_ntop(AF_INET6, &peer.sin6_addr, host, sizeof(host));
+}
+
+/**
+ * @brief getRateLimit - bytes per second, 0 - unlimited
+ */
+uint64_t Tunnel::getRateLimit() const {
+    return egress.getRate();
+}
+
+/**
+ * @brief getQueuedCount - packets waiting in the egress queue
+ */
+size_t Tunnel::getQueuedCount() const {
+    return egress.size();
+}
+
+/**
+ * @brief getOffload
+ * @return kernel data path of the tunnel or nullptr
+ */
+const XfrmSession* Tunnel::getOffload() const {
+    return offload.get();
+}
+
+bool Tunnel::isHibernated() const {
+    return !hibernated.empty();
+}
+
+bool Tunnel::isPipelined() const {
+    return pipeline != nullptr;
+}
+
+/**
+ * @brief getTimers - timer wheel of the worker that serves the tunnel
+ */
+TimerWheel* Tunnel::getTimers() const {
+    return timers;
+}
+
+/**
+ * @brief getHibernatedCount - hibernated tunnels of all workers
+ */
+size_t Tunnel::getHibernatedCount() {
+    return hibernatedCount;
+}
+
+/**
+ * @brief ioRecv - wolfSSL receive callback,
+ * hands the pending datagram (if any) to wolfSSL
+ */
+int Tunnel::ioRecv(WOLFSSL*, char* buf, int sz, void* ctx) {
+    Tunnel* tunnel = static_cast<Tunnel*>(ctx);
+
+    if(tunnel->rxData == nullptr)
+        return WOLFSSL_CBIO_ERR_WANT_READ;
+
+    int length = tunnel->rxLength < sz ? tunnel->rxLength : sz;
+    memcpy(buf, tunnel->rxData, length);
+    tunnel->rxData = nullptr; // one datagram per call
+    return length;
+}
+
+/**
+ * @brief ioSend - wolfSSL send callback,
+ * queues the record to the send queue of the shared listener socket
+ */
+int Tunnel::ioSend(WOLFSSL*, char* buf, int sz, void* ctx) {
+    Tunnel* tunnel = static_cast<Tunnel*>(ctx);
+
+    if(tunnel->cryptoPool != nullptr && !tunnel->pipeline)
+        tunnel->noteSentRecords(buf, sz);
+    if(!tunnel->listener.queue(tunnel->peer, buf, sz)) {
+        if(tunnel->state == HANDSHAKE) {
+            // handshake flight must be sent completely:
+            if(!tunnel->waitingWritable) {
+                tunnel->waitingWritable = true;
+                tunnel->listener.waitWritable(tunnel);
+            }
+            return WOLFSSL_CBIO_ERR_WANT_WRITE;
+        }
+        // socket is full, the datagram is lost like on the wire
+    }
+    return sz;
+}
+
+/**
+ * @brief genCookie - wolfSSL DTLS cookie callback
+ */
+int Tunnel::genCookie(WOLFSSL*, unsigned char* buf, int sz, void* ctx) {
+    Tunnel* tunnel = static_cast<Tunnel*>(ctx);
+    return DtlsListener::generateCookie(tunnel->peer, buf, sz);
+}
+
+/**
+ * @brief bindSession - routes wolfSSL I/O of the session
+ * through the listener
+ */
+void Tunnel::bindSession() {
+    wolfSSL_SetIOReadCtx(ssl, this);
+    wolfSSL_SetIOWriteCtx(ssl, this);
+    wolfSSL_SetCookieCtx(ssl, this);
+}
+
+/**
+ * @brief hibernate - keeps the exported session and frees the wolfSSL
+ * object with its record buffers, unless packets or control messages
+ * are in flight
+ */
+void Tunnel::hibernate() {
+    if(parametersRetries > 0 || rxCount > 0 || egress.size() > 0 ||
+       keepalive.isProbing() || (pathMtu && pathMtu->isSearching())) {
+        timers->schedule(idleTimer, std::chrono::milliseconds(CONTROL_RETRANSMIT));
+        return;
+    }
+
+    std::string session;
+    if(!exportSession(session)) {
+        static LogLimiter limiter;
+        TunnelManager::log("[" + tunStr + "] cannot export the session, "
+                           "the tunnel does not hibernate", Logger::ERROR, limiter);
+        sslContext = nullptr;
+        return;
+    }
+    wolfSSL_free(ssl);
+    ssl = nullptr;
+    hibernated.swap(session);
+    ++hibernatedCount;
+    if(Logger::enabled(Logger::DEBUG))
+        TunnelManager::log("[" + tunStr + "] hibernated", Logger::DEBUG);
+}
+
+/**
+ * @brief wake - imports the session of the hibernated tunnel
+ * into a new wolfSSL object
+ * @return false if the tunnel is closed
+ */
+bool Tunnel::wake() {
+    if(hibernated.empty())
+        return true;
+
+    ssl = wolfSSL_new(sslContext);
+    if(ssl == nullptr || !importSession(hibernated)) {
+        TunnelManager::log("[" + tunStr + "] cannot restore the hibernated session",
+                           Logger::ERROR);
+        if(ssl != nullptr)
+            wolfSSL_free(ssl);
+        ssl = nullptr;
+        close();
+        return false;
+    }
+    bindSession();
+    std::string().swap(hibernated);
+    --hibernatedCount;
+    // a keepalive of the client doesn't keep the tunnel awake:
+    timers->schedule(idleTimer, lastPacket + idleTime);
+    return true;
+}
+
+/**
+ * @brief continueHandshake - resumes wolfSSL_accept
+ * from the point where it wanted to read or write
+ */
+void Tunnel::continueHandshake() {
+    if(wolfSSL_accept(ssl) == SSL_SUCCESS) {
+        onEstablished();
+        return;
+    }
+
+    int e = wolfSSL_get_error(ssl, 0);
+    if(e == SSL_ERROR_WANT_READ) {
+        // a new flight is sent, wait for the reply:
+        armRetransmitTimer();
+    } else if(e != SSL_ERROR_WANT_WRITE) {
+        logSslError("[" + name() + "] wolfSSL_accept(ssl) failed");
+        close();
+    }
+}
+
+void Tunnel::armRetransmitTimer() {
+    retransmitAt = std::chrono::steady_clock::now() +
+                   std::chrono::seconds(wolfSSL_dtls_get_current_timeout(ssl));
+    timers->schedule(handshakeTimer,
+                     std::min(retransmitAt,
+                              created + std::chrono::milliseconds(HANDSHAKE_TIMEOUT)));
+}
+
+/**
+ * @brief onHandshakeTimer - handshake deadline and retransmission
+ * of the last flight
+ */
+void Tunnel::onHandshakeTimer() {
+    if(state != HANDSHAKE)
+        return;
+
+    TimePoint now = std::chrono::steady_clock::now();
+    if(now - created >= std::chrono::milliseconds(HANDSHAKE_TIMEOUT)) {
+        TunnelManager::log("[" + name() + "] handshake timed out");
+        close();
+        return;
+    }
+    // the flight is lost, let wolfSSL resend it:
+    if(!waitingWritable && now >= retransmitAt) {
+        if(wolfSSL_dtls_got_timeout(ssl) != SSL_SUCCESS) {
+            int e = wolfSSL_get_error(ssl, 0);
+            if(e != SSL_ERROR_WANT_READ && e != SSL_ERROR_WANT_WRITE) {
+                logSslError("[" + name() + "] handshake failed");
+                close();
+                return;
+            }
+        }
+    }
+    armRetransmitTimer();
+}
+
+/**
+ * @brief onKeepaliveTimer - sends a keepalive if nothing was sent
+ * for the keepalive interval and checks the probe in flight
+ */
+void Tunnel::onKeepaliveTimer() {
+    if(state != ESTABLISHED)
+        return;
+
+    TimePoint now = std::chrono::steady_clock::now();
+    if(keepalive.onTimeout(now) && Logger::enabled(Logger::DEBUG)) {
+        TunnelManager::log("[" + tunStr + "] keepalive probe is lost, interval " +
+                           std::to_string(keepalive.getInterval().count()) + " ms",
+                           Logger::DEBUG);
+    }
+
+    // a client keeps its session with keepalives, they wake the tunnel
+    if(!hibernated.empty()) {
+        timers->schedule(keepaliveTimer, now + keepalive.getInterval());
+        return;
+    }
+
+    // we are receiving for a long time but not sending
+    TimePoint due = lastSent + keepalive.getInterval();
+    if(now >= due) {
+        sendKeepalive(now);
+        lastSent = now;
+        due      = now + keepalive.getInterval();
+    }
+    if(keepalive.isProbing())
+        due = std::min(due, keepalive.getAckDeadline());
+    timers->schedule(keepaliveTimer, due);
+}
+
+/**
+ * @brief onDeadPeerTimer - closes the tunnel if nothing
+ * was received from the client for a long time
+ */
+void Tunnel::onDeadPeerTimer() {
+    if(state != ESTABLISHED)
+        return;
+
+    TimePoint deadline = lastReceived + Keepalive::getDeadPeerTimeout();
+    if(std::chrono::steady_clock::now() < deadline) {
+        timers->schedule(deadPeerTimer, deadline);
+        return;
+    }
+
+    if(!hibernated.empty())
+        TunnelManager::log("[" + tunStr + "] hibernated client is gone");
+    else
+        TunnelManager::log("[" + tunStr + "]" +
+                           "Sending for a long time but"
+                           " not receiving. Breaking...");
+    close();
+}
+
+/**
+ * @brief onControlTimer - the parameters or their ACK are lost
+ */
+void Tunnel::onControlTimer() {
+    if(state != ESTABLISHED || parametersRetries == 0)
+        return;
+
+    --parametersRetries;
+    sendParameters();
+    if(parametersRetries == 0)
+        TunnelManager::log("[" + tunStr + "] parameters are not acknowledged",
+                           std::cerr);
+}
+
+void Tunnel::onProbeTimer() {
+    if(state != ESTABLISHED || !pathMtu)
+        return;
+
+    if(hibernated.empty())
+        probePath(std::chrono::steady_clock::now());
+    timers->schedule(probeTimer, std::chrono::milliseconds(
+                         pathMtu->isSearching() ? PathMtu::PROBE_TIMEOUT
+                                                : PathMtu::RAISE_INTERVAL));
+}
+
+void Tunnel::onIdleTimer() {
+    if(state != ESTABLISHED || sslContext == nullptr || !hibernated.empty())
+        return;
+
+    TimePoint due = lastPacket + idleTime;
+    if(std::chrono::steady_clock::now() >= due)
+        hibernate(); // may be tried again later
+    else
+        timers->schedule(idleTimer, due);
+}
+
+/**
+ * @brief onPipelineTimer - moves the records of a heavy tunnel
+ * to the crypto pipeline
+ */
+void Tunnel::onPipelineTimer() {
+    if(state != ESTABLISHED || cryptoPool == nullptr || pipeline)
+        return;
+
+    uint64_t bytes = metrics.rxBytes + metrics.txBytes;
+    uint64_t rate  = (bytes - checkedBytes) * 1000 / PIPELINE_CHECK;
+    checkedBytes   = bytes;
+    // the records of the parameters and of the offload are wolfSSL's:
+    if(rate >= HEAVY_RATE && parametersConfirmed && hibernated.empty() && !offload)
+        startPipeline();
+    if(cryptoPool != nullptr && !pipeline)
+        timers->schedule(pipelineTimer, std::chrono::milliseconds(PIPELINE_CHECK));
+}
+
+void Tunnel::cancelTimers() {
+    handshakeTimer.cancel();
+    keepaliveTimer.cancel();
+    deadPeerTimer.cancel();
+    controlTimer.cancel();
+    probeTimer.cancel();
+    idleTimer.cancel();
+    pipelineTimer.cancel();
+}
+
+/**
+ * @brief onEstablished - attaches TUN interface, sends client
+ * parameters and starts forwarding packets
+ */
+void Tunnel::onEstablished() {
+    auto handshakeDuration = std::chrono::steady_clock::now() - created;
+    auto handshakeTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                handshakeDuration);
+
+    if(!establishHandler(*this)) {
+        close();
+        return;
+    }
+
+    state    = ESTABLISHED;
+    lastSent = std::chrono::steady_clock::now();
+    workerMetrics->handshake.record(handshakeDuration);
+    Metrics::instance().countHandshake(wolfSSL_session_reused(ssl) != 0);
+
+    TunnelManager::log("New client connected to [" + tunStr + "], handshake "
+                       "took " + std::to_string(handshakeTime.count()) + " ms");
+    ControlMessage& parameters = cliParams->parametersToSend;
+    parameters.setSequence(++controlSequence);
+    parameters.setFlags(ControlMessage::ACK_REQUESTED);
+    parametersRetries = CONTROL_RETRIES;
+    sendParameters();
+
+    tunnelMtu = parameters.getMtu();
+    if(PathMtu::isEnabled())
+        pathMtu.reset(new PathMtu(tunnelMtu));
+    startForwarding();
+}
+
+/**
+ * @brief startForwarding - publishes the metrics of the tunnel,
+ * starts reading its TUN interface and its timers
+ */
+void Tunnel::startForwarding() {
+    handshakeTimer.cancel();
+    TimePoint now = std::chrono::steady_clock::now();
+    timers->schedule(keepaliveTimer, now + keepalive.getInterval());
+    timers->schedule(deadPeerTimer, now + Keepalive::getDeadPeerTimeout());
+    if(pathMtu)
+        timers->schedule(probeTimer, now);
+    if(sslContext != nullptr)
+        timers->schedule(idleTimer, now + idleTime);
+    if(cryptoPool != nullptr)
+        timers->schedule(pipelineTimer, now + std::chrono::milliseconds(PIPELINE_CHECK));
+
+    metrics.tunnel = tunStr;
+    metrics.client = IPManager::getIpString(cliTunAddr);
+    Metrics::instance().addTunnel(&metrics);
+
+    // outgoing packets: TUN interface -> tunnel.
+    // (packets of the shared device are routed by the worker)
+    if(ownsInterface) {
+        loop->addFd(interface, EPOLLIN, [this](uint32_t) {
+            onInterfaceReadable();
+        });
+    }
+}
+
+/**
+ * @brief sendParameters - sends the parameters once,
+ * 'onControlTimer' sends them again until the client acknowledges them
+ */
+void Tunnel::sendParameters() {
+    parametersSentAt = std::chrono::steady_clock::now();
+    sendControl(cliParams->parametersToSend);
+    if(parametersRetries > 0)
+        timers->schedule(controlTimer, parametersSentAt +
+                         std::chrono::milliseconds(CONTROL_RETRANSMIT));
+}
+
+/**
+ * @brief sendKeepalive - a keepalive after an idle interval in both
+ * directions asks for ACK, it probes the NAT binding of the client
+ */
+void Tunnel::sendKeepalive(TimePoint now) {
+    if(keepalive.onSent(now, now - lastReceived >= keepalive.getInterval())) {
+        keepaliveSequence = ++controlSequence;
+        sendControl(ControlMessage(ControlMessage::KEEPALIVE, keepaliveSequence,
+                                   ControlMessage::ACK_REQUESTED));
+    } else {
+        sendControl(ControlMessage(ControlMessage::KEEPALIVE));
+    }
+    addCounter(metrics.keepalivesSent, 1);
+    if(Logger::enabled(Logger::DEBUG))
+        TunnelManager::log("sent keepalive", Logger::DEBUG);
+}
+
+void Tunnel::sendControl(const ControlMessage& message) {
+    if(!wake())
+        return;
+    int sent = sendRecord(message.data(), message.size());
+    if(sent < 0)
+        logSslError("Error sending control message: " + std::to_string(sent));
+}
+
+/**
+ * @brief sendRecord - sends a record that is not a packet,
+ * the crypto pipeline keeps it in order with the packets
+ * @return wolfSSL_send result
+ */
+int Tunnel::sendRecord(const char* data, int length) {
+    if(!pipeline)
+        return wolfSSL_send(ssl, data, length, MSG_NOSIGNAL);
+
+    if(pipeline->seal(RecordCipher::APPLICATION_DATA, data, length))
+        flushLater();
+    return length; // or lost like on the wire
+}
+
+/**
+ * @brief flushLater - 'onFlush' will be called when the worker
+ * has dispatched its events
+ */
+void Tunnel::flushLater() {
+    if(!rxScheduled) {
+        rxScheduled = true;
+        listener.flushLater(this);
+    }
+}
+
+/**
+ * @brief onInterfaceReadable - reads packets from TUN to the egress
+ * queue, while the queue is full the interface is not watched
+ */
+void Tunnel::onInterfaceReadable() {
+    int length = 0;
+    TunDevice::PacketHandler send = [this](const char* data, int length) {
+        queuePacket(data, length);
+    };
+
+    // super-packets are cut to MTU-sized packets before they are queued.
+    Packet* packet = packets->acquire();
+    char*   buffer = packet->payload();
+    while (!egress.full() &&
+           (length = read(interface, buffer, TunDevice::MAX_FRAME)) > 0) {
+        if(!vnetHeader) {
+            queuePacket(buffer, length);
+        } else if(TunDevice::segment(buffer, length, send) < 0) {
+            static LogLimiter limiter;
+            TunnelManager::log("[" + tunStr + "] malformed packet "
+                               "from TUN interface", Logger::ERROR, limiter);
+        }
+        lastSent = lastPacket = std::chrono::steady_clock::now();
+    }
+    packets->release(packet);
+
+    // the kernel keeps the packets, the scheduler resumes us
+    if(egress.full())
+        loop->modifyFd(interface, 0);
+}
+
+void Tunnel::queuePacket(const char* data, int length) {
+    if(!wake())
+        return;
+    scheduler->enqueue(egress, data, length);
+}
+
+/**
+ * @brief resumeInterface - the egress queue has room again
+ */
+void Tunnel::resumeInterface() {
+    if(state == ESTABLISHED && ownsInterface)
+        loop->modifyFd(interface, EPOLLIN);
+}
+
+void Tunnel::sendPacket(const char* data, int length) {
+    if(pipeline) {
+        // encrypted by the crypto threads, see 'startPipeline'
+        if(!pipeline->seal(RecordCipher::APPLICATION_DATA, data, length))
+            return;
+        flushLater();
+        addCounter(metrics.txPackets, 1);
+        addCounter(metrics.txBytes, length);
+        return;
+    }
+
+    TimePoint start = std::chrono::steady_clock::now();
+    // write the outgoing packet to the tunnel.
+    int sent = wolfSSL_send(ssl, data, length, MSG_NOSIGNAL);
+    addCounter(metrics.encryptNanos, elapsedNanos(start));
+
+    if(sent < 0) {
+        static LogLimiter limiter;
+        logSslError("sentData < 0", &limiter);
+        return;
+    }
+    addCounter(metrics.txPackets, 1);
+    addCounter(metrics.txBytes, length);
+}
+
+void Tunnel::readRecords() {
+    int length = 0;
+    // a pipeline started later must not accept the records read here:
+    RecordHeader header = RecordHeader();
+    bool tracked = cryptoPool != nullptr && rxData != nullptr &&
+                   RecordCipher::parseHeader(rxData, rxLength, header);
+
+    while (true) {
+        Packet* packet = packets->acquire();
+        char*   buffer = packet->payload();
+        TimePoint start = std::chrono::steady_clock::now();
+        length = wolfSSL_recv(ssl, buffer, TunDevice::MAX_PACKET, 0);
+        addCounter(metrics.decryptNanos, elapsedNanos(start));
+        if (length <= 0) {
+            packets->release(packet);
+            break;
+        }
+
+        if(tracked && header.epoch == recordEpoch)
+            receivedRecord = std::max(receivedRecord, header.sequence);
+        if(!onRecord(packet, length))
+            return; // closed by the client
+    }
+
+    if (length == 0) {
+        TunnelManager::log(std::string() +
+                           "recv() length == " +
+                           std::to_string(length) +
+                           ". Breaking..",
+                           std::cerr);
+        close();
+        return;
+    }
+
+    // the datagram is consumed when wolfSSL wants more data.
+    if (wolfSSL_get_error(ssl, 0) != SSL_ERROR_WANT_READ) {
+        static LogLimiter limiter;
+        logSslError("wolfSSL_recv() < 0", &limiter);
+    }
+}
+
+/**
+ * @brief onRecord - a decrypted record: packets are collected
+ * in the batch for TUN, control messages are handled at once
+ * @param packet - the record, released by the tunnel
+ * @return false if the tunnel is closed
+ */
+bool Tunnel::onRecord(Packet* packet, int length) {
+    char* buffer = packet->payload();
+
+    // control messages start with zero.
+    if (buffer[0] != 0) {
+        // the client sends packets only after it has the parameters
+        if(!parametersConfirmed) {
+            parametersConfirmed = true;
+            parametersRetries   = 0;
+        }
+        lastPacket         = lastReceived;
+        packet->length     = length;
+        rxBatch[rxCount++] = packet;
+        if(rxCount == PacketFilter::BATCH)
+            flushReceived();
+        else
+            flushLater();
+        return true;
+    }
+
+    // packets sent before the message go first
+    flushReceived();
+    bool open = onControlMessage(buffer, length);
+    packets->release(packet);
+    return open;
+}
+
+/**
+ * @brief onPipelineRecord - a record of the client opened
+ * by the crypto pipeline, in the order of the records
+ */
+void Tunnel::onPipelineRecord(const char* data, int length) {
+    if(state != ESTABLISHED || length <= 0 || length > TunDevice::MAX_PACKET)
+        return;
+
+    Packet* packet = packets->acquire();
+    memcpy(packet->payload(), data, length);
+    onRecord(packet, length);
+}
+
+/**
+ * @brief noteSentRecords - remembers epoch and sequence number
+ * of the last record written by wolfSSL, the crypto pipeline
+ * continues after it
+ */
+void Tunnel::noteSentRecords(const char* data, int length) {
+    RecordHeader header;
+    while(RecordCipher::parseHeader(data, length, header)) {
+        if(header.epoch > recordEpoch ||
+           (header.epoch == recordEpoch && header.sequence > sentRecord)) {
+            recordEpoch = header.epoch;
+            sentRecord  = header.sequence;
+        }
+        data   += RecordCipher::HEADER_SIZE + header.length;
+        length -= RecordCipher::HEADER_SIZE + header.length;
+    }
+}
+
+/**
+ * @brief startPipeline - from now the records of application data
+ * are protected by the crypto threads with the keys of the session.
+ * The first record continues the sequence numbers of wolfSSL,
+ * the records of the client wolfSSL has read are replays.
+ * wolfSSL keeps the other records (alerts, handshake retransmissions).
+ */
+void Tunnel::startPipeline() {
+    RecordKey readKey;
+    RecordKey writeKey;
+    std::shared_ptr<CryptoPipeline> started;
+    if(exportRecordKeys(readKey, writeKey)) {
+        started = std::make_shared<CryptoPipeline>(*cryptoPool, *loop, metrics,
+                                                   readKey, writeKey,
+                                                   sentRecord + 1, receivedRecord);
+    }
+    if(!started || !started->isReady()) {
+        static LogLimiter limiter;
+        TunnelManager::log("[" + tunStr + "] cannot export record keys, "
+                           "the tunnel stays on its worker", Logger::ERROR, limiter);
+        cryptoPool = nullptr;
+        return;
+    }
+
+    started->setHandlers([this](char* data, int length) {
+        listener.queue(peer, data, length); // or lost like on the wire
+    }, [this](char* data, int length) {
+        onPipelineRecord(data, length);
+    });
+    pipeline = started;
+    // the session of wolfSSL is behind the sequence numbers:
+    sslContext = nullptr;
+    idleTimer.cancel();
+    TunnelManager::log("[" + tunStr + "] records are protected by " +
+                       std::to_string(cryptoPool->size()) + " crypto threads");
+}
+
+/**
+ * @brief stopPipeline - drops the records in the pipeline and sends
+ * the close notification, wolfSSL cannot do it with its sequence numbers
+ */
+void Tunnel::stopPipeline() {
+    const char closeNotify[] = { 1, 0 }; // warning, close_notify
+    char record[sizeof(closeNotify) + RecordCipher::OVERHEAD];
+    int  size = pipeline->sealNow(RecordCipher::ALERT, closeNotify,
+                                  sizeof(closeNotify), record);
+    if(size > 0)
+        listener.queue(peer, record, size);
+    pipeline->close();
+    pipeline.reset();
+}
+
+/**
+ * @brief onFlush - called by the listener when the worker
+ * has dispatched its events
+ */
+void Tunnel::onFlush() {
+    rxScheduled = false;
+    flushReceived();
+    if(pipeline)
+        pipeline->dispatch();
+}
+
+/**
+ * @brief flushReceived - writes the batch of decrypted packets
+ * that pass the filter to TUN, class by class
+ */
+void Tunnel::flushReceived() {
+    if(rxCount == 0)
+        return;
+
+    char*   data[PacketFilter::BATCH];
+    int     lengths[PacketFilter::BATCH];
+    uint8_t verdicts[PacketFilter::BATCH];
+    for(size_t i = 0; i < rxCount; ++i) {
+        data[i]    = rxBatch[i]->payload();
+        lengths[i] = rxBatch[i]->length;
+    }
+    filter->check(data, lengths, rxCount, verdicts);
+
+    TimePoint now = std::chrono::steady_clock::now();
+    for(uint8_t type = 0; type < PacketFilter::CLASSES; ++type) {
+        for(size_t i = 0; i < rxCount; ++i) {
+            if(verdicts[i] != type)
+                continue;
+            if(!ingress.consume(lengths[i], now)) {
+                addCounter(metrics.rxRateLimited, 1);
+                continue;
+            }
+            addCounter(metrics.rxPackets, 1);
+            addCounter(metrics.rxBytes, lengths[i]);
+            // write the incoming packet to the output stream.
+            if(TunDevice::write(interface, vnetHeader, data[i], lengths[i]) < 0) {
+                addCounter(metrics.tunWriteErrors, 1);
+                static LogLimiter limiter;
+                TunnelManager::log("write(interface, packet, length) < 0",
+                                   Logger::ERROR, limiter);
+            }
+        }
+    }
+
+    for(size_t i = 0; i < rxCount; ++i) {
+        if(verdicts[i] == PacketFilter::MALFORMED)
+            addCounter(metrics.rxMalformed, 1);
+        else if(verdicts[i] == PacketFilter::SPOOFED)
+            addCounter(metrics.rxSpoofed, 1);
+        else if(verdicts[i] == PacketFilter::DENIED)
+            addCounter(metrics.rxDenied, 1);
+        packets->release(rxBatch[i]);
+    }
+    rxCount = 0;
+}
+
+/**
+ * @brief onControlMessage - handles a record that starts with zero,
+ * older 2-byte messages {0, type} are still accepted
+ * @return false if the tunnel is closed
+ */
+bool Tunnel::onControlMessage(const char* data, int length) {
+    ControlMessage message;
+    if(ControlMessage::parse(data, length, message)) {
+        if(Logger::enabled(Logger::DEBUG))
+            TunnelManager::log("Recieved control message " +
+                               std::to_string(message.getType()) +
+                               " from client", Logger::DEBUG);
+        switch(message.getType()) {
+        case ControlMessage::ACK:
+            if(message.getSequence() == cliParams->parametersToSend.getSequence()) {
+                parametersConfirmed = true;
+                parametersRetries   = 0;
+            }
+            if(pathMtu && message.getSequence() == probeSequence)
+                pathMtu->onAck();
+            if(keepalive.isProbing() && message.getSequence() == keepaliveSequence &&
+               keepalive.onAck() && Logger::enabled(Logger::DEBUG)) {
+                TunnelManager::log("[" + tunStr + "] keepalive interval " +
+                                   std::to_string(keepalive.getInterval().count()) +
+                                   " ms", Logger::DEBUG);
+            }
+            break;
+        case ControlMessage::DISCONNECT:
+            if(message.getFlags() & ControlMessage::ACK_REQUESTED)
+                sendControl(ControlMessage::ack(message.getSequence()));
+            TunnelManager::log("DISCONNECT from client");
+            close();
+            return false;
+        default:
+            break; // keepalive, unknown types only refresh 'lastReceived'
+        }
+        return true;
+    }
+
+    if(length == 2 && data[1] == CLIENT_WANT_DISCONNECT) {
+        TunnelManager::log("WANT_DISCONNECT from client");
+        close();
+        return false;
+    }
+    if(length > 1 && data[1] == CLIENT_WANT_OFFLOAD)
+        onOffloadRequest(data, length);
+    return true;
+}
+
+/**
+ * @brief probePath - sends the next path MTU probe,
+ * applies the MTU when the search is finished
+ */
+void Tunnel::probePath(TimePoint now) {
+    if(int size = pathMtu->nextProbe(now)) {
+        ControlMessage probe(ControlMessage::PROBE, ++controlSequence,
+                             ControlMessage::ACK_REQUESTED);
+        probe.addMtu(size);
+        probe.pad(size);
+        probeSequence = controlSequence;
+        sendControl(probe);
+        if(Logger::enabled(Logger::DEBUG))
+            TunnelManager::log("[" + tunStr + "] MTU probe " +
+                               std::to_string(size), Logger::DEBUG);
+    }
+
+    if(pathMtu->getMtu() != tunnelMtu) {
+        TunnelManager::log("[" + tunStr + "] path MTU " +
+                           std::to_string(pathMtu->getMtu()));
+        setTunnelMtu(pathMtu->getMtu());
+        updateParameters();
+    }
+}
+
+/**
+ * @brief setTunnelMtu - MTU of the tunnel and of its TUN interface
+ */
+void Tunnel::setTunnelMtu(int mtu) {
+    tunnelMtu = mtu;
+    // the shared device keeps the MTU, the client still sends smaller packets
+    if(ownsInterface && !TunDevice::setMtu(tunStr, tunnelMtu)) {
+        TunnelManager::log("[" + tunStr + "] cannot set MTU: " +
+                           std::string(strerror(errno)), std::cerr);
+    }
+}
+
+/**
+ * @brief updateParameters - sends the parameters with the new MTU
+ */
+void Tunnel::updateParameters() {
+    ControlMessage& parameters = cliParams->parametersToSend;
+    parameters.setMtu(tunnelMtu);
+    parameters.setSequence(++controlSequence);
+    parameters.setFlags(ControlMessage::ACK_REQUESTED);
+    parametersRetries = CONTROL_RETRIES;
+    sendParameters();
+}
+
+/**
+ * @brief onOffloadRequest - moves the packets of the client
+ * to ESP states in the kernel and replies with the server SPI,
+ * the tunnel stays on the DTLS path if it cannot be done
+ */
+void Tunnel::onOffloadRequest(const char* data, int length) {
+    uint32_t spi  = 0;
+    uint16_t port = 0;
+    // the request is repeated if the reply is lost:
+    if(offload == nullptr && offloadHandler
+       && XfrmOffload::parseRequest(data, length, spi, port)
+       && IN6_IS_ADDR_V4MAPPED(&peer.sin6_addr)) {
+        std::unique_ptr<XfrmSession> session(new XfrmSession);
+        memcpy(&session->peerAddr, &peer.sin6_addr.s6_addr[12], sizeof(in_addr_t));
+        session->peerPort   = port;
+        session->outSpi     = spi;
+        session->tunnelAddr = cliTunAddr;
+        bool installed = false;
+        if(!exportKeys(session->keys, sizeof(session->keys))) {
+            static LogLimiter limiter;
+            TunnelManager::log("[" + name() + "] cannot export DTLS keys, "
+                               "offload is refused", Logger::ERROR, limiter);
+        } else {
+            installed = offloadHandler(*this, *session);
+        }
+        // only the kernel keeps the keys:
+        memset(session->keys, 0, sizeof(session->keys));
+        if(installed) {
+            offload = std::move(session);
+            TunnelManager::log("[" + tunStr + "] packets are offloaded to the kernel");
+        }
+    }
+
+    char reply[XfrmOffload::MESSAGE_SIZE];
+    int  size = offload != nullptr ?
+                XfrmOffload::buildReply(reply, true, offload->inSpi, offload->localPort) :
+                XfrmOffload::buildReply(reply, false, 0, 0);
+    if(sendRecord(reply, size) < 0)
+        logSslError("Error sending offload reply");
+}
+
+/**
+ * @brief exportKeys - RFC 5705 keying material of the DTLS session
+ * for the ESP states, needs wolfSSL with HAVE_KEYING_MATERIAL
+ */
+bool Tunnel::exportKeys(unsigned char* keys, size_t length) {
+#ifdef HAVE_KEYING_MATERIAL
+    return wolfSSL_export_keying_material(ssl, keys, length, XfrmOffload::EXPORTER_LABEL,
+                                          strlen(XfrmOffload::EXPORTER_LABEL),
+                                          nullptr, 0, 0) == WOLFSSL_SUCCESS;
+#else
+    (void)keys;
+    (void)length;
+    return false;
+#endif
+}
+
+/**
+ * @brief exportRecordKeys - keys of both directions of the session
+ * for the crypto pipeline, needs wolfSSL with ATOMIC_USER
+ * and an AES-GCM cipher suite
+ */
+bool Tunnel::exportRecordKeys(RecordKey& readKey, RecordKey& writeKey) {
+#ifdef ATOMIC_USER
+    int keySize = wolfSSL_GetKeySize(ssl);
+    if(wolfSSL_GetBulkCipher(ssl) != wolfssl_aes_gcm || recordEpoch == 0
+       || keySize <= 0 || keySize > RecordKey::MAX_KEY_SIZE
+       || wolfSSL_GetIVSize(ssl) != RecordKey::SALT_SIZE)
+        return false;
+
+    const unsigned char* keys[]  = { wolfSSL_GetClientWriteKey(ssl),
+                                     wolfSSL_GetServerWriteKey(ssl) };
+    const unsigned char* salts[] = { wolfSSL_GetClientWriteIV(ssl),
+                                     wolfSSL_GetServerWriteIV(ssl) };
+    RecordKey* exported[] = { &readKey, &writeKey };
+    for(int i = 0; i < 2; ++i) {
+        if(keys[i] == nullptr || salts[i] == nullptr)
+            return false;
+        memcpy(exported[i]->key, keys[i], keySize);
+        memcpy(exported[i]->salt, salts[i], RecordKey::SALT_SIZE);
+        exported[i]->keySize = keySize;
+        exported[i]->epoch   = recordEpoch;
+    }
+    return true;
+#else
+    (void)readKey;
+    (void)writeKey;
+    return false;
+#endif
+}
+
+/**
+ * @brief exportSession - DTLS state of the session (keys, sequence
+ * numbers and epoch), needs wolfSSL with WOLFSSL_SESSION_EXPORT
+ */
+bool Tunnel::exportSession(std::string& session) {
+#ifdef WOLFSSL_SESSION_EXPORT
+    unsigned int size = 0;
+    wolfSSL_dtls_export(ssl, nullptr, &size); // sets the size only
+    if(size == 0)
+        return false;
+    session.resize(size);
+    int exported = wolfSSL_dtls_export(ssl, (unsigned char*)&session[0], &size);
+    if(exported <= 0)
+        return false;
+    session.resize(exported);
+    return true;
+#else
+    (void)session;
+    return false;
+#endif
+}
+
+bool Tunnel::importSession(const std::string& session) {
+#ifdef WOLFSSL_SESSION_EXPORT
+    return !session.empty() &&
+           wolfSSL_dtls_import(ssl, (const unsigned char*)session.data(),
+                               session.size()) > 0;
+#else
+    (void)session;
+    return false;
+#endif
+}
+
+/**
+ * @brief logSslError - logs the message with the last wolfSSL error
+ * @param limiter - rate limit of a data path call site, may be nullptr
+ */
+void Tunnel::logSslError(const std::string& msg, LogLimiter* limiter) {
+    int e = ssl != nullptr ? wolfSSL_get_error(ssl, 0) : 0;
+    addCounter(metrics.sslErrors, 1);
+    Metrics::instance().countSslError(e);
+
+    std::string text = msg + ": error = " + std::to_string(e) + ", " +
+                       wolfSSL_ERR_reason_error_string(e);
+    if(limiter != nullptr)
+        TunnelManager::log(text, Logger::ERROR, *limiter);
+    else
+        TunnelManager::log(text, Logger::ERROR);
+}
+
+/**
+ * @brief elapsedNanos
+ * @return nanoseconds since 'start'
+ */
+uint64_t Tunnel::elapsedNanos(TimePoint start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief name
+ * @return tunnel interface name or client address
+ * if the interface is not attached yet
+ */
+std::string Tunnel::name() const {
+    if(hasInterface())
+        return tunStr;
+
+    char buffer[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, &peer.sin6_addr, buffer, sizeof(buffer));
+    return std::string() + buffer + ':' + std::to_string(ntohs(peer.sin6_port));
+}
@@ -0,0 +1,287 @@
+#ifndef TUNNEL_HPP
+#define TUNNEL_HPP
+
+#include "client_parameters.hpp"
+#include "crypto_pipeline.hpp"
+#include "dtls_listener.hpp"
+#include "event_loop.hpp"
+#include "handoff.hpp"
+#include "keepalive.hpp"
+#include "metrics.hpp"
+#include "packet_filter.hpp"
+#include "packet_pool.hpp"
+#include "path_mtu.hpp"
+#include "timer_wheel.hpp"
+#include "tun_device.hpp"
+#include "traffic_shaper.hpp"
+#include "tunnel_mgr.hpp"
+#include "xfrm_offload.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+
+/**
+ * @brief The Tunnel class<br>
+ * State of one connected client: DTLS session, client transport<br>
+ * address, and (after the handshake) TUN interface and tunnel addresses.<br>
+ * The tunnel is served by the event loop of one worker.<br>
+ * Its datagrams come from the worker's DtlsListener via 'onDatagram'<br>
+ * and are passed to wolfSSL through custom I/O callbacks.<br>
+ * The DTLS handshake is a non-blocking state machine resumed<br>
+ * by datagrams, socket writability and timers.<br>
+ * Deadlines of the tunnel (handshake, retransmissions, keepalive,<br>
+ * dead peer, hibernation) are timers of the TimerWheel of the worker,<br>
+ * they check the timestamps of the tunnel when they expire, so<br>
+ * packets only update the timestamps. Keepalives follow the NAT<br>
+ * binding timeout of the client (see Keepalive).<br>
+ * With a shared TUN device the tunnel writes to the queue of<br>
+ * its worker and gets packets routed by the worker.<br>
+ * Packet buffers are taken from the pool of the worker<br>
+ * only while a packet is being processed.<br>
+ * Decrypted packets are collected in a batch that is checked<br>
+ * by the PacketFilter of the client and written to TUN when the<br>
+ * worker has dispatched its events, higher QoS classes first.<br>
+ * Packets for the client wait in its EgressQueue, the EgressScheduler<br>
+ * of the worker shares the worker fairly between the tunnels.<br>
+ * Both directions may be limited to the rate of the client.<br>
+ * Counters of the established tunnel are published in Metrics.<br>
+ * On request of the client the packets can be moved to the kernel<br>
+ * (see XfrmOffload), the DTLS session then carries control messages only.<br>
+ * Parameters are sent once as a ControlMessage and sent again<br>
+ * until the client acknowledges them.<br>
+ * With path MTU discovery (see PathMtu) the MTU of the TUN<br>
+ * interface follows the path to the client, the client gets<br>
+ * the new MTU in updated parameters.<br>
+ * Parameters changed by the control API are sent the same way.<br>
+ * An established tunnel can be handed off to a new server process<br>
+ * (see Handoff) and restored there without a new handshake.<br>
+ * A tunnel without packets for the idle time hibernates: the wolfSSL<br>
+ * object is freed, only the exported session (keys, sequence<br>
+ * numbers, epoch) is kept. The next datagram of the client or packet<br>
+ * for it imports the session into a new wolfSSL object.<br>
+ * With a CryptoPool a tunnel that forwards more than HEAVY_RATE<br>
+ * moves the protection of its records to a CryptoPipeline, so one<br>
+ * client may use more cores than the one of its worker. wolfSSL<br>
+ * then only sees the other records, the session cannot be exported<br>
+ * any more (no hibernation or handoff).<br>
+ * When the client is gone the close handler is called<br>
+ * so the owner can release resources.<br>
+ */
+class Tunnel {
+public:
+    typedef std::function<bool(Tunnel& tunnel)> EstablishHandler;
+    typedef std::function<void(Tunnel* tunnel)> CloseHandler;
+    typedef std::function<bool(Tunnel& tunnel, XfrmSession& session)> OffloadHandler;
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    enum PacketType {
+        ZERO_PACKET            = 0,
+        CLIENT_WANT_CONNECT    = 1,
+        CLIENT_WANT_DISCONNECT = 2,
+        CLIENT_WANT_OFFLOAD    = XfrmOffload::REQUEST,
+        SERVER_OFFLOAD_READY   = XfrmOffload::READY,
+        SERVER_OFFLOAD_REFUSED = XfrmOffload::REFUSED
+    };
+
+    enum State {
+        HANDSHAKE,   // waiting for DTLS handshake messages
+        ESTABLISHED, // forwarding packets
+        CLOSED
+    };
+
+    static const int HANDSHAKE_TIMEOUT  = 10000;  // ms to complete handshake
+    static const int CONTROL_RETRANSMIT = 1000;   // ms to wait for ACK
+    static const int CONTROL_RETRIES    = 5;      // resends of unacknowledged message
+    static const int PIPELINE_CHECK     = 1000;   // ms between checks of the rate
+    static const uint64_t HEAVY_RATE    = 25000000; // bytes per second to pipeline
+
+private:
+    int                               interface; // TUN interface
+    bool                              ownsInterface; // false for shared TUN
+    bool                              vnetHeader; // IFF_VNET_HDR queue
+    WOLFSSL*                          ssl;
+    DtlsListener&                     listener;
+    sockaddr_in6                      peer;
+    std::string                       tunStr;
+    in_addr_t                         serTunAddr;
+    in_addr_t                         cliTunAddr;
+    in6_addr                          cliTunAddr6;
+    uint8_t                           cliPrefix6; // 0 - no IPv6 address
+    size_t                            tunNumber;
+    std::unique_ptr<ClientParameters> cliParams;
+    EventLoop*                        loop;
+    TimerWheel*                       timers;    // of the worker
+    PacketPool*                       packets;   // buffers of the worker
+    EgressScheduler*                  scheduler; // of the worker
+    WorkerMetrics*                    workerMetrics;
+    TunnelMetrics                     metrics;
+    EstablishHandler                  establishHandler;
+    CloseHandler                      closeHandler;
+    OffloadHandler                    offloadHandler;
+    std::unique_ptr<XfrmSession>      offload; // kernel data path
+    State                             state;
+    bool                              waitingWritable;
+    std::unique_ptr<PacketFilter>     filter;
+    Packet*                           rxBatch[PacketFilter::BATCH]; // decrypted
+    size_t                            rxCount;
+    bool                              rxScheduled; // flush is a listener's task
+    EgressQueue                       egress;  // packets for the client
+    TokenBucket                       ingress; // rate limit of the client
+    const char*                       rxData;    // pending datagram
+    int                               rxLength;
+    TimePoint                         created;
+    TimePoint                         retransmitAt;
+    TimePoint                         lastSent;
+    TimePoint                         lastReceived;
+    uint16_t                          controlSequence; // of the last sent message
+    int                               parametersRetries; // 0 - acknowledged
+    bool                              parametersConfirmed; // the first ones
+    TimePoint                         parametersSentAt;
+    std::unique_ptr<PathMtu>          pathMtu;
+    uint16_t                          probeSequence;
+    int                               tunnelMtu;
+    WOLFSSL_CTX*                      sslContext; // for a new session, null - no hibernation
+    std::chrono::milliseconds         idleTime;   // without packets until hibernation
+    TimePoint                         lastPacket; // forwarded in either direction
+    std::string                       hibernated; // exported session, empty - awake
+    Keepalive                         keepalive;
+    uint16_t                          keepaliveSequence; // of the last probe
+    WheelTimer                        handshakeTimer; // deadline and flight resend
+    WheelTimer                        keepaliveTimer;
+    WheelTimer                        deadPeerTimer;
+    WheelTimer                        controlTimer;   // parameters resend
+    WheelTimer                        probeTimer;     // path MTU probes
+    WheelTimer                        idleTimer;      // hibernation
+    CryptoPool*                       cryptoPool; // nullptr - no pipelined mode
+    std::shared_ptr<CryptoPipeline>   pipeline;   // protects the records
+    WheelTimer                        pipelineTimer;  // rate checks
+    uint64_t                          checkedBytes;   // forwarded until the last check
+    uint16_t                          recordEpoch;    // of the records wolfSSL wrote
+    uint64_t                          sentRecord;     // last sequence number written
+    uint64_t                          receivedRecord; // and read by wolfSSL
+
+    static std::atomic<size_t>        hibernatedCount;
+
+public:
+    /* Forbid creating default copy ctor: */
+    Tunnel(Tunnel& that) = delete;
+
+    explicit Tunnel(WOLFSSL* ssl,
+                    DtlsListener& listener,
+                    const sockaddr_in6& peer);
+    ~Tunnel();
+
+    void start(EventLoop& loop,
+               TimerWheel& timers,
+               PacketPool& packets,
+               EgressScheduler& scheduler,
+               WorkerMetrics& workerMetrics,
+               const EstablishHandler& onEstablished,
+               const CloseHandler& onClose);
+    void attachInterface(int interface,
+                         bool vnetHeader,
+                         const std::string& tunStr,
+                         in_addr_t serTunAddr,
+                         in_addr_t cliTunAddr,
+                         size_t tunNumber,
+                         ClientParameters* cliParams);
+    void useSharedQueue(int queue, bool vnetHeader);
+    void setOffloadHandler(const OffloadHandler& handler);
+    void setClientAddr6(const in6_addr& address, uint8_t prefixLength);
+    void setAccessList(const AccessList& access);
+    void setRateLimit(uint64_t rate);
+    void setParameters(ClientParameters* cliParams);
+    void setHibernation(WOLFSSL_CTX* sslContext, std::chrono::seconds idleTime);
+    void setCryptoPool(CryptoPool* pool);
+    void forward(const char* data, int length);
+    void onDatagram(const char* data, int length);
+    void onWritable();
+    void onFlush();
+    void close();
+    bool exportState(HandoffTunnel& handoff);
+    bool restore(const HandoffTunnel& handoff);
+    void handOff();
+
+    State getState() const;
+    bool hasInterface() const;
+    bool isSharedInterface() const;
+    const std::string& getTunStr() const;
+    in_addr_t getServerAddr() const;
+    in_addr_t getClientAddr() const;
+    bool hasClientAddr6() const;
+    const in6_addr& getClientAddr6() const;
+    uint8_t getClientPrefix6() const;
+    size_t getTunNumber() const;
+    const TunnelMetrics& getMetrics() const;
+    const sockaddr_in6& getPeer() const;
+    std::string getPeerHost() const;
+    uint64_t getRateLimit() const;
+    size_t getQueuedCount() const;
+    const XfrmSession* getOffload() const;
+    bool isHibernated() const;
+    bool isPipelined() const;
+    TimerWheel* getTimers() const;
+
+    static size_t getHibernatedCount();
+
+    static int ioRecv(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int ioSend(WOLFSSL* ssl, char* buf, int sz, void* ctx);
+    static int genCookie(WOLFSSL* ssl, unsigned char* buf, int sz, void* ctx);
+
+private:
+    void bindSession();
+    void hibernate();
+    bool wake();
+    void continueHandshake();
+    void armRetransmitTimer();
+    void onHandshakeTimer();
+    void onKeepaliveTimer();
+    void onDeadPeerTimer();
+    void onControlTimer();
+    void onProbeTimer();
+    void onIdleTimer();
+    void onPipelineTimer();
+    void cancelTimers();
+    void onEstablished();
+    void startForwarding();
+    void sendParameters();
+    void sendKeepalive(TimePoint now);
+    void sendControl(const ControlMessage& message);
+    int  sendRecord(const char* data, int length);
+    void flushLater();
+    void onInterfaceReadable();
+    void queuePacket(const char* data, int length);
+    void resumeInterface();
+    void sendPacket(const char* data, int length);
+    void readRecords();
+    bool onRecord(Packet* packet, int length);
+    void onPipelineRecord(const char* data, int length);
+    void noteSentRecords(const char* data, int length);
+    void startPipeline();
+    void stopPipeline();
+    void flushReceived();
+    bool onControlMessage(const char* data, int length);
+    void probePath(TimePoint now);
+    void updateParameters();
+    void setTunnelMtu(int mtu);
+    void onOffloadRequest(const char* data, int length);
+    bool exportKeys(unsigned char* keys, size_t length);
+    bool exportRecordKeys(RecordKey& readKey, RecordKey& writeKey);
+    bool exportSession(std::string& session);
+    bool importSession(const std::string& session);
+    void logSslError(const std::string& msg, LogLimiter* limiter = nullptr);
+    std::string name() const;
+    static uint64_t elapsedNanos(TimePoint start);
+};
+
+#endif // TUNNEL_HPP
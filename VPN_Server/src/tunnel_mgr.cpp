@@ -1,9 +1,32 @@
 #include "tunnel_mgr.hpp"
 
-TunnelManager::TunnelManager() : tunNumber(0) { }
+TunnelManager::TunnelManager()
+    : tunNumber(0),
+      backend(new ShellNetworkBackend),
+      addresses(nullptr),
+      multiQueue(false),
+      poolSize(0),
+      poolRunning(false),
+      keepInterfaces(false) { }
 
 TunnelManager::~TunnelManager() {
-    cleanupTunnels("vpn_tun");
+    stopInterfacePool();
+    if(!keepInterfaces)
+        cleanupTunnels("vpn_tun");
+    delete backend;
+}
+
+/**
+ * @brief setNetworkBackend - replaces the network backend,
+ * the manager owns the backend from now
+ */
+void TunnelManager::setNetworkBackend(NetworkBackend* backend) {
+    delete this->backend;
+    this->backend = backend;
+}
+
+NetworkBackend& TunnelManager::getNetworkBackend() {
+    return *backend;
 }
 
 /**
@@ -24,18 +47,19 @@ void TunnelManager::execTerminalCommand(const std::string& cmd) {
  * @param tunStr - tunnel interface name (e.g. 'tun3')
  */
 void TunnelManager::closeiftun(const std::string& tunStr) {
-    std::string t = "ip link delete " + tunStr;
-    execTerminalCommand(t.c_str());
+    backend->deleteLink(tunStr);
 }
 
 void TunnelManager::closeTunNumber(const size_t& num,
                                    const std::string tunPrefix) {
     closeiftun(std::string() + tunPrefix + "tun" + std::to_string(num));
+    std::lock_guard<std::mutex> lock(numbersMutex);
     tunQueue.push(num);
     tunSet.erase(num);
 }
 
 void TunnelManager::closeAllTunnels(const std::string tunPrefix) {
+    std::lock_guard<std::mutex> lock(numbersMutex);
     for(const size_t& tunNum : tunSet) {
          closeiftun(std::string() + tunPrefix +  "tun" + std::to_string(tunNum));
     }
@@ -53,6 +77,7 @@ void TunnelManager::closeAllTunnels(const std::list<std::string>& tunList) {
  * @return the number of tunnel to create it
  */
 size_t TunnelManager::getTunNumber() {
+    std::lock_guard<std::mutex> lock(numbersMutex);
     if(tunQueue.empty()) {
         tunSet.insert(tunNumber);
         return tunNumber++;
@@ -64,6 +89,7 @@ size_t TunnelManager::getTunNumber() {
 }
 
 void TunnelManager::removeTunFromSet(const size_t& tunNumber) {
+    std::lock_guard<std::mutex> lock(numbersMutex);
     tunSet.erase(tunNumber);
 }
 
@@ -72,19 +98,15 @@ void TunnelManager::removeTunFromSet(const size_t& tunNumber) {
  *                           (server must be running with root permissions)
  * @param serverTunAddr    - server tunnel ip
  * @param clientTunAddr    - client tunnel ip
+ * @param tunStr           - tunnel interface name
+ * @param multiQueue       - create multi-queue interface
  */
 void TunnelManager::createUnixTunnel
 (const std::string& serverTunAddr,
  const std::string& clientTunAddr,
- const std::string&      tunStr) {
-
-    std::string tunName = tunStr;
-    std::string tunInterfaceSetup = "ip tuntap add dev " + tunName +  " mode tun";
-    execTerminalCommand(tunInterfaceSetup);
-
-    std::string ifconfig = "ifconfig " + tunName + " " + serverTunAddr +
-                      " dstaddr " + clientTunAddr + " up";
-    execTerminalCommand(ifconfig);
+ const std::string&      tunStr,
+ bool                multiQueue) {
+    backend->createTunnel(tunStr, serverTunAddr, clientTunAddr, multiQueue);
 }
 
 /**
@@ -107,6 +129,276 @@ void TunnelManager::cleanupTunnels(const char* tunnelPrefix) {
     freeifaddrs(iface);
 }
 
+/**
+ * @brief configureInterfaces - sets what client interfaces look like
+ * @param addresses  - pool of tunnel addresses
+ * @param multiQueue - create multi-queue interfaces
+ * @param poolSize   - count of interfaces kept ready
+ */
+void TunnelManager::configureInterfaces(IPManager& addresses,
+                                        bool multiQueue,
+                                        size_t poolSize) {
+    this->addresses  = &addresses;
+    this->multiQueue = multiQueue;
+    this->poolSize   = poolSize;
+}
+
+/**
+ * @brief startInterfacePool - starts the thread that keeps
+ * 'poolSize' interfaces ready
+ */
+void TunnelManager::startInterfacePool() {
+    if(poolSize == 0 || poolThread.joinable())
+        return;
+
+    poolRunning = true;
+    poolThread  = std::thread([this]() { refillInterfaces(); });
+}
+
+/**
+ * @brief stopInterfacePool - stops refilling and removes ready interfaces
+ */
+void TunnelManager::stopInterfacePool() {
+    if(!poolThread.joinable())
+        return;
+
+    poolMutex.lock();
+        poolRunning = false;
+    poolMutex.unlock();
+    poolCondition.notify_all();
+    poolThread.join();
+
+    if(!keepInterfaces) {
+        for(const TunInterface& iface : readyInterfaces)
+            destroyInterface(iface);
+    }
+    readyInterfaces.clear();
+}
+
+/**
+ * @brief acquireInterface - takes a ready interface from the pool,
+ * creates one if the pool is empty
+ * @param identity - client identity for the address lease,
+ * empty if the client doesn't need the same address
+ * @return false if the interface cannot be created
+ */
+bool TunnelManager::acquireInterface(TunInterface& result,
+                                     const std::string& identity) {
+    poolMutex.lock();
+        bool ready = !readyInterfaces.empty();
+        if(ready) {
+            result = readyInterfaces.front();
+            readyInterfaces.pop_front();
+        }
+    poolMutex.unlock();
+
+    if(ready)
+        poolCondition.notify_one(); // refill the pool
+    else if(!createInterface(result))
+        return false;
+
+    if(!identity.empty())
+        applyLease(result, identity);
+    return true;
+}
+
+/**
+ * @brief releaseInterface - interface of a gone client is reset
+ * and kept for the next one, unless the pool is full
+ * @param leased - the client address stays taken by the lease of the
+ * gone client (see IPManager::releaseLease), the interface is kept
+ * with another one
+ */
+void TunnelManager::releaseInterface(const TunInterface& iface, bool leased) {
+    TunInterface released = iface;
+    if(leased)
+        released.clientAddr = 0; // not returned to the pool
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    if(!poolRunning || readyInterfaces.size() >= poolSize) {
+        lock.unlock();
+        destroyInterface(released);
+        return;
+    }
+    lock.unlock();
+
+    // drop the state left by the previous client:
+    if(!backend->resetLink(iface.name)) {
+        destroyInterface(released);
+        return;
+    }
+
+    if(leased) {
+        released.clientAddr = addresses->getAddrFromPool();
+        if(released.clientAddr == 0 ||
+           !backend->changePeer(iface.name,
+                                IPManager::getIpString(iface.serverAddr),
+                                IPManager::getIpString(iface.clientAddr),
+                                IPManager::getIpString(released.clientAddr))) {
+            destroyInterface(released);
+            return;
+        }
+    }
+
+    lock.lock();
+    readyInterfaces.push_back(released);
+}
+
+size_t TunnelManager::readyInterfacesCount() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return readyInterfaces.size();
+}
+
+/**
+ * @brief reserveInterface - takes the number and the addresses
+ * of an interface created by the previous server process,
+ * must be called before the interface pool is started
+ */
+void TunnelManager::reserveInterface(const TunInterface& iface) {
+    addresses->reserveAddr(iface.serverAddr);
+    addresses->reserveAddr(iface.clientAddr);
+
+    std::lock_guard<std::mutex> lock(numbersMutex);
+    tunSet.insert(iface.number);
+    if(iface.number >= tunNumber)
+        tunNumber = iface.number + 1;
+}
+
+/**
+ * @brief detachInterfacePool - stops refilling and moves the ready
+ * interfaces to 'ready' without removing them (see Handoff)
+ */
+void TunnelManager::detachInterfacePool(std::vector<TunInterface>& ready) {
+    if(poolThread.joinable()) {
+        poolMutex.lock();
+            poolRunning = false;
+        poolMutex.unlock();
+        poolCondition.notify_all();
+        poolThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    ready.assign(readyInterfaces.begin(), readyInterfaces.end());
+    readyInterfaces.clear();
+}
+
+/**
+ * @brief attachInterfacePool - the pool gets back 'ready' interfaces
+ * (reserved already) and is started again
+ */
+void TunnelManager::attachInterfacePool(const std::vector<TunInterface>& ready) {
+    poolMutex.lock();
+        readyInterfaces.insert(readyInterfaces.end(), ready.begin(), ready.end());
+    poolMutex.unlock();
+    startInterfacePool();
+}
+
+/**
+ * @brief setKeepInterfaces - the interfaces belong to another
+ * server process: they are not removed by 'stopInterfacePool'
+ * and by the destructor
+ */
+void TunnelManager::setKeepInterfaces(bool keep) {
+    keepInterfaces = keep;
+}
+
+/**
+ * @brief createInterface - allocates tunnel addresses
+ * and creates a new interface with them
+ * @return false if there are no free addresses or interface
+ * cannot be created
+ */
+bool TunnelManager::createInterface(TunInterface& result) {
+    result.serverAddr = addresses->getAddrFromPool();
+    result.clientAddr = addresses->getAddrFromPool();
+
+    if(result.serverAddr == 0 || result.clientAddr == 0) {
+        TunnelManager::log("No free IP addresses. Tunnel will not be created.",
+                           std::cerr);
+        if(result.serverAddr != 0)
+            addresses->returnAddrToPool(result.serverAddr);
+        if(result.clientAddr != 0)
+            addresses->returnAddrToPool(result.clientAddr);
+        return false;
+    }
+
+    result.number = getTunNumber();
+    result.name   = "vpn_tun" + std::to_string(result.number);
+
+    try {
+        createUnixTunnel(IPManager::getIpString(result.serverAddr),
+                         IPManager::getIpString(result.clientAddr),
+                         result.name,
+                         multiQueue);
+    } catch (const std::exception& e) {
+        TunnelManager::log(e.what(), std::cerr);
+        destroyInterface(result);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief applyLease - readdresses the interface to the address
+ * kept by the lease of the client. Otherwise the current
+ * address of the interface becomes the lease of the client.
+ */
+void TunnelManager::applyLease(TunInterface& iface, const std::string& identity) {
+    in_addr_t leased = addresses->getLeasedAddr(identity);
+    if(leased == 0) {
+        addresses->setLease(identity, iface.clientAddr);
+        return;
+    }
+
+    if(backend->changePeer(iface.name,
+                           IPManager::getIpString(iface.serverAddr),
+                           IPManager::getIpString(iface.clientAddr),
+                           IPManager::getIpString(leased))) {
+        addresses->returnAddrToPool(iface.clientAddr);
+        iface.clientAddr = leased;
+    } else {
+        addresses->returnAddrToPool(leased);
+        addresses->setLease(identity, iface.clientAddr);
+    }
+}
+
+/**
+ * @brief destroyInterface - removes the interface and returns
+ * its addresses to the pool, a zero address is skipped
+ */
+void TunnelManager::destroyInterface(const TunInterface& iface) {
+    if(iface.serverAddr != 0)
+        addresses->returnAddrToPool(iface.serverAddr);
+    if(iface.clientAddr != 0)
+        addresses->returnAddrToPool(iface.clientAddr);
+    closeTunNumber(iface.number);
+}
+
+/**
+ * @brief refillInterfaces - body of the pool thread
+ */
+void TunnelManager::refillInterfaces() {
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while(poolRunning) {
+        if(readyInterfaces.size() >= poolSize) {
+            poolCondition.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        TunInterface iface;
+        bool created = createInterface(iface);
+        lock.lock();
+
+        if(!created) {
+            // e.g. no free addresses, try again later
+            poolCondition.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        readyInterfaces.push_back(iface);
+    }
+}
+
 /**
  * @brief currentTime
  * @return string with time in format "<WWW MMM DD hh:mm:ss yyyy>"
@@ -119,32 +411,24 @@ std::string TunnelManager::currentTime() {
 }
 
 /**
- * @brief log - log out the message to output stream 's'
- * (needs to be reimplemented as separate
- *  class in log.hpp or utils.hpp)
+ * @brief log - queues the message to the asynchronous logger
  * @param msg - message to log out
- * @param s   - output stream
+ * @param s   - std::cerr for errors, std::cout otherwise
  */
 void TunnelManager::log(const std::string& msg,
                 std::ostream& s) {
-// Check if GCC ver. bigger or equals 5.0.0
-// (because there is no std::put_time on older versions):
-#if GCC_VERSION >= 50000
-    auto timeNow = std::chrono::system_clock::now();
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                timeNow.time_since_epoch()
-                ) % 1000;
-
-    std::time_t currTime
-            = std::chrono::system_clock::to_time_t(timeNow);
-
-    s << std::put_time(std::localtime(&currTime), "<%d.%m.%y %H:%M:%S.")
-      << ms.count() << '>'
-      << " <THREAD ID: " << std::this_thread::get_id()  << '>'
-      << ' '
-      << msg << std::endl;
-#else
-    s << currentTime() << ' '
-      << msg << std::endl;
-#endif
+    Logger::instance().write(&s == &std::cerr ? Logger::ERROR : Logger::INFO,
+                             msg);
+}
+
+void TunnelManager::log(const std::string& msg, Logger::Level level) {
+    Logger::instance().write(level, msg);
+}
+
+/**
+ * @brief log - rate limited message, see LogLimiter
+ */
+void TunnelManager::log(const std::string& msg, Logger::Level level,
+                        LogLimiter& limiter) {
+    Logger::instance().write(level, msg, limiter);
 }
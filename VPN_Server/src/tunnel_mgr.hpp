@@ -8,8 +8,11 @@
 #include <chrono>   // std::chrono::system_clock::now()
 #include <queue>
 #include <set>
+#include <vector>
 #include <thread>
-#include <iomanip> // std::put_time
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <string.h>
 
 #include <unistd.h> // pid_t
@@ -18,15 +21,35 @@
 #include <sys/types.h>
 #include <ifaddrs.h>
 
-#define GCC_VERSION (__GNUC__ * 10000 \
-                     + __GNUC_MINOR__ * 100 \
-                     + __GNUC_PATCHLEVEL__ * 10)
+#include "ip_manager.hpp"
+#include "logger.hpp"
+#include "network_backend.hpp"
+
+/**
+ * @brief The TunInterface struct<br>
+ * TUN interface created for a client together with<br>
+ * its point-to-point tunnel addresses.<br>
+ */
+struct TunInterface {
+    size_t      number;
+    std::string name;
+    in_addr_t   serverAddr;
+    in_addr_t   clientAddr;
+};
 
 /**
  * @brief The TunnelManager class
  * Contains tunnel set of currently using tunnels
  * Generates number of next tunnel and
- * contains a queue of freed tunnels
+ * contains a queue of freed tunnels.
+ * Interfaces are created and removed by the network backend
+ * (shell commands until another backend is set).
+ * A pool of ready, addressed interfaces is refilled by a background
+ * thread, so a connecting client doesn't wait for interface creation.
+ * Interfaces of gone clients are reset and returned to the pool.
+ * A reconnecting client gets its previous address if it is free.
+ * Interfaces handed off by the previous server process (see Handoff)<br>
+ * are reserved and adopted instead of being cleaned up.<br>
  */
 class TunnelManager {
 private:
@@ -35,6 +58,18 @@ private:
     std::queue<size_t> tunQueue;
     std::set<size_t>   tunSet;
     size_t             tunNumber;
+    std::mutex         numbersMutex; // guards tunnel numbers
+    NetworkBackend*    backend;
+    // interface pool:
+    IPManager*               addresses;
+    bool                     multiQueue;
+    size_t                   poolSize;
+    bool                     poolRunning;
+    bool                     keepInterfaces; // owned by another process
+    std::deque<TunInterface> readyInterfaces;
+    std::mutex               poolMutex;
+    std::condition_variable  poolCondition;
+    std::thread              poolThread;
 public:
     /* Forbid creating default copy ctor: */
     TunnelManager(TunnelManager& that) = delete;
@@ -42,7 +77,9 @@ public:
     explicit TunnelManager();
     ~TunnelManager();
 
-    void execTerminalCommand(const std::string& cmd);
+    void setNetworkBackend(NetworkBackend* backend);
+    NetworkBackend& getNetworkBackend();
+    static void execTerminalCommand(const std::string& cmd);
     void closeiftun(const std::string& tunStr);
     void closeTunNumber(const size_t& num, const std::string tunPrefix = "vpn_");
     void closeAllTunnels(const std::string tunPrefix = "vpn_");
@@ -52,14 +89,37 @@ public:
     void createUnixTunnel
     (const std::string& serverTunAddr,
      const std::string& clientTunAddr,
-     const std::string&      tunStr);
+     const std::string&      tunStr,
+     bool                multiQueue = false);
 
     void cleanupTunnels(const char* tunnelPrefix = "vpn_");
 
+    void configureInterfaces(IPManager& addresses,
+                             bool multiQueue,
+                             size_t poolSize);
+    void startInterfacePool();
+    void stopInterfacePool();
+    bool acquireInterface(TunInterface& result,
+                          const std::string& identity = std::string());
+    void releaseInterface(const TunInterface& iface, bool leased = false);
+    size_t readyInterfacesCount();
+    void reserveInterface(const TunInterface& iface);
+    void detachInterfacePool(std::vector<TunInterface>& ready);
+    void attachInterfacePool(const std::vector<TunInterface>& ready);
+    void setKeepInterfaces(bool keep);
+
     static std::string currentTime();
     static void log(const std::string& msg,
                     std::ostream& s = std::cout);
+    static void log(const std::string& msg, Logger::Level level);
+    static void log(const std::string& msg, Logger::Level level,
+                    LogLimiter& limiter);
 
+private:
+    bool createInterface(TunInterface& result);
+    void applyLease(TunInterface& iface, const std::string& identity);
+    void destroyInterface(const TunInterface& iface);
+    void refillInterfaces();
 };
 
 #endif // TUNNEL_MGR_HPP
@@ -1,61 +1,111 @@
 #include "vpn_server.hpp"
 
-VPNServer::VPNServer (int argc, char** argv) {
+const char* const VPNServer::SHARED_TUN = "vpn_tun_shared";
+
+VPNServer::VPNServer (int argc, char** argv)
+    : manager6(nullptr), tunFlags(0), sharedTun(false), sharedServerAddr(0),
+      routes(nullptr), metricsPort(0), sessionCacheSize(20000),
+      ticketRotation(TicketKeys::ROTATION), cipherPolicy("auto"),
+      sessions(nullptr), tickets(nullptr), espPort(0), xfrm(nullptr),
+      ioEngine("epoll"), pathMtuDiscovery(false), idleTime(0),
+      keepaliveMin(Keepalive::DEFAULT_INTERVAL), keepaliveMax(Keepalive::DEFAULT_INTERVAL),
+      leaseTime(0), cryptoThreads(0), cryptoPool(nullptr), handoffSocket(-1),
+      keepInterfaces(false), workers(nullptr) {
     this->argc = argc;
     this->argv = argv;
     parseArguments(argc, argv); // fill 'cliParams struct'
+    if(!handoffPath.empty())
+        receiveHandoff(); // workers and port of the running server
 
+    if(!cliParams.virtualNetwork6.empty()) {
+        manager6 = new IP6Manager(cliParams.virtualNetwork6,
+                                  atoi(cliParams.networkMask6.c_str()));
+    }
     manager = new IPManager(cliParams.virtualNetworkIp + '/' + cliParams.networkMask,
-                            6); // IP pool init size
+                            workersCount); // address shards
     tunMgr  = new TunnelManager;
+    tunMgr->setNetworkBackend(NetworkBackend::create(networkBackend));
+    tunMgr->configureInterfaces(*manager, tunFlags & TunDevice::MULTI_QUEUE,
+                                readyInterfaces);
+    tunMgr->setKeepInterfaces(keepInterfaces);
+    NetworkBackend& network = tunMgr->getNetworkBackend();
 
     // Enable IP forwarding
-    tunMgr->execTerminalCommand("echo 1 > /proc/sys/net/ipv4/ip_forward");
-
-    /* In case if program was terminated by error: */
-    tunMgr->cleanupTunnels();
+    network.setForwarding(true);
+    if(manager6 != nullptr)
+        network.setForwarding6(true);
 
     // Pick a range of private addresses and perform NAT over chosen network interface.
     std::string virtualLanAddress = cliParams.virtualNetworkIp + '/' + cliParams.networkMask;
     std::string physInterfaceName = cliParams.physInterface;
 
-    // Delete previous rule if server crashed:
-    std::string delPrevPostrouting
-            = "iptables -t nat -D POSTROUTING -s " + virtualLanAddress +
-              " -o " + physInterfaceName + " -j MASQUERADE";
-    tunMgr->execTerminalCommand(delPrevPostrouting);
+    if(handoffSocket >= 0) {
+        // interfaces and the NAT rule of the previous process are kept:
+        reserveInherited();
+    } else {
+        /* In case if program was terminated by error: */
+        tunMgr->cleanupTunnels();
+
+        // Delete previous rule if server crashed:
+        network.removeMasquerade(virtualLanAddress, physInterfaceName);
+        network.addMasquerade(virtualLanAddress, physInterfaceName);
+        // unique local addresses are not routed in the Internet,
+        // prefixes of a global network are routed to the server:
+        if(manager6 != nullptr && manager6->isUniqueLocal()) {
+            network.removeMasquerade(manager6->getNetworkString(), physInterfaceName);
+            network.addMasquerade(manager6->getNetworkString(), physInterfaceName);
+        }
+    }
 
-    std::string postrouting
-            = "iptables -t nat -A POSTROUTING -s " + virtualLanAddress +
-              " -o " + physInterfaceName + " -j MASQUERADE";
-    tunMgr->execTerminalCommand(postrouting);
     initSsl(); // initialize ssl context
 }
 
 VPNServer::~VPNServer() {
-    // Clean all tunnels with prefix "vpn_"
-    tunMgr->cleanupTunnels();
-    // Disable IP Forwarding:
-    tunMgr->execTerminalCommand("echo 0 > /proc/sys/net/ipv4/ip_forward");
-    // Remove NAT rule from iptables:
-    std::string virtualLanAddress = cliParams.virtualNetworkIp + '/' + cliParams.networkMask;
-    std::string physInterfaceName = cliParams.physInterface;
-    std::string postrouting
-            = "iptables -t nat -D POSTROUTING -s " + virtualLanAddress +
-              " -o " + physInterfaceName + " -j MASQUERADE";
-    tunMgr->execTerminalCommand(postrouting);
+    Metrics::instance().clearGauges();
+    // the sessions of the clients are not closed:
+    if(keepInterfaces && workers != nullptr) {
+        workers->freeze();
+        workers->handOff();
+    }
+    // Stop serving clients before the interfaces are removed
+    delete workers;
+    delete cryptoPool; // after the pipelines of the tunnels
+    delete xfrm;
+    delete routes;
+    tunMgr->stopInterfacePool();
+    if(!keepInterfaces) {
+        // Clean all tunnels with prefix "vpn_"
+        tunMgr->cleanupTunnels();
+        NetworkBackend& network = tunMgr->getNetworkBackend();
+        // Disable IP Forwarding:
+        network.setForwarding(false);
+        // Remove NAT rule:
+        std::string virtualLanAddress = cliParams.virtualNetworkIp + '/' + cliParams.networkMask;
+        std::string physInterfaceName = cliParams.physInterface;
+        network.removeMasquerade(virtualLanAddress, physInterfaceName);
+        if(manager6 != nullptr) {
+            network.setForwarding6(false);
+            if(manager6->isUniqueLocal())
+                network.removeMasquerade(manager6->getNetworkString(), physInterfaceName);
+        }
+    }
+    if(handoffSocket >= 0)
+        close(handoffSocket);
 
     wolfSSL_CTX_free(ctx);
     wolfSSL_Cleanup();
+    delete sessions;
+    delete tickets;
 
     delete manager;
+    delete manager6;
     delete tunMgr;
 }
 
 /**
  * @brief initServer\r\n
- * Main method, creates first thread with vpn connection,\r\n
- * waiting for a client
+ * Main method, starts workers that listen
+ * for clients and serve the tunnels
  */
 void VPNServer::initServer() {
     mutex.lock();
@@ -63,191 +113,860 @@ void VPNServer::initServer() {
                   << std::endl;
     mutex.unlock();
 
-    std::thread t(&VPNServer::createNewConnection, this);
-    t.detach();
+    // established tunnels may move their packets to the kernel:
+    if(espPort != 0) {
+        try {
+            xfrm = new XfrmOffload(espPort);
+            TunnelManager::log("Kernel offload (ESP in UDP) on port " +
+                               std::to_string(espPort));
+        } catch (const std::exception& e) {
+            TunnelManager::log(std::string() + e.what() +
+                               ", all tunnels stay in userspace", std::cerr);
+        }
+    }
 
-    while(true) {
-        std::this_thread::sleep_for(std::chrono::seconds(100));
+    // heavy tunnels are not limited to the core of their worker:
+    if(cryptoThreads > 0) {
+        cryptoPool = new CryptoPool(cryptoThreads);
+        TunnelManager::log("Tunnels over " + std::to_string(Tunnel::HEAVY_RATE * 8 / 1000000) +
+                           " Mbit/s are protected by " + std::to_string(cryptoThreads) +
+                           " crypto threads");
+    }
+
+    // loops of the workers (and of the metrics endpoint):
+    if(ioEngine != "epoll") {
+        try {
+            delete IoEngine::create(ioEngine);
+        } catch (const std::exception& e) {
+            TunnelManager::log(std::string() + e.what() +
+                               ", falling back to epoll", std::cerr);
+            ioEngine = "epoll";
+        }
+    }
+    IoEngine::setDefault(ioEngine);
+    TunnelManager::log("I/O engine: " + ioEngine);
+
+    // before the listeners of the workers are created:
+    PathMtu::setEnabled(pathMtuDiscovery);
+    if(pathMtuDiscovery)
+        TunnelManager::log("Path MTU discovery, MTU up to " + cliParams.mtu);
+    Keepalive::configure(keepaliveMin, keepaliveMax);
+    if(Keepalive::isAdaptive())
+        TunnelManager::log("Keepalive interval " + std::to_string(keepaliveMin) +
+                           " s, follows NAT bindings up to " +
+                           std::to_string(keepaliveMax) + " s");
+
+    // interfaces for the first clients are created in background
+    // (the previous process gives its ready ones):
+    if(!sharedTun)
+        tunMgr->attachInterfacePool(inherited.readyInterfaces);
+
+    workers = new WorkerPool(workersCount, port,
+        [this](DtlsListener& listener, const sockaddr_in6& peer) {
+            return createTunnel(listener, peer);
+        },
+        [this](Tunnel& tunnel) {
+            return setupTunnel(tunnel);
+        },
+        [this](Tunnel& tunnel) {
+            releaseTunnel(tunnel);
+        });
+    if(handoffSocket >= 0)
+        workers->adoptListeners(inherited.listeners);
+    if(sharedTun)
+        setupSharedTun();
+    workers->start();
+    TunnelManager::log("Started " + std::to_string(workers->size()) +
+                       " worker(s) listening on port " + port);
+    if(handoffSocket >= 0)
+        completeTakeover();
+
+    // the main thread serves the metrics endpoint (or just waits):
+    EventLoop loop;
+    std::unique_ptr<MetricsServer> metrics;
+    if(metricsPort != 0) {
+        addMetricsGauges();
+        metrics.reset(new MetricsServer(metricsPort));
+        metrics->attach(loop);
+        TunnelManager::log("Metrics on http://127.0.0.1:" +
+                           std::to_string(metricsPort) + "/metrics");
+    }
+    // settings are changed without a restart:
+    std::unique_ptr<ControlServer> controlServer;
+    if(!controlPath.empty()) {
+        controlServer.reset(new ControlServer(controlPath,
+            [this](const std::string& command) {
+                return control(command);
+            }));
+        controlServer->attach(loop);
+        TunnelManager::log("Control API on " + controlPath);
+    }
+    // a new server process may take over the clients:
+    int handoffListener = -1;
+    if(!handoffPath.empty()) {
+        handoffListener = Handoff::listen(handoffPath);
+        loop.addFd(handoffListener, EPOLLIN, [this, &loop, handoffListener](uint32_t) {
+            if(handOff(handoffListener))
+                loop.stop();
+        });
+        TunnelManager::log("Handoff socket " + handoffPath);
+    }
+    loop.run();
+
+    if(handoffListener >= 0) {
+        loop.removeFd(handoffListener);
+        close(handoffListener);
     }
 }
 
 /**
- * @brief createNewConnection\r\n
- * Method creates new connection (tunnel)
- * waiting for client. When client is connected,
- * the new instance of this method will be runned
- * in another thread
+ * @brief control\r\n
+ * Runs a command of the control API, called by the main thread:
+ * reload, set KEY VALUE..., sessions, kick CLIENT,
+ * drain WORKER|all, undrain WORKER|all, help.
+ * @return response text, "ERROR: ..." if the command failed
  */
-void VPNServer::createNewConnection() {
-    mutex.lock();
-    // create ssl from sslContext:
-    // run commands via unix terminal (needs sudo)
-    in_addr_t serTunAddr    = manager->getAddrFromPool();
-    in_addr_t cliTunAddr    = manager->getAddrFromPool();
-    std::string serverIpStr = IPManager::getIpString(serTunAddr);
-    std::string clientIpStr = IPManager::getIpString(cliTunAddr);
-    size_t tunNumber        = tunMgr->getTunNumber();
-    std::string tunStr      = "vpn_tun" + std::to_string(tunNumber);
-    std::string tempTunStr = tunStr;
-    int interface = 0; // Tun interface
-    int sentParameters = -12345;
-    int e = 0;
-    // allocate the buffer for a single packet.
-    char packet[32767];
-    int timer = 0;
-    bool isClientConnected = true;
-    bool idle = true;
-    int length = 0;
-    int sentData = 0;
-    std::pair<int, WOLFSSL*> tunnel;
-
-    if(serTunAddr == 0 || cliTunAddr == 0) {
-        TunnelManager::log("No free IP addresses. Tunnel will not be created.",
-                           std::cerr);
-        return;
+std::string VPNServer::control(const std::string& command) {
+    std::istringstream words(command);
+    std::string name;
+    std::string argument;
+    words >> name >> argument;
+    if(name != "sessions" && name != "help")
+        TunnelManager::log("Control: " + command);
+
+    try {
+        if(name == "reload") {
+            if(configPath.empty())
+                throw std::invalid_argument("No configuration file");
+            ServerSettings settings;
+            settings.load(configPath);
+            return "OK " + applySettings(settings) + "\n";
+        }
+        if(name == "set" && argument == "rate") {
+            // a single limit, the others are kept:
+            std::string limit;
+            words >> limit;
+            size_t separator = limit.find('=');
+            if(separator == std::string::npos)
+                setRateLimit("", RateLimits::parseRate(limit));
+            else
+                setRateLimit(limit.substr(0, separator),
+                             RateLimits::parseRate(limit.substr(separator + 1)));
+            return "OK rate\n";
+        }
+        if(name == "set") {
+            ServerSettings settings;
+            settings.add(command.substr(command.find("set") + 3));
+            return "OK " + applySettings(settings) + "\n";
+        }
+        if(name == "sessions")
+            return listSessions();
+        if(name == "kick") {
+            return "OK " + std::to_string(kickSessions(argument)) +
+                   " session(s) closed\n";
+        }
+        if(name == "drain" || name == "undrain")
+            return drainWorkers(argument, name == "drain");
+        if(name == "help" || name.empty()) {
+            return "reload                 - read the configuration file again\n"
+                   "set mtu|dns|route|interface VALUE...\n"
+                   "set rate [HOST=]RATE   - change one rate limit\n"
+                   "sessions               - list established sessions\n"
+                   "kick HOST|ADDRESS|TUN  - close the sessions of a client\n"
+                   "drain WORKER|all       - refuse new clients on the worker\n"
+                   "undrain WORKER|all     - accept new clients again\n";
+        }
+        throw std::invalid_argument("Unknown command " + name);
+    } catch (const std::exception& e) {
+        return std::string("ERROR: ") + e.what() + "\n";
     }
+}
 
-    tunMgr->createUnixTunnel(serverIpStr,
-                             clientIpStr,
-                             tunStr);
-    // Get TUN interface.
-    interface = get_interface(tunStr.c_str());
+/**
+ * @brief applySettings\r\n
+ * Changes the settings of the server. New clients get the new
+ * parameters, established ones get them in updated parameters
+ * over their DTLS sessions; a new physical interface moves the NAT
+ * rule. The port and the virtual network are fixed: a new server
+ * process can take over the clients instead (see Handoff).
+ * @return names of the changed settings
+ * @throws std::invalid_argument if the interface doesn't exist,
+ * nothing is changed then
+ */
+std::string VPNServer::applySettings(const ServerSettings& settings) {
+    if(!settings.physInterface.empty() && !isNetIfaceExists(settings.physInterface))
+        throw std::invalid_argument("No such network interface");
 
+    std::string changed;
+    std::string previousInterface;
+    bool        parametersChanged = false;
+    mutex.lock();
+        if(!settings.mtu.empty() && settings.mtu != cliParams.mtu) {
+            cliParams.mtu = settings.mtu;
+            changed += " mtu";
+        }
+        if(!settings.dnsIp.empty() && settings.dnsIp != cliParams.dnsIp) {
+            cliParams.dnsIp = settings.dnsIp;
+            changed += " dns";
+        }
+        if(!settings.routeIp.empty() && (settings.routeIp != cliParams.routeIp ||
+                                         settings.routeMask != cliParams.routeMask)) {
+            cliParams.routeIp   = settings.routeIp;
+            cliParams.routeMask = settings.routeMask;
+            changed += " route";
+        }
+        if(!settings.dnsIp6.empty() && settings.dnsIp6 != cliParams.dnsIp6) {
+            cliParams.dnsIp6 = settings.dnsIp6;
+            changed += " dns6";
+        }
+        if(!settings.routeIp6.empty() && (settings.routeIp6 != cliParams.routeIp6 ||
+                                          settings.routeMask6 != cliParams.routeMask6)) {
+            cliParams.routeIp6   = settings.routeIp6;
+            cliParams.routeMask6 = settings.routeMask6;
+            changed += " route6";
+        }
+        parametersChanged = !changed.empty();
+        previousInterface = cliParams.physInterface;
+        if(!settings.physInterface.empty() && settings.physInterface != previousInterface) {
+            cliParams.physInterface = settings.physInterface;
+            changed += " interface";
+        }
     mutex.unlock();
+    if(!settings.rateLimits.empty()) {
+        rateLimits.replace(settings.rateLimits); // checked by ServerSettings
+        changed += " rate";
+    }
 
-    // fill array with parameters to send:
-    std::unique_ptr<ClientParameters> cliParams(buildParameters(clientIpStr));
-
-    // wait for a tunnel.
-    while ((tunnel = get_tunnel(port.c_str())).first != -1
-           &&
-           tunnel.second != nullptr) {
-
-        TunnelManager::log("New client connected to [" + tunStr + "]");
-
-        // send the parameters several times in case of packet loss.
-        for (int i = 0; i < 3; ++i) {
-            sentParameters =
-                wolfSSL_send(tunnel.second, cliParams->parametersToSend,
-                             sizeof(cliParams->parametersToSend),
-                             MSG_NOSIGNAL);
-
-            if(sentParameters < 0) {
-                TunnelManager::log("Error sending parameters: " +
-                                std::to_string(sentParameters));
-                e = wolfSSL_get_error(tunnel.second, 0);
-                printf("error = %d, %s\n", e, wolfSSL_ERR_reason_error_string(e));
+    // the server runs already:
+    if(workers != nullptr) {
+        if(parametersChanged) {
+            workers->updateParameters([this](const Tunnel& tunnel) {
+                return buildParameters(tunnel.getClientAddr(), tunnel.getClientAddr6(),
+                                       tunnel.getClientPrefix6());
+            });
+        }
+        if(previousInterface != cliParams.physInterface) {
+            NetworkBackend& network = tunMgr->getNetworkBackend();
+            std::string virtualLanAddress = cliParams.virtualNetworkIp + '/' +
+                                            cliParams.networkMask;
+            network.removeMasquerade(virtualLanAddress, previousInterface);
+            network.addMasquerade(virtualLanAddress, cliParams.physInterface);
+            if(manager6 != nullptr && manager6->isUniqueLocal()) {
+                network.removeMasquerade(manager6->getNetworkString(), previousInterface);
+                network.addMasquerade(manager6->getNetworkString(), cliParams.physInterface);
             }
         }
+        if(!settings.rateLimits.empty())
+            workers->updateRateLimits(rateLimits);
+    }
+    return changed.empty() ? "nothing changed" : changed.substr(1);
+}
 
-        // we keep forwarding packets till something goes wrong.
-        while (isClientConnected) {
-            // assume that we did not make any progress in this iteration.
-            idle = true;
-
-            // read the outgoing packet from the input stream.
-            length = read(interface, packet, sizeof(packet));
-            if (length > 0) {
-                // write the outgoing packet to the tunnel.
-                sentData = wolfSSL_send(tunnel.second, packet, length, MSG_NOSIGNAL);
-                if(sentData < 0) {
-                    TunnelManager::log("sentData < 0");
-                    e = wolfSSL_get_error(tunnel.second, 0);
-                    printf("error = %d, %s\n", e, wolfSSL_ERR_reason_error_string(e));
-                }
-
-                // there might be more outgoing packets.
-                idle = false;
-
-                // if we were receiving, switch to sending.
-                if (timer < 1)
-                    timer = 1;
-            }
+/**
+ * @brief listSessions\r\n
+ * Established sessions of all workers, one per line.
+ */
+std::string VPNServer::listSessions() {
+    std::string result = "WORKER TUNNEL ADDRESS PEER RX_BYTES TX_BYTES RATE\n";
+    for(const SessionInfo& session : workers->getSessions()) {
+        result += std::to_string(session.worker) + ' ' + session.tunnel + ' ' +
+                  IPManager::getIpString(session.client) +
+                  (session.client6.empty() ? "" : ',' + session.client6) +
+                  " [" + session.peer +
+                  "]:" + std::to_string(session.port) + ' ' +
+                  std::to_string(session.rxBytes) + ' ' +
+                  std::to_string(session.txBytes) + ' ' +
+                  (session.rateLimit != 0 ? std::to_string(session.rateLimit * 8) : "-") +
+                  (session.offloaded ? " offloaded" : "") +
+                  (session.hibernated ? " hibernated" : "") +
+                  (session.pipelined ? " pipelined" : "") + '\n';
+    }
+    for(size_t i = 0; i < workers->size(); ++i) {
+        if(workers->isDraining(i))
+            result += "worker " + std::to_string(i) + " is draining\n";
+    }
+    return result;
+}
+
+/**
+ * @brief kickSessions\r\n
+ * Closes the sessions of the client connecting from the host,
+ * with the tunnel address (IPv4 or IPv6) or on the tunnel interface 'client'.
+ * @return count of closed sessions
+ */
+size_t VPNServer::kickSessions(const std::string& client) {
+    if(client.empty())
+        throw std::invalid_argument("Client host, address or tunnel is required");
+
+    std::string host;
+    in_addr_t   address  = 0;
+    in6_addr    address6 = in6addr_any;
+    try {
+        host = AccessPolicy::hostKey(client);
+        inet_pton(AF_INET, client.c_str(), &address);
+        inet_pton(AF_INET6, client.c_str(), &address6);
+    } catch (const std::invalid_argument&) {
+        // not an address, the name of the tunnel
+    }
+    return workers->closeSessions([&](const Tunnel& tunnel) {
+        return host.empty() ? tunnel.getTunStr() == client
+                            : tunnel.getPeerHost() == host ||
+                              tunnel.getClientAddr() == address ||
+                              (tunnel.hasClientAddr6() &&
+                               IN6_ARE_ADDR_EQUAL(&tunnel.getClientAddr6(), &address6));
+    });
+}
 
-            // read the incoming packet from the tunnel.
-            length = wolfSSL_recv(tunnel.second, packet, sizeof(packet), 0);
-            if (length == 0) {
-                TunnelManager::log(std::string() +
-                                   "recv() length == " +
-                                   std::to_string(length) +
-                                   ". Breaking..",
+/**
+ * @brief drainWorkers\r\n
+ * Draining workers serve their sessions but refuse new clients,
+ * e.g. before the server is stopped.
+ * @param worker - index of a worker or "all"
+ */
+std::string VPNServer::drainWorkers(const std::string& worker, bool drain) {
+    size_t first = 0;
+    size_t last  = workers->size();
+    if(worker != "all") {
+        if(worker.empty() || worker.find_first_not_of("0123456789") != std::string::npos)
+            throw std::invalid_argument("Worker index or 'all' is required");
+        first = atoi(worker.c_str());
+        last  = first + 1;
+    }
+    for(size_t i = first; i < last; ++i)
+        workers->setDraining(i, drain);
+    return std::string("OK ") + (drain ? "draining" : "accepting clients") + "\n";
+}
+
+/**
+ * @brief receiveHandoff\r\n
+ * Connects to the server process listening on the handoff socket
+ * and receives its state. The new process serves with the workers
+ * and the port of the previous one. Nothing is received if no
+ * server listens on the socket: this is the first process.
+ * @throws std::runtime_error if the state cannot be received
+ * or does not fit the options
+ */
+void VPNServer::receiveHandoff() {
+    handoffSocket = Handoff::connect(handoffPath);
+    if(handoffSocket < 0)
+        return;
+
+    TunnelManager::log("Taking over from the server on " + handoffPath);
+    try {
+        Handoff::receive(handoffSocket, inherited);
+        if(inherited.listeners.empty() || inherited.listeners.size() > MAX_WORKERS)
+            throw std::runtime_error("Handoff state has no workers");
+        if((inherited.sharedServerAddr != 0) != sharedTun)
+            throw std::runtime_error("Handoff state: -s option differs from "
+                                     "the previous process");
+    } catch (...) {
+        inherited.closeDescriptors();
+        close(handoffSocket);
+        handoffSocket = -1;
+        throw;
+    }
+
+    workersCount   = inherited.listeners.size();
+    port           = inherited.port;
+    keepInterfaces = true; // until the previous process has exited
+}
+
+/**
+ * @brief reserveInherited\r\n
+ * Takes the addresses and numbers of the inherited interfaces,
+ * the IPv6 prefixes of the inherited tunnels and the addresses
+ * of the inherited leases, so they are not given to new clients.
+ * A lease keeps the hold time it has left, but not more than
+ * the lease time of this process.
+ */
+void VPNServer::reserveInherited() {
+    if(inherited.sharedServerAddr != 0)
+        manager->reserveAddr(inherited.sharedServerAddr);
+    for(const TunInterface& iface : inherited.readyInterfaces)
+        tunMgr->reserveInterface(iface);
+    for(const HandoffTunnel& tunnel : inherited.tunnels) {
+        if(sharedTun)
+            manager->reserveAddr(tunnel.iface.clientAddr);
+        else
+            tunMgr->reserveInterface(tunnel.iface);
+        if(manager6 != nullptr && tunnel.clientPrefix6 == manager6->getClientPrefix()) {
+            manager6->reserve(IP6Manager::getIpString(tunnel.peer.sin6_addr),
+                              tunnel.clientAddr6);
+        }
+    }
+
+    for(HandoffLease& lease : inherited.leases) {
+        if(leaseTime == 0)
+            lease.holdTime = 0; // leases don't expire here
+        else if(lease.holdTime == 0 || lease.holdTime > (uint32_t)leaseTime)
+            lease.holdTime = leaseTime;
+        std::chrono::seconds holdTime(lease.holdTime); // armed by 'completeTakeover'
+
+        if(lease.clientAddr != 0)
+            manager->restoreLease(lease.identity, lease.clientAddr, holdTime);
+        if(manager6 != nullptr && lease.clientPrefix6 == manager6->getClientPrefix())
+            manager6->restoreLease(lease.identity, lease.clientAddr6, holdTime);
+    }
+}
+
+/**
+ * @brief completeTakeover\r\n
+ * The workers restore the inherited tunnels and the hold
+ * timers of the inherited leases, then the previous
+ * process is told to exit without removing the interfaces.
+ */
+void VPNServer::completeTakeover() {
+    for(const HandoffTunnel& tunnel : inherited.tunnels) {
+        workers->adoptTunnel(tunnel, [this](Tunnel& tunnel,
+                                            const HandoffTunnel& handoff) {
+            adoptTunnel(tunnel, handoff);
+        });
+    }
+    for(size_t i = 0; i < inherited.leases.size(); ++i) {
+        const HandoffLease& lease = inherited.leases[i];
+        if(lease.holdTime != 0) {
+            workers->postTimer(i, std::chrono::seconds(lease.holdTime),
+                               leaseExpiry(lease.identity));
+        }
+    }
+    Handoff::sendAck(handoffSocket);
+    close(handoffSocket);
+    handoffSocket = -1;
+
+    keepInterfaces = false;
+    tunMgr->setKeepInterfaces(false);
+    TunnelManager::log("Took over " + std::to_string(inherited.tunnels.size()) +
+                       " tunnel(s) and " + std::to_string(inherited.leases.size()) +
+                       " lease(s) from the previous server");
+    inherited = HandoffState(); // the descriptors are owned by the workers
+}
+
+/**
+ * @brief handOff\r\n
+ * Gives the listeners, interfaces and sessions to the new server
+ * process connected to the handoff socket. The workers are frozen
+ * meanwhile, so the exported sessions don't change. If the new
+ * process doesn't acknowledge the state the workers are resumed.
+ * Offloaded tunnels and unfinished handshakes are not handed off,
+ * their clients connect again. Leases of gone clients are handed
+ * off with the hold time they have left.
+ * @param listener - handoff socket
+ * @return true if the server must exit now
+ */
+bool VPNServer::handOff(int listener) {
+    int client = Handoff::accept(listener);
+    if(client < 0)
+        return false;
+
+    TunnelManager::log("Handing off to a new server process");
+    workers->freeze();
+    HandoffState state;
+    state.port             = port;
+    state.sharedServerAddr = sharedTun ? sharedServerAddr : 0;
+    state.sharedVnetHeader = tunFlags & TunDevice::VNET_HEADER;
+    tunMgr->detachInterfacePool(state.readyInterfaces);
+    workers->exportState(state);
+    exportLeases(state.leases);
+
+    bool done = false;
+    try {
+        Handoff::send(client, state);
+        done = Handoff::waitAck(client);
+    } catch (const std::exception& e) {
+        TunnelManager::log(e.what(), std::cerr);
+    }
+    close(client);
+
+    if(!done) {
+        TunnelManager::log("Handoff failed, serving the clients further", std::cerr);
+        if(!sharedTun)
+            tunMgr->attachInterfacePool(state.readyInterfaces);
+        workers->resume();
+        return false;
+    }
+
+    workers->handOff();
+    keepInterfaces = true;
+    tunMgr->setKeepInterfaces(true);
+    TunnelManager::log("Handed off " + std::to_string(state.tunnels.size()) +
+                       " tunnel(s), exiting");
+    return true;
+}
+
+/**
+ * @brief exportLeases\r\n
+ * Leases of gone clients for the new server process,
+ * the IPv4 and IPv6 leases of a client are merged.
+ */
+void VPNServer::exportLeases(std::vector<HandoffLease>& leases) {
+    std::unordered_map<std::string, size_t> byIdentity;
+    manager->getGoneLeases([&](const std::string& identity, in_addr_t ip,
+                               std::chrono::seconds holdTime) {
+        HandoffLease lease;
+        lease.identity   = identity;
+        lease.clientAddr = ip;
+        lease.holdTime   = holdTime.count();
+        byIdentity[identity] = leases.size();
+        leases.push_back(lease);
+    });
+    if(manager6 == nullptr)
+        return;
+
+    uint8_t prefix6 = manager6->getClientPrefix();
+    manager6->getGoneLeases([&](const std::string& identity, const in6_addr& address,
+                                std::chrono::seconds holdTime) {
+        auto found = byIdentity.find(identity);
+        if(found == byIdentity.end()) {
+            HandoffLease lease;
+            lease.identity = identity;
+            lease.holdTime = holdTime.count();
+            found = byIdentity.emplace(identity, leases.size()).first;
+            leases.push_back(lease);
+        }
+        leases[found->second].clientAddr6   = address;
+        leases[found->second].clientPrefix6 = prefix6;
+    });
+}
+
+/**
+ * @brief leaseExpiry\r\n
+ * Timer task that forgets the leases of a gone client if their
+ * hold time is over, so the addresses are free again.
+ */
+TimerWheel::Task VPNServer::leaseExpiry(const std::string& identity) {
+    return [this, identity]() {
+        manager->expireLease(identity);
+        if(manager6 != nullptr)
+            manager6->expireLease(identity);
+    };
+}
+
+/**
+ * @brief addMetricsGauges - gauges of the server state,
+ * read by the metrics endpoint
+ */
+void VPNServer::addMetricsGauges() {
+    Metrics& metrics = Metrics::instance();
+    metrics.addGauge("vpn_active_tunnels",
+                     "Tunnels served by workers, including handshakes.",
+                     [this]() { return workers->tunnelsCount(); });
+    metrics.addGauge("vpn_address_pool_used",
+                     "Tunnel addresses given to clients and interfaces or kept by leases.",
+                     [this]() { return manager->usedAddrCount(); });
+    metrics.addGauge("vpn_address_pool_capacity",
+                     "Addresses of the virtual network.",
+                     [this]() { return manager->networkCapacity(); });
+    if(manager6 != nullptr) {
+        metrics.addGauge("vpn_address6_pool_used",
+                         "IPv6 prefixes given to clients.",
+                         [this]() { return manager6->usedCount(); });
+        metrics.addGauge("vpn_address6_pool_capacity",
+                         "Prefixes of the virtual IPv6 network.",
+                         [this]() { return manager6->getCapacity() - 1; });
+    }
+    metrics.addGauge("vpn_ready_interfaces",
+                     "Interfaces created in advance and not used yet.",
+                     [this]() { return tunMgr->readyInterfacesCount(); });
+
+    if(sessions != nullptr) {
+        metrics.addCounterReader("vpn_session_cache_hits_total",
+                                 "Resumed sessions found in the session cache.",
+                                 [this]() { return sessions->getHits(); });
+        metrics.addCounterReader("vpn_session_cache_misses_total",
+                                 "Session IDs not found in the session cache.",
+                                 [this]() { return sessions->getMisses(); });
+        metrics.addCounterReader("vpn_session_cache_evictions_total",
+                                 "Sessions evicted from the full session cache.",
+                                 [this]() { return sessions->getEvictions(); });
+        metrics.addGauge("vpn_session_cache_entries",
+                         "Sessions in the session cache.",
+                         [this]() { return sessions->size(); });
+        metrics.addGauge("vpn_session_cache_hit_ratio",
+                         "Share of session cache lookups that found the session.",
+                         [this]() { return sessions->hitRatio(); });
+    }
+    if(idleTime > 0) {
+        metrics.addGauge("vpn_hibernated_tunnels",
+                         "Idle tunnels that keep their exported session only.",
+                         []() { return Tunnel::getHibernatedCount(); });
+    }
+    if(xfrm != nullptr) {
+        metrics.addGauge("vpn_offloaded_tunnels",
+                         "Tunnels forwarded by kernel ESP states.",
+                         [this]() { return xfrm->size(); });
+    }
+    if(cryptoPool != nullptr) {
+        metrics.addGauge("vpn_pipelined_tunnels",
+                         "Heavy tunnels protected by the crypto threads.",
+                         [this]() { return cryptoPool->pipelinesCount(); });
+    }
+    if(tickets != nullptr) {
+        metrics.addCounterReader("vpn_session_tickets_issued_total",
+                                 "Session tickets encrypted for clients.",
+                                 [this]() { return tickets->getIssued(); });
+        metrics.addCounterReader("vpn_session_tickets_accepted_total",
+                                 "Session tickets of the current key.",
+                                 [this]() { return tickets->getAccepted(); });
+        metrics.addCounterReader("vpn_session_tickets_renewed_total",
+                                 "Session tickets of the previous key, renewed.",
+                                 [this]() { return tickets->getRenewed(); });
+        metrics.addCounterReader("vpn_session_tickets_rejected_total",
+                                 "Session tickets of unknown keys or broken.",
+                                 [this]() { return tickets->getRejected(); });
+    }
+}
+
+/**
+ * @brief createTunnel\r\n
+ * Method creates new connection (tunnel) for the client
+ * that has returned the DTLS cookie of the listener. Called by
+ * workers, the DTLS handshake is done by the tunnel itself.
+ * @param listener - listener socket that received the request
+ * @param peer     - client transport address
+ * @return new tunnel or nullptr if it cannot be created
+ */
+Tunnel* VPNServer::createTunnel(DtlsListener& listener,
+                                const sockaddr_in6& peer) {
+    WOLFSSL* ssl;
+
+    /* Create the WOLFSSL Object */
+    if ((ssl = wolfSSL_new(ctx)) == NULL) {
+        TunnelManager::log("wolfSSL_new error.", std::cerr);
+        return nullptr;
+    }
+
+    Tunnel* tunnel = new Tunnel(ssl, listener, peer);
+    if(idleTime > 0)
+        tunnel->setHibernation(ctx, std::chrono::seconds(idleTime));
+    if(cryptoPool != nullptr)
+        tunnel->setCryptoPool(cryptoPool);
+    if(xfrm != nullptr) {
+        tunnel->setOffloadHandler([this](Tunnel& tunnel, XfrmSession& session) {
+            return offloadTunnel(tunnel, session);
+        });
+    }
+    return tunnel;
+}
+
+/**
+ * @brief setupTunnel\r\n
+ * Attaches TUN interface with tunnel addresses to the client
+ * which has completed the handshake, so slow or malicious
+ * clients don't hold any of them. The interface is taken
+ * from the pool of ready interfaces if there is one.
+ * Clients are identified by their host address, so a client
+ * reconnecting from another port gets the same tunnel address.
+ * With the shared TUN device only the client address is allocated.
+ * With an IPv6 network the client gets its prefix too, routed
+ * to its interface (the shared TUN device has the route of the network).
+ * @param tunnel - tunnel with established DTLS session
+ * @return true if the interface is attached to the tunnel
+ */
+bool VPNServer::setupTunnel(Tunnel& tunnel) {
+    std::string identity = tunnel.getPeerHost();
+
+    if(sharedTun) {
+        // only the address is needed, the worker routes the packets:
+        in_addr_t clientAddr = manager->getLeasedAddr(identity);
+        if(clientAddr == 0) {
+            clientAddr = manager->getAddrFromPool();
+            if(clientAddr == 0) {
+                TunnelManager::log("No free IP addresses. Tunnel will not be created.",
                                    std::cerr);
-                break;
-            }
-            if (length > 0) {
-                // ignore control messages, which start with zero.
-                if (packet[0] != 0) {
-                    // write the incoming packet to the output stream.
-                    sentData = write(interface, packet, length);
-                    if(sentData < 0) {
-                        TunnelManager::log("write(interface, packet, length) < 0");
-                    }
-                } else {
-                    TunnelManager::log("Recieved empty control msg from client");
-                    if(packet[1] == CLIENT_WANT_DISCONNECT && length == 2) {
-                        TunnelManager::log("WANT_DISCONNECT from client");
-                        isClientConnected = false;
-                    }
-                }
-
-                // there might be more incoming packets.
-                idle = false;
-
-                // if we were sending, switch to receiving.
-                if (timer > 0) {
-                    timer = 0;
-                }
+                return false;
             }
+            manager->setLease(identity, clientAddr);
+        }
+        in6_addr clientAddr6 = in6addr_any;
+        uint8_t  prefix6     = acquireAddr6(identity, clientAddr6);
+        tunnel.attachInterface(-1, false, SHARED_TUN, sharedServerAddr,
+                               clientAddr, 0,
+                               buildParameters(clientAddr, clientAddr6, prefix6));
+        if(prefix6 != 0)
+            tunnel.setClientAddr6(clientAddr6, prefix6);
+        if(!accessPolicy.empty())
+            tunnel.setAccessList(accessPolicy.forClient(identity));
+        tunnel.setRateLimit(rateLimits.forClient(identity));
+        return true;
+    }
 
-            // if we are idle or waiting for the network, sleep for a
-            // fraction of time to avoid busy looping.
-            if (idle) {
-                std::this_thread::sleep_for(std::chrono::microseconds(100000));
-
-                // increase the timer. This is inaccurate but good enough,
-                // since everything is operated in non-blocking mode.
-                timer += (timer > 0) ? 100 : -100;
-
-                // we are receiving for a long time but not sending
-                if (timer < -10000) {  // -16000
-                    // send empty control messages.
-                    packet[0] = 0;
-                    for (int i = 0; i < 3; ++i) {
-                        sentData = wolfSSL_send(tunnel.second, packet, 1, MSG_NOSIGNAL);
-                        if(sentData < 0) {
-                            TunnelManager::log("sentData < 0");
-                            e = wolfSSL_get_error(tunnel.second, 0);
-                            printf("error = %d, %s\n", e, wolfSSL_ERR_reason_error_string(e));
-                        } else {
-                            TunnelManager::log("sent empty control packet");
-                        }
-                    }
+    TunInterface iface;
+    if(!tunMgr->acquireInterface(iface, identity))
+        return false;
+
+    int interface = -1; // Tun interface
+    try {
+        // Get TUN interface.
+        interface = get_interface(iface.name.c_str());
+    } catch (const std::exception& e) {
+        TunnelManager::log(e.what(), std::cerr);
+        tunMgr->releaseInterface(iface, manager->releaseLease(identity, iface.clientAddr));
+        return false;
+    }
 
-                    // switch to sending.
-                    timer = 1;
-                }
+    in6_addr clientAddr6 = in6addr_any;
+    uint8_t  prefix6     = acquireAddr6(identity, clientAddr6);
+    // fill array with parameters to send:
+    tunnel.attachInterface(interface, tunFlags & TunDevice::VNET_HEADER,
+                           iface.name, iface.serverAddr, iface.clientAddr,
+                           iface.number,
+                           buildParameters(iface.clientAddr, clientAddr6, prefix6));
+    if(prefix6 != 0) {
+        tunnel.setClientAddr6(clientAddr6, prefix6);
+        tunMgr->getNetworkBackend().addRoute6(iface.name,
+                                              IP6Manager::getPrefixString(clientAddr6, prefix6));
+    }
+    if(!accessPolicy.empty())
+        tunnel.setAccessList(accessPolicy.forClient(identity));
+    tunnel.setRateLimit(rateLimits.forClient(identity));
+    return true;
+}
 
-                // we are sending for a long time but not receiving.
-                if (timer > TIMEOUT_LIMIT) {
-                    TunnelManager::log("[" + tempTunStr + "]" +
-                                       "Sending for a long time but"
-                                       " not receiving. Breaking...");
-                    break;
-                }
-            }
+/**
+ * @brief acquireAddr6\r\n
+ * Gives the client its IPv6 prefix if the server has an IPv6 network,
+ * a client reconnecting in time gets the same one. The client
+ * is served over IPv4 only if there are no free prefixes.
+ * @param address - address of the client in its prefix
+ * @return length of the prefix, 0 - no IPv6 address
+ */
+uint8_t VPNServer::acquireAddr6(const std::string& identity, in6_addr& address) {
+    if(manager6 == nullptr)
+        return 0;
+    if(!manager6->acquire(identity, address)) {
+        TunnelManager::log("No free IPv6 prefixes, the client gets IPv4 only.",
+                           std::cerr);
+        return 0;
+    }
+    return manager6->getClientPrefix();
+}
+
+/**
+ * @brief setRateLimit\r\n
+ * Changes the rate limit of the clients while the server runs
+ * (control API), open tunnels get the new limit from their workers.
+ * @param host - client host address, empty for the default limit
+ * @param rate - bytes per second, 0 - unlimited
+ * @throws std::invalid_argument if 'host' is not an address
+ */
+void VPNServer::setRateLimit(const std::string& host, uint64_t rate) {
+    if(host.empty())
+        rateLimits.setDefault(rate);
+    else
+        rateLimits.set(host, rate);
+
+    if(workers != nullptr)
+        workers->updateRateLimits(rateLimits);
+}
+
+/**
+ * @brief adoptTunnel\r\n
+ * Attaches the inherited interface (or the address on the shared
+ * TUN device) to a tunnel handed off by the previous process,
+ * called by its worker before the session is restored.
+ * The addresses were reserved by 'reserveInherited'.
+ * @param handoff - state of the tunnel in the previous process
+ */
+void VPNServer::adoptTunnel(Tunnel& tunnel, const HandoffTunnel& handoff) {
+    std::string identity = tunnel.getPeerHost();
+    const TunInterface& iface = handoff.iface;
+
+    // the prefix was reserved if the IPv6 network is the same:
+    size_t  index   = 0;
+    uint8_t prefix6 = 0;
+    if(manager6 != nullptr && handoff.clientPrefix6 == manager6->getClientPrefix()
+       && manager6->indexOf(handoff.clientAddr6, index))
+        prefix6 = handoff.clientPrefix6;
+
+    manager->setLease(identity, iface.clientAddr);
+    tunnel.attachInterface(handoff.interface, handoff.vnetHeader, iface.name,
+                           iface.serverAddr, iface.clientAddr, iface.number,
+                           buildParameters(iface.clientAddr, handoff.clientAddr6, prefix6));
+    if(prefix6 != 0)
+        tunnel.setClientAddr6(handoff.clientAddr6, prefix6);
+    if(!accessPolicy.empty())
+        tunnel.setAccessList(accessPolicy.forClient(identity));
+    tunnel.setRateLimit(rateLimits.forClient(identity));
+}
+
+/**
+ * @brief offloadTunnel\r\n
+ * Installs the kernel data path of the tunnel, called by its
+ * worker when the client asks for it. The outer server address
+ * is the source address of the route to the client.
+ * @param session - addresses and keys from the tunnel,
+ *                  the server part is filled here
+ * @return false if the tunnel must stay on the DTLS path
+ */
+bool VPNServer::offloadTunnel(Tunnel& tunnel, XfrmSession& session) {
+    if(!XfrmOffload::localAddressFor(session.peerAddr, session.localAddr)) {
+        TunnelManager::log("[" + tunnel.getTunStr() + "] no route to the client, "
+                           "offload is refused", std::cerr);
+        return false;
+    }
+    session.localPort = xfrm->getPort();
+    session.inSpi     = xfrm->allocateSpi();
+    try {
+        xfrm->install(session);
+    } catch (const std::exception& e) {
+        TunnelManager::log("[" + tunnel.getTunStr() + "] " + e.what(), std::cerr);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief releaseTunnel\r\n
+ * Gives the interface of the tunnel back to the pool
+ * (or removes it together with its addresses if the pool is full).
+ * The client address stays taken by the lease of the client,
+ * the interface gets another one.
+ * The IPv6 prefix of the client is released together with
+ * the address. With a lease time the leases of the client expire
+ * unless the client connects again in time.
+ * Called by workers when a client is gone.
+ * @param tunnel - closed tunnel
+ */
+void VPNServer::releaseTunnel(Tunnel& tunnel) {
+    if(tunnel.getOffload() != nullptr)
+        xfrm->remove(*tunnel.getOffload());
+
+    if(!tunnel.hasInterface())
+        return; // the handshake was not completed
+
+    std::string identity = tunnel.getPeerHost();
+    bool leased = manager->releaseLease(identity, tunnel.getClientAddr());
+
+    if(tunnel.hasClientAddr6()) {
+        if(!tunnel.isSharedInterface()) {
+            std::string prefix = IP6Manager::getPrefixString(tunnel.getClientAddr6(),
+                                                             tunnel.getClientPrefix6());
+            tunMgr->getNetworkBackend().removeRoute6(tunnel.getTunStr(), prefix);
         }
-        TunnelManager::log("Client has been disconnected from tunnel [" +
-                           tempTunStr + "]");
+        manager6->release(identity, tunnel.getClientAddr6());
+    }
 
-        break;
+    // the leases wait for the client on the timer wheel of the worker,
+    // a handoff carries the rest of the hold time over ('exportLeases'):
+    if(leaseTime > 0 && tunnel.getTimers() != nullptr) {
+        manager->holdLease(identity, std::chrono::seconds(leaseTime));
+        if(manager6 != nullptr)
+            manager6->holdLease(identity, std::chrono::seconds(leaseTime));
+        tunnel.getTimers()->post(std::chrono::seconds(leaseTime), leaseExpiry(identity));
     }
-    TunnelManager::log("Tunnel closed.");
-    wolfSSL_shutdown(tunnel.second);
-    wolfSSL_free(tunnel.second);
-    //
-    manager->returnAddrToPool(serTunAddr);
-    manager->returnAddrToPool(cliTunAddr);
-    tunMgr->closeTunNumber(tunNumber);
+
+    if(tunnel.isSharedInterface()) {
+        if(!leased)
+            manager->returnAddrToPool(tunnel.getClientAddr());
+        return;
+    }
+
+    TunInterface iface;
+    iface.number     = tunnel.getTunNumber();
+    iface.name       = tunnel.getTunStr();
+    iface.serverAddr = tunnel.getServerAddr();
+    iface.clientAddr = tunnel.getClientAddr();
+    tunMgr->releaseInterface(iface, leased);
 }
 
 /**
@@ -291,6 +1010,9 @@ void VPNServer::parseArguments(int argc, char** argv) {
     };
 
     port = argv[1]; // port to listen
+    workersCount = WorkerPool::defaultWorkersCount();
+    networkBackend = "netlink";
+    readyInterfaces = 4;
 
     if(atoi(port.c_str()) < 1 || atoi(port.c_str()) > 0xFFFF) {
         throw std::invalid_argument(
@@ -324,6 +1046,10 @@ void VPNServer::parseArguments(int argc, char** argv) {
                     }
                     break;
                 case 'd':
+                    if((i + 1) < argc && correctIp6(argv[i + 1])) {
+                        cliParams.dnsIp6 = argv[i + 1];
+                        break;
+                    }
                     if((i + 1) < argc) {
                         cliParams.dnsIp = argv[i + 1];
                     }
@@ -332,6 +1058,17 @@ void VPNServer::parseArguments(int argc, char** argv) {
                     }
                     break;
                 case 'r':
+                    if((i + 1) < argc && correctIp6(argv[i + 1])) {
+                        cliParams.routeIp6 = argv[i + 1];
+                        if((i + 2) < argc) {
+                            cliParams.routeMask6 = argv[i + 2];
+                            int mask = atoi(cliParams.routeMask6.c_str());
+                            if(mask < 0 || mask > 128) {
+                                throw std::invalid_argument("Invalid route mask");
+                            }
+                        }
+                        break;
+                    }
                     if((i + 1) < argc) {
                         cliParams.routeIp = argv[i + 1];
                     }
@@ -345,6 +1082,172 @@ void VPNServer::parseArguments(int argc, char** argv) {
                         }
                     }
                     break;
+                case '6':
+                    if((i + 1) < argc) {
+                        cliParams.virtualNetwork6 = argv[i + 1];
+                    }
+                    if(!correctIp6(cliParams.virtualNetwork6)) {
+                        throw std::invalid_argument("Invalid IPv6 network");
+                    }
+                    if((i + 2) < argc) {
+                        cliParams.networkMask6 = argv[i + 2];
+                    }
+                    if(cliParams.networkMask6.empty()
+                       || cliParams.networkMask6.find_first_not_of("0123456789") != std::string::npos
+                       || atoi(cliParams.networkMask6.c_str()) > IP6Manager::MAX_NETWORK_PREFIX) {
+                        throw std::invalid_argument("Invalid IPv6 mask");
+                    }
+                    break;
+                case 'w':
+                    if((i + 1) < argc) {
+                        workersCount = atoi(argv[i + 1]);
+                    }
+                    if(workersCount < 1 || workersCount > MAX_WORKERS) {
+                        throw std::invalid_argument("Invalid workers count");
+                    }
+                    break;
+                case 'q':
+                    tunFlags |= TunDevice::MULTI_QUEUE;
+                    break;
+                case 'g':
+                    tunFlags |= TunDevice::VNET_HEADER;
+                    break;
+                case 'n':
+                    if((i + 1) < argc) {
+                        networkBackend = argv[i + 1];
+                    }
+                    if(!NetworkBackend::isBackendName(networkBackend)) {
+                        throw std::invalid_argument("Invalid network backend");
+                    }
+                    break;
+                case 'p':
+                    if((i + 1) < argc) {
+                        readyInterfaces = atoi(argv[i + 1]);
+                    }
+                    if(readyInterfaces > MAX_READY_INTERFACES) {
+                        throw std::invalid_argument("Invalid interface pool size");
+                    }
+                    break;
+                case 's':
+                    sharedTun = true;
+                    break;
+                case 'e':
+                    if((i + 1) < argc) {
+                        metricsPort = atoi(argv[i + 1]);
+                    }
+                    if(metricsPort < 1 || metricsPort > 0xFFFF) {
+                        throw std::invalid_argument("Invalid metrics port");
+                    }
+                    break;
+                case 'c':
+                    if((i + 1) < argc) {
+                        sessionCacheSize = atoi(argv[i + 1]);
+                    }
+                    if(sessionCacheSize < 0 || sessionCacheSize > MAX_SESSION_CACHE) {
+                        throw std::invalid_argument("Invalid session cache size");
+                    }
+                    break;
+                case 'k':
+                    if((i + 1) < argc) {
+                        ticketRotation = atoi(argv[i + 1]);
+                    }
+                    if(ticketRotation < 0) {
+                        throw std::invalid_argument("Invalid ticket key rotation");
+                    }
+                    break;
+                case 'o':
+                    if((i + 1) < argc) {
+                        espPort = atoi(argv[i + 1]);
+                    }
+                    if(espPort < 1 || espPort > 0xFFFF
+                       || std::to_string(espPort) == port) {
+                        throw std::invalid_argument("Invalid ESP port");
+                    }
+                    break;
+                case 'x':
+                    if((i + 1) < argc) {
+                        cipherPolicy = argv[i + 1];
+                    }
+                    if(!CipherSuites::isPolicyName(cipherPolicy)) {
+                        throw std::invalid_argument("Invalid cipher policy");
+                    }
+                    break;
+                case 't':
+                    pathMtuDiscovery = true;
+                    break;
+                case 'f':
+                    // throws std::invalid_argument for a bad file:
+                    accessPolicy.load((i + 1) < argc ? argv[i + 1] : "");
+                    break;
+                case 'b':
+                    // RATE or HOST=RATE, may be repeated:
+                    rateLimits.add((i + 1) < argc ? argv[i + 1] : "");
+                    break;
+                case 'l':
+                    if((i + 1) < argc) {
+                        handoffPath = argv[i + 1];
+                    }
+                    if(!Handoff::isValidPath(handoffPath)) {
+                        throw std::invalid_argument("Invalid handoff socket path");
+                    }
+                    break;
+                case 'z':
+                    if((i + 1) < argc) {
+                        idleTime = atoi(argv[i + 1]);
+                    }
+                    if(idleTime < 1 || idleTime > MAX_IDLE_TIME) {
+                        throw std::invalid_argument("Invalid idle time");
+                    }
+                    break;
+                case 'v':
+                    if(!Keepalive::parse((i + 1) < argc ? argv[i + 1] : "",
+                                         keepaliveMin, keepaliveMax)) {
+                        throw std::invalid_argument("Invalid keepalive interval");
+                    }
+                    break;
+                case 'h':
+                    if((i + 1) < argc) {
+                        leaseTime = atoi(argv[i + 1]);
+                    }
+                    if(leaseTime < 1 || leaseTime > MAX_LEASE_TIME) {
+                        throw std::invalid_argument("Invalid lease time");
+                    }
+                    break;
+                case 'C':
+                    if((i + 1) < argc) {
+                        cryptoThreads = atoi(argv[i + 1]);
+                    }
+                    if(cryptoThreads < 1 || cryptoThreads > (int)CryptoPool::MAX_THREADS) {
+                        throw std::invalid_argument("Invalid crypto threads count");
+                    }
+                    break;
+                case 'y':
+                    if((i + 1) < argc) {
+                        configPath = argv[i + 1];
+                    }
+                    {
+                        // throws std::invalid_argument for a bad file:
+                        ServerSettings settings;
+                        settings.load(configPath);
+                        applySettings(settings);
+                    }
+                    break;
+                case 'j':
+                    if((i + 1) < argc) {
+                        controlPath = argv[i + 1];
+                    }
+                    if(!ControlServer::isValidPath(controlPath)) {
+                        throw std::invalid_argument("Invalid control socket path");
+                    }
+                    break;
+                case 'u':
+                    if((i + 1) < argc) {
+                        ioEngine = argv[i + 1];
+                    }
+                    if(!IoEngine::isEngineName(ioEngine)) {
+                        throw std::invalid_argument("Invalid I/O engine");
+                    }
+                    break;
                 case 'i':
                     cliParams.physInterface = argv[i + 1];
                     if(!isNetIfaceExists(cliParams.physInterface)) {
@@ -360,6 +1263,16 @@ void VPNServer::parseArguments(int argc, char** argv) {
      */
     for(size_t i = 0; i < default_values; ++i)
         SetDefaultSettings(std_params[i], i);
+
+    // IPv6 parameters are sent to clients with IPv6 addresses only:
+    if(!cliParams.virtualNetwork6.empty()) {
+        if(cliParams.dnsIp6.empty())
+            cliParams.dnsIp6 = "2001:4860:4860::8888";
+        if(cliParams.routeIp6.empty())
+            cliParams.routeIp6 = "::";
+        if(cliParams.routeMask6.empty())
+            cliParams.routeMask6 = "0";
+    }
 }
 
 /**
@@ -382,6 +1295,16 @@ bool VPNServer::correctIp(const std::string& ipAddr) {
     return inet_pton(AF_INET, ipAddr.c_str(), &stub) == 1;
 }
 
+/**
+ * @brief VPNServer::correctIp6 checks IPv6 address correctness
+ * @param ipAddr
+ * @return true if IPv6 address is correct
+ */
+bool VPNServer::correctIp6(const std::string& ipAddr) {
+    in6_addr stub;
+    return IP6Manager::parse(ipAddr, stub);
+}
+
 /**
  * @brief VPNServer::isNetIfaceExists checks existance of network interface
  * @param iface - system network interface name, e.g. 'eth0'
@@ -395,8 +1318,10 @@ bool VPNServer::isNetIfaceExists(const std::string& iface) {
 
     while (tmp) {
         if (tmp->ifa_addr && tmp->ifa_addr->sa_family == AF_PACKET)
-            if(strcmp(iface.c_str(), tmp->ifa_name) == 0)
+            if(strcmp(iface.c_str(), tmp->ifa_name) == 0) {
+                freeifaddrs(addrs);
                 return true;
+            }
 
         tmp = tmp->ifa_next;
     }
@@ -408,143 +1333,90 @@ bool VPNServer::isNetIfaceExists(const std::string& iface) {
 
 /**
  * @brief buildParameters
- * @param clientIp - Client's tunnel IP address
+ * @param clientAddr    - Client's tunnel IP address
+ * @param clientAddr6   - Client's IPv6 address
+ * @param clientPrefix6 - length of its prefix, 0 - no IPv6 address
  * @return         - pointer to ClientParameters structure
  * with filled parameters to send to the client.
  */
-ClientParameters* VPNServer::buildParameters(const std::string& clientIp) {
+ClientParameters* VPNServer::buildParameters(in_addr_t clientAddr,
+                                             const in6_addr& clientAddr6,
+                                             uint8_t clientPrefix6) {
+    // called by the workers, the settings may be changed meanwhile:
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     ClientParameters* cliParams = new ClientParameters;
-    int size = sizeof(cliParams->parametersToSend);
-    // Here is parameters string formed:
-    std::string paramStr = std::string() + "m," + this->cliParams.mtu +
-            " a," + clientIp + ",32 d," + this->cliParams.dnsIp +
-            " r," + this->cliParams.routeIp + "," + this->cliParams.routeMask;
-
-    // fill parameters array:
-    cliParams->parametersToSend[0] = 0; // control messages always start with zero
-    memcpy(&cliParams->parametersToSend[1], paramStr.c_str(), paramStr.length());
-    memset(&cliParams->parametersToSend[paramStr.length() + 1], ' ', size - (paramStr.length() + 1));
+    ControlMessage& message = cliParams->parametersToSend;
+    // the tunnel sets the sequence number when it sends the message:
+    message = ControlMessage(ControlMessage::PARAMETERS);
+    message.addMtu(atoi(this->cliParams.mtu.c_str()));
+    message.addAddress(ControlMessage::ADDRESS, clientAddr, 32);
+    message.addAddress(ControlMessage::DNS, inet_addr(this->cliParams.dnsIp.c_str()));
+    message.addAddress(ControlMessage::ROUTE, inet_addr(this->cliParams.routeIp.c_str()),
+                       atoi(this->cliParams.routeMask.c_str()));
+    if(clientPrefix6 != 0) {
+        in6_addr dns6;
+        in6_addr route6;
+        message.addAddress(ControlMessage::ADDRESS6, clientAddr6, clientPrefix6);
+        if(IP6Manager::parse(this->cliParams.dnsIp6, dns6))
+            message.addAddress(ControlMessage::DNS6, dns6);
+        if(IP6Manager::parse(this->cliParams.routeIp6, route6))
+            message.addAddress(ControlMessage::ROUTE6, route6,
+                               atoi(this->cliParams.routeMask6.c_str()));
+    }
 
     return cliParams;
 }
 
 /**
  * @brief get_interface
- * Tries to open dev/net/tun interface
+ * Tries to open dev/net/tun interface.
+ * The interface of a client is served by a single worker,
+ * so one queue is opened even for multi-queue devices.
  * @param name - tunnel interface name (e.g. "tun0")
  * @return descriptor of interface
  */
 int VPNServer::get_interface(const char *name) {
-    int interface = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
-
-    ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
-    strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name));
-
-    if (int status = ioctl(interface, TUNSETIFF, &ifr)) {
-        throw std::runtime_error("Cannot get TUN interface\nStatus is: " +
-                                 status);
-    }
-
-    return interface;
+    return TunDevice::open(name, 1, tunFlags).front();
 }
 
 /**
- * @brief get_tunnel
- * Method creates listening datagram socket for income connection,
- * binds it to IP address and waiting for connection.
- * When client is connected, method initialize SSL session and
- * set socket to nonblocking mode.
- * @param port - port to listen
- * @return If success, pair with socket descriptor and
- * SSL session object pointer will be returned, otherwise
- * negative SD and nullptr.
+ * @brief setupSharedTun
+ * Creates the TUN device of all clients with the server address
+ * and opens a queue of it for every worker. After a handoff the
+ * workers get the queues of the previous process instead.
+ * The IPv6 network is routed to the device as a whole.
  */
-std::pair<int, WOLFSSL*> VPNServer::get_tunnel(const char *port) {
-    // we use an IPv6 socket to cover both IPv4 and IPv6.
-    int tunnel = socket(AF_INET6, SOCK_DGRAM, 0);
-    int flag = 1;
-     // receive packets till the secret matches.
-    char packet[1024];
-    memset(packet, 0, sizeof(packet[0] * 1024));
-
-    socklen_t addrlen;
-    WOLFSSL* ssl;
-
-    /* Create the WOLFSSL Object */
-    if ((ssl = wolfSSL_new(ctx)) == NULL) {
-        throw std::runtime_error("wolfSSL_new error.");
-    }
-    setsockopt(tunnel, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    flag = 0;
-    setsockopt(tunnel, IPPROTO_IPV6, IPV6_V6ONLY, &flag, sizeof(flag));
-
-    // accept packets received on any local address.
-    sockaddr_in6 addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin6_family = AF_INET6;
-    addr.sin6_port = htons(atoi(port));
-
-    // call bind(2) in a loop since Linux does not have SO_REUSEPORT.
-    while (bind(tunnel, (sockaddr *)&addr, sizeof(addr))) {
-        if (errno != EADDRINUSE) {
-            return std::pair<int, WOLFSSL*>(-1, nullptr);
-        }
-        std::this_thread::sleep_for(std::chrono::microseconds(100000));
+void VPNServer::setupSharedTun() {
+    routes = new RouteTable(inet_addr(cliParams.virtualNetworkIp.c_str()),
+                            atoi(cliParams.networkMask.c_str()), manager6);
+    if(handoffSocket >= 0) {
+        // the device and the queues of the previous process:
+        sharedServerAddr = inherited.sharedServerAddr;
+        workers->attachSharedQueues(inherited.sharedQueues,
+                                    inherited.sharedVnetHeader, *routes);
+        if(manager6 != nullptr)
+            tunMgr->getNetworkBackend().addRoute6(SHARED_TUN, manager6->getNetworkString());
+        return;
     }
 
-    addrlen = sizeof(addr);
-    int recievedLen = 0;
-    do {
-        recievedLen = 0;
-        recievedLen = recvfrom(tunnel, packet, sizeof(packet), 0,
-                              (sockaddr *)&addr, &addrlen);
-        /*
-        TunnelManager::log("packet[0] == " +
-                           std::to_string(packet[0]) +
-                           ", packet[1] == " +
-                           std::to_string(packet[1]) +
-                           ", receivecLen == " + std::to_string(recievedLen));
-        */
-        if(recievedLen == 2
-           && packet[0] == ZERO_PACKET
-           && packet[1] == CLIENT_WANT_CONNECT)
-              break;
-
-    } while (true);
-
-    /* if client is connected then run another instance of connection
-     * in a new thread: */
-    std::thread thr(&VPNServer::createNewConnection, this);
-    thr.detach();
-
-    // connect to the client
-    connect(tunnel, (sockaddr *)&addr, addrlen);
+    sharedServerAddr = manager->getAddrFromPool();
+    if(sharedServerAddr == 0)
+        throw std::runtime_error("No free IP address for " + std::string(SHARED_TUN));
 
-    // put the tunnel into non-blocking mode.
-    fcntl(tunnel, F_SETFL, O_NONBLOCK);
+    // the workers read their own queues:
+    int flags = tunFlags;
+    if(workers->size() > 1)
+        flags |= TunDevice::MULTI_QUEUE;
 
-    // set the session ssl to client connection port
-    wolfSSL_set_fd(ssl, tunnel);
-    wolfSSL_set_using_nonblock(ssl, 1);
+    tunMgr->getNetworkBackend().createSharedTunnel(
+                SHARED_TUN, IPManager::getIpString(sharedServerAddr),
+                atoi(cliParams.networkMask.c_str()),
+                flags & TunDevice::MULTI_QUEUE);
+    if(manager6 != nullptr)
+        tunMgr->getNetworkBackend().addRoute6(SHARED_TUN, manager6->getNetworkString());
 
-    int acceptStatus = SSL_FAILURE;
-    int tryCounter   = 1;
-
-    // Try to accept ssl connection for 50 times:
-    while( (acceptStatus = wolfSSL_accept(ssl)) != SSL_SUCCESS
-          && tryCounter++ <= 50) {
-        TunnelManager::log("wolfSSL_accept(ssl) != SSL_SUCCESS. Sleeping..");
-        std::this_thread::sleep_for(std::chrono::microseconds(200000));
-    }
-
-    if(tryCounter >= 50) {
-        wolfSSL_free(ssl);
-        return std::pair<int, WOLFSSL*>(-1, nullptr);
-    }
-
-    return std::pair<int, WOLFSSL*>(tunnel, ssl);
+    workers->attachSharedQueues(TunDevice::open(SHARED_TUN, workers->size(), flags),
+                                flags & TunDevice::VNET_HEADER, *routes);
 }
 
 /**
@@ -564,6 +1436,27 @@ void VPNServer::initSsl() {
     if ((ctx = wolfSSL_CTX_new(wolfDTLSv1_2_server_method())) == NULL) {
         throw std::runtime_error("wolfSSL_CTX_new error.");
     }
+    /* AEAD suites that are fast on this CPU go first: */
+    CpuFeatures cpu     = CpuFeatures::detect();
+    const char* ciphers = CipherSuites::select(cipherPolicy, cpu);
+    if (ciphers != nullptr && wolfSSL_CTX_set_cipher_list(ctx, ciphers) != SSL_SUCCESS) {
+        throw std::runtime_error(std::string() + "Cannot set cipher list " + ciphers);
+    }
+    TunnelManager::log("CPU: " + cpu.describe() + ", cipher policy '" + cipherPolicy +
+                       "': " + (ciphers != nullptr ? ciphers : "wolfSSL defaults"));
+    /* All sessions share the listener sockets of workers: */
+    wolfSSL_SetIORecv(ctx, Tunnel::ioRecv);
+    wolfSSL_SetIOSend(ctx, Tunnel::ioSend);
+    wolfSSL_CTX_SetGenCookie(ctx, Tunnel::genCookie);
+    /* Reconnecting clients resume their sessions without certificates: */
+    if(sessionCacheSize > 0) {
+        sessions = new SessionCache(sessionCacheSize);
+        sessions->attach(ctx);
+    }
+    if(ticketRotation > 0) {
+        tickets = new TicketKeys(ticketRotation);
+        tickets->attach(ctx);
+    }
     /* Load CA certificates */
     if (wolfSSL_CTX_load_verify_locations(ctx, caCertLoc, 0) !=
             SSL_SUCCESS) {
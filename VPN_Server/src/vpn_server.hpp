@@ -1,8 +1,22 @@
 #ifndef VPN_SERVER_HPP
 #define VPN_SERVER_HPP
 
+#include "cipher_suites.hpp"
 #include "client_parameters.hpp"
+#include "control_server.hpp"
+#include "crypto_pipeline.hpp"
+#include "handoff.hpp"
+#include "network_backend.hpp"
+#include "packet_filter.hpp"
+#include "route_table.hpp"
+#include "session_cache.hpp"
+#include "traffic_shaper.hpp"
 #include "tunnel_mgr.hpp"
+#include "event_loop.hpp"
+#include "metrics.hpp"
+#include "tun_device.hpp"
+#include "tunnel.hpp"
+#include "worker_pool.hpp"
 
 #include <thread>
 #include <mutex>
@@ -38,40 +52,106 @@
  * organizes a process of creating, removing and processing<br>
  * vpn tunnels, provides encrypting/decrypting of packets.<br>
  * To run the server loop call 'initServer' method.<br>
+ * With a handoff socket (see Handoff) a new server process<br>
+ * takes over the clients of the running one.<br>
+ * Client parameters, the NAT interface and rate limits may be<br>
+ * changed while the server runs: by reloading the configuration<br>
+ * file or by the control API (see ControlServer).<br>
+ * Idle tunnels may hibernate to keep the memory of a large<br>
+ * number of mostly idle clients low (see Tunnel).<br>
+ * Records of heavy tunnels may be protected by a pool<br>
+ * of crypto threads (see CryptoPipeline).<br>
+ * With an IPv6 network clients are dual-stack: every client<br>
+ * gets a prefix of it too (see IP6Manager).<br>
  */
 class VPNServer {
+public:
+    static const char* const SHARED_TUN; // interface of all clients
+
 private:
     int                  argc;
     char**               argv;
     ClientParameters     cliParams;
     IPManager*           manager;
+    IP6Manager*          manager6; // nullptr - clients have IPv4 only
     std::string          port;
     TunnelManager*       tunMgr;
     std::recursive_mutex mutex;
-    const int            TIMEOUT_LIMIT = 60000;
     const unsigned       default_values = 7;
+    const size_t         MAX_WORKERS = 256;
+    const size_t         MAX_READY_INTERFACES = 256;
+    const int            MAX_SESSION_CACHE = 1000000;
+    const int            MAX_IDLE_TIME = 86400;
+    const int            MAX_LEASE_TIME = 604800;
+    size_t               workersCount;
+    int                  tunFlags; // TunDevice::Flags
+    std::string          networkBackend;
+    size_t               readyInterfaces; // interface pool size
+    bool                 sharedTun; // one TUN device for all clients
+    in_addr_t            sharedServerAddr;
+    RouteTable*          routes;   // routes of the shared TUN device
+    int                  metricsPort; // 0 - no metrics endpoint
+    int                  sessionCacheSize; // 0 - no session resumption by ID
+    int                  ticketRotation;   // s, 0 - no session tickets
+    std::string          cipherPolicy; // CipherSuites policy name
+    SessionCache*        sessions;
+    TicketKeys*          tickets;
+    int                  espPort; // ESP-in-UDP port, 0 - no kernel offload
+    XfrmOffload*         xfrm;
+    std::string          ioEngine; // IoEngine name of the workers
+    bool                 pathMtuDiscovery; // MTU of every tunnel is probed
+    int                  idleTime; // s until idle tunnels hibernate, 0 - never
+    int                  keepaliveMin; // s, keepalive interval of new tunnels
+    int                  keepaliveMax; // s, the interval grows up to it
+    int                  leaseTime; // s a gone client keeps its address, 0 - always
+    int                  cryptoThreads; // 0 - no pipelined tunnels
+    CryptoPool*          cryptoPool;
+    AccessPolicy         accessPolicy; // rules for packets of the clients
+    RateLimits           rateLimits;   // bytes per second of the clients
+    std::string          handoffPath;  // Unix socket of upgrades, empty - off
+    std::string          configPath;   // settings file, empty - none
+    std::string          controlPath;  // Unix socket of the control API
+    HandoffState         inherited;    // state of the previous process
+    int                  handoffSocket; // connection to the previous process
+    bool                 keepInterfaces; // they belong to another process
+    WorkerPool*          workers;
     WOLFSSL_CTX*         ctx;
 
 public:
-    enum PacketType {
-        ZERO_PACKET            = 0,
-        CLIENT_WANT_CONNECT    = 1,
-        CLIENT_WANT_DISCONNECT = 2
-    };
-
     explicit VPNServer(int argc, char** argv);
     ~VPNServer();
 
     void initServer();
-    void createNewConnection();
+    Tunnel* createTunnel(DtlsListener& listener, const sockaddr_in6& peer);
+    bool setupTunnel(Tunnel& tunnel);
+    void releaseTunnel(Tunnel& tunnel);
+    bool offloadTunnel(Tunnel& tunnel, XfrmSession& session);
+    void setRateLimit(const std::string& host, uint64_t rate);
+    void adoptTunnel(Tunnel& tunnel, const HandoffTunnel& handoff);
+    std::string control(const std::string& command);
+    std::string applySettings(const ServerSettings& settings);
+    std::string listSessions();
+    std::string drainWorkers(const std::string& worker, bool drain);
+    size_t kickSessions(const std::string& client);
+    void receiveHandoff();
+    void reserveInherited();
+    void completeTakeover();
+    bool handOff(int listener);
+    void exportLeases(std::vector<HandoffLease>& leases);
+    TimerWheel::Task leaseExpiry(const std::string& identity);
     void SetDefaultSettings(std::string *&in_param, const size_t& type);
     void parseArguments(int argc, char** argv);
     bool correctSubmask(const std::string& submaskString);
     bool correctIp(const std::string& ipAddr);
+    bool correctIp6(const std::string& ipAddr);
     bool isNetIfaceExists(const std::string& iface);
-    ClientParameters* buildParameters(const std::string& clientIp);
+    uint8_t acquireAddr6(const std::string& identity, in6_addr& address);
+    ClientParameters* buildParameters(in_addr_t clientAddr,
+                                      const in6_addr& clientAddr6 = in6addr_any,
+                                      uint8_t clientPrefix6 = 0);
     int get_interface(const char *name);
-    std::pair<int, WOLFSSL*> get_tunnel(const char *port);
+    void setupSharedTun();
+    void addMetricsGauges();
     void initSsl();
 
 };
@@ -0,0 +1,785 @@
+#include "worker_pool.hpp"
+
+const int    Worker::TIMER_TICK;
+const size_t Worker::MAX_HANDSHAKES;
+const size_t Worker::PACKETS_SLAB;
+const size_t Worker::ROUTE_RING;
+
+Worker::Outbound::Outbound() : ring(ROUTE_RING), pushed(false) { }
+
+Worker::Worker(size_t index,
+               const std::string& port,
+               const DtlsListener::SessionFactory& factory,
+               const Tunnel::EstablishHandler& establishHandler,
+               const ReleaseHandler& handler)
+    : index(index),
+      port(port),
+      factory(factory),
+      establishHandler(establishHandler),
+      timers(std::chrono::milliseconds(TIMER_TICK)),
+      packets(TunDevice::MAX_FRAME, PACKETS_SLAB),
+      inheritedListener(-1),
+      tickTimer(-1),
+      load(0),
+      draining(false),
+      releaseHandler(handler),
+      sharedQueue(-1),
+      sharedVnetHeader(false),
+      routes(nullptr),
+      routeDrops(0) {
+    Metrics::instance().addWorker(&metrics);
+}
+
+Worker::~Worker() {
+    stop();
+    Metrics::instance().removeWorker(&metrics);
+    if(sharedQueue >= 0)
+        close(sharedQueue);
+    if(inheritedListener >= 0)
+        close(inheritedListener);
+}
+
+/**
+ * @brief attachSharedQueue - gives the worker its queue of the shared
+ * TUN device, must be called before 'start'. The worker owns the queue.
+ * @param vnetHeader - the queue was opened with IFF_VNET_HDR
+ * @param routes     - routes of all workers
+ */
+void Worker::attachSharedQueue(int queue, bool vnetHeader, RouteTable& routes) {
+    sharedQueue      = queue;
+    sharedVnetHeader = vnetHeader;
+    this->routes     = &routes;
+}
+
+/**
+ * @brief connect - creates the ring of packets routed by this worker
+ * to the tunnels of 'peer', must be called before 'start'
+ */
+void Worker::connect(Worker& peer) {
+    std::unique_ptr<Outbound>& ring = outbound[&peer.loop];
+    ring.reset(new Outbound());
+    peer.inbound.push_back(&ring->ring);
+}
+
+/**
+ * @brief updateRateLimits - applies changed limits to the open
+ * tunnels of the worker, may be called from any thread
+ * @param limits - must outlive the worker
+ */
+void Worker::updateRateLimits(const RateLimits& limits) {
+    loop.post([this, &limits]() {
+        for(auto& tunnel : tunnels) {
+            if(tunnel.second->getState() != Tunnel::ESTABLISHED)
+                continue;
+            uint64_t rate = limits.forClient(tunnel.second->getPeerHost());
+            if(rate != tunnel.second->getRateLimit())
+                tunnel.second->setRateLimit(rate);
+        }
+    });
+}
+
+/**
+ * @brief updateParameters - sends new parameters to the established
+ * tunnels of the worker, may be called from any thread
+ * @param builder - parameters of a client by its tunnel (addresses),
+ *                  called by the worker thread
+ */
+void Worker::updateParameters(const ParametersBuilder& builder) {
+    loop.post([this, builder]() {
+        for(auto& tunnel : tunnels) {
+            if(tunnel.second->getState() == Tunnel::ESTABLISHED)
+                tunnel.second->setParameters(builder(*tunnel.second));
+        }
+    });
+}
+
+/**
+ * @brief getSessions - established tunnels of the worker,
+ * waits for the worker thread
+ */
+std::vector<SessionInfo> Worker::getSessions() {
+    std::vector<SessionInfo> sessions;
+    runInLoop([this, &sessions]() {
+        for(auto& entry : tunnels) {
+            const Tunnel& tunnel = *entry.second;
+            if(tunnel.getState() != Tunnel::ESTABLISHED)
+                continue;
+            SessionInfo info;
+            info.worker    = index;
+            info.tunnel    = tunnel.getTunStr();
+            info.client    = tunnel.getClientAddr();
+            if(tunnel.hasClientAddr6())
+                info.client6 = IP6Manager::getIpString(tunnel.getClientAddr6());
+            info.peer      = tunnel.getPeerHost();
+            info.port      = ntohs(tunnel.getPeer().sin6_port);
+            info.rxBytes   = tunnel.getMetrics().rxBytes;
+            info.txBytes   = tunnel.getMetrics().txBytes;
+            info.rateLimit = tunnel.getRateLimit();
+            info.offloaded  = tunnel.getOffload() != nullptr;
+            info.hibernated = tunnel.isHibernated();
+            info.pipelined  = tunnel.isPipelined();
+            sessions.push_back(info);
+        }
+    });
+    return sessions;
+}
+
+/**
+ * @brief closeSessions - closes the established tunnels of the
+ * worker that 'match', their clients get the close notification
+ * @return count of closed tunnels
+ */
+size_t Worker::closeSessions(const SessionMatcher& match) {
+    size_t count = 0;
+    runInLoop([this, &match, &count]() {
+        std::vector<Tunnel*> matched;
+        for(auto& tunnel : tunnels) {
+            if(tunnel.second->getState() == Tunnel::ESTABLISHED && match(*tunnel.second))
+                matched.push_back(tunnel.first);
+        }
+        for(Tunnel* tunnel : matched)
+            tunnel->close();
+        count = matched.size();
+    });
+    return count;
+}
+
+/**
+ * @brief setDraining - a draining worker refuses new clients,
+ * its tunnels are served until they are gone
+ */
+void Worker::setDraining(bool drain) {
+    draining = drain;
+}
+
+bool Worker::isDraining() const {
+    return draining;
+}
+
+/**
+ * @brief adoptListener - the worker listens on the bound socket
+ * of the previous server process instead of binding a new one,
+ * must be called before 'start'. The worker owns the socket.
+ */
+void Worker::adoptListener(int sd) {
+    inheritedListener = sd;
+}
+
+/**
+ * @brief adoptTunnel - restores a tunnel handed off by the previous
+ * server process in the worker loop, may be called after 'start'
+ * from any thread. The tunnel is dropped if its session cannot
+ * be imported.
+ * @param handler - attaches the interface of the tunnel like
+ *                  the establish handler does after a handshake
+ */
+void Worker::adoptTunnel(const HandoffTunnel& handoff, const AdoptHandler& handler) {
+    loop.post([this, handoff, handler]() {
+        Tunnel* tunnel = factory(*listener, handoff.peer);
+        if(tunnel == nullptr) {
+            if(handoff.interface >= 0)
+                close(handoff.interface);
+            return;
+        }
+
+        ++load;
+        tunnels[tunnel] = std::unique_ptr<Tunnel>(tunnel);
+        tunnel->start(loop, timers, packets, scheduler, metrics,
+                      [this](Tunnel& t) { return establishTunnel(t); },
+                      [this](Tunnel* t) { closeTunnel(t); });
+        listener->addSession(tunnel);
+        handler(*tunnel, handoff);
+
+        bool routed = true;
+        if(tunnel->isSharedInterface()) {
+            routed = addRoutes(*tunnel);
+            if(routed)
+                tunnel->useSharedQueue(sharedQueue, sharedVnetHeader);
+        }
+        if(!routed || !tunnel->restore(handoff)) {
+            TunnelManager::log("Worker #" + std::to_string(index) +
+                               ": cannot take over [" + tunnel->getTunStr() + "]",
+                               std::cerr);
+            tunnel->close(); // releases the interface
+        }
+    });
+}
+
+/**
+ * @brief postTimer - runs 'task' on the worker thread after 'delay',
+ * may be called from any thread
+ */
+void Worker::postTimer(std::chrono::milliseconds delay, const TimerWheel::Task& task) {
+    loop.post([this, delay, task]() {
+        timers.post(delay, task);
+    });
+}
+
+/**
+ * @brief start - binds the worker listener (or takes the inherited one)
+ * and runs the worker event loop in a new thread
+ */
+void Worker::start() {
+    DtlsListener::SessionFactory create = [this](DtlsListener& l,
+                                                 const sockaddr_in6& peer) {
+        return createTunnel(l, peer);
+    };
+    if(inheritedListener >= 0)
+        listener.reset(new DtlsListener(inheritedListener, create));
+    else
+        listener.reset(new DtlsListener(port, create));
+    inheritedListener = -1;
+    // records of the scheduler are sent by the same loop iteration:
+    scheduler.attach(loop);
+    scheduler.setDelayHistogram(&metrics.forward);
+    listener->attach(loop);
+    listener->setDelayHistogram(&metrics.txQueueDelay);
+    tickTimer = loop.addTimer(std::chrono::milliseconds(TIMER_TICK), [this]() {
+        onTick();
+    });
+    if(sharedQueue >= 0) {
+        loop.addFd(sharedQueue, EPOLLIN, [this](uint32_t) {
+            onSharedQueueReadable();
+        });
+        // packets of other workers are forwarded before the flush:
+        loop.addWakeHandler([this]() { drainInbound(); });
+        loop.addFlushHandler([this]() { wakePeers(); });
+    }
+    thread = std::thread([this]() {
+        TunnelManager::log("Worker #" + std::to_string(index) + " started");
+        loop.run();
+    });
+}
+
+/**
+ * @brief stop - stops the event loop and waits for the worker thread.
+ * Tunnels that are still open are destroyed without releasing
+ * their addresses: the server is shutting down.
+ */
+void Worker::stop() {
+    if(listener == nullptr)
+        return;
+
+    freeze();
+    loop.removeTimer(tickTimer);
+    scheduler.detach();
+    if(sharedQueue >= 0) {
+        loop.removeFd(sharedQueue);
+        for(auto& tunnel : tunnels)
+            removeRoutes(tunnel.first);
+    }
+    tunnels.clear();
+    listener->detach();
+
+    const BatchStats& stats = listener->getStats();
+    TunnelManager::log("Worker #" + std::to_string(index) +
+                       ": average rx batch " +
+                       std::to_string(stats.averageRxBatch()) +
+                       ", average tx batch " +
+                       std::to_string(stats.averageTxBatch()) +
+                       ", dropped " + std::to_string(stats.txDropped) +
+                       ", routed packets dropped " + std::to_string(routeDrops));
+
+    std::vector<uint64_t> forward;
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    metrics.forward.addTo(forward, count, sum);
+    TunnelManager::log("Worker #" + std::to_string(index) +
+                       ": forwarding p50 " +
+                       std::to_string(Histogram::percentile(forward, 0.5)) +
+                       " us, p99 " +
+                       std::to_string(Histogram::percentile(forward, 0.99)) +
+                       " us");
+
+    // high-water marks tell how much memory the clients really need
+    const PoolStats& txStats = listener->getPoolStats();
+    TunnelManager::log("Worker #" + std::to_string(index) +
+                       ": packet buffers high-water " +
+                       std::to_string(packets.getStats().highWater) + " of " +
+                       std::to_string(packets.getStats().allocated) +
+                       ", send queue high-water " +
+                       std::to_string(txStats.highWater) + " of " +
+                       std::to_string(txStats.allocated));
+    listener.reset();
+}
+
+/**
+ * @brief freeze - stops the worker thread, the listener and the tunnels
+ * stay as they are. Records queued by the last loop iteration are sent.
+ */
+void Worker::freeze() {
+    if(!thread.joinable())
+        return;
+
+    loop.post([this]() { loop.stop(); });
+    thread.join();
+}
+
+/**
+ * @brief resume - runs the event loop of the frozen worker again
+ */
+void Worker::resume() {
+    if(listener == nullptr || thread.joinable())
+        return;
+
+    thread = std::thread([this]() { loop.run(); });
+}
+
+/**
+ * @brief exportState - adds the listener, the shared TUN queue and
+ * the established tunnels of the frozen worker to 'state'. Tunnels
+ * forwarded by the kernel or by a crypto pipeline cannot be handed
+ * off and are closed,
+ * their clients connect again. Unfinished handshakes are not exported.
+ */
+void Worker::exportState(HandoffState& state) {
+    state.listeners.push_back(listener->getFd());
+    if(sharedQueue >= 0)
+        state.sharedQueues.push_back(sharedQueue);
+
+    std::vector<Tunnel*> closed;
+    for(auto& tunnel : tunnels) {
+        if(tunnel.second->getState() != Tunnel::ESTABLISHED)
+            continue;
+        HandoffTunnel handoff;
+        handoff.worker = index;
+        if(tunnel.second->exportState(handoff))
+            state.tunnels.push_back(handoff);
+        else
+            closed.push_back(tunnel.first);
+    }
+    for(Tunnel* tunnel : closed)
+        tunnel->close();
+    listener->flush(); // close notifications
+}
+
+/**
+ * @brief handOff - the new server process serves the tunnels
+ * of the frozen worker, they are destroyed without closing
+ * their sessions and interfaces
+ */
+void Worker::handOff() {
+    for(auto& tunnel : tunnels)
+        tunnel.second->handOff();
+}
+
+size_t Worker::getLoad() const {
+    return load;
+}
+
+size_t Worker::getIndex() const {
+    return index;
+}
+
+const PoolStats& Worker::getPacketStats() const {
+    return packets.getStats();
+}
+
+/**
+ * @brief createTunnel - creates a tunnel for a new client
+ * of the worker listener, the worker owns the tunnel
+ * @return new tunnel or nullptr if it cannot be created
+ */
+Tunnel* Worker::createTunnel(DtlsListener& listener,
+                             const sockaddr_in6& peer) {
+    if(draining) {
+        static LogLimiter limiter;
+        TunnelManager::log("Worker #" + std::to_string(index) +
+                           " is draining, new client refused", Logger::INFO, limiter);
+        return nullptr;
+    }
+    if(handshakes.size() >= MAX_HANDSHAKES) {
+        // the peer has returned the cookie, but may still be
+        // a flood of real addresses that never ends its handshake:
+        static LogLimiter limiter;
+        TunnelManager::log("Worker #" + std::to_string(index) +
+                           ": too many handshakes in progress, the oldest one is dropped",
+                           Logger::WARNING, limiter);
+        handshakes.front()->close(); // ends its handshake
+    }
+
+    Tunnel* tunnel = factory(listener, peer);
+    if(tunnel == nullptr)
+        return nullptr;
+
+    ++load;
+    handshakesIndex[tunnel] = handshakes.insert(handshakes.end(), tunnel);
+    tunnels[tunnel] = std::unique_ptr<Tunnel>(tunnel);
+    tunnel->start(loop, timers, packets, scheduler, metrics,
+                  [this](Tunnel& t) { return establishTunnel(t); },
+                  [this](Tunnel* t) { closeTunnel(t); });
+    return tunnel;
+}
+
+/**
+ * @brief establishTunnel - handshake of 'tunnel' is done,
+ * the server attaches the tunnel interface
+ */
+bool Worker::establishTunnel(Tunnel& tunnel) {
+    if(!establishHandler(tunnel))
+        return false;
+
+    if(tunnel.isSharedInterface()) {
+        if(!addRoutes(tunnel)) {
+            TunnelManager::log("Worker #" + std::to_string(index) +
+                               ": cannot route " +
+                               IPManager::getIpString(tunnel.getClientAddr()),
+                               std::cerr);
+            endHandshake(&tunnel); // the tunnel has the address, released on close
+            return false;
+        }
+        tunnel.useSharedQueue(sharedQueue, sharedVnetHeader);
+    }
+
+    endHandshake(&tunnel);
+    TunnelManager::log("[" + tunnel.getTunStr() + "] is served by worker #" +
+                       std::to_string(index));
+    return true;
+}
+
+/**
+ * @brief endHandshake - the tunnel doesn't hold a handshake slot anymore
+ */
+void Worker::endHandshake(Tunnel* tunnel) {
+    auto it = handshakesIndex.find(tunnel);
+    if(it == handshakesIndex.end())
+        return;
+    handshakes.erase(it->second);
+    handshakesIndex.erase(it);
+}
+
+/**
+ * @brief closeTunnel - releases tunnel resources. The tunnel object
+ * is destroyed later, since we're called from its own handler.
+ */
+void Worker::closeTunnel(Tunnel* tunnel) {
+    endHandshake(tunnel); // if closed before the handshake was done
+    if(tunnel->hasInterface() && tunnel->isSharedInterface())
+        removeRoutes(tunnel);
+
+    listener->removeSession(tunnel);
+    releaseHandler(*tunnel);
+    loop.post([this, tunnel]() {
+        tunnels.erase(tunnel);
+        TunnelManager::log("Tunnel closed.");
+        --load;
+    });
+}
+
+/**
+ * @brief addRoutes - routes the addresses of the tunnel
+ * on the shared TUN device to it
+ * @return false if an address cannot be routed
+ */
+bool Worker::addRoutes(Tunnel& tunnel) {
+    if(sharedQueue < 0 || !routes->add(tunnel.getClientAddr(), &tunnel, &loop))
+        return false;
+    if(tunnel.hasClientAddr6() && !routes->add(tunnel.getClientAddr6(), &tunnel, &loop)) {
+        routes->remove(tunnel.getClientAddr(), &tunnel);
+        return false;
+    }
+    return true;
+}
+
+void Worker::removeRoutes(Tunnel* tunnel) {
+    routes->remove(tunnel->getClientAddr(), tunnel);
+    if(tunnel->hasClientAddr6())
+        routes->remove(tunnel->getClientAddr6(), tunnel);
+}
+
+/**
+ * @brief onTick - runs the expired timers of the tunnels,
+ * the cost doesn't depend on the count of tunnels
+ */
+void Worker::onTick() {
+    timers.advance();
+}
+
+/**
+ * @brief runInLoop - runs 'task' by the worker thread and waits for it,
+ * a worker that doesn't run executes it right away
+ */
+void Worker::runInLoop(const std::function<void()>& task) {
+    if(!thread.joinable()) {
+        task();
+        return;
+    }
+
+    std::promise<void> done;
+    loop.post([&task, &done]() {
+        task();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+/**
+ * @brief onSharedQueueReadable - reads packets from the queue
+ * of the shared TUN device and routes them to the tunnels
+ */
+void Worker::onSharedQueueReadable() {
+    int length = 0;
+    TunDevice::PacketHandler route = [this](const char* data, int length) {
+        routePacket(data, length);
+    };
+
+    Packet* packet = packets.acquire();
+    char*   buffer = packet->payload();
+    while ((length = read(sharedQueue, buffer, TunDevice::MAX_FRAME)) > 0) {
+        // segments of a super-packet have the same destination
+        if(!sharedVnetHeader) {
+            routePacket(buffer, length);
+        } else if(TunDevice::segment(buffer, length, route) < 0) {
+            static LogLimiter limiter;
+            TunnelManager::log("Worker #" + std::to_string(index) +
+                               ": malformed packet from TUN device",
+                               Logger::ERROR, limiter);
+        }
+    }
+    packets.release(packet);
+}
+
+/**
+ * @brief routePacket - sends an IPv4 or IPv6 packet to the tunnel
+ * of its destination address
+ * @param handedOver - the packet was routed here by another worker,
+ *                     it is not passed on again
+ */
+void Worker::routePacket(const char* data, int length, bool handedOver) {
+    if(length >= 20 && (data[0] & 0xf0) == 0x40) {
+        in_addr_t destination = 0;
+        memcpy(&destination, data + 16, sizeof(destination));
+        routeTo(destination, data, length, handedOver);
+    } else if(length >= 40 && (data[0] & 0xf0) == 0x60) {
+        in6_addr destination;
+        memcpy(&destination, data + 24, sizeof(destination));
+        routeTo(destination, data, length, handedOver);
+    }
+}
+
+/**
+ * @brief routeTo - sends the packet to the tunnel of 'destination'.
+ * A packet for a tunnel of another worker is copied to a buffer
+ * of the pool and queued in the ring to that worker, it is dropped
+ * if the ring is full.
+ */
+template<typename Address>
+void Worker::routeTo(const Address& destination, const char* data, int length,
+                     bool handedOver) {
+    EventLoop* owner  = nullptr;
+    Tunnel*    tunnel = routes->find(destination, owner);
+    if(tunnel == nullptr)
+        return; // no such client
+
+    if(owner == &loop) {
+        tunnel->forward(data, length);
+        return;
+    }
+
+    auto peer = outbound.find(owner);
+    if(handedOver || peer == outbound.end())
+        return; // the tunnel is gone from this worker meanwhile
+
+    Packet* packet = packets.acquire();
+    memcpy(packet->payload(), data, length);
+    packet->length = length;
+    if(!peer->second->ring.push(packet, packets)) {
+        packets.release(packet);
+        ++routeDrops;
+        return;
+    }
+    peer->second->pushed = true;
+}
+
+/**
+ * @brief wakePeers - wakes the workers that got packets
+ * from this one during the loop iteration, once per iteration.
+ * Packets they have forwarded meanwhile are back in the pool.
+ */
+void Worker::wakePeers() {
+    for(auto& peer : outbound) {
+        peer.second->ring.reclaim(packets);
+        if(!peer.second->pushed)
+            continue;
+        peer.second->pushed = false;
+        peer.first->wake();
+    }
+}
+
+/**
+ * @brief drainInbound - forwards the packets routed to this worker
+ * by the other ones. The route is checked again, the tunnel may be gone.
+ */
+void Worker::drainInbound() {
+    for(PacketRing* ring : inbound) {
+        ring->drain([this](Packet* packet) {
+            routePacket(packet->payload(), packet->length, true);
+        });
+    }
+}
+
+WorkerPool::WorkerPool(size_t workersCount,
+                       const std::string& port,
+                       const DtlsListener::SessionFactory& factory,
+                       const Tunnel::EstablishHandler& establishHandler,
+                       const Worker::ReleaseHandler& handler) {
+    for(size_t i = 0; i < workersCount; ++i) {
+        workers.push_back(std::unique_ptr<Worker>(
+                              new Worker(i, port, factory,
+                                         establishHandler, handler)));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+/**
+ * @brief attachSharedQueues - gives every worker its queue
+ * of the shared TUN device and its rings to the other workers
+ * @param queues - one queue per worker
+ */
+void WorkerPool::attachSharedQueues(const std::vector<int>& queues,
+                                    bool vnetHeader,
+                                    RouteTable& routes) {
+    if(queues.size() != workers.size())
+        throw std::invalid_argument("One TUN queue per worker is required");
+
+    for(size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->attachSharedQueue(queues[i], vnetHeader, routes);
+        for(size_t j = 0; j < workers.size(); ++j) {
+            if(j != i)
+                workers[i]->connect(*workers[j]);
+        }
+    }
+}
+
+/**
+ * @brief updateRateLimits - see 'Worker::updateRateLimits'
+ */
+void WorkerPool::updateRateLimits(const RateLimits& limits) {
+    for(auto& worker : workers)
+        worker->updateRateLimits(limits);
+}
+
+/**
+ * @brief updateParameters - see 'Worker::updateParameters'
+ */
+void WorkerPool::updateParameters(const Worker::ParametersBuilder& builder) {
+    for(auto& worker : workers)
+        worker->updateParameters(builder);
+}
+
+std::vector<SessionInfo> WorkerPool::getSessions() {
+    std::vector<SessionInfo> sessions;
+    for(auto& worker : workers) {
+        std::vector<SessionInfo> part = worker->getSessions();
+        sessions.insert(sessions.end(), part.begin(), part.end());
+    }
+    return sessions;
+}
+
+size_t WorkerPool::closeSessions(const Worker::SessionMatcher& match) {
+    size_t count = 0;
+    for(auto& worker : workers)
+        count += worker->closeSessions(match);
+    return count;
+}
+
+/**
+ * @brief setDraining - see 'Worker::setDraining'
+ * @throws std::invalid_argument if there is no such worker
+ */
+void WorkerPool::setDraining(size_t worker, bool drain) {
+    if(worker >= workers.size())
+        throw std::invalid_argument("No such worker");
+    workers[worker]->setDraining(drain);
+}
+
+bool WorkerPool::isDraining(size_t worker) const {
+    return worker < workers.size() && workers[worker]->isDraining();
+}
+
+/**
+ * @brief adoptListeners - see 'Worker::adoptListener'
+ * @param sockets - one socket per worker
+ */
+void WorkerPool::adoptListeners(const std::vector<int>& sockets) {
+    if(sockets.size() != workers.size())
+        throw std::invalid_argument("One listener socket per worker is required");
+
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i]->adoptListener(sockets[i]);
+}
+
+/**
+ * @brief adoptTunnel - the tunnel is restored by the worker
+ * that served it in the previous process
+ */
+void WorkerPool::adoptTunnel(const HandoffTunnel& handoff,
+                             const Worker::AdoptHandler& handler) {
+    workers[handoff.worker % workers.size()]->adoptTunnel(handoff, handler);
+}
+
+/**
+ * @brief postTimer - see 'Worker::postTimer', 'worker' is taken
+ * modulo the count of workers
+ */
+void WorkerPool::postTimer(size_t worker, std::chrono::milliseconds delay,
+                           const TimerWheel::Task& task) {
+    workers[worker % workers.size()]->postTimer(delay, task);
+}
+
+void WorkerPool::start() {
+    for(auto& worker : workers)
+        worker->start();
+}
+
+void WorkerPool::stop() {
+    for(auto& worker : workers)
+        worker->stop();
+}
+
+void WorkerPool::freeze() {
+    for(auto& worker : workers)
+        worker->freeze();
+}
+
+void WorkerPool::resume() {
+    for(auto& worker : workers)
+        worker->resume();
+}
+
+/**
+ * @brief exportState - see 'Worker::exportState',
+ * the workers must be frozen
+ */
+void WorkerPool::exportState(HandoffState& state) {
+    for(auto& worker : workers)
+        worker->exportState(state);
+}
+
+void WorkerPool::handOff() {
+    for(auto& worker : workers)
+        worker->handOff();
+}
+
+size_t WorkerPool::size() const {
+    return workers.size();
+}
+
+size_t WorkerPool::tunnelsCount() const {
+    size_t count = 0;
+    for(auto& worker : workers)
+        count += worker->getLoad();
+    return count;
+}
+
+/**
+ * @brief defaultWorkersCount
+ * @return count of CPU cores (at least one)
+ */
+size_t WorkerPool::defaultWorkersCount() {
+    size_t cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
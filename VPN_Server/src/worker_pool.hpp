@@ -0,0 +1,209 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include "dtls_listener.hpp"
+#include "event_loop.hpp"
+#include "handoff.hpp"
+#include "route_table.hpp"
+#include "timer_wheel.hpp"
+#include "traffic_shaper.hpp"
+#include "tunnel.hpp"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The SessionInfo struct<br>
+ * Established tunnel as listed by the control API.<br>
+ */
+struct SessionInfo {
+    size_t      worker;
+    std::string tunnel;  // interface name
+    in_addr_t   client;  // tunnel address
+    std::string client6; // IPv6 address, empty - none
+    std::string peer;    // client host
+    uint16_t    port;    // client port
+    uint64_t    rxBytes;
+    uint64_t    txBytes;
+    uint64_t    rateLimit; // bytes per second, 0 - unlimited
+    bool        offloaded;
+    bool        hibernated;
+    bool        pipelined;
+};
+
+/**
+ * @brief The Worker class<br>
+ * One reactor thread. Owns its DTLS listener and a set of tunnels<br>
+ * and multiplexes all their descriptors in a single event loop.<br>
+ * Tunnels of the worker share its pool of packet buffers.<br>
+ * Timers of all tunnels of the worker (keepalives, timeouts,<br>
+ * retransmissions) are kept in one TimerWheel, turned every TIMER_TICK.<br>
+ * With a shared TUN device the worker reads its own queue of the<br>
+ * device and routes packets to tunnels by destination address<br>
+ * (IPv6 packets by the prefix of the client).<br>
+ * A packet for a tunnel of another worker is copied to a pooled<br>
+ * buffer and queued in the PacketRing from this worker to that one,<br>
+ * the other worker is woken once per loop iteration and drains<br>
+ * the whole ring.<br>
+ * Packets for the clients are sent by the EgressScheduler<br>
+ * of the worker, so every tunnel gets its share of the worker.<br>
+ * For a handoff (see Handoff) the worker is frozen: its thread<br>
+ * stops with all the state kept, so the state can be exported,<br>
+ * then the worker is resumed or its tunnels are handed off.<br>
+ * A draining worker serves its tunnels but refuses new clients.<br>
+ */
+class Worker {
+public:
+    typedef std::function<void(Tunnel& tunnel)> ReleaseHandler;
+    typedef std::function<void(Tunnel& tunnel,
+                               const HandoffTunnel& handoff)> AdoptHandler;
+    typedef std::function<ClientParameters*(const Tunnel& tunnel)> ParametersBuilder;
+    typedef std::function<bool(const Tunnel& tunnel)> SessionMatcher;
+
+    static const int    TIMER_TICK = 100;      // ms, resolution of the timer wheel
+    static const size_t MAX_HANDSHAKES = 1024; // unfinished handshakes
+    static const size_t PACKETS_SLAB = 4;      // packet buffers per allocation
+    static const size_t ROUTE_RING = 64;       // packets on the way to another worker
+
+private:
+    /**
+     * @brief The Outbound struct - ring of packets routed to
+     * the tunnels of another worker, 'pushed' since its last wakeup
+     */
+    struct Outbound {
+        PacketRing ring;
+        bool       pushed;
+
+        Outbound();
+    };
+
+    size_t                                              index;
+    std::string                                         port;
+    DtlsListener::SessionFactory                        factory;
+    Tunnel::EstablishHandler                            establishHandler;
+    EventLoop                                           loop;
+    TimerWheel                                          timers;
+    PacketPool                                          packets;
+    EgressScheduler                                     scheduler;
+    WorkerMetrics                                       metrics;
+    std::unique_ptr<DtlsListener>                       listener;
+    int                                                 inheritedListener;
+    std::thread                                         thread;
+    int                                                 tickTimer;
+    std::atomic<size_t>                                 load;
+    std::atomic<bool>                                   draining;
+    std::list<Tunnel*>                                  handshakes; // oldest first
+    std::unordered_map<Tunnel*, std::list<Tunnel*>::iterator> handshakesIndex;
+    std::unordered_map<Tunnel*, std::unique_ptr<Tunnel> > tunnels;
+    ReleaseHandler                                      releaseHandler;
+    int                                                 sharedQueue;
+    bool                                                sharedVnetHeader;
+    RouteTable*                                         routes;
+    std::unordered_map<EventLoop*, std::unique_ptr<Outbound> > outbound; // by loop of the peer
+    std::vector<PacketRing*>                            inbound;
+    uint64_t                                            routeDrops; // rings were full
+
+public:
+    /* Forbid creating default copy ctor: */
+    Worker(Worker& that) = delete;
+
+    explicit Worker(size_t index,
+                    const std::string& port,
+                    const DtlsListener::SessionFactory& factory,
+                    const Tunnel::EstablishHandler& establishHandler,
+                    const ReleaseHandler& handler);
+    ~Worker();
+
+    void attachSharedQueue(int queue, bool vnetHeader, RouteTable& routes);
+    void connect(Worker& peer);
+    void updateRateLimits(const RateLimits& limits);
+    void updateParameters(const ParametersBuilder& builder);
+    std::vector<SessionInfo> getSessions();
+    size_t closeSessions(const SessionMatcher& match);
+    void setDraining(bool drain);
+    bool isDraining() const;
+    void adoptListener(int sd);
+    void adoptTunnel(const HandoffTunnel& handoff, const AdoptHandler& handler);
+    void postTimer(std::chrono::milliseconds delay, const TimerWheel::Task& task);
+    void start();
+    void stop();
+    void freeze();
+    void resume();
+    void exportState(HandoffState& state);
+    void handOff();
+    size_t getLoad() const;
+    size_t getIndex() const;
+    const PoolStats& getPacketStats() const;
+
+private:
+    Tunnel* createTunnel(DtlsListener& listener, const sockaddr_in6& peer);
+    bool establishTunnel(Tunnel& tunnel);
+    void endHandshake(Tunnel* tunnel);
+    void closeTunnel(Tunnel* tunnel);
+    bool addRoutes(Tunnel& tunnel);
+    void removeRoutes(Tunnel* tunnel);
+    void onTick();
+    void runInLoop(const std::function<void()>& task);
+    void onSharedQueueReadable();
+    void routePacket(const char* data, int length, bool handedOver = false);
+    template<typename Address>
+    void routeTo(const Address& destination, const char* data, int length,
+                 bool handedOver);
+    void wakePeers();
+    void drainInbound();
+};
+
+/**
+ * @brief The WorkerPool class<br>
+ * Fixed set of workers (one per core by default).<br>
+ * Listeners of the workers form a SO_REUSEPORT group, so new clients<br>
+ * are spread across workers by the kernel hash of their address.<br>
+ */
+class WorkerPool {
+private:
+    std::vector<std::unique_ptr<Worker> > workers;
+
+public:
+    /* Forbid creating default copy ctor: */
+    WorkerPool(WorkerPool& that) = delete;
+
+    explicit WorkerPool(size_t workersCount,
+                        const std::string& port,
+                        const DtlsListener::SessionFactory& factory,
+                        const Tunnel::EstablishHandler& establishHandler,
+                        const Worker::ReleaseHandler& handler);
+    ~WorkerPool();
+
+    void attachSharedQueues(const std::vector<int>& queues,
+                            bool vnetHeader,
+                            RouteTable& routes);
+    void updateRateLimits(const RateLimits& limits);
+    void updateParameters(const Worker::ParametersBuilder& builder);
+    std::vector<SessionInfo> getSessions();
+    size_t closeSessions(const Worker::SessionMatcher& match);
+    void setDraining(size_t worker, bool drain);
+    bool isDraining(size_t worker) const;
+    void adoptListeners(const std::vector<int>& sockets);
+    void adoptTunnel(const HandoffTunnel& handoff,
+                     const Worker::AdoptHandler& handler);
+    void postTimer(size_t worker, std::chrono::milliseconds delay,
+                   const TimerWheel::Task& task);
+    void start();
+    void stop();
+    void freeze();
+    void resume();
+    void exportState(HandoffState& state);
+    void handOff();
+    size_t size() const;
+    size_t tunnelsCount() const;
+
+    static size_t defaultWorkersCount();
+};
+
+#endif // WORKER_POOL_HPP
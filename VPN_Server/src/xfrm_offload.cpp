@@ -0,0 +1,326 @@
+#include "xfrm_offload.hpp"
+
+#include <random>
+
+const char   XfrmOffload::REQUEST;
+const char   XfrmOffload::READY;
+const char   XfrmOffload::REFUSED;
+const int    XfrmOffload::MESSAGE_SIZE;
+const int    XfrmOffload::ICV_BITS;
+const char* const XfrmOffload::EXPORTER_LABEL = "EXPORTER-VPN-ESP";
+
+const size_t XfrmSession::KEY_SIZE;
+const size_t XfrmSession::SALT_SIZE;
+const size_t XfrmSession::KEYS_SIZE;
+
+namespace {
+
+const uint32_t FIRST_SPI     = 256; // 1..255 are reserved by IANA
+const uint8_t  REPLAY_WINDOW = 64;
+
+void setAddress(xfrm_address_t& address, in_addr_t value) {
+    memset(&address, 0, sizeof(address));
+    address.a4 = value;
+}
+
+} // namespace
+
+XfrmSession::XfrmSession()
+    : localAddr(0), localPort(0), peerAddr(0), peerPort(0),
+      tunnelAddr(0), inSpi(0), outSpi(0) {
+    memset(keys, 0, sizeof(keys));
+}
+
+/**
+ * @brief XfrmOffload constructor - opens the XFRM netlink socket
+ * and the ESP-in-UDP socket, throws if the kernel has no support
+ * @param port - UDP port of ESP datagrams
+ */
+XfrmOffload::XfrmOffload(uint16_t port)
+    : xfrm(NETLINK_XFRM),
+      port(port),
+      nextSpi(FIRST_SPI),
+      sessionsCount(0) {
+    encapSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(encapSocket < 0) {
+        throw std::runtime_error(std::string() +
+                                 "Cannot create ESP socket: " + strerror(errno));
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(port);
+    int encap = UDP_ENCAP_ESPINUDP;
+    if(bind(encapSocket, (sockaddr *)&addr, sizeof(addr)) < 0
+       || setsockopt(encapSocket, IPPROTO_UDP, UDP_ENCAP, &encap, sizeof(encap)) < 0) {
+        int error = errno;
+        close(encapSocket);
+        throw std::runtime_error(std::string() +
+                                 "Cannot open ESP-in-UDP port " +
+                                 std::to_string(port) + ": " + strerror(error));
+    }
+
+    // SPIs of a previous run may still be installed:
+    std::random_device random;
+    nextSpi = FIRST_SPI + random() % 0x7fff0000;
+}
+
+XfrmOffload::~XfrmOffload() {
+    close(encapSocket);
+}
+
+/**
+ * @brief install - adds both states and the policies of the session,
+ * throws if the kernel refused any of them (nothing is left installed)
+ */
+void XfrmOffload::install(const XfrmSession& session) {
+    NetlinkMessage message;
+    buildInstall(message, session);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int error = xfrm.request(message);
+    if(error != 0) {
+        NetlinkMessage rollback;
+        buildRemove(rollback, session);
+        xfrm.request(rollback);
+        throw std::runtime_error(std::string() +
+                                 "Cannot install XFRM state: " + strerror(-error));
+    }
+    ++sessionsCount;
+}
+
+/**
+ * @brief remove - deletes the states and policies of the session,
+ * its packets take the route of the tunnel again
+ */
+void XfrmOffload::remove(const XfrmSession& session) {
+    NetlinkMessage message;
+    buildRemove(message, session);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    xfrm.request(message);
+    --sessionsCount;
+}
+
+/**
+ * @brief allocateSpi
+ * @return SPI of a new inbound state
+ */
+uint32_t XfrmOffload::allocateSpi() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(nextSpi < FIRST_SPI)
+        nextSpi = FIRST_SPI;
+    return nextSpi++;
+}
+
+uint16_t XfrmOffload::getPort() const {
+    return port;
+}
+
+size_t XfrmOffload::size() const {
+    return sessionsCount;
+}
+
+/**
+ * @brief parseRequest - reads the offload request of a client
+ * @param spi  - SPI of the inbound state of the client
+ * @param port - UDP port of the client for ESP datagrams
+ * @return false if it is not a valid request
+ */
+bool XfrmOffload::parseRequest(const char* data, int length,
+                               uint32_t& spi, uint16_t& port) {
+    if(length != MESSAGE_SIZE || data[0] != 0 || data[1] != REQUEST)
+        return false;
+
+    memcpy(&spi, data + 2, sizeof(spi));
+    memcpy(&port, data + 6, sizeof(port));
+    spi  = ntohl(spi);
+    port = ntohs(port);
+    return spi >= FIRST_SPI && port != 0;
+}
+
+/**
+ * @brief buildReply
+ * @param data  - at least MESSAGE_SIZE bytes
+ * @param ready - the session is offloaded, 'spi' and 'port' are sent
+ * @return length of the reply
+ */
+int XfrmOffload::buildReply(char* data, bool ready, uint32_t spi, uint16_t port) {
+    data[0] = 0;
+    data[1] = ready ? READY : REFUSED;
+    if(!ready)
+        return 2;
+
+    spi  = htonl(spi);
+    port = htons(port);
+    memcpy(data + 2, &spi, sizeof(spi));
+    memcpy(data + 6, &port, sizeof(port));
+    return MESSAGE_SIZE;
+}
+
+/**
+ * @brief localAddressFor - source address of the route to 'peer',
+ * the outer source of ESP datagrams to the client
+ */
+bool XfrmOffload::localAddressFor(in_addr_t peer, in_addr_t& local) {
+    int sd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(sd < 0)
+        return false;
+
+    sockaddr_in addr;
+    socklen_t   length = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = peer;
+    addr.sin_port        = htons(9); // connect(2) only looks up the route
+    bool found = connect(sd, (sockaddr *)&addr, sizeof(addr)) == 0
+                 && getsockname(sd, (sockaddr *)&addr, &length) == 0;
+    close(sd);
+
+    local = addr.sin_addr.s_addr;
+    return found && local != INADDR_ANY;
+}
+
+/**
+ * @brief buildInstall - states of both directions in tunnel mode,
+ * policies for traffic to the client and from it (local and forwarded)
+ */
+void XfrmOffload::buildInstall(NetlinkMessage& message, const XfrmSession& session) {
+    // client -> server
+    addState(message, session.peerAddr, session.peerPort,
+             session.localAddr, session.localPort,
+             session.inSpi, session.inSpi, session.keys);
+    // server -> client
+    addState(message, session.localAddr, session.localPort,
+             session.peerAddr, session.peerPort,
+             session.outSpi, session.inSpi,
+             session.keys + XfrmSession::KEY_SIZE + XfrmSession::SALT_SIZE);
+
+    addPolicy(message, XFRM_POLICY_OUT, session.tunnelAddr,
+              session.localAddr, session.peerAddr, session.inSpi);
+    addPolicy(message, XFRM_POLICY_IN, session.tunnelAddr,
+              session.peerAddr, session.localAddr, session.inSpi);
+    addPolicy(message, XFRM_POLICY_FWD, session.tunnelAddr,
+              session.peerAddr, session.localAddr, session.inSpi);
+}
+
+void XfrmOffload::buildRemove(NetlinkMessage& message, const XfrmSession& session) {
+    uint8_t dirs[] = { XFRM_POLICY_OUT, XFRM_POLICY_IN, XFRM_POLICY_FWD };
+    for(uint8_t dir : dirs) {
+        xfrm_userpolicy_id policy;
+        memset(&policy, 0, sizeof(policy));
+        fillSelector(policy.sel, dir, session.tunnelAddr);
+        policy.dir = dir;
+        message.begin(XFRM_MSG_DELPOLICY, NLM_F_REQUEST | NLM_F_ACK,
+                      &policy, sizeof(policy));
+    }
+
+    struct {
+        in_addr_t destination;
+        uint32_t  spi;
+    } states[] = {
+        { session.localAddr, session.inSpi },
+        { session.peerAddr,  session.outSpi }
+    };
+    for(const auto& state : states) {
+        xfrm_usersa_id id;
+        memset(&id, 0, sizeof(id));
+        setAddress(id.daddr, state.destination);
+        id.spi    = htonl(state.spi);
+        id.family = AF_INET;
+        id.proto  = IPPROTO_ESP;
+        message.begin(XFRM_MSG_DELSA, NLM_F_REQUEST | NLM_F_ACK, &id, sizeof(id));
+    }
+}
+
+/**
+ * @brief addState - ESP state with AES-GCM, encapsulated in UDP
+ * @param key - KEY_SIZE bytes of the key, then SALT_SIZE bytes of salt
+ */
+void XfrmOffload::addState(NetlinkMessage& message, in_addr_t source, uint16_t sourcePort,
+                           in_addr_t destination, uint16_t destinationPort,
+                           uint32_t spi, uint32_t reqid, const unsigned char* key) {
+    xfrm_usersa_info info;
+    memset(&info, 0, sizeof(info));
+    info.sel.family = AF_INET;
+    setAddress(info.id.daddr, destination);
+    info.id.spi   = htonl(spi);
+    info.id.proto = IPPROTO_ESP;
+    setAddress(info.saddr, source);
+    info.lft.soft_byte_limit   = XFRM_INF;
+    info.lft.hard_byte_limit   = XFRM_INF;
+    info.lft.soft_packet_limit = XFRM_INF;
+    info.lft.hard_packet_limit = XFRM_INF;
+    info.reqid         = reqid;
+    info.family        = AF_INET;
+    info.mode          = XFRM_MODE_TUNNEL;
+    info.replay_window = REPLAY_WINDOW;
+    message.begin(XFRM_MSG_NEWSA, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL,
+                  &info, sizeof(info));
+
+    const size_t keySize = XfrmSession::KEY_SIZE + XfrmSession::SALT_SIZE;
+    char aeadBuffer[sizeof(xfrm_algo_aead) + keySize];
+    xfrm_algo_aead* aead = reinterpret_cast<xfrm_algo_aead*>(aeadBuffer);
+    memset(aeadBuffer, 0, sizeof(aeadBuffer));
+    strncpy(aead->alg_name, "rfc4106(gcm(aes))", sizeof(aead->alg_name) - 1);
+    aead->alg_key_len = keySize * 8;
+    aead->alg_icv_len = ICV_BITS;
+    memcpy(aead->alg_key, key, keySize);
+    message.put(XFRMA_ALG_AEAD, aeadBuffer, sizeof(aeadBuffer));
+
+    xfrm_encap_tmpl encap;
+    memset(&encap, 0, sizeof(encap));
+    encap.encap_type  = UDP_ENCAP_ESPINUDP;
+    encap.encap_sport = htons(sourcePort);
+    encap.encap_dport = htons(destinationPort);
+    message.put(XFRMA_ENCAP, &encap, sizeof(encap));
+}
+
+/**
+ * @brief addPolicy - packets of the tunnel address use the states
+ * between 'source' and 'destination' (outer addresses)
+ */
+void XfrmOffload::addPolicy(NetlinkMessage& message, uint8_t dir, in_addr_t tunnelAddr,
+                            in_addr_t source, in_addr_t destination, uint32_t reqid) {
+    xfrm_userpolicy_info info;
+    memset(&info, 0, sizeof(info));
+    fillSelector(info.sel, dir, tunnelAddr);
+    info.lft.soft_byte_limit   = XFRM_INF;
+    info.lft.hard_byte_limit   = XFRM_INF;
+    info.lft.soft_packet_limit = XFRM_INF;
+    info.lft.hard_packet_limit = XFRM_INF;
+    info.dir    = dir;
+    info.action = XFRM_POLICY_ALLOW;
+    message.begin(XFRM_MSG_NEWPOLICY, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL,
+                  &info, sizeof(info));
+
+    xfrm_user_tmpl tmpl;
+    memset(&tmpl, 0, sizeof(tmpl));
+    setAddress(tmpl.id.daddr, destination);
+    tmpl.id.proto = IPPROTO_ESP;
+    tmpl.family   = AF_INET;
+    setAddress(tmpl.saddr, source);
+    tmpl.reqid    = reqid;
+    tmpl.mode     = XFRM_MODE_TUNNEL;
+    tmpl.aalgos   = ~0u;
+    tmpl.ealgos   = ~0u;
+    tmpl.calgos   = ~0u;
+    message.put(XFRMA_TMPL, &tmpl, sizeof(tmpl));
+}
+
+/**
+ * @brief fillSelector - traffic to the tunnel address for the
+ * outbound policy, from it for the inbound and forward ones
+ */
+void XfrmOffload::fillSelector(xfrm_selector& selector, uint8_t dir, in_addr_t tunnelAddr) {
+    selector.family = AF_INET;
+    if(dir == XFRM_POLICY_OUT) {
+        setAddress(selector.daddr, tunnelAddr);
+        selector.prefixlen_d = 32;
+    } else {
+        setAddress(selector.saddr, tunnelAddr);
+        selector.prefixlen_s = 32;
+    }
+}
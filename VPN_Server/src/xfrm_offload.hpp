@@ -0,0 +1,105 @@
+#ifndef XFRM_OFFLOAD_HPP
+#define XFRM_OFFLOAD_HPP
+
+#include "netlink_backend.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <linux/xfrm.h>
+
+/**
+ * @brief The XfrmSession struct<br>
+ * ESP-in-UDP tunnel of one client: outer addresses and ports,<br>
+ * tunnel address of the client, SPIs and keys of both directions.<br>
+ * 'keys' are exported from the DTLS session (RFC 5705):<br>
+ * key and salt of client -> server, then of server -> client.<br>
+ */
+struct XfrmSession {
+    static const size_t KEY_SIZE  = 16; // AES-128
+    static const size_t SALT_SIZE = 4;  // rfc4106 nonce salt
+    static const size_t KEYS_SIZE = 2 * (KEY_SIZE + SALT_SIZE);
+
+    in_addr_t     localAddr;  // server address the client connects to
+    uint16_t      localPort;
+    in_addr_t     peerAddr;   // client transport address
+    uint16_t      peerPort;   // ESP port of the client
+    in_addr_t     tunnelAddr; // tunnel address of the client
+    uint32_t      inSpi;      // chosen by the server
+    uint32_t      outSpi;     // chosen by the client
+    unsigned char keys[KEYS_SIZE];
+
+    explicit XfrmSession();
+};
+
+/**
+ * @brief The XfrmOffload class<br>
+ * Kernel data path of established tunnels: after the DTLS handshake<br>
+ * and parameters a client may ask to move its packets to ESP in UDP<br>
+ * (RFC 3948) with AES-GCM (RFC 4106). The server then installs<br>
+ * XFRM states and policies for the tunnel address of the client,<br>
+ * its packets are encrypted and decrypted by the kernel without<br>
+ * copies to the server process. The DTLS session stays for control<br>
+ * messages and keepalives. ESP uses its own UDP port: the kernel<br>
+ * takes every datagram of an encapsulation socket that does not start<br>
+ * with a zero marker, so DTLS records cannot share it.<br>
+ * Request and reply are control messages of the tunnel:<br>
+ * {0, REQUEST, SPI (4 bytes), ESP port (2 bytes)} from the client,<br>
+ * {0, READY, SPI, ESP port} or {0, REFUSED} from the server.<br>
+ */
+class XfrmOffload {
+public:
+    static const char REQUEST = 3;
+    static const char READY   = 4;
+    static const char REFUSED = 5;
+    static const int  MESSAGE_SIZE = 8;   // request and READY
+    static const int  ICV_BITS     = 128;
+    static const char* const EXPORTER_LABEL;
+
+private:
+    NetlinkSocket       xfrm;
+    std::mutex          mutex;   // workers share the netlink socket
+    int                 encapSocket;
+    uint16_t            port;
+    uint32_t            nextSpi;
+    std::atomic<size_t> sessionsCount;
+
+public:
+    /* Forbid creating default copy ctor: */
+    XfrmOffload(XfrmOffload& that) = delete;
+
+    explicit XfrmOffload(uint16_t port);
+    ~XfrmOffload();
+
+    void install(const XfrmSession& session);
+    void remove(const XfrmSession& session);
+    uint32_t allocateSpi();
+    uint16_t getPort() const;
+    size_t size() const;
+
+    static bool parseRequest(const char* data, int length,
+                             uint32_t& spi, uint16_t& port);
+    static int buildReply(char* data, bool ready, uint32_t spi, uint16_t port);
+    static bool localAddressFor(in_addr_t peer, in_addr_t& local);
+    static void buildInstall(NetlinkMessage& message, const XfrmSession& session);
+    static void buildRemove(NetlinkMessage& message, const XfrmSession& session);
+
+private:
+    static void addState(NetlinkMessage& message, in_addr_t source, uint16_t sourcePort,
+                         in_addr_t destination, uint16_t destinationPort,
+                         uint32_t spi, uint32_t reqid, const unsigned char* key);
+    static void addPolicy(NetlinkMessage& message, uint8_t dir, in_addr_t tunnelAddr,
+                          in_addr_t source, in_addr_t destination, uint32_t reqid);
+    static void fillSelector(xfrm_selector& selector, uint8_t dir, in_addr_t tunnelAddr);
+};
+
+#endif // XFRM_OFFLOAD_HPP
@@ -0,0 +1,40 @@
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+
+# client threads share the cores with workers, keep info messages out
+DEFINES += LOG_LEVEL=2
+
+SOURCES += src/main.cpp \
+    src/forwarding_bench.cpp \
+    ../VPN_Server/src/tunnel_mgr.cpp \
+    ../VPN_Server/src/ip_manager.cpp \
+    ../VPN_Server/src/event_loop.cpp \
+    ../VPN_Server/src/tunnel.cpp \
+    ../VPN_Server/src/worker_pool.cpp \
+    ../VPN_Server/src/dtls_listener.cpp \
+    ../VPN_Server/src/tun_device.cpp \
+    ../VPN_Server/src/packet_pool.cpp \
+    ../VPN_Server/src/network_backend.cpp \
+    ../VPN_Server/src/netlink_backend.cpp \
+    ../VPN_Server/src/route_table.cpp \
+    ../VPN_Server/src/logger.cpp \
+    ../VPN_Server/src/metrics.cpp \
+    ../VPN_Server/src/session_cache.cpp \
+    ../VPN_Server/src/xfrm_offload.cpp \
+    ../VPN_Server/src/io_engine.cpp \
+    ../VPN_Server/src/control_message.cpp \
+    ../VPN_Server/src/path_mtu.cpp \
+    ../VPN_Server/src/packet_filter.cpp \
+    ../VPN_Server/src/traffic_shaper.cpp \
+    ../VPN_Server/src/handoff.cpp \
+    ../VPN_Server/src/timer_wheel.cpp \
+    ../VPN_Server/src/keepalive.cpp \
+    ../VPN_Server/src/crypto_pipeline.cpp
+
+HEADERS += \
+    src/forwarding_bench.hpp
+
+LIBS += -lpthread \
+        -lwolfssl
@@ -0,0 +1,522 @@
+#include "forwarding_bench.hpp"
+
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <time.h>
+
+const int BenchClient::STALL_TIMEOUT;
+const int BenchClient::DRAIN_TIME;
+const int ForwardingBench::ESTABLISH_TIMEOUT;
+
+namespace {
+
+const size_t IP_HEADER = 20;
+const size_t STAMP     = sizeof(uint64_t); // send time after the header
+
+uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double threadCpu() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+} // namespace
+
+BenchConfig::BenchConfig()
+    : port("5555"),
+      certs("../VPN_Server/certs"),
+      clients(4),
+      workers(1),
+      seconds(5),
+      window(64),
+      mtus(1, 1400),
+      upstream(true),
+      downstream(true),
+      engine("epoll") {
+    sizes.push_back(64);
+    sizes.push_back(512);
+    sizes.push_back(1400);
+}
+
+BenchResult::BenchResult()
+    : mtu(0), size(0), clients(0), workers(0), seconds(0),
+      packets(0), lost(0), packetsPerSecond(0), gbitPerSecond(0),
+      p50(0), p99(0), p999(0), serverCpu(0), cpuPerGbit(0) { }
+
+/**
+ * @brief toJson
+ * @return the result as one line of JSON, so results
+ * of many runs can be appended to one file
+ */
+std::string BenchResult::toJson() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "{\"time\":" << time(nullptr)
+        << ",\"direction\":\"" << direction << "\""
+        << ",\"mtu\":" << mtu
+        << ",\"size\":" << size
+        << ",\"clients\":" << clients
+        << ",\"workers\":" << workers
+        << ",\"engine\":\"" << engine << "\""
+        << ",\"seconds\":" << seconds
+        << ",\"packets\":" << packets
+        << ",\"lost\":" << lost
+        << ",\"pps\":" << packetsPerSecond
+        << ",\"gbps\":" << gbitPerSecond
+        << ",\"latency_us\":{\"p50\":" << p50
+        << ",\"p99\":" << p99
+        << ",\"p999\":" << p999 << "}"
+        << ",\"server_cpu_seconds\":" << serverCpu
+        << ",\"cpu_seconds_per_gbit\":" << cpuPerGbit << "}";
+    return out.str();
+}
+
+/**
+ * @brief BenchClient constructor - creates the in-memory interface
+ * @param serverAddr - server tunnel address
+ * @param clientAddr - tunnel address of the client, source of its packets
+ */
+BenchClient::BenchClient(size_t index, in_addr_t serverAddr, in_addr_t clientAddr)
+    : index(index),
+      sd(-1),
+      ssl(nullptr),
+      tunEnd(-1),
+      serverEnd(-1),
+      serverAddr(serverAddr),
+      clientAddr(clientAddr),
+      sent(0),
+      received(0),
+      bytes(0),
+      cpu(0) {
+    int ends[2];
+    if(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, ends) < 0)
+        throw std::runtime_error(std::string() + "socketpair: " + strerror(errno));
+    tunEnd    = ends[0];
+    serverEnd = ends[1];
+}
+
+BenchClient::~BenchClient() {
+    if(ssl != nullptr)
+        wolfSSL_free(ssl);
+    if(sd >= 0)
+        close(sd);
+    close(tunEnd);
+    if(serverEnd >= 0)
+        close(serverEnd);
+}
+
+/**
+ * @brief bind - creates the UDP socket of the client
+ * @return local port, identifies the client on the server
+ */
+uint16_t BenchClient::bind() {
+    sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sd < 0)
+        throw std::runtime_error(std::string() + "socket: " + strerror(errno));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length     = sizeof(addr);
+    if(::bind(sd, (sockaddr *)&addr, sizeof(addr)) < 0
+       || getsockname(sd, (sockaddr *)&addr, &length) < 0) {
+        throw std::runtime_error(std::string() + "bind: " + strerror(errno));
+    }
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief connect - sends the connect request and does the DTLS
+ * handshake with the server on the loopback interface
+ * @param port - server port
+ */
+void BenchClient::connect(WOLFSSL_CTX* ctx, const std::string& port) {
+    sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family      = AF_INET;
+    server.sin_port        = htons(atoi(port.c_str()));
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(::connect(sd, (sockaddr *)&server, sizeof(server)) < 0)
+        throw std::runtime_error(std::string() + "connect: " + strerror(errno));
+
+    // repeated like the real client does, in case of packet loss:
+    const char request[] = { Tunnel::ZERO_PACKET, Tunnel::CLIENT_WANT_CONNECT };
+    for(int i = 0; i < 3; ++i)
+        send(sd, request, sizeof(request), 0);
+
+    if((ssl = wolfSSL_new(ctx)) == NULL)
+        throw std::runtime_error("wolfSSL_new error.");
+    wolfSSL_set_fd(ssl, sd);
+    if(wolfSSL_connect(ssl) != SSL_SUCCESS) {
+        int e = wolfSSL_get_error(ssl, 0);
+        throw std::runtime_error("Client #" + std::to_string(index) +
+                                 ": wolfSSL_connect failed: " +
+                                 wolfSSL_ERR_reason_error_string(e));
+    }
+
+    // the forwarding loop must never wait for a socket:
+    setNonBlocking(sd);
+    wolfSSL_dtls_set_using_nonblock(ssl, 1);
+}
+
+/**
+ * @brief takeServerEnd - gives the server end of the interface
+ * to the tunnel, the tunnel closes it
+ */
+int BenchClient::takeServerEnd() {
+    int fd = serverEnd;
+    serverEnd = -1;
+    return fd;
+}
+
+/**
+ * @brief run - sends packets with the send time inside and waits for
+ * them on the other side of the tunnel until 'stop' is set.
+ * If nothing arrives for STALL_TIMEOUT the packets in flight are
+ * considered lost, so a full socket buffer doesn't stop the client.
+ * @param upstream - client -> TUN if true, TUN -> client otherwise
+ * @param size     - size of IP packets
+ * @param window   - max packets in flight
+ */
+void BenchClient::run(bool upstream, int size, int window,
+                      const std::atomic<bool>& stop) {
+    std::vector<char> buffer(TunDevice::MAX_FRAME, 0);
+    double   cpuStart   = threadCpu();
+    uint64_t writtenOff = 0;
+    auto     progress   = std::chrono::steady_clock::now();
+
+    while(!stop) {
+        // late packets of a lost window make it negative
+        while(int64_t(sent - received - writtenOff) < window
+              && sendPacket(upstream, buffer.data(), size)) {
+            ++sent;
+        }
+
+        if(receivePackets(upstream, buffer.data()) > 0) {
+            progress = std::chrono::steady_clock::now();
+        } else if(std::chrono::steady_clock::now() - progress >
+                  std::chrono::milliseconds(STALL_TIMEOUT)) {
+            writtenOff = sent - received;
+            progress   = std::chrono::steady_clock::now();
+        }
+    }
+
+    // packets in flight are counted if they arrive soon:
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(DRAIN_TIME);
+    while(received < sent && std::chrono::steady_clock::now() < deadline)
+        receivePackets(upstream, buffer.data());
+
+    cpu = threadCpu() - cpuStart;
+}
+
+size_t BenchClient::getIndex() const {
+    return index;
+}
+
+in_addr_t BenchClient::getServerAddr() const {
+    return serverAddr;
+}
+
+in_addr_t BenchClient::getClientAddr() const {
+    return clientAddr;
+}
+
+uint64_t BenchClient::getSent() const {
+    return sent;
+}
+
+uint64_t BenchClient::getReceived() const {
+    return received;
+}
+
+uint64_t BenchClient::getBytes() const {
+    return bytes;
+}
+
+double BenchClient::getCpu() const {
+    return cpu;
+}
+
+const Histogram& BenchClient::getLatency() const {
+    return latency;
+}
+
+/**
+ * @brief sendPacket - writes one packet to the DTLS session (upstream)
+ * or to the interface (downstream)
+ * @return false if the socket is full
+ */
+bool BenchClient::sendPacket(bool upstream, char* buffer, int size) {
+    fillPacket(buffer, size, upstream);
+    if(upstream)
+        return wolfSSL_write(ssl, buffer, size) == size;
+    return write(tunEnd, buffer, size) == size;
+}
+
+/**
+ * @brief receivePackets - waits up to 1 ms and reads all packets
+ * from the interface (upstream) or from the DTLS session (downstream)
+ * @return count of received packets
+ */
+int BenchClient::receivePackets(bool upstream, char* buffer) {
+    pollfd fd;
+    fd.fd     = upstream ? tunEnd : sd;
+    fd.events = POLLIN;
+    if(poll(&fd, 1, 1) <= 0)
+        return 0;
+
+    int count  = 0;
+    int length = 0;
+    if(upstream) {
+        while((length = read(tunEnd, buffer, TunDevice::MAX_FRAME)) > 0) {
+            onPacket(buffer, length);
+            ++count;
+        }
+        return count;
+    }
+
+    while((length = wolfSSL_read(ssl, buffer, TunDevice::MAX_FRAME)) > 0) {
+        // control messages start with zero, parameters are acknowledged
+        if(buffer[0] == 0) {
+            ControlMessage message;
+            if(ControlMessage::parse(buffer, length, message) &&
+               message.getType() == ControlMessage::PARAMETERS) {
+                ControlMessage ack = ControlMessage::ack(message.getSequence());
+                wolfSSL_write(ssl, ack.data(), ack.size());
+            }
+            continue;
+        }
+        onPacket(buffer, length);
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief fillPacket - IPv4 header from the client address
+ * (or to it) and the current time
+ */
+void BenchClient::fillPacket(char* buffer, int size, bool upstream) const {
+    in_addr_t source      = upstream ? clientAddr : serverAddr;
+    in_addr_t destination = upstream ? serverAddr : clientAddr;
+    uint16_t  totalLength = htons(size);
+    uint64_t  stamp       = nowNanos();
+
+    buffer[0] = 0x45; // IPv4, 20-byte header
+    memcpy(buffer + 2, &totalLength, sizeof(totalLength));
+    buffer[8] = 64;   // TTL
+    buffer[9] = IPPROTO_UDP;
+    memcpy(buffer + 12, &source, sizeof(source));
+    memcpy(buffer + 16, &destination, sizeof(destination));
+    memcpy(buffer + IP_HEADER, &stamp, sizeof(stamp));
+}
+
+void BenchClient::onPacket(const char* data, int length) {
+    if(length < int(IP_HEADER + STAMP))
+        return;
+
+    uint64_t stamp = 0;
+    memcpy(&stamp, data + IP_HEADER, sizeof(stamp));
+    latency.record((nowNanos() - stamp) / 1000);
+    ++received;
+    bytes += length;
+}
+
+ForwardingBench::ForwardingBench(const BenchConfig& config)
+    : config(config), serverCtx(nullptr), clientCtx(nullptr), established(0) {
+    IoEngine::setDefault(config.engine);
+    initSsl();
+}
+
+ForwardingBench::~ForwardingBench() {
+    wolfSSL_CTX_free(clientCtx);
+    wolfSSL_CTX_free(serverCtx);
+    wolfSSL_Cleanup();
+}
+
+/**
+ * @brief run - one measurement: starts the workers, connects
+ * the clients and lets them send packets for 'seconds'
+ * @param upstream - client -> TUN if true, TUN -> client otherwise
+ * @param mtu      - MTU sent to the clients
+ * @param size     - size of IP packets, not above 'mtu'
+ */
+BenchResult ForwardingBench::run(bool upstream, int mtu, int size) {
+    // clients are destroyed after the workers that use their interfaces
+    std::vector<std::unique_ptr<BenchClient> > clients;
+    in_addr_t serverAddr = inet_addr("10.0.0.1");
+
+    clientsByPort.clear();
+    established = 0;
+    for(size_t i = 0; i < config.clients; ++i) {
+        BenchClient* client = new BenchClient(i, serverAddr,
+                                              htonl(0x0a000002 + i));
+        clients.push_back(std::unique_ptr<BenchClient>(client));
+        std::lock_guard<std::mutex> lock(mutex);
+        clientsByPort[client->bind()] = client;
+    }
+
+    WorkerPool workers(config.workers, config.port,
+        [this](DtlsListener& listener, const sockaddr_in6& peer) {
+            return createTunnel(listener, peer);
+        },
+        [this, mtu](Tunnel& tunnel) {
+            return setupTunnel(tunnel, mtu);
+        },
+        [](Tunnel&) { });
+    workers.start();
+
+    for(auto& client : clients)
+        client->connect(clientCtx, config.port);
+
+    // the tunnel is set up after the server has sent its last flight:
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(ESTABLISH_TIMEOUT);
+    while(established < clients.size()) {
+        if(std::chrono::steady_clock::now() > deadline)
+            throw std::runtime_error("Tunnels are not established in time");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    double cpuStart = processCpu();
+    auto   start    = std::chrono::steady_clock::now();
+    for(auto& client : clients) {
+        BenchClient* c = client.get();
+        threads.push_back(std::thread([c, upstream, size, this, &stop]() {
+            c->run(upstream, size, config.window, stop);
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    stop = true;
+    auto end = std::chrono::steady_clock::now();
+    for(auto& thread : threads)
+        thread.join();
+    double cpu = processCpu() - cpuStart;
+    workers.stop();
+
+    BenchResult result;
+    result.direction = upstream ? "up" : "down";
+    result.mtu       = mtu;
+    result.size      = size;
+    result.clients   = clients.size();
+    result.workers   = workers.size();
+    result.engine    = IoEngine::getDefault();
+    result.seconds   = std::chrono::duration<double>(end - start).count();
+
+    std::vector<uint64_t> latency;
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    uint64_t bytes = 0;
+    for(auto& client : clients) {
+        result.packets += client->getReceived();
+        if(client->getSent() > client->getReceived())
+            result.lost += client->getSent() - client->getReceived();
+        bytes += client->getBytes();
+        cpu   -= client->getCpu();
+        client->getLatency().addTo(latency, count, sum);
+    }
+
+    double gbit             = bytes * 8 / 1e9;
+    result.packetsPerSecond = result.packets / result.seconds;
+    result.gbitPerSecond    = gbit / result.seconds;
+    result.p50              = Histogram::percentile(latency, 0.5);
+    result.p99              = Histogram::percentile(latency, 0.99);
+    result.p999             = Histogram::percentile(latency, 0.999);
+    // the same as CPU cores busy per Gbit/s:
+    result.serverCpu        = cpu > 0 ? cpu : 0;
+    result.cpuPerGbit       = gbit > 0 ? result.serverCpu / gbit : 0;
+    return result;
+}
+
+/**
+ * @brief initSsl - server context like in VPNServer,
+ * client context trusts the CA of the server certificate
+ */
+void ForwardingBench::initSsl() {
+    std::string caCertLoc   = config.certs + "/ca_cert.pem";
+    std::string servCertLoc = config.certs + "/server-cert.pem";
+    std::string servKeyLoc  = config.certs + "/server-key.pem";
+    wolfSSL_Init();
+
+    if ((serverCtx = wolfSSL_CTX_new(wolfDTLSv1_2_server_method())) == NULL)
+        throw std::runtime_error("wolfSSL_CTX_new error.");
+    wolfSSL_SetIORecv(serverCtx, Tunnel::ioRecv);
+    wolfSSL_SetIOSend(serverCtx, Tunnel::ioSend);
+    wolfSSL_CTX_SetGenCookie(serverCtx, Tunnel::genCookie);
+    if (wolfSSL_CTX_use_certificate_file(serverCtx, servCertLoc.c_str(),
+                                         SSL_FILETYPE_PEM) != SSL_SUCCESS)
+        throw std::runtime_error("Error loading " + servCertLoc);
+    if (wolfSSL_CTX_use_PrivateKey_file(serverCtx, servKeyLoc.c_str(),
+                                        SSL_FILETYPE_PEM) != SSL_SUCCESS)
+        throw std::runtime_error("Error loading " + servKeyLoc);
+
+    if ((clientCtx = wolfSSL_CTX_new(wolfDTLSv1_2_client_method())) == NULL)
+        throw std::runtime_error("wolfSSL_CTX_new error.");
+    if (wolfSSL_CTX_load_verify_locations(clientCtx, caCertLoc.c_str(), 0)
+            != SSL_SUCCESS)
+        throw std::runtime_error("Error loading " + caCertLoc);
+}
+
+Tunnel* ForwardingBench::createTunnel(DtlsListener& listener,
+                                      const sockaddr_in6& peer) {
+    WOLFSSL* ssl = wolfSSL_new(serverCtx);
+    if (ssl == NULL)
+        return nullptr;
+    return new Tunnel(ssl, listener, peer);
+}
+
+/**
+ * @brief setupTunnel - attaches the in-memory interface
+ * of the client with the same port as the peer
+ */
+bool ForwardingBench::setupTunnel(Tunnel& tunnel, int mtu) {
+    BenchClient* client = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = clientsByPort.find(ntohs(tunnel.getPeer().sin6_port));
+        if(found == clientsByPort.end())
+            return false;
+        client = found->second;
+    }
+
+    ClientParameters* params = new ClientParameters;
+    ControlMessage& message = params->parametersToSend;
+    message = ControlMessage(ControlMessage::PARAMETERS);
+    message.addMtu(mtu);
+    message.addAddress(ControlMessage::ADDRESS, client->getClientAddr(), 32);
+    message.addAddress(ControlMessage::DNS, inet_addr("8.8.8.8"));
+    message.addAddress(ControlMessage::ROUTE, INADDR_ANY, 0);
+
+    tunnel.attachInterface(client->takeServerEnd(), false,
+                           "bench" + std::to_string(client->getIndex()),
+                           client->getServerAddr(), client->getClientAddr(),
+                           client->getIndex(), params);
+    ++established;
+    return true;
+}
+
+/**
+ * @brief processCpu
+ * @return user and system CPU seconds of all threads
+ */
+double ForwardingBench::processCpu() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
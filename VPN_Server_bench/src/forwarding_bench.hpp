@@ -0,0 +1,166 @@
+#ifndef FORWARDING_BENCH_HPP
+#define FORWARDING_BENCH_HPP
+
+#include "../../VPN_Server/src/metrics.hpp"
+#include "../../VPN_Server/src/tunnel.hpp"
+#include "../../VPN_Server/src/worker_pool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+
+/**
+ * @brief The BenchConfig struct<br>
+ * Parameters of a benchmark session, see usage of VPN_Server_bench.<br>
+ */
+struct BenchConfig {
+    std::string      port;
+    std::string      certs;     // directory with server certificates
+    size_t           clients;
+    size_t           workers;
+    int              seconds;   // measured time of every run
+    int              window;    // packets in flight per client
+    std::vector<int> mtus;
+    std::vector<int> sizes;     // IP packet sizes
+    bool             upstream;  // client -> TUN
+    bool             downstream; // TUN -> client
+    std::string      engine;    // IoEngine of the workers
+
+    explicit BenchConfig();
+};
+
+/**
+ * @brief The BenchResult struct<br>
+ * Result of one run: one direction, MTU and packet size.<br>
+ * Latency is the time from the write of a packet on one side<br>
+ * of the tunnel to its read on the other side.<br>
+ */
+struct BenchResult {
+    std::string direction;
+    int         mtu;
+    int         size;
+    size_t      clients;
+    size_t      workers;
+    std::string engine;
+    double      seconds;
+    uint64_t    packets;   // delivered
+    uint64_t    lost;
+    double      packetsPerSecond;
+    double      gbitPerSecond;
+    uint64_t    p50;       // us
+    uint64_t    p99;
+    uint64_t    p999;
+    double      serverCpu; // seconds of all threads except the clients
+    double      cpuPerGbit;
+
+    explicit BenchResult();
+    std::string toJson() const;
+};
+
+/**
+ * @brief The BenchClient class<br>
+ * Synthetic client: a DTLS session over its own UDP socket and<br>
+ * the far end of the in-memory TUN interface of its tunnel.<br>
+ * The interface is a datagram socket pair, so the server reads<br>
+ * and writes whole packets just like with /dev/net/tun.<br>
+ * Driven by one thread, keeps 'window' packets in flight.<br>
+ */
+class BenchClient {
+public:
+    static const int STALL_TIMEOUT = 20; // ms without progress, window is lost
+    static const int DRAIN_TIME    = 50; // ms to wait for late packets
+
+private:
+    size_t    index;
+    int       sd;          // UDP socket of the DTLS session
+    WOLFSSL*  ssl;
+    int       tunEnd;      // our end of the interface
+    int       serverEnd;   // taken by the tunnel
+    in_addr_t serverAddr;
+    in_addr_t clientAddr;
+    uint64_t  sent;
+    uint64_t  received;
+    uint64_t  bytes;
+    double    cpu;         // seconds used by the client thread
+    Histogram latency;
+
+public:
+    /* Forbid creating default copy ctor: */
+    BenchClient(BenchClient& that) = delete;
+
+    explicit BenchClient(size_t index, in_addr_t serverAddr, in_addr_t clientAddr);
+    ~BenchClient();
+
+    uint16_t bind();
+    void connect(WOLFSSL_CTX* ctx, const std::string& port);
+    int takeServerEnd();
+    void run(bool upstream, int size, int window,
+             const std::atomic<bool>& stop);
+
+    size_t getIndex() const;
+    in_addr_t getServerAddr() const;
+    in_addr_t getClientAddr() const;
+    uint64_t getSent() const;
+    uint64_t getReceived() const;
+    uint64_t getBytes() const;
+    double getCpu() const;
+    const Histogram& getLatency() const;
+
+private:
+    bool sendPacket(bool upstream, char* buffer, int size);
+    int receivePackets(bool upstream, char* buffer);
+    void fillPacket(char* buffer, int size, bool upstream) const;
+    void onPacket(const char* data, int length);
+};
+
+/**
+ * @brief The ForwardingBench class<br>
+ * Runs the real workers and tunnels of the server on the loopback<br>
+ * interface with synthetic clients. The server side is the same<br>
+ * as in VPN_Server except for the TUN interfaces: every tunnel<br>
+ * gets an in-memory interface, so no root privileges are needed<br>
+ * and the kernel routing is not a part of the measurement.<br>
+ */
+class ForwardingBench {
+public:
+    static const int ESTABLISH_TIMEOUT = 10000; // ms for all handshakes
+
+private:
+    BenchConfig                            config;
+    WOLFSSL_CTX*                           serverCtx;
+    WOLFSSL_CTX*                           clientCtx;
+    std::mutex                             mutex; // clients by port
+    std::unordered_map<uint16_t, BenchClient*> clientsByPort;
+    std::atomic<size_t>                    established;
+
+public:
+    /* Forbid creating default copy ctor: */
+    ForwardingBench(ForwardingBench& that) = delete;
+
+    explicit ForwardingBench(const BenchConfig& config);
+    ~ForwardingBench();
+
+    BenchResult run(bool upstream, int mtu, int size);
+
+private:
+    void initSsl();
+    Tunnel* createTunnel(DtlsListener& listener, const sockaddr_in6& peer);
+    bool setupTunnel(Tunnel& tunnel, int mtu);
+    static double processCpu();
+};
+
+#endif // FORWARDING_BENCH_HPP
@@ -0,0 +1,155 @@
+/** \mainpage Forwarding benchmark of VPN Server
+ *
+ * Runs workers and tunnels of the server with synthetic DTLS clients
+ * on the loopback interface and measures the forwarding path
+ * in both directions.\r\n
+ * Every run prints one line of JSON, so results can be appended
+ * to a file and compared between releases:\r\n
+ * <pre>./VPN_Server_bench -c 8 -w 2 -m 1400,1500 -s 64,512,1400 -o results.jsonl</pre>
+ */
+
+#include "forwarding_bench.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+void printUsage(const char* name) {
+    std::cerr <<
+    "* How to:\n"
+    "* " << name << " -c 4 -w 1 -t 5 -m 1400 -s 64,512,1400\n"
+    "* [-p 5555]         - port of the workers on 127.0.0.1 (default = 5555)\n"
+    "* [-c 4]            - synthetic clients, one thread each (default = 4)\n"
+    "* [-w 1]            - worker threads count (default = 1)\n"
+    "* [-t 5]            - seconds of every run (default = 5)\n"
+    "* [-W 64]           - packets in flight per client (default = 64)\n"
+    "* [-m 1400,1500]    - MTUs sent to the clients (default = 1400)\n"
+    "* [-s 64,512,1400]  - IP packet sizes, sizes above MTU are skipped\n"
+    "* [-d up|down|both] - client -> TUN, TUN -> client (default = both)\n"
+    "* [-k dir]          - server certificates (default = ../VPN_Server/certs)\n"
+    "* [-o file]         - append results to the file (default = stdout)\n"
+    "* [-u epoll]        - I/O engine of the workers, epoll or io_uring (default = epoll)\n*\n";
+}
+
+std::vector<int> parseList(const std::string& list, int min, int max,
+                           const std::string& what) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string item;
+    while(std::getline(stream, item, ',')) {
+        int value = atoi(item.c_str());
+        if(value < min || value > max)
+            throw std::invalid_argument("Invalid " + what + ": " + item);
+        values.push_back(value);
+    }
+    if(values.empty())
+        throw std::invalid_argument("Invalid " + what);
+    return values;
+}
+
+int parseNumber(const char* text, int min, int max, const std::string& what) {
+    int value = atoi(text);
+    if(value < min || value > max)
+        throw std::invalid_argument("Invalid " + what);
+    return value;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    std::string output;
+
+    try {
+        for(int i = 1; i < argc; ++i) {
+            if(strlen(argv[i]) != 2 || argv[i][0] != '-' || i + 1 >= argc)
+                throw std::invalid_argument(std::string() +
+                                            "Invalid argument " + argv[i]);
+            const char* value = argv[++i];
+            switch (argv[i - 1][1]) {
+                case 'p':
+                    parseNumber(value, 1, 0xFFFF, "port");
+                    config.port = value;
+                    break;
+                case 'c':
+                    config.clients = parseNumber(value, 1, 1024, "clients count");
+                    break;
+                case 'w':
+                    config.workers = parseNumber(value, 1, 256, "workers count");
+                    break;
+                case 't':
+                    config.seconds = parseNumber(value, 1, 3600, "duration");
+                    break;
+                case 'W':
+                    config.window = parseNumber(value, 1, 4096, "window");
+                    break;
+                case 'm':
+                    // the same range as the -m option of the server
+                    config.mtus = parseList(value, 1000, 2000, "mtu");
+                    break;
+                case 's':
+                    config.sizes = parseList(value, 28, TunDevice::MAX_PACKET,
+                                             "packet size");
+                    break;
+                case 'd':
+                    if(strcmp(value, "up") == 0) {
+                        config.downstream = false;
+                    } else if(strcmp(value, "down") == 0) {
+                        config.upstream = false;
+                    } else if(strcmp(value, "both") != 0) {
+                        throw std::invalid_argument("Invalid direction");
+                    }
+                    break;
+                case 'k':
+                    config.certs = value;
+                    break;
+                case 'o':
+                    output = value;
+                    break;
+                case 'u':
+                    if(!IoEngine::isEngineName(value))
+                        throw std::invalid_argument("Invalid I/O engine");
+                    config.engine = value;
+                    break;
+                default:
+                    throw std::invalid_argument(std::string() +
+                                                "Invalid argument " + argv[i - 1]);
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if(!output.empty()) {
+        file.open(output.c_str(), std::ios::app);
+        if(!file) {
+            std::cerr << "Cannot open " << output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+
+    try {
+        ForwardingBench bench(config);
+        for(int mtu : config.mtus) {
+            for(int size : config.sizes) {
+                if(size > mtu)
+                    continue;
+                if(config.downstream)
+                    out << bench.run(false, mtu, size).toJson() << std::endl;
+                if(config.upstream)
+                    out << bench.run(true, mtu, size).toJson() << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
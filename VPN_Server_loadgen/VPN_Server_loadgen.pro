@@ -0,0 +1,18 @@
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += src/main.cpp \
+    src/connect_load.cpp \
+    ../VPN_Server/src/control_message.cpp \
+    ../VPN_Server/src/event_loop.cpp \
+    ../VPN_Server/src/metrics.cpp \
+    ../VPN_Server/src/io_engine.cpp \
+    ../VPN_Server/src/packet_pool.cpp
+
+HEADERS += \
+    src/connect_load.hpp
+
+LIBS += -lpthread \
+        -lwolfssl
@@ -0,0 +1,280 @@
+#include "connect_load.hpp"
+
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+
+const int ConnectLoad::TICK;
+
+namespace {
+
+// see protocol_specs.md
+const char CONNECT_REQUEST[] = { 0, 1 };
+
+} // namespace
+
+LoadConfig::LoadConfig()
+    : host("127.0.0.1"),
+      caCert("../VPN_Server/certs/ca_cert.pem"),
+      connections(1000),
+      concurrency(256),
+      rate(0),
+      threads(1),
+      timeout(10000),
+      hold(false) { }
+
+LoadConnection::LoadConnection()
+    : sd(-1), ssl(nullptr), state(HANDSHAKE) { }
+
+LoadConnection::~LoadConnection() {
+    if(ssl != nullptr)
+        wolfSSL_free(ssl);
+    if(sd >= 0)
+        close(sd);
+}
+
+LoadStats::LoadStats() : succeeded(0), failed(0), timedOut(0) { }
+
+/**
+ * @brief ConnectLoad constructor
+ * @param ctx   - DTLS client context, shared by the threads
+ * @param total - connections of the thread
+ * @param rate  - connects/s of the thread, 0 - no limit
+ */
+ConnectLoad::ConnectLoad(const LoadConfig& config, WOLFSSL_CTX* ctx,
+                         size_t total, double rate)
+    : config(config),
+      ctx(ctx),
+      total(total),
+      rate(rate),
+      started(0),
+      pending(0),
+      succeeded(0),
+      failed(0),
+      timedOut(0) {
+    addrinfo hints;
+    addrinfo* result = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(config.host.c_str(), config.port.c_str(), &hints, &result) != 0)
+        throw std::invalid_argument("Cannot resolve " + config.host);
+    memcpy(&server, result->ai_addr, sizeof(server));
+    freeaddrinfo(result);
+}
+
+/**
+ * @brief run - opens all connections of the thread and
+ * returns when every one of them is done or has failed
+ */
+void ConnectLoad::run() {
+    begin = std::chrono::steady_clock::now();
+    int timer = loop.addTimer(std::chrono::milliseconds(TICK), [this]() {
+        onTick();
+    });
+    openMore();
+    if(!isDone())
+        loop.run();
+    loop.removeTimer(timer);
+
+    // held connections leave together, like after the storm
+    for(auto& connection : connections) {
+        if(connection.second->state == LoadConnection::CONNECTED)
+            disconnect(connection.second.get());
+    }
+    connections.clear();
+}
+
+void ConnectLoad::addTo(LoadStats& stats) const {
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    stats.succeeded += succeeded;
+    stats.failed    += failed;
+    stats.timedOut  += timedOut;
+    handshake.addTo(stats.handshake, count, sum);
+    parameters.addTo(stats.parameters, count, sum);
+    firstPacket.addTo(stats.firstPacket, count, sum);
+}
+
+/**
+ * @brief openMore - starts new connections while there are
+ * free handshake slots and the rate limit allows
+ */
+void ConnectLoad::openMore() {
+    size_t allowed = total;
+    if(rate > 0) {
+        double elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+        allowed = std::min(total, size_t(rate * elapsed) + 1);
+    }
+
+    while(started < allowed && pending < config.concurrency)
+        open();
+}
+
+/**
+ * @brief open - sends the connect request from a new socket
+ * and starts the DTLS handshake
+ */
+void ConnectLoad::open() {
+    ++started;
+    std::unique_ptr<LoadConnection> connection(new LoadConnection);
+    connection->sd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if(connection->sd < 0
+       || connect(connection->sd, (sockaddr *)&server, sizeof(server)) < 0
+       || (connection->ssl = wolfSSL_new(ctx)) == NULL) {
+        ++failed; // e.g. out of descriptors, see ulimit -n
+        return;
+    }
+    wolfSSL_set_fd(connection->ssl, connection->sd);
+    wolfSSL_dtls_set_using_nonblock(connection->ssl, 1);
+
+    // repeated like the real client does, in case of packet loss:
+    connection->requested = std::chrono::steady_clock::now();
+    for(int i = 0; i < 3; ++i)
+        send(connection->sd, CONNECT_REQUEST, sizeof(CONNECT_REQUEST), 0);
+
+    LoadConnection* c = connection.get();
+    connections[c->sd] = std::move(connection);
+    ++pending;
+    loop.addFd(c->sd, EPOLLIN, [this, c](uint32_t) {
+        onReadable(c);
+    });
+    continueHandshake(c);
+}
+
+void ConnectLoad::onReadable(LoadConnection* connection) {
+    if(connection->state == LoadConnection::HANDSHAKE)
+        continueHandshake(connection);
+    else
+        readRecords(connection);
+}
+
+/**
+ * @brief continueHandshake - resumes wolfSSL_connect,
+ * the parameters may come in the same batch of datagrams
+ */
+void ConnectLoad::continueHandshake(LoadConnection* connection) {
+    if(wolfSSL_connect(connection->ssl) == SSL_SUCCESS) {
+        connection->established = std::chrono::steady_clock::now();
+        connection->state       = LoadConnection::PARAMETERS;
+        handshake.record(connection->established - connection->requested);
+        readRecords(connection);
+        return;
+    }
+
+    int e = wolfSSL_get_error(connection->ssl, 0);
+    if(e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+        connection->retransmitAt = std::chrono::steady_clock::now() +
+                std::chrono::seconds(wolfSSL_dtls_get_current_timeout(connection->ssl));
+        return;
+    }
+    ++failed;
+    finish(connection, false);
+}
+
+/**
+ * @brief readRecords - waits for the PARAMETERS control message
+ * and acknowledges it, so the server does not send it again
+ */
+void ConnectLoad::readRecords(LoadConnection* connection) {
+    if(connection->state != LoadConnection::PARAMETERS) {
+        // drop keepalives and parameters resent before our ACK arrived
+        char buffer[ControlMessage::MAX_SIZE];
+        while(wolfSSL_read(connection->ssl, buffer, sizeof(buffer)) > 0) { }
+        return;
+    }
+
+    char buffer[ControlMessage::MAX_SIZE];
+    int  length = 0;
+    while((length = wolfSSL_read(connection->ssl, buffer, sizeof(buffer))) > 0) {
+        ControlMessage message;
+        if(!ControlMessage::parse(buffer, length, message) ||
+           message.getType() != ControlMessage::PARAMETERS)
+            continue;
+        ControlMessage ack = ControlMessage::ack(message.getSequence());
+        wolfSSL_write(connection->ssl, ack.data(), ack.size());
+        auto now = std::chrono::steady_clock::now();
+        parameters.record(now - connection->established);
+        firstPacket.record(now - connection->requested);
+        ++succeeded;
+        finish(connection, true);
+        return;
+    }
+
+    int e = wolfSSL_get_error(connection->ssl, 0);
+    if(e != SSL_ERROR_WANT_READ && e != SSL_ERROR_WANT_WRITE) {
+        ++failed;
+        finish(connection, false);
+    }
+}
+
+/**
+ * @brief onTick - timeouts and retransmission of lost handshake
+ * flights, then new connections if the rate limit allows
+ */
+void ConnectLoad::onTick() {
+    auto now     = std::chrono::steady_clock::now();
+    auto timeout = std::chrono::milliseconds(config.timeout);
+    std::vector<LoadConnection*> expired;
+
+    for(auto& item : connections) {
+        LoadConnection* connection = item.second.get();
+        if(connection->state == LoadConnection::CONNECTED)
+            continue;
+        if(now - connection->requested > timeout) {
+            expired.push_back(connection);
+        } else if(connection->state == LoadConnection::HANDSHAKE
+                  && now >= connection->retransmitAt) {
+            wolfSSL_dtls_got_timeout(connection->ssl);
+            connection->retransmitAt = now +
+                    std::chrono::seconds(wolfSSL_dtls_get_current_timeout(connection->ssl));
+        }
+    }
+
+    for(LoadConnection* connection : expired) {
+        ++timedOut;
+        finish(connection, false);
+    }
+
+    openMore();
+    if(isDone())
+        loop.stop();
+}
+
+/**
+ * @brief finish - the connection is done: it is kept if the
+ * connections are held, closed otherwise. The object is destroyed
+ * later, since we may be called from its own handler.
+ */
+void ConnectLoad::finish(LoadConnection* connection, bool success) {
+    --pending;
+    if(success && config.hold) {
+        connection->state = LoadConnection::CONNECTED;
+    } else {
+        if(success)
+            disconnect(connection);
+        int sd = connection->sd;
+        loop.removeFd(sd);
+        // the descriptor is closed by the destructor, so it isn't reused before
+        loop.post([this, sd]() { connections.erase(sd); });
+    }
+
+    openMore();
+    if(isDone())
+        loop.stop();
+}
+
+/**
+ * @brief disconnect - DISCONNECT control message, the server
+ * removes the tunnel right away (no ACK is waited for)
+ */
+void ConnectLoad::disconnect(LoadConnection* connection) {
+    ControlMessage message(ControlMessage::DISCONNECT);
+    wolfSSL_write(connection->ssl, message.data(), message.size());
+}
+
+bool ConnectLoad::isDone() const {
+    return started == total && pending == 0;
+}
@@ -0,0 +1,138 @@
+#ifndef CONNECT_LOAD_HPP
+#define CONNECT_LOAD_HPP
+
+#include "../../VPN_Server/src/control_message.hpp"
+#include "../../VPN_Server/src/event_loop.hpp"
+#include "../../VPN_Server/src/metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/ssl.h>
+
+/**
+ * @brief The LoadConfig struct<br>
+ * Parameters of a connect storm, see usage of VPN_Server_loadgen.<br>
+ */
+struct LoadConfig {
+    std::string host;
+    std::string port;
+    std::string caCert;
+    size_t      connections; // total, split between threads
+    size_t      concurrency; // handshakes in flight per thread
+    size_t      rate;        // connects/s of all threads, 0 - no limit
+    size_t      threads;
+    int         timeout;     // ms from the request to the parameters
+    bool        hold;        // stay connected until the storm is over
+
+    explicit LoadConfig();
+};
+
+/**
+ * @brief The LoadConnection struct<br>
+ * One synthetic client: its socket, DTLS session and timestamps.<br>
+ */
+struct LoadConnection {
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    enum State {
+        HANDSHAKE,  // DTLS handshake in progress
+        PARAMETERS, // waiting for the client parameters
+        CONNECTED   // parameters are received (held connection)
+    };
+
+    int       sd;
+    WOLFSSL*  ssl;
+    State     state;
+    TimePoint requested;    // first CLIENT_WANT_CONNECT is sent
+    TimePoint established;  // wolfSSL_connect is done
+    TimePoint retransmitAt;
+
+    explicit LoadConnection();
+    ~LoadConnection();
+};
+
+/**
+ * @brief The LoadStats struct<br>
+ * Results of the threads, see 'ConnectLoad::addTo'.<br>
+ * Handshake is the time from the first connect request till the<br>
+ * end of the handshake, parameters - from the end of the handshake<br>
+ * till the parameters packet, first packet - from the request<br>
+ * till the parameters (the first record of the tunnel).<br>
+ */
+struct LoadStats {
+    uint64_t              succeeded;
+    uint64_t              failed;   // handshake or socket error
+    uint64_t              timedOut;
+    std::vector<uint64_t> handshake;
+    std::vector<uint64_t> parameters;
+    std::vector<uint64_t> firstPacket;
+
+    explicit LoadStats();
+};
+
+/**
+ * @brief The ConnectLoad class<br>
+ * Fires connect requests and DTLS handshakes at the server from<br>
+ * one thread: every connection is a non-blocking socket in the<br>
+ * event loop of the thread, handshakes are resumed by datagrams<br>
+ * and by the timer that also retransmits lost flights.<br>
+ */
+class ConnectLoad {
+public:
+    static const int TICK = 10; // ms, timeouts, retransmits and pacing
+
+private:
+    typedef std::unordered_map<int, std::unique_ptr<LoadConnection> > Connections;
+
+    const LoadConfig&                     config;
+    WOLFSSL_CTX*                          ctx;
+    sockaddr_in                           server;
+    size_t                                total;    // connections of the thread
+    double                                rate;     // connects/s of the thread
+    size_t                                started;
+    size_t                                pending;  // handshakes and parameters
+    std::chrono::steady_clock::time_point begin;
+    EventLoop                             loop;
+    Connections                           connections;
+    uint64_t                              succeeded;
+    uint64_t                              failed;
+    uint64_t                              timedOut;
+    Histogram                             handshake;
+    Histogram                             parameters;
+    Histogram                             firstPacket;
+
+public:
+    /* Forbid creating default copy ctor: */
+    ConnectLoad(ConnectLoad& that) = delete;
+
+    explicit ConnectLoad(const LoadConfig& config, WOLFSSL_CTX* ctx,
+                         size_t total, double rate);
+
+    void run();
+    void addTo(LoadStats& stats) const;
+
+private:
+    void openMore();
+    void open();
+    void onReadable(LoadConnection* connection);
+    void continueHandshake(LoadConnection* connection);
+    void readRecords(LoadConnection* connection);
+    void onTick();
+    void finish(LoadConnection* connection, bool success);
+    void disconnect(LoadConnection* connection);
+    bool isDone() const;
+};
+
+#endif // CONNECT_LOAD_HPP
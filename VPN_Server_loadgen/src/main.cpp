@@ -0,0 +1,166 @@
+/** \mainpage Connect storm load generator for VPN Server
+ *
+ * Fires thousands of concurrent connect requests and DTLS handshakes
+ * at a running server, like clients reconnecting after a network flap,
+ * and measures connects/s, handshake time, parameters delivery
+ * and time to the first packet of the tunnel.\r\n
+ * The result is one line of JSON:\r\n
+ * <pre>./VPN_Server_loadgen -h 127.0.0.1 -p 8000 -n 5000 -c 512 -j 2</pre>
+ */
+
+#include "connect_load.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+void printUsage(const char* name) {
+    std::cerr <<
+    "* How to:\n"
+    "* " << name << " -p 8000 -n 1000 -c 256\n"
+    "* -p 8000          - server port (mandatory)\n"
+    "* [-h 127.0.0.1]   - server address (default = 127.0.0.1)\n"
+    "* [-n 1000]        - connections to open (default = 1000)\n"
+    "* [-c 256]         - handshakes in flight per thread (default = 256)\n"
+    "* [-r 0]           - connects per second, 0 - no limit (default = 0)\n"
+    "* [-j 1]           - threads (default = 1)\n"
+    "* [-t 10000]       - ms to get the parameters (default = 10000)\n"
+    "* [-H]             - hold connections until all are done (default = off)\n"
+    "* [-k ca_cert.pem] - CA of the server (default = ../VPN_Server/certs/ca_cert.pem)\n"
+    "* Every connection uses a descriptor, raise 'ulimit -n' for big -c or -H.\n*\n";
+}
+
+int parseNumber(const char* text, int min, int max, const std::string& what) {
+    int value = atoi(text);
+    if(value < min || value > max)
+        throw std::invalid_argument("Invalid " + what);
+    return value;
+}
+
+void writePercentiles(std::ostream& out, const char* name,
+                      const std::vector<uint64_t>& buckets) {
+    out << ",\"" << name << "_us\":{\"p50\":" << Histogram::percentile(buckets, 0.5)
+        << ",\"p99\":" << Histogram::percentile(buckets, 0.99)
+        << ",\"p999\":" << Histogram::percentile(buckets, 0.999) << "}";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    LoadConfig config;
+
+    try {
+        for(int i = 1; i < argc; ++i) {
+            if(strcmp(argv[i], "-H") == 0) {
+                config.hold = true;
+                continue;
+            }
+            if(strlen(argv[i]) != 2 || argv[i][0] != '-' || i + 1 >= argc)
+                throw std::invalid_argument(std::string() +
+                                            "Invalid argument " + argv[i]);
+            const char* value = argv[++i];
+            switch (argv[i - 1][1]) {
+                case 'p':
+                    parseNumber(value, 1, 0xFFFF, "port");
+                    config.port = value;
+                    break;
+                case 'h':
+                    config.host = value;
+                    break;
+                case 'n':
+                    config.connections = parseNumber(value, 1, 10000000,
+                                                     "connections count");
+                    break;
+                case 'c':
+                    config.concurrency = parseNumber(value, 1, 65536, "concurrency");
+                    break;
+                case 'r':
+                    config.rate = parseNumber(value, 0, 10000000, "rate");
+                    break;
+                case 'j':
+                    config.threads = parseNumber(value, 1, 256, "threads count");
+                    break;
+                case 't':
+                    config.timeout = parseNumber(value, 1, 600000, "timeout");
+                    break;
+                case 'k':
+                    config.caCert = value;
+                    break;
+                default:
+                    throw std::invalid_argument(std::string() +
+                                                "Invalid argument " + argv[i - 1]);
+            }
+        }
+        if(config.port.empty())
+            throw std::invalid_argument("Server port is not set");
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    wolfSSL_Init();
+    WOLFSSL_CTX* ctx = wolfSSL_CTX_new(wolfDTLSv1_2_client_method());
+    if(ctx == NULL
+       || wolfSSL_CTX_load_verify_locations(ctx, config.caCert.c_str(), 0)
+          != SSL_SUCCESS) {
+        std::cerr << "Error loading " << config.caCert << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    LoadStats stats;
+    double    seconds = 0;
+    try {
+        // connections and rate are split between the threads
+        std::vector<std::unique_ptr<ConnectLoad> > loads;
+        for(size_t i = 0; i < config.threads; ++i) {
+            size_t total = config.connections / config.threads +
+                           (i < config.connections % config.threads ? 1 : 0);
+            loads.push_back(std::unique_ptr<ConnectLoad>(
+                                new ConnectLoad(config, ctx, total,
+                                                double(config.rate) / config.threads)));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for(auto& load : loads) {
+            ConnectLoad* l = load.get();
+            threads.push_back(std::thread([l]() { l->run(); }));
+        }
+        for(auto& thread : threads)
+            thread.join();
+        seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+        for(auto& load : loads)
+            load->addTo(stats);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    wolfSSL_CTX_free(ctx);
+    wolfSSL_Cleanup();
+
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"time\":" << time(nullptr)
+        << ",\"connections\":" << config.connections
+        << ",\"concurrency\":" << config.concurrency * config.threads
+        << ",\"threads\":" << config.threads
+        << ",\"hold\":" << (config.hold ? "true" : "false")
+        << ",\"succeeded\":" << stats.succeeded
+        << ",\"failed\":" << stats.failed
+        << ",\"timed_out\":" << stats.timedOut
+        << ",\"seconds\":" << seconds
+        << ",\"connects_per_second\":" << stats.succeeded / seconds;
+    writePercentiles(out, "handshake", stats.handshake);
+    writePercentiles(out, "parameters", stats.parameters);
+    writePercentiles(out, "first_packet", stats.firstPacket);
+    out << "}";
+    std::cout << out.str() << std::endl;
+
+    return stats.succeeded == config.connections ? EXIT_SUCCESS : EXIT_FAILURE;
+}
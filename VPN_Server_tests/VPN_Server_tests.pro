@@ -10,5 +10,23 @@ LIBS += -L/usr/local/lib -lgtest \
         -lwolfssl
 
 HEADERS += \
+    src/logger_test.hpp \
     src/ip_manager_test.hpp \
+    src/tun_device_test.hpp \
+    src/packet_pool_test.hpp \
+    src/route_table_test.hpp \
+    src/metrics_test.hpp \
+    src/session_cache_test.hpp \
+    src/cipher_suites_test.hpp \
+    src/xfrm_offload_test.hpp \
+    src/io_engine_test.hpp \
+    src/control_message_test.hpp \
+    src/path_mtu_test.hpp \
+    src/timer_wheel_test.hpp \
+    src/keepalive_test.hpp \
+    src/crypto_pipeline_test.hpp \
+    src/packet_filter_test.hpp \
+    src/traffic_shaper_test.hpp \
+    src/handoff_test.hpp \
+    src/control_server_test.hpp \
     src/vpn_server_test.hpp
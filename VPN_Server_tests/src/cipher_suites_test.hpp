@@ -0,0 +1,43 @@
+#ifndef CIPHER_SUITES_TEST_HPP
+#define CIPHER_SUITES_TEST_HPP
+
+#include "../../VPN_Server/src/cipher_suites.cpp"
+#include <gtest/gtest.h>
+
+TEST(CipherSuitesTest, AutoPrefersAesGcmWithAcceleration) {
+    CpuFeatures cpu;
+    cpu.aes   = true;
+    cpu.clmul = true;
+    ASSERT_STREQ(CipherSuites::AES_GCM_FIRST, CipherSuites::select("auto", cpu));
+}
+
+TEST(CipherSuitesTest, AutoPrefersChachaWithoutAcceleration) {
+    CpuFeatures cpu;
+    ASSERT_STREQ(CipherSuites::CHACHA20_FIRST, CipherSuites::select("auto", cpu));
+    // AES without GHASH instructions is still slow:
+    cpu.aes = true;
+    ASSERT_STREQ(CipherSuites::CHACHA20_FIRST, CipherSuites::select("auto", cpu));
+}
+
+TEST(CipherSuitesTest, PinnedPoliciesIgnoreCpu) {
+    CpuFeatures cpu;
+    ASSERT_STREQ(CipherSuites::AES_GCM_FIRST, CipherSuites::select("aes-gcm", cpu));
+    ASSERT_STREQ(CipherSuites::CHACHA20_FIRST, CipherSuites::select("chacha20", cpu));
+    ASSERT_EQ(nullptr, CipherSuites::select("default", cpu));
+}
+
+TEST(CipherSuitesTest, UnknownPolicyIsRejected) {
+    ASSERT_FALSE(CipherSuites::isPolicyName("rc4"));
+    ASSERT_THROW(CipherSuites::select("rc4", CpuFeatures()), std::invalid_argument);
+}
+
+TEST(CpuFeaturesTest, DescribesDetectedFeatures) {
+    CpuFeatures cpu;
+    ASSERT_EQ("no crypto extensions", cpu.describe());
+    cpu.aes   = true;
+    cpu.clmul = true;
+    ASSERT_EQ("aes clmul", cpu.describe());
+    ASSERT_FALSE(CpuFeatures::detect().describe().empty());
+}
+
+#endif // CIPHER_SUITES_TEST_HPP
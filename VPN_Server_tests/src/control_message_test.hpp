@@ -0,0 +1,114 @@
+#ifndef CONTROL_MESSAGE_TEST_HPP
+#define CONTROL_MESSAGE_TEST_HPP
+
+#include "../../VPN_Server/src/control_message.cpp"
+#include <gtest/gtest.h>
+
+TEST(ControlMessageTest, ParametersRoundTrip) {
+    ControlMessage message(ControlMessage::PARAMETERS, 7,
+                           ControlMessage::ACK_REQUESTED);
+    message.addMtu(1400);
+    message.addAddress(ControlMessage::ADDRESS, inet_addr("10.0.0.2"), 32);
+    message.addAddress(ControlMessage::DNS, inet_addr("8.8.8.8"));
+    message.addAddress(ControlMessage::ROUTE, inet_addr("0.0.0.0"), 0);
+    message.addAddress(ControlMessage::ROUTE, inet_addr("192.168.0.0"), 16);
+
+    ControlMessage parsed;
+    ASSERT_TRUE(ControlMessage::parse(message.data(), message.size(), parsed));
+    ASSERT_EQ(ControlMessage::PARAMETERS, parsed.getType());
+    ASSERT_EQ(ControlMessage::ACK_REQUESTED, parsed.getFlags());
+    ASSERT_EQ(7, parsed.getSequence());
+
+    std::vector<ControlField> fields = parsed.getFields();
+    ASSERT_EQ(5u, fields.size());
+    ASSERT_EQ(ControlMessage::MTU, fields[0].tag);
+    uint16_t mtu = 0;
+    memcpy(&mtu, fields[0].value, sizeof(mtu));
+    ASSERT_EQ(1400, ntohs(mtu));
+    ASSERT_EQ(ControlMessage::ROUTE, fields[4].tag);
+    ASSERT_EQ(5, fields[4].length);
+    ASSERT_EQ(16, fields[4].value[4]);
+
+    // much smaller than the old 1024-byte packet
+    ASSERT_GT(64, message.size());
+}
+
+TEST(ControlMessageTest, Ipv6FieldsHaveTheirSizes) {
+    in6_addr address, dns;
+    inet_pton(AF_INET6, "fd00:1:0:5::1", &address);
+    inet_pton(AF_INET6, "2001:4860:4860::8888", &dns);
+    ControlMessage message(ControlMessage::PARAMETERS);
+    message.addAddress(ControlMessage::ADDRESS6, address, 64);
+    message.addAddress(ControlMessage::ROUTE6, in6addr_any, 0);
+    message.addAddress(ControlMessage::DNS6, dns);
+
+    ControlMessage parsed;
+    ASSERT_TRUE(ControlMessage::parse(message.data(), message.size(), parsed));
+    std::vector<ControlField> fields = parsed.getFields();
+    ASSERT_EQ(3u, fields.size());
+    ASSERT_EQ(ControlMessage::ADDRESS6, fields[0].tag);
+    ASSERT_EQ(17, fields[0].length);
+    ASSERT_EQ(0, memcmp(fields[0].value, &address, sizeof(address)));
+    ASSERT_EQ(64, fields[0].value[16]);
+    ASSERT_EQ(17, fields[1].length);
+    ASSERT_EQ(ControlMessage::DNS6, fields[2].tag);
+    ASSERT_EQ(16, fields[2].length);
+}
+
+TEST(ControlMessageTest, UnknownFieldsAreKept) {
+    ControlMessage message(ControlMessage::PARAMETERS);
+    message.addField(static_cast<ControlMessage::Tag>(200), "hint", 4);
+    message.addMtu(1400);
+
+    ControlMessage parsed;
+    ASSERT_TRUE(ControlMessage::parse(message.data(), message.size(), parsed));
+    std::vector<ControlField> fields = parsed.getFields();
+    ASSERT_EQ(2u, fields.size());
+    ASSERT_EQ(200, fields[0].tag);
+    ASSERT_EQ(ControlMessage::MTU, fields[1].tag);
+}
+
+TEST(ControlMessageTest, TrailingPaddingIsDropped) {
+    ControlMessage message = ControlMessage::ack(300);
+    std::string record(message.data(), message.size());
+    record.append(10, ' ');
+
+    ControlMessage parsed;
+    ASSERT_TRUE(ControlMessage::parse(record.data(), record.size(), parsed));
+    ASSERT_EQ(ControlMessage::ACK, parsed.getType());
+    ASSERT_EQ(300, parsed.getSequence());
+    ASSERT_EQ(ControlMessage::HEADER_SIZE, parsed.size());
+}
+
+TEST(ControlMessageTest, MalformedMessagesAreRejected) {
+    ControlMessage message(ControlMessage::PARAMETERS);
+    message.addMtu(1400);
+    ControlMessage parsed;
+
+    // truncated field
+    ASSERT_FALSE(ControlMessage::parse(message.data(), message.size() - 1, parsed));
+    // older messages {0, type} and IP packets
+    const char disconnect[] = { 0, 2 };
+    ASSERT_FALSE(ControlMessage::parse(disconnect, sizeof(disconnect), parsed));
+    const char packet[ControlMessage::HEADER_SIZE] = { 0x45 };
+    ASSERT_FALSE(ControlMessage::parse(packet, sizeof(packet), parsed));
+
+    // field length past the message length
+    std::string record(message.data(), message.size());
+    record[ControlMessage::HEADER_SIZE + 1] = 10;
+    ASSERT_FALSE(ControlMessage::parse(record.data(), record.size(), parsed));
+}
+
+TEST(ControlMessageTest, TooLongFieldException) {
+    ControlMessage message(ControlMessage::PARAMETERS);
+    std::string value(256, 'x');
+    ASSERT_THROW(message.addField(ControlMessage::ROUTE, value.data(), value.size()),
+                 std::invalid_argument);
+    // no more than MAX_SIZE bytes
+    while(message.size() + 7 <= ControlMessage::MAX_SIZE)
+        message.addAddress(ControlMessage::ROUTE, inet_addr("10.0.0.0"), 8);
+    ASSERT_THROW(message.addAddress(ControlMessage::ROUTE, inet_addr("10.0.0.0"), 8),
+                 std::invalid_argument);
+}
+
+#endif // CONTROL_MESSAGE_TEST_HPP
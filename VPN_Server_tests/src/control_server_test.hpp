@@ -0,0 +1,88 @@
+#ifndef CONTROL_SERVER_TEST_HPP
+#define CONTROL_SERVER_TEST_HPP
+
+#include "../../VPN_Server/src/control_server.cpp"
+#include <gtest/gtest.h>
+
+#include <thread>
+
+TEST(ServerSettingsTest, SettingsAreParsedFromLines) {
+    ServerSettings settings;
+    settings.add("mtu 1400");
+    settings.add("dns 1.1.1.1 # resolver of the clients");
+    settings.add("route 10.1.0.0 16");
+    settings.add("  ");
+    settings.add("rate 8m");
+    settings.add("rate 10.1.2.3=1m");
+
+    ASSERT_EQ("1400", settings.mtu);
+    ASSERT_EQ("1.1.1.1", settings.dnsIp);
+    ASSERT_EQ("10.1.0.0", settings.routeIp);
+    ASSERT_EQ("16", settings.routeMask);
+    ASSERT_TRUE(settings.physInterface.empty());
+    ASSERT_EQ(std::vector<std::string>({ "8m", "10.1.2.3=1m" }), settings.rateLimits);
+}
+
+TEST(ServerSettingsTest, Ipv6SettingsAreKeptApart) {
+    ServerSettings settings;
+    settings.add("dns 1.1.1.1");
+    settings.add("dns 2606:4700:4700::1111");
+    settings.add("route 2001:db8:: 32");
+
+    ASSERT_EQ("1.1.1.1", settings.dnsIp);
+    ASSERT_EQ("2606:4700:4700::1111", settings.dnsIp6);
+    ASSERT_TRUE(settings.routeIp.empty());
+    ASSERT_EQ("2001:db8::", settings.routeIp6);
+    ASSERT_EQ("32", settings.routeMask6);
+    ASSERT_THROW(settings.add("route :: 129"), std::invalid_argument);
+    ASSERT_THROW(settings.add("dns fd00::1::2"), std::invalid_argument);
+}
+
+TEST(ServerSettingsTest, InvalidSettingsAreRejected) {
+    ServerSettings settings;
+    ASSERT_THROW(settings.add("mtu 100"), std::invalid_argument);
+    ASSERT_THROW(settings.add("dns 1.1.1"), std::invalid_argument);
+    ASSERT_THROW(settings.add("route 10.1.0.0 33"), std::invalid_argument);
+    ASSERT_THROW(settings.add("rate fast"), std::invalid_argument);
+    ASSERT_THROW(settings.add("port 8000"), std::invalid_argument);
+    ASSERT_THROW(settings.add("mtu 1400 1500"), std::invalid_argument);
+    ASSERT_THROW(settings.load("/tmp/vpn_no_such_settings"), std::invalid_argument);
+    ASSERT_TRUE(settings.mtu.empty());
+}
+
+TEST(ControlServerTest, CommandGetsResponse) {
+    const std::string path = "/tmp/vpn_control_test.sock";
+    EventLoop loop;
+    std::string received;
+    ControlServer server(path, [&received](const std::string& command) {
+        received = command;
+        return std::string("OK\n");
+    });
+    server.attach(loop);
+    std::thread thread([&loop]() { loop.run(); });
+
+    int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    ASSERT_EQ(0, connect(sd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    const char command[] = "set dns 1.1.1.1\r\n";
+    ASSERT_EQ(ssize_t(sizeof(command) - 1), write(sd, command, sizeof(command) - 1));
+
+    std::string response;
+    char buffer[64];
+    ssize_t length = 0;
+    while((length = read(sd, buffer, sizeof(buffer))) > 0)
+        response.append(buffer, length);
+    close(sd);
+
+    loop.post([&loop]() { loop.stop(); });
+    thread.join();
+    server.detach();
+    unlink(path.c_str());
+    ASSERT_EQ("OK\n", response);
+    ASSERT_EQ("set dns 1.1.1.1", received);
+}
+
+#endif // CONTROL_SERVER_TEST_HPP
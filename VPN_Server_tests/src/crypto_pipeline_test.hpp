@@ -0,0 +1,180 @@
+#ifndef CRYPTO_PIPELINE_TEST_HPP
+#define CRYPTO_PIPELINE_TEST_HPP
+
+#include "../../VPN_Server/src/crypto_pipeline.cpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+RecordKey recordKey(unsigned char value, uint16_t epoch = 1) {
+    RecordKey key;
+    memset(key.key, value, 16);
+    key.keySize = 16;
+    memset(key.salt, value + 1, RecordKey::SALT_SIZE);
+    key.epoch = epoch;
+    return key;
+}
+
+std::string sealRecord(RecordCipher& cipher, uint64_t sequence, const std::string& payload) {
+    std::string record(payload.size() + RecordCipher::OVERHEAD, 0);
+    memcpy(&record[RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE],
+           payload.data(), payload.size());
+    int length = cipher.seal(RecordCipher::APPLICATION_DATA, sequence,
+                             &record[0], payload.size());
+    record.resize(length > 0 ? length : 0);
+    return record;
+}
+
+} // namespace
+
+TEST(RecordCipherTest, SealedRecordOpens) {
+    RecordCipher sealer;
+    RecordCipher opener;
+    ASSERT_TRUE(sealer.setKey(recordKey(7)));
+    ASSERT_TRUE(opener.setKey(recordKey(7)));
+
+    std::string record = sealRecord(sealer, 0x123456789A, "packet");
+    ASSERT_EQ(6 + RecordCipher::OVERHEAD, (int)record.size());
+    RecordHeader header;
+    ASSERT_TRUE(RecordCipher::parseHeader(record.data(), record.size(), header));
+    ASSERT_EQ(RecordCipher::APPLICATION_DATA, header.type);
+    ASSERT_EQ(1, header.epoch);
+    ASSERT_EQ(0x123456789Au, header.sequence);
+    ASSERT_EQ(record.size() - RecordCipher::HEADER_SIZE, header.length);
+
+    uint64_t sequence = 0;
+    ASSERT_EQ(6, opener.open(&record[0], record.size(), sequence));
+    ASSERT_EQ(0x123456789Au, sequence);
+    ASSERT_EQ("packet", record.substr(RecordCipher::HEADER_SIZE +
+                                      RecordCipher::NONCE_SIZE, 6));
+}
+
+TEST(RecordCipherTest, ForgedRecordsAreRejected) {
+    RecordCipher sealer;
+    RecordCipher opener;
+    RecordCipher otherEpoch;
+    ASSERT_TRUE(sealer.setKey(recordKey(7)));
+    ASSERT_TRUE(opener.setKey(recordKey(7)));
+    ASSERT_TRUE(otherEpoch.setKey(recordKey(7, 2)));
+    uint64_t sequence = 0;
+
+    std::string record = sealRecord(sealer, 5, "packet");
+    std::string forged = record;
+    forged[RecordCipher::HEADER_SIZE + RecordCipher::NONCE_SIZE] ^= 1;
+    ASSERT_EQ(-1, opener.open(&forged[0], forged.size(), sequence));
+    forged = record;
+    forged[10] ^= 1; // sequence number is authenticated
+    ASSERT_EQ(-1, opener.open(&forged[0], forged.size(), sequence));
+    forged = record;
+    ASSERT_EQ(-1, otherEpoch.open(&forged[0], forged.size(), sequence));
+    ASSERT_EQ(-1, opener.open(&forged[0], RecordCipher::HEADER_SIZE, sequence));
+    ASSERT_EQ(6, opener.open(&record[0], record.size(), sequence));
+}
+
+TEST(ReplayWindowTest, RecordsAreAcceptedOnce) {
+    ReplayWindow window(100);
+    ASSERT_FALSE(window.accept(100));
+    ASSERT_FALSE(window.accept(50));
+    ASSERT_TRUE(window.accept(105));
+    ASSERT_TRUE(window.accept(103)); // reordered
+    ASSERT_FALSE(window.accept(103));
+    ASSERT_TRUE(window.accept(101));
+    ASSERT_FALSE(window.accept(99)); // counted as received
+    ASSERT_TRUE(window.accept(105 + ReplayWindow::SIZE));
+    ASSERT_FALSE(window.accept(104)); // out of the window
+    ASSERT_TRUE(window.accept(106));
+}
+
+/**
+ * @brief The CryptoPipelineTest class - records of a client sealed
+ * and opened by pipelines with a pool of four threads
+ */
+class CryptoPipelineTest : public testing::Test {
+protected:
+    CryptoPool                pool; // outlives the tasks posted to the loop
+    EventLoop                 loop;
+    TunnelMetrics             metrics;
+    std::vector<std::string>  sealed;
+    std::vector<std::string>  opened;
+    std::vector<std::string>* awaited;
+    size_t                    awaitedCount;
+
+    CryptoPipelineTest() : pool(4), awaited(nullptr), awaitedCount(0) {
+        loop.addFlushHandler([this]() {
+            if(awaited != nullptr && awaited->size() >= awaitedCount)
+                loop.stop();
+        });
+    }
+
+    std::shared_ptr<CryptoPipeline> create(const RecordKey& read, const RecordKey& write) {
+        std::shared_ptr<CryptoPipeline> pipeline =
+                std::make_shared<CryptoPipeline>(pool, loop, metrics, read, write, 1, 0);
+        pipeline->setHandlers([this](char* data, int length) {
+            sealed.emplace_back(data, length);
+        }, [this](char* data, int length) {
+            opened.emplace_back(data, length);
+        });
+        return pipeline;
+    }
+
+    void runUntil(std::vector<std::string>& records, size_t count) {
+        awaited      = &records;
+        awaitedCount = count;
+        loop.run();
+    }
+};
+
+TEST_F(CryptoPipelineTest, RecordsKeepTheirOrder) {
+    std::shared_ptr<CryptoPipeline> server = create(recordKey(1), recordKey(2));
+    ASSERT_TRUE(server->isReady());
+    const size_t count = 10 * CryptoPipeline::BATCH_SIZE + 5;
+    for(size_t i = 0; i < count; ++i) {
+        std::string packet = "packet " + std::to_string(i);
+        ASSERT_TRUE(server->seal(RecordCipher::APPLICATION_DATA,
+                                 packet.data(), packet.size()));
+    }
+    server->dispatch();
+    runUntil(sealed, count);
+
+    ASSERT_EQ(count, sealed.size());
+    std::shared_ptr<CryptoPipeline> client = create(recordKey(2), recordKey(1));
+    for(size_t i = 0; i < count; ++i) {
+        RecordHeader header;
+        ASSERT_TRUE(RecordCipher::parseHeader(sealed[i].data(), sealed[i].size(), header));
+        ASSERT_EQ(i + 1, header.sequence);
+        ASSERT_TRUE(client->accepts(sealed[i].data(), sealed[i].size()));
+        ASSERT_TRUE(client->open(sealed[i].data(), sealed[i].size()));
+    }
+    client->open(sealed[3].data(), sealed[3].size()); // replayed
+    client->dispatch();
+    runUntil(opened, count);
+
+    ASSERT_EQ(count, opened.size());
+    for(size_t i = 0; i < count; ++i)
+        ASSERT_EQ("packet " + std::to_string(i), opened[i]);
+    ASSERT_EQ(1u, client->getDropped());
+    ASSERT_EQ(2u, pool.pipelinesCount());
+}
+
+TEST_F(CryptoPipelineTest, FullPipelineDropsRecords) {
+    std::shared_ptr<CryptoPipeline> server = create(recordKey(1), recordKey(2));
+    char packet[CryptoPipeline::MAX_PAYLOAD + 1] = { 1 };
+    ASSERT_FALSE(server->seal(RecordCipher::APPLICATION_DATA, packet, sizeof(packet)));
+
+    // the worker doesn't collect the done batches:
+    const size_t capacity = CryptoPipeline::MAX_IN_FLIGHT * CryptoPipeline::BATCH_SIZE;
+    size_t accepted = 0;
+    for(size_t i = 0; i < 2 * capacity; ++i) {
+        if(server->seal(RecordCipher::APPLICATION_DATA, packet, 100))
+            ++accepted;
+    }
+    ASSERT_EQ(capacity, accepted);
+    ASSERT_EQ(capacity + 1, server->getDropped());
+    server->close();
+    ASSERT_FALSE(server->seal(RecordCipher::APPLICATION_DATA, packet, 100));
+}
+
+#endif // CRYPTO_PIPELINE_TEST_HPP
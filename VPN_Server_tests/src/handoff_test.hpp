@@ -0,0 +1,135 @@
+#ifndef HANDOFF_TEST_HPP
+#define HANDOFF_TEST_HPP
+
+#include "../../VPN_Server/src/handoff.cpp"
+#include <gtest/gtest.h>
+
+/**
+ * @brief testState - two workers, a ready interface,
+ * a tunnel with its own interface and a held lease
+ */
+HandoffState testState(int listener1, int listener2, int interface) {
+    HandoffState state;
+    state.port = "8000";
+    state.listeners.push_back(listener1);
+    state.listeners.push_back(listener2);
+
+    TunInterface ready;
+    ready.number     = 3;
+    ready.name       = "vpn_tun3";
+    ready.serverAddr = inet_addr("10.0.0.7");
+    ready.clientAddr = inet_addr("10.0.0.8");
+    state.readyInterfaces.push_back(ready);
+
+    HandoffTunnel tunnel;
+    tunnel.worker = 1;
+    tunnel.peer.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::ffff:192.0.2.10", &tunnel.peer.sin6_addr);
+    tunnel.peer.sin6_port   = htons(40000);
+    tunnel.interface        = interface;
+    tunnel.iface.number     = 1;
+    tunnel.iface.name       = "vpn_tun1";
+    tunnel.iface.serverAddr = inet_addr("10.0.0.3");
+    tunnel.iface.clientAddr = inet_addr("10.0.0.4");
+    tunnel.controlSequence  = 513;
+    tunnel.mtu              = 1380;
+    inet_pton(AF_INET6, "fd00:1:0:4::1", &tunnel.clientAddr6);
+    tunnel.clientPrefix6    = 64;
+    tunnel.session          = std::string("\x01\x00\x02", 3);
+    state.tunnels.push_back(tunnel);
+
+    HandoffLease lease;
+    lease.identity   = "::ffff:192.0.2.11";
+    lease.clientAddr = inet_addr("10.0.0.9");
+    lease.holdTime   = 3599;
+    state.leases.push_back(lease);
+    return state;
+}
+
+TEST(HandoffTest, StateIsDecodedAsEncoded) {
+    std::vector<int> fds;
+    std::string data = Handoff::encode(testState(10, 11, 12), fds);
+    ASSERT_EQ(3u, fds.size());
+
+    std::vector<int> received = { 20, 21, 22 };
+    HandoffState state;
+    Handoff::decode(data, received, state);
+    ASSERT_EQ("8000", state.port);
+    ASSERT_EQ(0u, state.sharedServerAddr);
+    ASSERT_EQ(std::vector<int>({ 20, 21 }), state.listeners);
+    ASSERT_EQ(1u, state.readyInterfaces.size());
+    ASSERT_EQ("vpn_tun3", state.readyInterfaces[0].name);
+    ASSERT_EQ(inet_addr("10.0.0.8"), state.readyInterfaces[0].clientAddr);
+
+    ASSERT_EQ(1u, state.tunnels.size());
+    const HandoffTunnel& tunnel = state.tunnels[0];
+    ASSERT_EQ(1u, tunnel.worker);
+    ASSERT_EQ(22, tunnel.interface);
+    ASSERT_EQ(40000, ntohs(tunnel.peer.sin6_port));
+    ASSERT_EQ(1u, tunnel.iface.number);
+    ASSERT_EQ(inet_addr("10.0.0.4"), tunnel.iface.clientAddr);
+    ASSERT_EQ(513, tunnel.controlSequence);
+    ASSERT_EQ(1380, tunnel.mtu);
+    ASSERT_EQ("fd00:1:0:4::1", IP6Manager::getIpString(tunnel.clientAddr6));
+    ASSERT_EQ(64, tunnel.clientPrefix6);
+    ASSERT_EQ(std::string("\x01\x00\x02", 3), tunnel.session);
+
+    ASSERT_EQ(1u, state.leases.size());
+    ASSERT_EQ("::ffff:192.0.2.11", state.leases[0].identity);
+    ASSERT_EQ(inet_addr("10.0.0.9"), state.leases[0].clientAddr);
+    ASSERT_EQ(0, state.leases[0].clientPrefix6);
+    ASSERT_EQ(3599u, state.leases[0].holdTime);
+}
+
+TEST(HandoffTest, BrokenStateIsRejected) {
+    std::vector<int> fds;
+    std::string data = Handoff::encode(testState(10, 11, 12), fds);
+
+    HandoffState state;
+    ASSERT_THROW(Handoff::decode(data.substr(0, data.size() - 1), fds, state),
+                 std::runtime_error);
+    std::vector<int> missing = { 20, 21 }; // the tunnel interface is not received
+    HandoffState other;
+    ASSERT_THROW(Handoff::decode(data, missing, other), std::runtime_error);
+}
+
+TEST(HandoffTest, DescriptorsArePassedToThePeer) {
+    int pair[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair));
+    int pipes[3][2];
+    for(int i = 0; i < 3; ++i)
+        ASSERT_EQ(0, pipe(pipes[i]));
+
+    // the write ends are passed, the test reads what the peer writes:
+    Handoff::send(pair[0], testState(pipes[0][1], pipes[1][1], pipes[2][1]));
+    HandoffState state;
+    Handoff::receive(pair[1], state);
+    ASSERT_EQ(2u, state.listeners.size());
+    ASSERT_EQ(1u, state.tunnels.size());
+
+    ASSERT_EQ(1, write(state.tunnels[0].interface, "x", 1));
+    char byte = 0;
+    ASSERT_EQ(1, read(pipes[2][0], &byte, 1));
+    ASSERT_EQ('x', byte);
+
+    Handoff::sendAck(pair[1]);
+    ASSERT_TRUE(Handoff::waitAck(pair[0]));
+    close(pair[1]);
+    ASSERT_FALSE(Handoff::waitAck(pair[0]));
+
+    state.closeDescriptors();
+    close(pair[0]);
+    for(int i = 0; i < 3; ++i) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+}
+
+TEST(HandoffTest, NoServerOnPath) {
+    ASSERT_EQ(-1, Handoff::connect("/tmp/vpn_handoff_test_no_server"));
+    ASSERT_FALSE(Handoff::isValidPath(""));
+    ASSERT_FALSE(Handoff::isValidPath(std::string(sizeof(sockaddr_un::sun_path), 'a')));
+    ASSERT_THROW(Handoff::listen(""), std::invalid_argument);
+}
+
+#endif // HANDOFF_TEST_HPP
@@ -0,0 +1,168 @@
+#ifndef IO_ENGINE_TEST_HPP
+#define IO_ENGINE_TEST_HPP
+
+#include "../../VPN_Server/src/io_engine.cpp"
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+
+class IoEngineTest : public testing::TestWithParam<const char*> {
+protected:
+    void SetUp() {
+        try {
+            engine = IoEngine::create(GetParam());
+        } catch (const std::runtime_error& e) {
+            engine = nullptr; // io_uring is disabled on this host
+        }
+        ASSERT_EQ(0, pipe(fds));
+        ASSERT_EQ(0, pipe(others));
+    }
+    void TearDown() {
+        delete engine;
+        close(fds[0]);
+        close(fds[1]);
+        close(others[0]);
+        close(others[1]);
+    }
+
+    static bool contains(const std::vector<IoEvent>& events,
+                         int fd, uint32_t mask) {
+        for(const IoEvent& event : events) {
+            if(event.fd == fd && (event.events & mask))
+                return true;
+        }
+        return false;
+    }
+
+    IoEngine* engine;
+    int       fds[2];
+    int       others[2];
+};
+
+TEST_P(IoEngineTest, ReadinessIsLevelTriggered) {
+    if(engine == nullptr)
+        return;
+    std::vector<IoEvent> events;
+    engine->add(fds[0], EPOLLIN);
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+
+    engine->wait(events);
+    ASSERT_TRUE(contains(events, fds[0], EPOLLIN));
+
+    // not read yet: reported again
+    engine->wait(events);
+    ASSERT_TRUE(contains(events, fds[0], EPOLLIN));
+}
+
+TEST_P(IoEngineTest, ModifiedMaskIsUsed) {
+    if(engine == nullptr)
+        return;
+    std::vector<IoEvent> events;
+    engine->add(fds[1], 0);
+    engine->add(others[0], EPOLLIN);
+    engine->modify(fds[1], EPOLLOUT);
+    ASSERT_EQ(1, write(others[1], "x", 1));
+
+    // the write end of an empty pipe is writable
+    for(int i = 0; i < 3 && !contains(events, fds[1], EPOLLOUT); ++i)
+        engine->wait(events);
+    ASSERT_TRUE(contains(events, fds[1], EPOLLOUT));
+}
+
+TEST_P(IoEngineTest, RemovedDescriptorIsNotReported) {
+    if(engine == nullptr)
+        return;
+    std::vector<IoEvent> events;
+    engine->add(fds[0], EPOLLIN);
+    engine->add(others[0], EPOLLIN);
+    engine->remove(fds[0]);
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+    ASSERT_EQ(1, write(others[1], "x", 1));
+
+    engine->wait(events);
+    ASSERT_TRUE(contains(events, others[0], EPOLLIN));
+    ASSERT_FALSE(contains(events, fds[0], EPOLLIN));
+}
+
+INSTANTIATE_TEST_CASE_P(Engines, IoEngineTest,
+                        testing::Values("epoll", "io_uring"));
+
+TEST(IoEngineName, UnknownNameException) {
+    ASSERT_FALSE(IoEngine::isEngineName("kqueue"));
+    ASSERT_THROW(IoEngine::create("kqueue"), std::invalid_argument);
+    ASSERT_THROW(IoEngine::setDefault("kqueue"), std::invalid_argument);
+    ASSERT_EQ("epoll", IoEngine::getDefault());
+}
+
+/**
+ * @brief The Datagrams class - collects datagrams of a multishot receive
+ */
+class Datagrams : public UringRequest {
+public:
+    BufferRing*              ring;
+    std::vector<std::string> received;
+
+    void complete(int result, uint32_t flags) override {
+        if(!(flags & IORING_CQE_F_BUFFER))
+            return;
+        uint16_t id  = flags >> IORING_CQE_BUFFER_SHIFT;
+        char*    buf = ring->buffer(id);
+        size_t   header = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in);
+        received.push_back(std::string(buf + header, result - header));
+        ring->recycle(id);
+    }
+};
+
+TEST(UringEngineTest, MultishotReceiveUsesPoolBuffers) {
+    UringEngine* engine = nullptr;
+    try {
+        engine = new UringEngine;
+    } catch (const std::runtime_error& e) {
+        return; // io_uring is disabled on this host
+    }
+
+    int receiverSd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int senderSd   = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    ASSERT_EQ(0, bind(receiverSd, (sockaddr *)&addr, sizeof(addr)));
+    ASSERT_EQ(0, getsockname(receiverSd, (sockaddr *)&addr, &length));
+
+    {
+        PacketPool pool(2048, 4);
+        BufferRing ring(*engine, pool, 7, 4);
+        ASSERT_EQ(4u, pool.getStats().inUse);
+
+        Datagrams datagrams;
+        datagrams.ring = &ring;
+        msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_namelen = sizeof(sockaddr_in);
+        engine->recvMultishot(receiverSd, &header, ring.getGroup(), &datagrams);
+
+        // more datagrams than buffers: the buffers are recycled
+        std::vector<IoEvent> events;
+        for(int i = 0; i < 10; ++i) {
+            std::string data = "datagram " + std::to_string(i);
+            sendto(senderSd, data.data(), data.size(), 0,
+                   (sockaddr *)&addr, sizeof(addr));
+            engine->wait(events);
+        }
+
+        ASSERT_EQ(10u, datagrams.received.size());
+        ASSERT_EQ("datagram 0", datagrams.received[0]);
+        ASSERT_EQ("datagram 9", datagrams.received[9]);
+        ASSERT_TRUE(events.empty());
+
+        ASSERT_THROW(new BufferRing(*engine, pool, 8, 3), std::invalid_argument);
+    }
+    // the receive is still armed, it is cancelled by closing the ring
+    delete engine;
+    close(receiverSd);
+    close(senderSd);
+}
+
+#endif // IO_ENGINE_TEST_HPP
@@ -3,6 +3,7 @@
 
 #include "../../VPN_Server/src/ip_manager.cpp"
 #include <gtest/gtest.h>
+#include <set>
 
 class IPManagerTest : public testing::Test {
 protected:
@@ -62,4 +63,240 @@ TEST_F(IPManagerTest, TestGetAddrFromPool) {
 
 }
 
+TEST_F(IPManagerTest, TestReturnAddrToPool) {
+    in_addr_t first  = mgr->getAddrFromPool();
+    in_addr_t second = mgr->getAddrFromPool();
+    mgr->returnAddrToPool(first);
+    mgr->returnAddrToPool(first); // second return is ignored
+    ASSERT_EQ(1, mgr->usedAddrCount());
+    ASSERT_EQ(first, mgr->getAddrFromPool());
+    ASSERT_EQ(htonl(ntohl(second) + 1), mgr->getAddrFromPool());
+}
+
+TEST_F(IPManagerTest, TestReserveAddr) {
+    ASSERT_TRUE(mgr->reserveAddr(inet_addr("10.0.0.1")));
+    ASSERT_FALSE(mgr->reserveAddr(inet_addr("10.0.0.1")));
+    ASSERT_FALSE(mgr->reserveAddr(inet_addr("10.0.0.0")));       // network
+    ASSERT_FALSE(mgr->reserveAddr(inet_addr("10.255.255.255"))); // broadcast
+    ASSERT_FALSE(mgr->reserveAddr(inet_addr("192.168.0.1")));
+    ASSERT_EQ(mgr->getAddrFromPool(), inet_addr("10.0.0.2"));
+}
+
+TEST_F(IPManagerTest, TestLeases) {
+    in_addr_t ip = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.10", ip);
+    ASSERT_EQ(0, mgr->getLeasedAddr("192.168.1.10")); // still in use
+    ASSERT_EQ(0, mgr->getLeasedAddr("192.168.1.11"));
+
+    // another connection of the client took the lease:
+    in_addr_t other = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.10", other);
+    ASSERT_FALSE(mgr->releaseLease("192.168.1.10", ip));
+    mgr->returnAddrToPool(ip);
+
+    ASSERT_TRUE(mgr->releaseLease("192.168.1.10", other));
+    ASSERT_EQ(1, mgr->usedAddrCount()); // kept by the lease
+    ASSERT_EQ(other, mgr->getLeasedAddr("192.168.1.10"));
+    ASSERT_EQ(0, mgr->getLeasedAddr("192.168.1.10"));
+}
+
+TEST_F(IPManagerTest, TestLeasedAddrIsKeptForGoneClient) {
+    in_addr_t first = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.10", first);
+    ASSERT_TRUE(mgr->releaseLease("192.168.1.10", first));
+
+    // another client connects meanwhile:
+    ASSERT_EQ(0, mgr->getLeasedAddr("192.168.1.11"));
+    in_addr_t second = mgr->getAddrFromPool();
+    ASSERT_NE(first, second);
+    mgr->setLease("192.168.1.11", second);
+
+    ASSERT_EQ(first, mgr->getLeasedAddr("192.168.1.10"));
+}
+
+TEST_F(IPManagerTest, TestLeaseExpiry) {
+    in_addr_t ip = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.10", ip);
+    mgr->releaseLease("192.168.1.10", ip);
+    auto now = std::chrono::steady_clock::now();
+
+    mgr->holdLease("192.168.1.10", std::chrono::seconds(60));
+    ASSERT_FALSE(mgr->expireLease("192.168.1.10", now)); // hold time is not over
+    ASSERT_TRUE(mgr->expireLease("192.168.1.10", now + std::chrono::seconds(61)));
+    ASSERT_EQ(0, mgr->getLeasedAddr("192.168.1.10"));
+    ASSERT_EQ(0, mgr->leasesCount());
+
+    // the client came back before the lease expired:
+    ip = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.11", ip);
+    mgr->releaseLease("192.168.1.11", ip);
+    mgr->holdLease("192.168.1.11", std::chrono::seconds(60));
+    ASSERT_EQ(ip, mgr->getLeasedAddr("192.168.1.11"));
+    ASSERT_FALSE(mgr->expireLease("192.168.1.11", now + std::chrono::seconds(61)));
+    ASSERT_EQ(1, mgr->leasesCount());
+}
+
+TEST_F(IPManagerTest, TestHeldAddrIsFreeOnlyAfterExpiry) {
+    IPManager small("192.168.0.0/30");
+    in_addr_t ip = small.getAddrFromPool();
+    small.setLease("192.168.1.10", ip);
+    ASSERT_TRUE(small.releaseLease("192.168.1.10", ip));
+    auto now = std::chrono::steady_clock::now();
+
+    small.holdLease("192.168.1.10", std::chrono::seconds(60));
+    ASSERT_FALSE(small.reserveAddr(ip)); // still kept by the lease
+    ASSERT_NE(ip, small.getAddrFromPool());
+
+    ASSERT_TRUE(small.expireLease("192.168.1.10", now + std::chrono::seconds(61)));
+    ASSERT_TRUE(small.reserveAddr(ip));
+}
+
+TEST_F(IPManagerTest, TestGoneLeasesAreRestored) {
+    in_addr_t ip = mgr->getAddrFromPool();
+    mgr->setLease("192.168.1.10", ip);
+    mgr->releaseLease("192.168.1.10", ip);
+    mgr->holdLease("192.168.1.10", std::chrono::seconds(60));
+
+    IPManager next("10.0.0.0/8");
+    mgr->getGoneLeases([&next](const std::string& identity, in_addr_t ip,
+                               std::chrono::seconds holdTime) {
+        ASSERT_GT(holdTime.count(), 0);
+        ASSERT_LE(holdTime.count(), 60);
+        ASSERT_TRUE(next.restoreLease(identity, ip, holdTime));
+    });
+    ASSERT_EQ(1, next.leasesCount());
+    ASSERT_FALSE(next.reserveAddr(ip));
+    ASSERT_FALSE(next.restoreLease("192.168.1.11", ip, std::chrono::seconds(0)));
+
+    auto later = std::chrono::steady_clock::now() + std::chrono::seconds(61);
+    ASSERT_TRUE(next.expireLease("192.168.1.10", later));
+    ASSERT_TRUE(next.reserveAddr(ip));
+}
+
+TEST(IPManagerShardsTest, TestExhaustSmallNetwork) {
+    IPManager small("192.168.0.0/24", 4);
+    std::set<in_addr_t> given;
+    for(size_t i = 0; i < 254; ++i) {
+        in_addr_t ip = small.getAddrFromPool();
+        ASSERT_TRUE(small.isInRange(ip));
+        ASSERT_TRUE(given.insert(ip).second);
+    }
+    ASSERT_EQ(0, small.getAddrFromPool());
+    ASSERT_EQ(0, given.count(inet_addr("192.168.0.0")));
+    ASSERT_EQ(0, given.count(inet_addr("192.168.0.255")));
+
+    small.returnAddrToPool(inet_addr("192.168.0.77"));
+    ASSERT_EQ(inet_addr("192.168.0.77"), small.getAddrFromPool());
+}
+
+TEST(IPManagerShardsTest, TestExhaustedPoolTakesOldestLease) {
+    IPManager small("192.168.0.0/30", 1); // two hosts
+    in_addr_t first  = small.getAddrFromPool();
+    in_addr_t second = small.getAddrFromPool();
+    small.setLease("192.168.1.10", first);
+    small.setLease("192.168.1.11", second);
+    ASSERT_EQ(0, small.getAddrFromPool());
+
+    small.releaseLease("192.168.1.11", second);
+    small.releaseLease("192.168.1.10", first);
+    ASSERT_EQ(second, small.getAddrFromPool()); // gone for longer
+    ASSERT_EQ(0, small.getLeasedAddr("192.168.1.11"));
+    ASSERT_EQ(first, small.getLeasedAddr("192.168.1.10"));
+    ASSERT_EQ(0, small.getAddrFromPool());
+}
+
+TEST(IPManagerShardsTest, TestBitmapLevels) {
+    AddressBitmap bitmap(64 * 64 + 5); // three levels
+    size_t index = 0;
+    for(size_t i = 0; i < 64 * 64 + 5; ++i) {
+        ASSERT_TRUE(bitmap.acquire(index));
+        ASSERT_EQ(i, index);
+    }
+    ASSERT_FALSE(bitmap.acquire(index));
+    ASSERT_TRUE(bitmap.release(4100));
+    ASSERT_FALSE(bitmap.release(4100));
+    ASSERT_TRUE(bitmap.acquire(index));
+    ASSERT_EQ(4100, index);
+    ASSERT_EQ(0, bitmap.getFreeCount());
+}
+
+TEST(IP6ManagerTest, ClientsGetPrefixesOfShortNetwork) {
+    IP6Manager mgr("fd00:1::", 48);
+    ASSERT_EQ("fd00:1::/48", mgr.getNetworkString());
+    ASSERT_EQ(64, mgr.getClientPrefix());
+    ASSERT_EQ(65536u, mgr.getCapacity());
+    ASSERT_TRUE(mgr.isUniqueLocal());
+
+    in6_addr first;
+    in6_addr second;
+    ASSERT_TRUE(mgr.acquire("192.168.1.10", first));
+    ASSERT_TRUE(mgr.acquire("192.168.1.11", second));
+    ASSERT_EQ("fd00:1:0:1::1", IP6Manager::getIpString(first));
+    ASSERT_EQ("fd00:1:0:2::1", IP6Manager::getIpString(second));
+    ASSERT_EQ("fd00:1:0:2::/64", IP6Manager::getPrefixString(second, 64));
+    ASSERT_EQ(2u, mgr.usedCount());
+
+    size_t index = 0;
+    ASSERT_TRUE(mgr.indexOf(second, index));
+    ASSERT_EQ(2u, index);
+    in6_addr other;
+    ASSERT_TRUE(IP6Manager::parse("fd00:2::1", other));
+    ASSERT_FALSE(mgr.indexOf(other, index));
+}
+
+TEST(IP6ManagerTest, ClientsGetAddressesOfLongNetwork) {
+    IP6Manager mgr("2001:db8::", 120);
+    ASSERT_EQ(128, mgr.getClientPrefix());
+    ASSERT_EQ(256u, mgr.getCapacity());
+    ASSERT_FALSE(mgr.isUniqueLocal());
+
+    in6_addr address;
+    for(size_t i = 1; i < 256; ++i)
+        ASSERT_TRUE(mgr.acquire(std::to_string(i), address));
+    ASSERT_EQ("2001:db8::ff", IP6Manager::getIpString(address));
+    ASSERT_FALSE(mgr.acquire("256", address));
+
+    mgr.release("255", address);
+    ASSERT_EQ(255u, mgr.usedCount()); // kept by the lease
+    in6_addr reclaimed;
+    ASSERT_TRUE(mgr.acquire("256", reclaimed)); // the lease of the gone client is taken
+    ASSERT_EQ(IP6Manager::getIpString(address), IP6Manager::getIpString(reclaimed));
+
+    mgr.release("256", reclaimed);
+    mgr.holdLease("256", std::chrono::seconds(0));
+    ASSERT_TRUE(mgr.expireLease("256"));
+    ASSERT_EQ(254u, mgr.usedCount());
+    ASSERT_TRUE(mgr.reserve("other", address));
+    ASSERT_FALSE(mgr.reserve("other", address));
+}
+
+TEST(IP6ManagerTest, LeasedPrefixComesBack) {
+    IP6Manager mgr("fd00:1::", 48);
+    in6_addr first;
+    in6_addr second;
+    in6_addr address;
+    ASSERT_TRUE(mgr.acquire("192.168.1.10", first));
+    ASSERT_TRUE(mgr.acquire("192.168.1.11", second));
+    mgr.release("192.168.1.10", first);
+    mgr.release("192.168.1.11", second);
+    mgr.holdLease("192.168.1.11", std::chrono::seconds(60));
+
+    // a new client doesn't get the prefixes of the gone clients:
+    ASSERT_TRUE(mgr.acquire("192.168.1.12", address));
+    ASSERT_NE(IP6Manager::getIpString(first), IP6Manager::getIpString(address));
+    ASSERT_NE(IP6Manager::getIpString(second), IP6Manager::getIpString(address));
+
+    ASSERT_TRUE(mgr.acquire("192.168.1.11", address));
+    ASSERT_EQ(IP6Manager::getIpString(second), IP6Manager::getIpString(address));
+    ASSERT_FALSE(mgr.expireLease("192.168.1.11",
+                                 std::chrono::steady_clock::now() + std::chrono::hours(1)));
+    ASSERT_EQ(3u, mgr.leasesCount());
+}
+
+TEST(IP6ManagerTest, WrongNetworkExceptionThrown) {
+    ASSERT_THROW(IP6Manager("fd00:1::", 125), std::invalid_argument);
+    ASSERT_THROW(IP6Manager("fd00:1::", -1), std::invalid_argument);
+    ASSERT_THROW(IP6Manager("10.0.0.0", 48), std::invalid_argument);
+}
+
 #endif // IP_MANAGER_TEST_HPP
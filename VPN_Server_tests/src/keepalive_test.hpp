@@ -0,0 +1,79 @@
+#ifndef KEEPALIVE_TEST_HPP
+#define KEEPALIVE_TEST_HPP
+
+#include "../../VPN_Server/src/keepalive.cpp"
+#include <gtest/gtest.h>
+
+class KeepaliveTest : public testing::Test {
+protected:
+    Keepalive::TimePoint now;
+
+    void SetUp() {
+        now = std::chrono::steady_clock::now();
+        Keepalive::configure(10, 80);
+    }
+    void TearDown() {
+        Keepalive::configure(Keepalive::DEFAULT_INTERVAL, Keepalive::DEFAULT_INTERVAL);
+    }
+};
+
+TEST_F(KeepaliveTest, AnsweredProbesGrowInterval) {
+    Keepalive keepalive;
+    ASSERT_EQ(10000, keepalive.getInterval().count());
+
+    ASSERT_FALSE(keepalive.onSent(now, false)); // the client is not quiet
+    for(int interval : { 20000, 40000, 80000 }) {
+        ASSERT_TRUE(keepalive.onSent(now, true));
+        ASSERT_TRUE(keepalive.onAck());
+        ASSERT_EQ(interval, keepalive.getInterval().count());
+    }
+    ASSERT_TRUE(keepalive.onSent(now, true));
+    ASSERT_FALSE(keepalive.onAck()); // the longest one is confirmed
+    ASSERT_FALSE(keepalive.onSent(now, true));
+}
+
+TEST_F(KeepaliveTest, LostProbeFallsBack) {
+    Keepalive keepalive;
+    ASSERT_TRUE(keepalive.onSent(now, true));
+    ASSERT_TRUE(keepalive.onAck());
+    ASSERT_TRUE(keepalive.onSent(now, true)); // 20 s
+
+    ASSERT_FALSE(keepalive.onTimeout(now));
+    ASSERT_TRUE(keepalive.onTimeout(now + std::chrono::milliseconds(Keepalive::ACK_TIMEOUT)));
+    ASSERT_EQ(10000, keepalive.getInterval().count());
+    ASSERT_FALSE(keepalive.isProbing());
+    ASSERT_FALSE(keepalive.onSent(now, true)); // settled
+}
+
+TEST_F(KeepaliveTest, FixedIntervalDoesNotProbe) {
+    Keepalive::configure(25, 25);
+    Keepalive keepalive;
+    ASSERT_FALSE(Keepalive::isAdaptive());
+    ASSERT_FALSE(keepalive.onSent(now, true));
+    ASSERT_EQ(25000, keepalive.getInterval().count());
+    ASSERT_EQ(Keepalive::TIMEOUT_LIMIT, Keepalive::getDeadPeerTimeout().count());
+}
+
+TEST_F(KeepaliveTest, DeadPeerTimeoutCoversLongestInterval) {
+    ASSERT_GT(Keepalive::getDeadPeerTimeout().count(), 2 * 80000);
+}
+
+TEST(KeepaliveOption, Parse) {
+    int low  = 0;
+    int high = 0;
+    ASSERT_TRUE(Keepalive::parse("15", low, high));
+    ASSERT_EQ(15, low);
+    ASSERT_EQ(15, high);
+    ASSERT_TRUE(Keepalive::parse("10:120", low, high));
+    ASSERT_EQ(10, low);
+    ASSERT_EQ(120, high);
+
+    ASSERT_FALSE(Keepalive::parse("", low, high));
+    ASSERT_FALSE(Keepalive::parse("0", low, high));
+    ASSERT_FALSE(Keepalive::parse("30:10", low, high));
+    ASSERT_FALSE(Keepalive::parse("10:", low, high));
+    ASSERT_FALSE(Keepalive::parse("10:9999", low, high));
+    ASSERT_FALSE(Keepalive::parse("-5", low, high));
+}
+
+#endif // KEEPALIVE_TEST_HPP
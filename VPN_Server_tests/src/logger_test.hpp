@@ -0,0 +1,72 @@
+#ifndef LOGGER_TEST_HPP
+#define LOGGER_TEST_HPP
+
+#include "../../VPN_Server/src/logger.cpp"
+#include <gtest/gtest.h>
+
+TEST(LogRingTest, MessagesAreReadInOrder) {
+    LogRing* ring = new LogRing;
+    LogRecord record;
+
+    ASSERT_TRUE(ring->push(Logger::INFO, "first"));
+    ASSERT_TRUE(ring->push(Logger::ERROR, "second"));
+    ASSERT_TRUE(ring->pop(record));
+    ASSERT_EQ("first", std::string(record.text, record.length));
+    ASSERT_TRUE(ring->pop(record));
+    ASSERT_EQ(Logger::ERROR, record.level);
+    ASSERT_FALSE(ring->pop(record));
+    ASSERT_TRUE(ring->empty());
+    delete ring;
+}
+
+TEST(LogRingTest, FullRingDropsMessages) {
+    LogRing* ring = new LogRing;
+    for(size_t i = 0; i < LogRing::CAPACITY; ++i)
+        ASSERT_TRUE(ring->push(Logger::INFO, "message"));
+
+    ASSERT_FALSE(ring->push(Logger::INFO, "lost"));
+    ASSERT_EQ(1u, ring->takeDropped());
+    ASSERT_EQ(0u, ring->takeDropped());
+    delete ring;
+}
+
+TEST(LogRingTest, LongMessageIsTruncated) {
+    LogRing* ring = new LogRing;
+    LogRecord record;
+    ring->push(Logger::INFO, std::string(1000, 'x'));
+    ASSERT_TRUE(ring->pop(record));
+    ASSERT_EQ(LogRecord::TEXT_SIZE, record.length);
+    delete ring;
+}
+
+TEST(LogLimiterTest, RepeatedMessagesAreSuppressed) {
+    LogLimiter limiter(3);
+    uint32_t suppressed = 0;
+    size_t allowed = 0;
+    for(int i = 0; i < 100; ++i) {
+        if(limiter.allow(suppressed))
+            ++allowed;
+    }
+    // the second may change during the loop
+    ASSERT_GE(allowed, 3u);
+    ASSERT_LE(allowed, 6u);
+}
+
+TEST(LoggerTest, DebugIsCompiledOutByDefault) {
+    ASSERT_FALSE(Logger::enabled(Logger::DEBUG));
+    ASSERT_TRUE(Logger::enabled(Logger::INFO));
+    ASSERT_TRUE(Logger::enabled(Logger::ERROR));
+}
+
+TEST(LoggerTest, MessagesOfExitedThreadsAreWritten) {
+    testing::internal::CaptureStdout();
+    std::thread thread([]() {
+        Logger::instance().write(Logger::INFO, "message from exited thread");
+    });
+    thread.join();
+    Logger::instance().flush();
+    std::string output = testing::internal::GetCapturedStdout();
+    ASSERT_NE(std::string::npos, output.find("<INFO> message from exited thread"));
+}
+
+#endif // LOGGER_TEST_HPP
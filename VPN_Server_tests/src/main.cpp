@@ -1,4 +1,22 @@
+#include "logger_test.hpp"
 #include "ip_manager_test.hpp"
+#include "tun_device_test.hpp"
+#include "packet_pool_test.hpp"
+#include "route_table_test.hpp"
+#include "metrics_test.hpp"
+#include "session_cache_test.hpp"
+#include "cipher_suites_test.hpp"
+#include "xfrm_offload_test.hpp"
+#include "io_engine_test.hpp"
+#include "control_message_test.hpp"
+#include "path_mtu_test.hpp"
+#include "timer_wheel_test.hpp"
+#include "keepalive_test.hpp"
+#include "crypto_pipeline_test.hpp"
+#include "packet_filter_test.hpp"
+#include "traffic_shaper_test.hpp"
+#include "handoff_test.hpp"
+#include "control_server_test.hpp"
 #include "vpn_server_test.hpp"
 
 int main(int argc, char *argv[]) {
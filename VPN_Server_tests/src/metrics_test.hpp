@@ -0,0 +1,102 @@
+#ifndef METRICS_TEST_HPP
+#define METRICS_TEST_HPP
+
+#include "../../VPN_Server/src/metrics.cpp"
+#include <gtest/gtest.h>
+
+TEST(HistogramTest, SmallValuesHaveOwnBuckets) {
+    for(uint64_t value = 0; value < Histogram::SUB_BUCKETS; ++value) {
+        ASSERT_EQ(value, Histogram::bucketIndex(value));
+        ASSERT_EQ(value + 1, Histogram::upperBound(value));
+    }
+}
+
+TEST(HistogramTest, ValueIsBelowUpperBoundOfItsBucket) {
+    uint64_t values[] = { 8, 9, 15, 16, 17, 100, 1000, 123456, 10000000 };
+    for(uint64_t value : values) {
+        size_t index = Histogram::bucketIndex(value);
+        ASSERT_LT(value, Histogram::upperBound(index));
+        ASSERT_GE(value, Histogram::upperBound(index - 1));
+    }
+}
+
+TEST(HistogramTest, HugeValuesGoToTheLastBucket) {
+    ASSERT_EQ(Histogram::BUCKETS - 1, Histogram::bucketIndex(~0ULL));
+}
+
+TEST(HistogramTest, Percentiles) {
+    Histogram histogram;
+    for(int i = 0; i < 99; ++i)
+        histogram.record(10);
+    histogram.record(5000);
+
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    histogram.addTo(buckets, count, sum);
+    ASSERT_EQ(100u, count);
+    ASSERT_EQ(99u * 10 + 5000, sum);
+    ASSERT_EQ(Histogram::upperBound(Histogram::bucketIndex(10)),
+              Histogram::percentile(buckets, 0.5));
+    ASSERT_EQ(Histogram::upperBound(Histogram::bucketIndex(5000)),
+              Histogram::percentile(buckets, 1.0));
+}
+
+TEST(MetricsTest, ClosedTunnelsStayInTotals) {
+    Metrics metrics;
+    TunnelMetrics tunnel;
+    tunnel.tunnel = "vpn_tun7";
+    tunnel.client = "10.0.0.3";
+    addCounter(tunnel.rxPackets, 3);
+    addCounter(tunnel.txBytes, 1500);
+
+    metrics.addTunnel(&tunnel);
+    std::string open = metrics.render();
+    ASSERT_NE(std::string::npos, open.find(
+        "vpn_tunnel_packets_total{tunnel=\"vpn_tun7\",client=\"10.0.0.3\","
+        "direction=\"rx\"} 3"));
+    ASSERT_NE(std::string::npos, open.find("vpn_bytes_total{direction=\"tx\"} 1500"));
+
+    metrics.removeTunnel(&tunnel);
+    std::string closed = metrics.render();
+    ASSERT_EQ(std::string::npos, closed.find("vpn_tun7"));
+    ASSERT_NE(std::string::npos, closed.find("vpn_packets_total{direction=\"rx\"} 3"));
+}
+
+TEST(MetricsTest, SslErrorsByCode) {
+    Metrics metrics;
+    metrics.countSslError(-308);
+    metrics.countSslError(-308);
+    metrics.countSslError(1);
+    std::string text = metrics.render();
+    ASSERT_NE(std::string::npos, text.find("vpn_ssl_errors_total{code=\"-308\"} 2"));
+    ASSERT_NE(std::string::npos, text.find("vpn_ssl_errors_total{code=\"other\"} 1"));
+}
+
+TEST(MetricsTest, GaugesAndHistograms) {
+    Metrics metrics;
+    WorkerMetrics worker;
+    worker.handshake.record(2000);
+    metrics.addWorker(&worker);
+    metrics.addGauge("vpn_test_gauge", "Test gauge.", []() { return 42; });
+
+    std::string text = metrics.render();
+    ASSERT_NE(std::string::npos, text.find("# TYPE vpn_test_gauge gauge\nvpn_test_gauge 42"));
+    ASSERT_NE(std::string::npos, text.find("vpn_handshake_duration_seconds_count 1"));
+    ASSERT_NE(std::string::npos, text.find("vpn_handshake_duration_seconds_bucket{le=\"+Inf\"} 1"));
+
+    metrics.clearGauges();
+    metrics.removeWorker(&worker);
+    ASSERT_EQ(std::string::npos, metrics.render().find("vpn_test_gauge"));
+}
+
+TEST(MetricsServerTest, OnlyMetricsPathIsServed) {
+    ASSERT_EQ(0u, MetricsServer::respond("GET /metrics HTTP/1.0\r\n\r\n")
+                  .find("HTTP/1.0 200 OK"));
+    ASSERT_EQ(0u, MetricsServer::respond("GET / HTTP/1.0\r\n\r\n")
+                  .find("HTTP/1.0 404 Not Found"));
+    ASSERT_EQ(0u, MetricsServer::respond("POST /metrics HTTP/1.0\r\n\r\n")
+                  .find("HTTP/1.0 404 Not Found"));
+}
+
+#endif // METRICS_TEST_HPP
@@ -0,0 +1,152 @@
+#ifndef PACKET_FILTER_TEST_HPP
+#define PACKET_FILTER_TEST_HPP
+
+#include "../../VPN_Server/src/packet_filter.cpp"
+#include <gtest/gtest.h>
+
+#include <netinet/ip.h>
+
+/**
+ * @brief The PacketFilterTest class - IPv4 packets of client 10.0.0.2
+ */
+class PacketFilterTest : public testing::Test {
+protected:
+    std::vector<std::string> packets;
+
+    void addPacket(const char* source, const char* destination,
+                   uint8_t protocol = IPPROTO_UDP, uint16_t port = 53,
+                   uint8_t tos = 0, int length = 28) {
+        std::string packet(length, 0);
+        iphdr header;
+        memset(&header, 0, sizeof(header));
+        header.version  = 4;
+        header.ihl      = 5;
+        header.tos      = tos;
+        header.tot_len  = htons(length);
+        header.protocol = protocol;
+        header.saddr    = inet_addr(source);
+        header.daddr    = inet_addr(destination);
+        memcpy(&packet[0], &header, sizeof(header));
+        packet[22] = port >> 8;
+        packet[23] = port & 0xFF;
+        packets.push_back(packet);
+    }
+
+    std::vector<uint8_t> check(const PacketFilter& filter) {
+        std::vector<char*>   data;
+        std::vector<int>     lengths;
+        std::vector<uint8_t> verdicts(packets.size());
+        for(std::string& packet : packets) {
+            data.push_back(&packet[0]);
+            lengths.push_back(packet.size());
+        }
+        filter.check(data.data(), lengths.data(), packets.size(), verdicts.data());
+        return verdicts;
+    }
+};
+
+TEST_F(PacketFilterTest, SpoofedAndMalformedPacketsAreDropped) {
+    PacketFilter filter(inet_addr("10.0.0.2"));
+    addPacket("10.0.0.2", "8.8.8.8");
+    addPacket("10.0.0.3", "8.8.8.8"); // other client
+    addPacket("10.0.0.2", "8.8.8.8");
+    addPacket("10.0.0.2", "8.8.8.8");
+    packets.back()[3] = 100;          // wrong total length
+    addPacket("10.0.0.2", "8.8.8.8"); // in the last incomplete group
+    packets.push_back(std::string(10, 0x45));
+
+    std::vector<uint8_t> verdicts = check(filter);
+    ASSERT_EQ(PacketFilter::NORMAL,    verdicts[0]);
+    ASSERT_EQ(PacketFilter::SPOOFED,   verdicts[1]);
+    ASSERT_EQ(PacketFilter::NORMAL,    verdicts[2]);
+    ASSERT_EQ(PacketFilter::MALFORMED, verdicts[3]);
+    ASSERT_EQ(PacketFilter::NORMAL,    verdicts[4]);
+    ASSERT_EQ(PacketFilter::MALFORMED, verdicts[5]);
+}
+
+TEST_F(PacketFilterTest, Ipv6PacketsNeedClientAddress) {
+    PacketFilter filter(inet_addr("10.0.0.2"));
+    std::string packet(48, 0);
+    packet[0] = 0x60;
+    packet[5] = 8; // payload length
+    in6_addr source;
+    inet_pton(AF_INET6, "fd00::2", &source);
+    memcpy(&packet[8], &source, sizeof(source));
+    packets.push_back(packet);
+    ASSERT_EQ(PacketFilter::SPOOFED, check(filter)[0]);
+
+    filter.setClientAddr6(source);
+    ASSERT_EQ(PacketFilter::NORMAL, check(filter)[0]);
+}
+
+TEST_F(PacketFilterTest, Ipv6PacketsComeFromClientPrefix) {
+    const char* sources[] = { "fd00:1:0:5::1", "fd00:1:0:5:a8b:2c:3d:4e",
+                              "fd00:1:0:6::1" };
+    for(const char* source : sources) {
+        std::string packet(48, 0);
+        packet[0] = 0x60;
+        packet[5] = 8;
+        inet_pton(AF_INET6, source, &packet[8]);
+        packets.push_back(packet);
+    }
+    in6_addr client;
+    inet_pton(AF_INET6, "fd00:1:0:5::1", &client);
+
+    PacketFilter filter(inet_addr("10.0.0.2"));
+    filter.setClientAddr6(client, 64);
+    std::vector<uint8_t> verdicts = check(filter);
+    ASSERT_EQ(PacketFilter::NORMAL,  verdicts[0]);
+    ASSERT_EQ(PacketFilter::NORMAL,  verdicts[1]); // privacy address
+    ASSERT_EQ(PacketFilter::SPOOFED, verdicts[2]);
+
+    AccessPolicy policy;
+    policy.add("allow 0.0.0.0/0");
+    PacketFilter limited(inet_addr("10.0.0.2"), policy.forClient("::1"));
+    limited.setClientAddr6(client, 64);
+    ASSERT_EQ(PacketFilter::DENIED, check(limited)[0]);
+}
+
+TEST_F(PacketFilterTest, DscpGivesClass) {
+    PacketFilter filter(inet_addr("10.0.0.2"));
+    addPacket("10.0.0.2", "8.8.8.8", IPPROTO_UDP, 5060, 46 << 2); // EF
+    addPacket("10.0.0.2", "8.8.8.8", IPPROTO_TCP, 80, 8 << 2);    // CS1
+    addPacket("10.0.0.2", "8.8.8.8", IPPROTO_TCP, 80, 10 << 2);   // AF11
+
+    std::vector<uint8_t> verdicts = check(filter);
+    ASSERT_EQ(PacketFilter::HIGH,   verdicts[0]);
+    ASSERT_EQ(PacketFilter::LOW,    verdicts[1]);
+    ASSERT_EQ(PacketFilter::NORMAL, verdicts[2]);
+}
+
+TEST_F(PacketFilterTest, FirstMatchingRuleWins) {
+    AccessPolicy policy;
+    policy.add("# local networks");
+    policy.add("allow 192.168.1.0/24 tcp 443");
+    policy.add("deny 192.168.0.0/16");
+    policy.add("client 203.0.113.7 deny 8.8.8.8 udp 53 # no other DNS");
+
+    addPacket("10.0.0.2", "192.168.1.10", IPPROTO_TCP, 443);
+    addPacket("10.0.0.2", "192.168.1.10", IPPROTO_TCP, 22);
+    addPacket("10.0.0.2", "8.8.8.8", IPPROTO_UDP, 53);
+
+    PacketFilter common(inet_addr("10.0.0.2"), policy.forClient("::ffff:198.51.100.1"));
+    std::vector<uint8_t> verdicts = check(common);
+    ASSERT_EQ(PacketFilter::NORMAL, verdicts[0]);
+    ASSERT_EQ(PacketFilter::DENIED, verdicts[1]);
+    ASSERT_EQ(PacketFilter::NORMAL, verdicts[2]);
+
+    PacketFilter client(inet_addr("10.0.0.2"), policy.forClient("::ffff:203.0.113.7"));
+    ASSERT_EQ(PacketFilter::DENIED, check(client)[2]);
+}
+
+TEST(AccessPolicyTest, InvalidRuleException) {
+    AccessPolicy policy;
+    ASSERT_THROW(policy.add("permit 10.0.0.0/8"), std::invalid_argument);
+    ASSERT_THROW(policy.add("deny 10.0.0.0/33"), std::invalid_argument);
+    ASSERT_THROW(policy.add("deny 10.0.0.0/8 icmp 7"), std::invalid_argument);
+    ASSERT_THROW(policy.add("client nowhere deny any"), std::invalid_argument);
+    ASSERT_THROW(policy.load("/nonexistent/acl.txt"), std::invalid_argument);
+    ASSERT_TRUE(policy.empty());
+}
+
+#endif // PACKET_FILTER_TEST_HPP
@@ -0,0 +1,113 @@
+#ifndef PACKET_POOL_TEST_HPP
+#define PACKET_POOL_TEST_HPP
+
+#include "../../VPN_Server/src/packet_pool.cpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+class PacketPoolTest : public testing::Test {
+protected:
+    void SetUp() {
+        pool = new PacketPool(1500, 2);
+    }
+    void TearDown() {
+        delete pool;
+    }
+    PacketPool* pool;
+};
+
+TEST_F(PacketPoolTest, PayloadIsCacheLineAligned) {
+    Packet* first  = pool->acquire();
+    Packet* second = pool->acquire();
+
+    ASSERT_EQ(0u, (uintptr_t)first->payload() % PacketPool::CACHE_LINE);
+    ASSERT_EQ(0u, (uintptr_t)second->payload() % PacketPool::CACHE_LINE);
+    ASSERT_GE(first->payload() - first->data, (ptrdiff_t)PacketPool::HEADROOM);
+
+    pool->release(first);
+    pool->release(second);
+}
+
+TEST_F(PacketPoolTest, ReleasedBufferIsReused) {
+    Packet* packet = pool->acquire();
+    pool->release(packet);
+
+    ASSERT_EQ(packet, pool->acquire());
+    ASSERT_EQ(2u, pool->getStats().allocated);
+}
+
+TEST_F(PacketPoolTest, HighWaterMarkIsKept) {
+    Packet* packets[5];
+    for(int i = 0; i < 5; ++i)
+        packets[i] = pool->acquire();
+    for(int i = 0; i < 5; ++i)
+        pool->release(packets[i]);
+
+    ASSERT_EQ(0u, pool->getStats().inUse);
+    ASSERT_EQ(5u, pool->getStats().highWater);
+    ASSERT_EQ(6u, pool->getStats().allocated);
+}
+
+TEST_F(PacketPoolTest, RingIsDrainedInOrder) {
+    PacketRing ring(3); // 4 slots
+    ASSERT_EQ(4u, ring.getSize());
+
+    Packet* packets[5];
+    for(int i = 0; i < 5; ++i) {
+        packets[i] = pool->acquire();
+        packets[i]->length = i;
+    }
+    for(int i = 0; i < 4; ++i)
+        ASSERT_TRUE(ring.push(packets[i], *pool));
+    ASSERT_FALSE(ring.push(packets[4], *pool)); // full
+
+    std::vector<int> lengths;
+    ASSERT_EQ(4u, ring.drain([&lengths](Packet* packet) {
+        lengths.push_back(packet->length);
+    }));
+    ASSERT_EQ(std::vector<int>({0, 1, 2, 3}), lengths);
+    ASSERT_EQ(0u, ring.drain([](Packet*) { FAIL(); }));
+
+    // drained slots are reclaimed by the next push of a full ring:
+    ASSERT_TRUE(ring.push(packets[4], *pool));
+    ASSERT_EQ(1u, pool->getStats().inUse);
+}
+
+TEST_F(PacketPoolTest, RingPassesPacketsBetweenThreads) {
+    const int count = 10000;
+    PacketRing ring(64);
+    std::atomic<bool> failed(false);
+
+    std::thread consumer([&ring, &failed]() {
+        int expected = 0;
+        while(expected < count) {
+            size_t drained = ring.drain([&expected, &failed](Packet* packet) {
+                int value = 0;
+                memcpy(&value, packet->payload(), sizeof(value));
+                if(value != expected++)
+                    failed = true;
+            });
+            if(drained == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    for(int i = 0; i < count; ) {
+        Packet* packet = pool->acquire();
+        memcpy(packet->payload(), &i, sizeof(i));
+        if(ring.push(packet, *pool)) {
+            ++i;
+        } else {
+            pool->release(packet);
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+    ring.reclaim(*pool);
+
+    ASSERT_FALSE(failed);
+    ASSERT_EQ(0u, pool->getStats().inUse);
+    ASSERT_LE(pool->getStats().allocated, 66u); // ring slots and one spare
+}
+
+#endif // PACKET_POOL_TEST_HPP
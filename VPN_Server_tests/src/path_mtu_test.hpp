@@ -0,0 +1,92 @@
+#ifndef PATH_MTU_TEST_HPP
+#define PATH_MTU_TEST_HPP
+
+#include "../../VPN_Server/src/path_mtu.cpp"
+#include <gtest/gtest.h>
+
+/**
+ * @brief The PathMtuTest class - path that carries records up to 'pathMtu'
+ */
+class PathMtuTest : public testing::Test {
+protected:
+    PathMtu::TimePoint now;
+
+    /* runs the search, returns count of sent probes */
+    int discover(PathMtu& search, int pathMtu) {
+        int probes = 0;
+        for(int i = 0; i < 1000 && search.isSearching(); ++i) {
+            int size = search.nextProbe(now);
+            if(size != 0) {
+                ++probes;
+                if(size <= pathMtu)
+                    search.onAck();
+            }
+            now += std::chrono::milliseconds(PathMtu::PROBE_TIMEOUT);
+        }
+        return probes;
+    }
+
+    void SetUp() {
+        now = std::chrono::steady_clock::now();
+    }
+};
+
+TEST_F(PathMtuTest, ConfiguredMtuIsConfirmedByOneProbe) {
+    PathMtu search(1400);
+    ASSERT_EQ(1, discover(search, 1500));
+    ASSERT_EQ(1400, search.getMtu());
+}
+
+TEST_F(PathMtuTest, SmallerPathIsFound) {
+    PathMtu search(1400);
+    ASSERT_EQ(1400, search.getMtu()); // until the search is finished
+    discover(search, 1232);
+    ASSERT_FALSE(search.isSearching());
+    ASSERT_LE(search.getMtu(), 1232);
+    ASSERT_GT(search.getMtu(), 1232 - PathMtu::SEARCH_STEP);
+}
+
+TEST_F(PathMtuTest, LostProbeIsSentAgain) {
+    PathMtu search(1400);
+    ASSERT_EQ(1400, search.nextProbe(now));
+    ASSERT_EQ(0, search.nextProbe(now)); // waiting for ACK
+    now += std::chrono::milliseconds(PathMtu::PROBE_TIMEOUT);
+    ASSERT_EQ(1400, search.nextProbe(now));
+    search.onAck();
+    ASSERT_EQ(0, search.nextProbe(now));
+    ASSERT_EQ(1400, search.getMtu());
+}
+
+TEST_F(PathMtuTest, LargerSizesAreProbedAgain) {
+    PathMtu search(1400);
+    discover(search, 1000);
+    int mtu = search.getMtu();
+    ASSERT_GT(1400, mtu);
+
+    now += std::chrono::milliseconds(PathMtu::RAISE_INTERVAL);
+    ASSERT_EQ(1400, search.nextProbe(now));
+    ASSERT_TRUE(search.isSearching());
+    discover(search, 1400);
+    ASSERT_EQ(1400, search.getMtu());
+}
+
+TEST(PathMtuParameters, MtuFieldIsUpdated) {
+    ControlMessage message(ControlMessage::PARAMETERS);
+    message.addMtu(1400);
+    message.addAddress(ControlMessage::DNS, inet_addr("8.8.8.8"));
+    message.setMtu(1200);
+    ASSERT_EQ(1200, message.getMtu());
+    ASSERT_EQ(2u, message.getFields().size());
+
+    // probes are padded to the probed size, padding is not parsed
+    ControlMessage probe(ControlMessage::PROBE, 1, ControlMessage::ACK_REQUESTED);
+    probe.addMtu(1300);
+    probe.pad(1300);
+    ASSERT_EQ(1300, probe.size());
+    ControlMessage parsed;
+    ASSERT_TRUE(ControlMessage::parse(probe.data(), probe.size(), parsed));
+    ASSERT_EQ(1300, parsed.getMtu());
+    ASSERT_EQ(1u, parsed.getFields().size());
+}
+
+#endif // PATH_MTU_TEST_HPP
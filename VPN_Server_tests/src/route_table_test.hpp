@@ -0,0 +1,96 @@
+#ifndef ROUTE_TABLE_TEST_HPP
+#define ROUTE_TABLE_TEST_HPP
+
+#include "../../VPN_Server/src/route_table.cpp"
+#include <gtest/gtest.h>
+
+class RouteTableTest : public testing::Test {
+protected:
+    void SetUp() {
+        routes = new RouteTable(inet_addr("10.0.0.0"), 8);
+    }
+    void TearDown() {
+        delete routes;
+    }
+    RouteTable* routes;
+
+    // routes keep the pointers only:
+    Tunnel*    first  = reinterpret_cast<Tunnel*>(0x1000);
+    Tunnel*    second = reinterpret_cast<Tunnel*>(0x2000);
+    EventLoop* loop   = reinterpret_cast<EventLoop*>(0x3000);
+};
+
+TEST_F(RouteTableTest, NoRoutesAfterConstruction) {
+    EventLoop* owner = nullptr;
+    ASSERT_EQ(nullptr, routes->find(inet_addr("10.0.0.2"), owner));
+    ASSERT_EQ(0u, routes->allocatedPages());
+}
+
+TEST_F(RouteTableTest, FoundRouteHasOwnerLoop) {
+    EventLoop* owner = nullptr;
+    ASSERT_TRUE(routes->add(inet_addr("10.1.2.3"), first, loop));
+    ASSERT_EQ(first, routes->find(inet_addr("10.1.2.3"), owner));
+    ASSERT_EQ(loop, owner);
+    ASSERT_EQ(nullptr, routes->find(inet_addr("10.1.2.4"), owner));
+    ASSERT_EQ(1u, routes->allocatedPages());
+}
+
+TEST_F(RouteTableTest, AddressOutsideNetworkIsRejected) {
+    EventLoop* owner = nullptr;
+    ASSERT_FALSE(routes->add(inet_addr("192.168.0.1"), first, loop));
+    ASSERT_EQ(nullptr, routes->find(inet_addr("192.168.0.1"), owner));
+    ASSERT_TRUE(routes->add(inet_addr("10.255.255.255"), first, loop));
+}
+
+TEST_F(RouteTableTest, RemoveKeepsRouteOfNewTunnel) {
+    EventLoop* owner = nullptr;
+    routes->add(inet_addr("10.0.0.2"), first, loop);
+    // the address was given to another client before removal:
+    routes->add(inet_addr("10.0.0.2"), second, loop);
+    routes->remove(inet_addr("10.0.0.2"), first);
+    ASSERT_EQ(second, routes->find(inet_addr("10.0.0.2"), owner));
+
+    routes->remove(inet_addr("10.0.0.2"), second);
+    ASSERT_EQ(nullptr, routes->find(inet_addr("10.0.0.2"), owner));
+}
+
+TEST(RouteTable6Test, RoutesCoverClientPrefixes) {
+    IP6Manager prefixes("fd00:1::", 48);
+    RouteTable routes(inet_addr("10.0.0.0"), 24, &prefixes);
+    Tunnel*    tunnel = reinterpret_cast<Tunnel*>(0x1000);
+    EventLoop* loop   = reinterpret_cast<EventLoop*>(0x3000);
+    EventLoop* owner  = nullptr;
+
+    in6_addr address;
+    ASSERT_TRUE(prefixes.acquire("client", address));
+    ASSERT_TRUE(routes.add(address, tunnel, loop));
+    ASSERT_EQ(1u, routes.allocatedPages());
+
+    // any address of the /64 of the client:
+    in6_addr destination = address;
+    destination.s6_addr[15] = 0x42;
+    destination.s6_addr[9]  = 0x17;
+    ASSERT_EQ(tunnel, routes.find(destination, owner));
+    ASSERT_EQ(loop, owner);
+    destination.s6_addr[7] ^= 1; // another prefix
+    ASSERT_EQ(nullptr, routes.find(destination, owner));
+
+    in6_addr outside;
+    ASSERT_TRUE(IP6Manager::parse("2001:db8::1", outside));
+    ASSERT_FALSE(routes.add(outside, tunnel, loop));
+    ASSERT_EQ(nullptr, routes.find(outside, owner));
+
+    routes.remove(address, tunnel);
+    ASSERT_EQ(nullptr, routes.find(address, owner));
+}
+
+TEST(RouteTable6Test, NoIpv6NetworkNoRoutes) {
+    RouteTable routes(inet_addr("10.0.0.0"), 24);
+    EventLoop* owner = nullptr;
+    in6_addr address;
+    ASSERT_TRUE(IP6Manager::parse("fd00:1::1", address));
+    ASSERT_FALSE(routes.add(address, nullptr, nullptr));
+    ASSERT_EQ(nullptr, routes.find(address, owner));
+}
+
+#endif // ROUTE_TABLE_TEST_HPP
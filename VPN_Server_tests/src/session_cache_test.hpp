@@ -0,0 +1,160 @@
+#ifndef SESSION_CACHE_TEST_HPP
+#define SESSION_CACHE_TEST_HPP
+
+#include "../../VPN_Server/src/session_cache.cpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<unsigned char> sessionData(unsigned char value) {
+    return std::vector<unsigned char>(64, value);
+}
+
+} // namespace
+
+TEST(SessionCacheTest, StoredSessionIsFound) {
+    SessionCache cache(1000);
+    std::vector<unsigned char> data;
+    cache.store("client", sessionData(1));
+
+    ASSERT_TRUE(cache.find("client", data));
+    ASSERT_EQ(sessionData(1), data);
+    ASSERT_EQ(1u, cache.size());
+    ASSERT_EQ(1u, cache.getHits());
+}
+
+TEST(SessionCacheTest, StoreReplacesSession) {
+    SessionCache cache(1000);
+    std::vector<unsigned char> data;
+    cache.store("client", sessionData(1));
+    cache.store("client", sessionData(2));
+
+    ASSERT_TRUE(cache.find("client", data));
+    ASSERT_EQ(sessionData(2), data);
+    ASSERT_EQ(1u, cache.size());
+}
+
+TEST(SessionCacheTest, UnknownSessionIsMiss) {
+    SessionCache cache(1000);
+    std::vector<unsigned char> data;
+    cache.store("client", sessionData(1));
+
+    ASSERT_FALSE(cache.find("other", data));
+    ASSERT_EQ(1u, cache.getMisses());
+    ASSERT_DOUBLE_EQ(0, cache.hitRatio());
+    ASSERT_TRUE(cache.find("client", data));
+    ASSERT_DOUBLE_EQ(0.5, cache.hitRatio());
+}
+
+TEST(SessionCacheTest, FullCacheEvictsLeastRecentlyUsed) {
+    // one session per shard:
+    SessionCache cache(SessionCache::SHARDS);
+    std::vector<unsigned char> data;
+    for(int i = 0; i < 1000; ++i)
+        cache.store("client" + std::to_string(i), sessionData(i));
+
+    ASSERT_LE(cache.size(), cache.capacity());
+    ASSERT_EQ(1000u, cache.size() + cache.getEvictions());
+    ASSERT_TRUE(cache.find("client999", data));
+    ASSERT_FALSE(cache.find("client0", data));
+}
+
+TEST(SessionCacheTest, FoundSessionIsNotEvicted) {
+    SessionCache cache(2 * SessionCache::SHARDS);
+    std::vector<unsigned char> data;
+    cache.store("first", sessionData(1));
+    // the sessions of the shard of "first" are evicted in LRU order:
+    for(int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(cache.find("first", data));
+        cache.store("client" + std::to_string(i), sessionData(i));
+    }
+    ASSERT_TRUE(cache.find("first", data));
+}
+
+TEST(SessionCacheTest, ExpiredSessionIsRemoved) {
+    SessionCache cache(1000, 0);
+    std::vector<unsigned char> data;
+    cache.store("client", sessionData(1));
+
+    ASSERT_FALSE(cache.find("client", data));
+    ASSERT_EQ(0u, cache.size());
+}
+
+TEST(SessionCacheTest, RemovedSessionIsMiss) {
+    SessionCache cache(1000);
+    std::vector<unsigned char> data;
+    cache.store("client", sessionData(1));
+    cache.remove("client");
+    cache.remove("other");
+
+    ASSERT_FALSE(cache.find("client", data));
+    ASSERT_EQ(0u, cache.size());
+}
+
+class TicketKeysTest : public testing::Test {
+protected:
+    unsigned char name[TicketKeys::NAME_SIZE];
+    unsigned char nonce[TicketKeys::NONCE_SIZE];
+    unsigned char tag[TicketKeys::TAG_SIZE];
+    unsigned char ticket[100];
+    unsigned char plain[100];
+
+    void SetUp() {
+        for(size_t i = 0; i < sizeof(plain); ++i)
+            plain[i] = i;
+        memcpy(ticket, plain, sizeof(plain));
+    }
+};
+
+TEST_F(TicketKeysTest, TicketOfCurrentKeyIsAccepted) {
+    TicketKeys keys;
+    ASSERT_TRUE(keys.encrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ASSERT_NE(0, memcmp(plain, ticket, sizeof(plain)));
+
+    ASSERT_EQ(TicketKeys::ACCEPTED,
+              keys.decrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ASSERT_EQ(0, memcmp(plain, ticket, sizeof(plain)));
+    ASSERT_EQ(1u, keys.getIssued());
+    ASSERT_EQ(1u, keys.getAccepted());
+}
+
+TEST_F(TicketKeysTest, NoncesAreNotReused) {
+    TicketKeys keys;
+    unsigned char first[TicketKeys::NONCE_SIZE];
+    ASSERT_TRUE(keys.encrypt(name, first, tag, ticket, sizeof(ticket)));
+    ASSERT_TRUE(keys.encrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ASSERT_NE(0, memcmp(first, nonce, sizeof(nonce)));
+}
+
+TEST_F(TicketKeysTest, TicketOfPreviousKeyIsRenewed) {
+    TicketKeys keys;
+    ASSERT_TRUE(keys.encrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    keys.rotate();
+
+    ASSERT_EQ(TicketKeys::RENEW,
+              keys.decrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ASSERT_EQ(0, memcmp(plain, ticket, sizeof(plain)));
+    ASSERT_EQ(1u, keys.getRenewed());
+}
+
+TEST_F(TicketKeysTest, TicketOfOldKeyIsRejected) {
+    TicketKeys keys;
+    ASSERT_TRUE(keys.encrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    keys.rotate();
+    keys.rotate();
+
+    ASSERT_EQ(TicketKeys::REJECTED,
+              keys.decrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ASSERT_EQ(1u, keys.getRejected());
+}
+
+TEST_F(TicketKeysTest, BrokenTicketIsRejected) {
+    TicketKeys keys;
+    ASSERT_TRUE(keys.encrypt(name, nonce, tag, ticket, sizeof(ticket)));
+    ticket[10] ^= 1;
+
+    ASSERT_EQ(TicketKeys::REJECTED,
+              keys.decrypt(name, nonce, tag, ticket, sizeof(ticket)));
+}
+
+#endif // SESSION_CACHE_TEST_HPP
@@ -0,0 +1,125 @@
+#ifndef TIMER_WHEEL_TEST_HPP
+#define TIMER_WHEEL_TEST_HPP
+
+#include "../../VPN_Server/src/timer_wheel.cpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The TimerWheelTest class - wheel of 100 ms ticks
+ * turned by a fake clock
+ */
+class TimerWheelTest : public testing::Test {
+protected:
+    TimerWheel::TimePoint start;
+    TimerWheel*           wheel;
+
+    TimerWheel::TimePoint at(int64_t ms) {
+        return start + std::chrono::milliseconds(ms);
+    }
+
+    void SetUp() {
+        start = std::chrono::steady_clock::now();
+        wheel = new TimerWheel(std::chrono::milliseconds(100), start);
+    }
+    void TearDown() {
+        delete wheel;
+    }
+};
+
+TEST_F(TimerWheelTest, TimerExpiresAtItsTick) {
+    int fired = 0;
+    WheelTimer timer([&fired]() { ++fired; });
+    wheel->schedule(timer, at(250)); // rounded up to 300 ms
+
+    ASSERT_EQ(1, wheel->size());
+    ASSERT_EQ(0, wheel->advance(at(299)));
+    ASSERT_EQ(1, wheel->advance(at(300)));
+    ASSERT_EQ(1, fired);
+    ASSERT_FALSE(timer.isScheduled());
+    ASSERT_EQ(0, wheel->size());
+}
+
+TEST_F(TimerWheelTest, FarTimersCascade) {
+    // the levels end at 6.4 s, 409.6 s and ~7.3 h:
+    std::vector<int64_t> deadlines = { 6300, 6400, 6500, 409500, 409700,
+                                       26214400, 26214500, 40000000 };
+    std::vector<int64_t> fired;
+    std::vector<std::unique_ptr<WheelTimer> > timers;
+    for(int64_t deadline : deadlines) {
+        timers.emplace_back(new WheelTimer([&fired, deadline]() {
+            fired.push_back(deadline);
+        }));
+        wheel->schedule(*timers.back(), at(deadline));
+    }
+
+    for(int64_t deadline : deadlines) {
+        wheel->advance(at(deadline - 100));
+        ASSERT_EQ(fired.end(), std::find(fired.begin(), fired.end(), deadline));
+        wheel->advance(at(deadline));
+        ASSERT_EQ(deadline, fired.back());
+    }
+    ASSERT_EQ(deadlines, fired);
+}
+
+TEST_F(TimerWheelTest, CancelledAndMovedTimers) {
+    int fired = 0;
+    WheelTimer cancelled([&fired]() { fired += 1; });
+    WheelTimer moved([&fired]() { fired += 10; });
+    wheel->schedule(cancelled, at(1000));
+    wheel->schedule(moved, at(1000));
+    wheel->schedule(moved, at(20000)); // to another level
+
+    cancelled.cancel();
+    ASSERT_EQ(1, wheel->size());
+    wheel->advance(at(19900));
+    ASSERT_EQ(0, fired);
+    wheel->advance(at(20000));
+    ASSERT_EQ(10, fired);
+
+    {
+        WheelTimer destroyed([&fired]() { fired += 100; });
+        wheel->schedule(destroyed, at(30000));
+    }
+    ASSERT_EQ(0, wheel->size());
+    wheel->advance(at(40000));
+    ASSERT_EQ(10, fired);
+}
+
+TEST_F(TimerWheelTest, HandlerReschedulesItself) {
+    int fired = 0;
+    WheelTimer timer;
+    timer.setHandler([&]() {
+        if(++fired < 5)
+            wheel->schedule(timer, at(fired * 1000 + 1000));
+    });
+    wheel->schedule(timer, at(1000));
+
+    ASSERT_EQ(5, wheel->advance(at(60000)));
+    ASSERT_EQ(5, fired);
+}
+
+TEST_F(TimerWheelTest, PastDeadlineExpiresOnNextTick) {
+    wheel->advance(at(1000));
+    int fired = 0;
+    WheelTimer timer([&fired]() { ++fired; });
+    wheel->schedule(timer, at(0));
+
+    ASSERT_EQ(0, wheel->advance(at(1000)));
+    ASSERT_EQ(1, wheel->advance(at(1100)));
+}
+
+TEST_F(TimerWheelTest, PostedTaskRunsOnce) {
+    int fired = 0;
+    wheel->post(std::chrono::milliseconds(0), [&fired]() { ++fired; });
+    wheel->post(std::chrono::milliseconds(0), [&fired]() { ++fired; });
+    ASSERT_EQ(2, wheel->size());
+
+    wheel->advance(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+    ASSERT_EQ(2, fired);
+    ASSERT_EQ(0, wheel->size());
+}
+
+#endif // TIMER_WHEEL_TEST_HPP
@@ -0,0 +1,158 @@
+#ifndef TRAFFIC_SHAPER_TEST_HPP
+#define TRAFFIC_SHAPER_TEST_HPP
+
+#include "../../VPN_Server/src/traffic_shaper.cpp"
+#include <gtest/gtest.h>
+
+TEST(TokenBucketTest, UnlimitedBucketPassesEverything) {
+    TokenBucket bucket;
+    auto now = std::chrono::steady_clock::now();
+    for(int i = 0; i < 1000; ++i)
+        ASSERT_TRUE(bucket.consume(1500, now));
+    ASSERT_EQ(0, bucket.delay(now).count());
+}
+
+TEST(TokenBucketTest, EmptyBucketIsRefilledAtRate) {
+    TokenBucket bucket(100000); // burst is MIN_BURST
+    auto now = std::chrono::steady_clock::now();
+
+    int passed = 0;
+    while(bucket.consume(1000, now))
+        ++passed;
+    ASSERT_EQ(17, passed); // the last one takes the bucket below zero
+    ASSERT_GT(bucket.delay(now).count(), 0);
+
+    now += bucket.delay(now);
+    ASSERT_TRUE(bucket.consume(1000, now));
+    ASSERT_FALSE(bucket.consume(1000, now));
+}
+
+TEST(RateLimitsTest, RatesAreParsedInBitsPerSecond) {
+    ASSERT_EQ(0u, RateLimits::parseRate("0"));
+    ASSERT_EQ(125u, RateLimits::parseRate("1000"));
+    ASSERT_EQ(1250000u, RateLimits::parseRate("10m"));
+    ASSERT_EQ(125000000u, RateLimits::parseRate("1G"));
+    ASSERT_THROW(RateLimits::parseRate(""), std::invalid_argument);
+    ASSERT_THROW(RateLimits::parseRate("fast"), std::invalid_argument);
+    ASSERT_THROW(RateLimits::parseRate("10x"), std::invalid_argument);
+    ASSERT_THROW(RateLimits::parseRate("10mb"), std::invalid_argument);
+}
+
+TEST(RateLimitsTest, ClientLimitReplacesDefault) {
+    RateLimits limits;
+    limits.add("8m");
+    limits.add("10.1.2.3=80k");
+
+    ASSERT_EQ(10000u, limits.forClient("::ffff:10.1.2.3"));
+    ASSERT_EQ(1000000u, limits.forClient("::ffff:10.1.2.4"));
+
+    limits.set("10.1.2.3", 0);
+    ASSERT_EQ(0u, limits.forClient("::ffff:10.1.2.3"));
+    ASSERT_THROW(limits.add("client=1m"), std::invalid_argument);
+}
+
+TEST(RateLimitsTest, ReplaceSwapsAllLimitsOrNothing) {
+    RateLimits limits;
+    limits.add("8m");
+    limits.add("10.1.2.3=80k");
+
+    limits.replace({"16m", "10.1.2.4=160k"});
+    ASSERT_EQ(2000000u, limits.forClient("::ffff:10.1.2.3"));
+    ASSERT_EQ(20000u, limits.forClient("::ffff:10.1.2.4"));
+
+    ASSERT_THROW(limits.replace({"1m", "client=1m"}), std::invalid_argument);
+    ASSERT_EQ(2000000u, limits.forClient("::ffff:10.1.2.3"));
+}
+
+/**
+ * @brief The EgressSchedulerTest class - queues of a bulk
+ * and an interactive client, sent packets are recorded by client
+ */
+class EgressSchedulerTest : public testing::Test {
+protected:
+    EventLoop        loop;
+    EgressScheduler  scheduler;
+    TunnelMetrics    bulkMetrics;
+    TunnelMetrics    interactiveMetrics;
+    EgressQueue      bulk;
+    EgressQueue      interactive;
+    std::string      sent; // 'b' or 'i' for every sent packet
+
+    void SetUp() override {
+        scheduler.attach(loop);
+        bulk.setSender([this](const char*, int) { sent += 'b'; }, bulkMetrics);
+        interactive.setSender([this](const char*, int) { sent += 'i'; },
+                              interactiveMetrics);
+    }
+
+    void TearDown() override {
+        scheduler.remove(bulk);
+        scheduler.remove(interactive);
+        scheduler.detach();
+    }
+
+    void enqueue(EgressQueue& queue, int count, int length) {
+        std::string packet(length, 'x');
+        for(int i = 0; i < count; ++i)
+            scheduler.enqueue(queue, packet.data(), length);
+    }
+};
+
+TEST_F(EgressSchedulerTest, SmallPacketsDoNotWaitForBulkQueue) {
+    enqueue(bulk, 100, 1400);
+    enqueue(interactive, 4, 100);
+
+    scheduler.run();
+    ASSERT_EQ(104u, sent.size());
+    ASSERT_EQ(std::string("biiii"), sent.substr(0, 5));
+    ASSERT_EQ(0u, scheduler.size());
+    ASSERT_EQ(0u, bulkMetrics.txQueued);
+}
+
+TEST_F(EgressSchedulerTest, RunSendsBudgetAndKeepsTheRest) {
+    enqueue(bulk, EgressQueue::LIMIT, 100);
+    enqueue(interactive, EgressQueue::LIMIT, 100);
+    enqueue(interactive, EgressQueue::LIMIT, 100);
+
+    scheduler.run();
+    ASSERT_EQ(EgressScheduler::BUDGET, sent.size());
+    ASSERT_EQ(2 * EgressQueue::LIMIT - EgressScheduler::BUDGET, scheduler.size());
+    ASSERT_EQ(EgressQueue::LIMIT, interactiveMetrics.txQueueDrops);
+}
+
+TEST_F(EgressSchedulerTest, FullQueueResumesProducerWhenHalfEmpty) {
+    bool resumed = false;
+    bulk.setResumeHandler([&resumed]() { resumed = true; });
+
+    enqueue(bulk, EgressQueue::LIMIT, 1400);
+    ASSERT_TRUE(bulk.full());
+    ASSERT_EQ(EgressQueue::LIMIT, bulkMetrics.txQueued);
+
+    scheduler.run();
+    ASSERT_TRUE(resumed);
+    ASSERT_FALSE(bulk.full());
+}
+
+TEST_F(EgressSchedulerTest, LongPacketIsDropped) {
+    enqueue(bulk, 2, 100);
+    std::string packet(EgressScheduler::PACKET_SIZE + 1, 'x');
+    ASSERT_FALSE(scheduler.enqueue(bulk, packet.data(), packet.size()));
+    ASSERT_EQ(1u, bulkMetrics.txQueueDrops);
+    ASSERT_TRUE(sent.empty()); // doesn't pass the queued packets
+
+    scheduler.run();
+    ASSERT_EQ(std::string("bb"), sent);
+}
+
+TEST_F(EgressSchedulerTest, LimitedQueueWaitsForTokens) {
+    bulk.setRate(10000); // burst of MIN_BURST bytes
+    enqueue(bulk, 20, 1400);
+    enqueue(interactive, 20, 1400);
+
+    scheduler.run();
+    ASSERT_EQ(12, std::count(sent.begin(), sent.end(), 'b'));
+    ASSERT_EQ(20, std::count(sent.begin(), sent.end(), 'i'));
+    ASSERT_EQ(8u, bulk.size());
+}
+
+#endif // TRAFFIC_SHAPER_TEST_HPP
@@ -0,0 +1,104 @@
+#ifndef TUN_DEVICE_TEST_HPP
+#define TUN_DEVICE_TEST_HPP
+
+#include "../../VPN_Server/src/tun_device.cpp"
+#include <gtest/gtest.h>
+
+class TunDeviceSegmentTest : public testing::Test {
+protected:
+    void SetUp() {
+        memset(frame, 0, sizeof(frame));
+
+        VnetHeader* vnet = reinterpret_cast<VnetHeader*>(frame);
+        vnet->flags       = VnetHeader::NEEDS_CSUM;
+        vnet->gsoType     = VnetHeader::GSO_TCPV4;
+        vnet->gsoSize     = 1000;
+        vnet->hdrLen      = 40;
+        vnet->csumStart   = 20;
+        vnet->csumOffset  = 16;
+
+        iphdr* ip    = reinterpret_cast<iphdr*>(frame + TunDevice::VNET_HEADER_SIZE);
+        ip->version  = 4;
+        ip->ihl      = 5;
+        ip->ttl      = 64;
+        ip->protocol = IPPROTO_TCP;
+        ip->id       = htons(100);
+        ip->tot_len  = htons(40 + PAYLOAD);
+        ip->saddr    = inet_addr("10.0.0.1");
+        ip->daddr    = inet_addr("10.0.0.2");
+
+        tcphdr* tcp = reinterpret_cast<tcphdr*>(frame + TunDevice::VNET_HEADER_SIZE + 20);
+        tcp->seq    = htonl(5000);
+        tcp->doff   = 5;
+        tcp->ack    = 1;
+        tcp->psh    = 1;
+        tcp->fin    = 1;
+
+        for(int i = 0; i < PAYLOAD; ++i)
+            frame[TunDevice::VNET_HEADER_SIZE + 40 + i] = (char)i;
+    }
+
+    static const int PAYLOAD = 2500;
+    char frame[TunDevice::MAX_FRAME];
+};
+
+TEST(TunDeviceChecksum, KnownIpHeaderChecksum) {
+    const uint8_t header[] = { 0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00,
+                               0x40, 0x11, 0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01,
+                               0xc0, 0xa8, 0x00, 0xc7 };
+    ASSERT_EQ(0xb861, TunDevice::checksum(header, sizeof(header)));
+}
+
+TEST_F(TunDeviceSegmentTest, SuperPacketIsCutByMss) {
+    std::vector<std::string> packets;
+    int count = TunDevice::segment(frame, TunDevice::VNET_HEADER_SIZE + 40 + PAYLOAD,
+                                   [&packets](const char* data, int length) {
+        packets.push_back(std::string(data, length));
+    });
+
+    ASSERT_EQ(3, count);
+    ASSERT_EQ(3u, packets.size());
+    ASSERT_EQ(1040u, packets[0].size());
+    ASSERT_EQ(1040u, packets[1].size());
+    ASSERT_EQ(540u, packets[2].size());
+
+    for(size_t i = 0; i < packets.size(); ++i) {
+        const iphdr*  ip  = reinterpret_cast<const iphdr*>(packets[i].data());
+        const tcphdr* tcp = reinterpret_cast<const tcphdr*>(packets[i].data() + 20);
+
+        ASSERT_EQ(packets[i].size(), ntohs(ip->tot_len));
+        ASSERT_EQ(100 + i, ntohs(ip->id));
+        ASSERT_EQ(0, TunDevice::checksum(ip, 20));
+        ASSERT_EQ(5000 + 1000 * i, ntohl(tcp->seq));
+        ASSERT_EQ(i == 2, tcp->fin);
+        ASSERT_EQ(i == 2, tcp->psh);
+        ASSERT_EQ((char)(1000 * i), packets[i][40]);
+
+        uint32_t pseudo = ((ntohl(ip->saddr) >> 16) + (ntohl(ip->saddr) & 0xFFFF) +
+                           (ntohl(ip->daddr) >> 16) + (ntohl(ip->daddr) & 0xFFFF) +
+                           IPPROTO_TCP + packets[i].size() - 20);
+        ASSERT_EQ(0, TunDevice::checksum(tcp, packets[i].size() - 20, pseudo));
+    }
+}
+
+TEST_F(TunDeviceSegmentTest, PlainPacketIsPassedThrough) {
+    VnetHeader* vnet = reinterpret_cast<VnetHeader*>(frame);
+    vnet->flags    = 0;
+    vnet->gsoType  = VnetHeader::GSO_NONE;
+
+    int length = 0;
+    int count  = TunDevice::segment(frame, TunDevice::VNET_HEADER_SIZE + 40 + PAYLOAD,
+                                    [&length](const char*, int packetLength) {
+        length = packetLength;
+    });
+
+    ASSERT_EQ(1, count);
+    ASSERT_EQ(40 + PAYLOAD, length);
+}
+
+TEST_F(TunDeviceSegmentTest, TruncatedFrameIsRejected) {
+    ASSERT_EQ(-1, TunDevice::segment(frame, TunDevice::VNET_HEADER_SIZE + 30,
+                                     [](const char*, int) { }));
+}
+
+#endif // TUN_DEVICE_TEST_HPP
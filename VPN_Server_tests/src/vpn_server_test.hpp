@@ -3,6 +3,12 @@
 
 #include <gtest/gtest.h>
 #include <../VPN_Server/src/tunnel_mgr.cpp>
+#include <../VPN_Server/src/network_backend.cpp>
+#include <../VPN_Server/src/netlink_backend.cpp>
+#include <../VPN_Server/src/event_loop.cpp>
+#include <../VPN_Server/src/tunnel.cpp>
+#include <../VPN_Server/src/worker_pool.cpp>
+#include <../VPN_Server/src/dtls_listener.cpp>
 #include <../VPN_Server/src/vpn_server.cpp>
 
 TEST(VpnServerCorrectSubmask, CorrectSubmask) {
@@ -98,6 +104,162 @@ TEST(VpnServerIpMaskArgument, ValidMaskNoExceptionThrown) {
     ASSERT_NO_THROW(new VPNServer(argc, argv));
 }
 
+TEST(VpnServerWorkersArgument, InvalidWorkersCountExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-w", "0" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerWorkersArgument, ValidWorkersCountNoExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-w", "4" };
+
+    ASSERT_NO_THROW(new VPNServer(argc, argv));
+}
+
+TEST(VpnServerNetworkBackendArgument, InvalidBackendExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-n", "ifconfig" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerNetworkBackendArgument, ShellBackendNoExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-n", "shell" };
+
+    ASSERT_NO_THROW(new VPNServer(argc, argv));
+}
+
+TEST(VpnServerInterfacePoolArgument, InvalidPoolSizeExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-p", "100000" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerMetricsArgument, InvalidMetricsPortExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-e", "0" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerSessionCacheArgument, InvalidSessionCacheSizeExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-c", "-1" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerTicketArgument, InvalidTicketRotationExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-k", "-60" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerCipherArgument, InvalidCipherPolicyExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-x", "rc4" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerOffloadArgument, EspPortOfListenerExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-o", "8000" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerIoEngineArgument, UnknownEngineExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-u", "select" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerAccessListArgument, MissingFileExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-f", "/nonexistent/acl.txt" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerRateLimitArgument, InvalidRateExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-b", "10.0.0.1=fast" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerHandoffArgument, InvalidPathExceptionThrown) {
+    int argc = 4;
+    std::string path(200, 'a');
+    char* argv[] = { "", "8000", "-l", &path[0] };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerConfigArgument, MissingFileExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-y", "/tmp/vpn_no_such_config" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerControlArgument, InvalidPathExceptionThrown) {
+    int argc = 4;
+    std::string path(200, 'a');
+    char* argv[] = { "", "8000", "-j", &path[0] };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerIdleTimeArgument, InvalidIdleTimeExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-z", "0" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerKeepaliveArgument, InvalidIntervalExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-v", "60:10" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerLeaseTimeArgument, InvalidLeaseTimeExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-h", "0" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerCryptoThreadsArgument, InvalidThreadsCountExceptionThrown) {
+    int argc = 4;
+    char* argv[] = { "", "8000", "-C", "0" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerIpv6NetworkArgument, InvalidNetworkExceptionThrown) {
+    int argc = 5;
+    char* argv[] = { "", "8000", "-6", "10.0.0.0", "48" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
+TEST(VpnServerIpv6NetworkArgument, InvalidMaskExceptionThrown) {
+    int argc = 5;
+    char* argv[] = { "", "8000", "-6", "fd00:1::", "125" };
+
+    ASSERT_THROW(new VPNServer(argc, argv), std::invalid_argument);
+}
+
 TEST(VpnServerNetworkIfaceArgument, NoSuchIfaceException) {
     int argc = 3;
     char* argv[] = { "", "-i", "etj0" };
@@ -106,4 +268,129 @@ TEST(VpnServerNetworkIfaceArgument, NoSuchIfaceException) {
 }
 
 
+/**
+ * @brief The FakeNetworkBackend class - interfaces exist only
+ * in the TunnelManager, every change succeeds
+ */
+class FakeNetworkBackend : public NetworkBackend {
+public:
+    void createTunnel(const std::string&, const std::string&,
+                      const std::string&, bool) override { }
+    void createSharedTunnel(const std::string&, const std::string&,
+                            uint32_t, bool) override { }
+    void deleteLink(const std::string&) override { }
+    bool resetLink(const std::string&) override { return true; }
+    bool changePeer(const std::string&, const std::string&,
+                    const std::string&, const std::string&) override { return true; }
+    void addRoute6(const std::string&, const std::string&) override { }
+    void removeRoute6(const std::string&, const std::string&) override { }
+    void setForwarding(bool) override { }
+    void setForwarding6(bool) override { }
+    void addMasquerade(const std::string&, const std::string&) override { }
+    void removeMasquerade(const std::string&, const std::string&) override { }
+};
+
+TEST(TunnelManagerLeaseTest, ClientGetsItsAddressBackAfterAnotherClient) {
+    IPManager addresses("10.0.0.0/24", 1);
+    TunnelManager manager;
+    manager.setNetworkBackend(new FakeNetworkBackend);
+    manager.configureInterfaces(addresses, false, 2);
+    manager.startInterfacePool();
+
+    TunInterface first;
+    ASSERT_TRUE(manager.acquireInterface(first, "192.168.1.10"));
+    manager.releaseInterface(first, addresses.releaseLease("192.168.1.10",
+                                                           first.clientAddr));
+
+    TunInterface other;
+    ASSERT_TRUE(manager.acquireInterface(other, "192.168.1.11"));
+    ASSERT_NE(first.clientAddr, other.clientAddr);
+
+    TunInterface again;
+    ASSERT_TRUE(manager.acquireInterface(again, "192.168.1.10"));
+    ASSERT_EQ(first.clientAddr, again.clientAddr);
+    manager.stopInterfacePool();
+}
+
+/**
+ * @brief clientHello - DTLS 1.2 ClientHello record
+ * with 'cookie' and record sequence number 'seq'
+ */
+static std::string clientHello(const std::string& cookie, char seq = 1) {
+    std::string body("\xfe\xfd", 2);
+    body += std::string(32, 'r');            // random
+    body += '\0';                            // session id
+    body += (char)cookie.size() + cookie;
+    body += std::string("\x00\x02\xc0\x2b\x01\x00", 6); // one suite, null compression
+
+    std::string message(1, 1);               // client_hello
+    message += std::string("\0", 1) + (char)(body.size() >> 8) + (char)body.size();
+    message += std::string("\0", 1) + seq;  // message_seq
+    message += std::string(3, '\0');         // fragment_offset
+    message += std::string("\0", 1) + (char)(body.size() >> 8) + (char)body.size();
+    message += body;
+
+    std::string record("\x16\xfe\xfd\x00\x00\x00\x00\x00\x00\x00", 10);
+    record += seq;
+    record += (char)(message.size() >> 8);
+    record += (char)message.size();
+    return record + message;
+}
+
+static sockaddr_in6 peerAddress(uint16_t port) {
+    sockaddr_in6 peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.sin6_family = AF_INET6;
+    peer.sin6_port   = htons(port);
+    inet_pton(AF_INET6, "::ffff:192.0.2.1", &peer.sin6_addr);
+    return peer;
+}
+
+TEST(DtlsListenerCookieTest, ClientReturnsCookieOfVerifyRequest) {
+    sockaddr_in6 peer = peerAddress(40000);
+    std::string hello = clientHello("", 5);
+    const unsigned char* cookie = nullptr;
+    ASSERT_EQ(0, DtlsListener::getHelloCookie(hello.data(), hello.size(), cookie));
+
+    unsigned char generated[DtlsListener::COOKIE_SIZE];
+    ASSERT_EQ(DtlsListener::COOKIE_SIZE,
+              DtlsListener::generateCookie(peer, generated, sizeof(generated)));
+    char request[128];
+    int length = DtlsListener::makeHelloVerifyRequest(hello.data(), generated,
+                                                      sizeof(generated),
+                                                      request, sizeof(request));
+    ASSERT_EQ(25 + 3 + DtlsListener::COOKIE_SIZE, length);
+    ASSERT_EQ(22, request[0]);
+    ASSERT_EQ(5, request[10]);               // sequence number of the ClientHello
+    ASSERT_EQ(3, request[13]);               // hello_verify_request
+    ASSERT_EQ(DtlsListener::COOKIE_SIZE, request[27]);
+    std::string returned(request + 28, DtlsListener::COOKIE_SIZE);
+
+    hello = clientHello(returned, 6);
+    ASSERT_EQ(DtlsListener::COOKIE_SIZE,
+              DtlsListener::getHelloCookie(hello.data(), hello.size(), cookie));
+    ASSERT_TRUE(DtlsListener::verifyCookie(peer, cookie, DtlsListener::COOKIE_SIZE));
+    ASSERT_FALSE(DtlsListener::verifyCookie(peerAddress(40001), cookie,
+                                            DtlsListener::COOKIE_SIZE));
+}
+
+TEST(DtlsListenerCookieTest, OnlyWholeClientHelloIsAccepted) {
+    const char request[] = { Tunnel::ZERO_PACKET, Tunnel::CLIENT_WANT_CONNECT };
+    const unsigned char* cookie = nullptr;
+    ASSERT_EQ(-1, DtlsListener::getHelloCookie(request, sizeof(request), cookie));
+
+    std::string hello = clientHello(std::string(DtlsListener::COOKIE_SIZE, 'c'));
+    ASSERT_EQ(-1, DtlsListener::getHelloCookie(hello.data(), hello.size() - 1, cookie));
+
+    std::string fragment = hello;
+    fragment[24] = (char)(fragment[24] - 1); // fragment_length
+    ASSERT_EQ(-1, DtlsListener::getHelloCookie(fragment.data(), fragment.size(), cookie));
+
+    std::string encrypted = hello;
+    encrypted[4] = 1; // epoch
+    ASSERT_EQ(-1, DtlsListener::getHelloCookie(encrypted.data(), encrypted.size(), cookie));
+    ASSERT_FALSE(DtlsListener::verifyCookie(peerAddress(40000),
+                                            (const unsigned char*)"short", 5));
+}
+
 #endif // VPN_SERVER_TEST_HPP
@@ -0,0 +1,102 @@
+#ifndef XFRM_OFFLOAD_TEST_HPP
+#define XFRM_OFFLOAD_TEST_HPP
+
+#include "../../VPN_Server/src/xfrm_offload.cpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint16_t> messageTypes(NetlinkMessage& message) {
+    std::vector<uint16_t> types;
+    for(size_t offset = 0; offset < message.size(); ) {
+        nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(message.data() + offset);
+        types.push_back(nlh->nlmsg_type);
+        offset += NLMSG_ALIGN(nlh->nlmsg_len);
+    }
+    return types;
+}
+
+} // namespace
+
+TEST(XfrmOffloadTest, RequestIsParsed) {
+    const char request[] = { 0, XfrmOffload::REQUEST, 0, 0, 0x12, 0x34, 0x11, (char)0x94 };
+    uint32_t spi  = 0;
+    uint16_t port = 0;
+
+    ASSERT_TRUE(XfrmOffload::parseRequest(request, sizeof(request), spi, port));
+    ASSERT_EQ(0x1234u, spi);
+    ASSERT_EQ(4500, port);
+}
+
+TEST(XfrmOffloadTest, InvalidRequestIsRejected) {
+    uint32_t spi  = 0;
+    uint16_t port = 0;
+    const char shortRequest[] = { 0, XfrmOffload::REQUEST, 0, 0, 0x12, 0x34 };
+    ASSERT_FALSE(XfrmOffload::parseRequest(shortRequest, sizeof(shortRequest), spi, port));
+
+    // SPIs below 256 are reserved:
+    const char reservedSpi[] = { 0, XfrmOffload::REQUEST, 0, 0, 0, 1, 0x11, (char)0x94 };
+    ASSERT_FALSE(XfrmOffload::parseRequest(reservedSpi, sizeof(reservedSpi), spi, port));
+
+    const char noPort[] = { 0, XfrmOffload::REQUEST, 0, 0, 0x12, 0x34, 0, 0 };
+    ASSERT_FALSE(XfrmOffload::parseRequest(noPort, sizeof(noPort), spi, port));
+}
+
+TEST(XfrmOffloadTest, ReadyReplyHasSpiAndPort) {
+    char reply[XfrmOffload::MESSAGE_SIZE];
+    ASSERT_EQ(XfrmOffload::MESSAGE_SIZE,
+              XfrmOffload::buildReply(reply, true, 0x1234, 4500));
+    ASSERT_EQ(0, reply[0]);
+    ASSERT_EQ(XfrmOffload::READY, reply[1]);
+
+    // the reply has the layout of a request:
+    uint32_t spi  = 0;
+    uint16_t port = 0;
+    reply[1] = XfrmOffload::REQUEST;
+    ASSERT_TRUE(XfrmOffload::parseRequest(reply, sizeof(reply), spi, port));
+    ASSERT_EQ(0x1234u, spi);
+    ASSERT_EQ(4500, port);
+}
+
+TEST(XfrmOffloadTest, RefusedReplyIsShort) {
+    char reply[XfrmOffload::MESSAGE_SIZE];
+    ASSERT_EQ(2, XfrmOffload::buildReply(reply, false, 0, 0));
+    ASSERT_EQ(XfrmOffload::REFUSED, reply[1]);
+}
+
+TEST(XfrmOffloadTest, SessionHasStatesAndPolicies) {
+    XfrmSession session;
+    session.localAddr  = inet_addr("192.0.2.1");
+    session.localPort  = 4500;
+    session.peerAddr   = inet_addr("198.51.100.7");
+    session.peerPort   = 4500;
+    session.tunnelAddr = inet_addr("10.0.0.2");
+    session.inSpi      = 0x1000;
+    session.outSpi     = 0x2000;
+
+    NetlinkMessage install;
+    XfrmOffload::buildInstall(install, session);
+    std::vector<uint16_t> expected = { XFRM_MSG_NEWSA, XFRM_MSG_NEWSA, XFRM_MSG_NEWPOLICY,
+                                       XFRM_MSG_NEWPOLICY, XFRM_MSG_NEWPOLICY };
+    ASSERT_EQ(expected, messageTypes(install));
+
+    xfrm_usersa_info* inbound = static_cast<xfrm_usersa_info*>(
+                NLMSG_DATA(reinterpret_cast<nlmsghdr*>(install.data())));
+    ASSERT_EQ(htonl(0x1000), inbound->id.spi);
+    ASSERT_EQ(session.localAddr, inbound->id.daddr.a4);
+    ASSERT_EQ(XFRM_MODE_TUNNEL, inbound->mode);
+
+    NetlinkMessage remove;
+    XfrmOffload::buildRemove(remove, session);
+    expected = { XFRM_MSG_DELPOLICY, XFRM_MSG_DELPOLICY, XFRM_MSG_DELPOLICY,
+                 XFRM_MSG_DELSA, XFRM_MSG_DELSA };
+    ASSERT_EQ(expected, messageTypes(remove));
+}
+
+TEST(XfrmOffloadTest, LocalAddressOfLoopbackPeer) {
+    in_addr_t local = 0;
+    ASSERT_TRUE(XfrmOffload::localAddressFor(inet_addr("127.0.0.1"), local));
+    ASSERT_EQ(inet_addr("127.0.0.1"), local);
+}
+
+#endif // XFRM_OFFLOAD_TEST_HPP